@@ -0,0 +1,158 @@
+/*
+   ass_blend_bench.c - replay image lists recorded with -vf ass=dump=<file>
+   through the vf_ass blending code and report the time spent per frame.
+
+   All recorded frames are blended onto one YV12 frame, once for each
+   combination of C/SSE2 kernels and image merging on/off.
+
+   Usage: ass_blend_bench <dump file> [loops]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "config.h"
+#include "cpudetect.h"
+#include "libmpcodecs/ass_blend.h"
+
+typedef struct {
+	ass_image_t* images;
+	int count;
+} frame_t;
+
+static int read_frames(FILE* f, frame_t** frames, int* w, int* h)
+{
+	char magic[8];
+	int32_t dim[2];
+	int n = 0, alloc = 0;
+
+	if (fread(magic, 1, 8, f) != 8 || memcmp(magic, ASS_DUMP_MAGIC, 8) ||
+	    fread(dim, sizeof(int32_t), 2, f) != 2)
+		return -1;
+	*w = dim[0];
+	*h = dim[1];
+	*frames = NULL;
+	for (;;) {
+		int32_t count;
+		frame_t* fr;
+		int i;
+
+		if (fread(&count, sizeof(int32_t), 1, f) != 1)
+			break;
+		if (n == alloc) {
+			alloc = alloc ? 2 * alloc : 256;
+			*frames = realloc(*frames, alloc * sizeof(frame_t));
+		}
+		fr = &(*frames)[n++];
+		fr->count = count;
+		fr->images = calloc(count ? count : 1, sizeof(ass_image_t));
+		for (i = 0; i < count; i++) {
+			ass_image_t* img = &fr->images[i];
+			int32_t hdr[5];
+			if (fread(hdr, sizeof(int32_t), 5, f) != 5)
+				return -1;
+			img->w = hdr[0];
+			img->h = hdr[1];
+			img->dst_x = hdr[2];
+			img->dst_y = hdr[3];
+			img->color = hdr[4];
+			img->stride = img->w;
+			img->bitmap = malloc(img->w * img->h + 1);
+			if (fread(img->bitmap, 1, img->w * img->h, f) != img->w * img->h)
+				return -1;
+			img->next = i + 1 < count ? img + 1 : NULL;
+		}
+	}
+	return n;
+}
+
+static unsigned int get_usec(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+int main(int argc, char* argv[])
+{
+	static const struct { int flags; const char* name; } modes[] = {
+		{ 0,                               "C"            },
+		{ ASS_BLEND_MERGE,                 "C, merge"     },
+		{ ASS_BLEND_SIMD,                  "SSE2"         },
+		{ ASS_BLEND_SIMD | ASS_BLEND_MERGE, "SSE2, merge" },
+	};
+	frame_t* frames;
+	int nframes, w, h, loops = 10;
+	int i, l, m;
+	long long images = 0, merged = 0;
+	unsigned char* planes[3];
+	int stride[3];
+	FILE* f;
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <dump file> [loops]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 2)
+		loops = atoi(argv[2]);
+	f = fopen(argv[1], "rb");
+	if (!f) {
+		perror(argv[1]);
+		return 1;
+	}
+	nframes = read_frames(f, &frames, &w, &h);
+	fclose(f);
+	if (nframes <= 0) {
+		fprintf(stderr, "%s: not an image list recording\n", argv[1]);
+		return 1;
+	}
+
+	GetCpuCaps(&gCpuCaps);
+
+	stride[0] = w;
+	stride[1] = stride[2] = (w + 1) / 2;
+	planes[0] = malloc(stride[0] * h);
+	planes[1] = malloc(stride[1] * ((h + 1) / 2));
+	planes[2] = malloc(stride[2] * ((h + 1) / 2));
+
+	for (m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+		ass_blend_t ctx;
+		unsigned int t;
+
+		if ((modes[m].flags & ASS_BLEND_SIMD) && !gCpuCaps.hasSSE2)
+			continue;
+		ass_blend_init(&ctx, modes[m].flags);
+		memset(planes[0], 128, stride[0] * h);
+		memset(planes[1], 128, stride[1] * ((h + 1) / 2));
+		memset(planes[2], 128, stride[2] * ((h + 1) / 2));
+		t = get_usec();
+		for (l = 0; l < loops; l++)
+			for (i = 0; i < nframes; i++)
+				if (frames[i].count)
+					ass_blend_frame(&ctx, planes, stride, frames[i].images);
+		t = get_usec() - t;
+		printf("%-12s %8.1f us/frame\n", modes[m].name,
+		       (double)t / (loops * nframes));
+		ass_blend_uninit(&ctx);
+	}
+
+	{
+		ass_blend_t ctx;
+		ass_blend_init(&ctx, ASS_BLEND_MERGE);
+		for (i = 0; i < nframes; i++) {
+			ass_image_t* img;
+			if (!frames[i].count)
+				continue;
+			images += frames[i].count;
+			for (img = ass_blend_merge(&ctx, frames[i].images); img; img = img->next)
+				merged++;
+		}
+		ass_blend_uninit(&ctx);
+	}
+	printf("%d frames %dx%d, %.1f images/frame, %.1f after merging\n",
+	       nframes, w, h, (double)images / nframes, (double)merged / nframes);
+	return 0;
+}
@@ -24,6 +24,10 @@
 #else
 	{"cache", "MPlayer was compiled without cache2 support.\n", CONF_TYPE_PRINT, CONF_NOCFG, 0, 0, NULL},
 #endif
+	{"file-buffer", &stream_file_buffer_size, CONF_TYPE_INT, CONF_RANGE, 2, 1024, NULL},
+	{"file-mmap", &stream_file_mmap, CONF_TYPE_FLAG, 0, 0, 1, NULL},
+	{"nofile-mmap", &stream_file_mmap, CONF_TYPE_FLAG, 0, 1, 0, NULL},
+	{"file-follow", &stream_file_follow, CONF_TYPE_INT, CONF_MIN, 0, 0, NULL},
 	{"vcd", "-vcd N has been removed, use vcd://N instead.\n", CONF_TYPE_PRINT, CONF_NOCFG ,0,0, NULL},
 	{"cuefile", "-cuefile has been removed, use cue://filename:N where N is the track number.\n", CONF_TYPE_PRINT, 0, 0, 0, NULL},
 	{"cdrom-device", &cdrom_device, CONF_TYPE_STRING, 0, 0, 0, NULL},
@@ -37,6 +41,7 @@
 #ifdef USE_DVDREAD
 	{"dvd", "-dvd N has been removed, use dvd://N instead.\n" , CONF_TYPE_PRINT, 0, 0, 0, NULL},
 	{"dvdangle", &dvd_angle, CONF_TYPE_INT, CONF_RANGE, 1, 99, NULL},
+	{"dvd-readahead", &dvd_readahead_size, CONF_TYPE_INT, CONF_RANGE, 0, 65536, NULL},
 	{"chapter", dvd_parse_chapter_range, CONF_TYPE_FUNC_PARAM, 0, 0, 0, NULL},
 #else
 	{"dvd", "MPlayer was compiled without libdvdread support.\n", CONF_TYPE_PRINT, CONF_NOCFG, 0, 0, NULL},
@@ -60,6 +65,11 @@
 	{"ipv4-only-proxy", &network_ipv4_only_proxy, CONF_TYPE_FLAG, 0, 0, 1, NULL},	
 	{"reuse-socket", &reuse_socket, CONF_TYPE_FLAG, CONF_GLOBAL, 0, 1, NULL},
 	{"noreuse-socket", &reuse_socket, CONF_TYPE_FLAG, CONF_GLOBAL, 1, 0, NULL},
+	{"udp-rcvbuf", &udp_rcvbuf, CONF_TYPE_INT, CONF_RANGE, 8, 65536, NULL},
+	{"udp-ring", &udp_ring_size, CONF_TYPE_INT, CONF_RANGE, 0, 262144, NULL},
+	{"http-range", &http_range_size, CONF_TYPE_INT, CONF_RANGE, 0, 65536, NULL},
+	{"http-prefetch", &http_prefetch, CONF_TYPE_FLAG, 0, 0, 1, NULL},
+	{"nohttp-prefetch", &http_prefetch, CONF_TYPE_FLAG, 0, 1, 0, NULL},
 #ifdef HAVE_AF_INET6
 	{"prefer-ipv6", &network_prefer_ipv4, CONF_TYPE_FLAG, 0, 1, 0, NULL},
 #else
@@ -113,6 +123,12 @@
 	{"saveidx", &index_file_save, CONF_TYPE_STRING, 0, 0, 0, NULL},
 	{"loadidx", &index_file_load, CONF_TYPE_STRING, 0, 0, 0, NULL},
 
+	// Matroska without Cues: index the clusters in the background
+	{"mkv-index", &mkv_cluster_index_enabled, CONF_TYPE_FLAG, 0, 0, 1, NULL},
+	{"nomkv-index", &mkv_cluster_index_enabled, CONF_TYPE_FLAG, 0, 1, 0, NULL},
+	{"mkv-index-cache", &mkv_cluster_index_cache, CONF_TYPE_FLAG, 0, 0, 1, NULL},
+	{"nomkv-index-cache", &mkv_cluster_index_cache, CONF_TYPE_FLAG, 0, 1, 0, NULL},
+
 	// select audio/video/subtitle stream
 	{"aid", &audio_id, CONF_TYPE_INT, CONF_RANGE, 0, 8190, NULL},
 	{"vid", &video_id, CONF_TYPE_INT, CONF_RANGE, 0, 8190, NULL},
@@ -138,6 +154,8 @@
 	{ "sub-demuxer", &sub_demuxer_name, CONF_TYPE_STRING, 0, 0, 0, NULL },
 	{ "extbased", &extension_parsing, CONF_TYPE_FLAG, 0, 0, 1, NULL },
 	{ "noextbased", &extension_parsing, CONF_TYPE_FLAG, 0, 1, 0, NULL },
+	{ "demuxer-probe", &demuxer_probe, CONF_TYPE_FLAG, 0, 0, 1, NULL },
+	{ "nodemuxer-probe", &demuxer_probe, CONF_TYPE_FLAG, 0, 1, 0, NULL },
 
         {"mf", mfopts_conf, CONF_TYPE_SUBCONFIG, 0,0,0, NULL},
 #ifdef USE_RADIO
@@ -294,6 +312,7 @@
 	{"sub-bg-alpha", &sub_bg_alpha, CONF_TYPE_INT, CONF_RANGE, 0, 255, NULL},
 	{"sub-no-text-pp", &sub_no_text_pp, CONF_TYPE_FLAG, 0, 0, 1, NULL},
 	{"sub-fuzziness", &sub_match_fuzziness, CONF_TYPE_INT, CONF_RANGE, 0, 2, NULL},
+	{"sub-lazy", &sub_lazy, CONF_TYPE_FLAG, 0, 0, 1, NULL},
 	{"font", &font_name, CONF_TYPE_STRING, 0, 0, 0, NULL},
 	{"ffactor", &font_factor, CONF_TYPE_FLOAT, CONF_RANGE, 0.0, 10.0, NULL},
  	{"subpos", &sub_pos, CONF_TYPE_INT, CONF_RANGE, 0, 100, NULL},
@@ -325,6 +344,7 @@
 	{"ass-color", &ass_color, CONF_TYPE_STRING, 0, 0, 0, NULL},
 	{"ass-border-color", &ass_border_color, CONF_TYPE_STRING, 0, 0, 0, NULL},
 	{"ass-styles", &ass_styles_file, CONF_TYPE_STRING, 0, 0, 0, NULL},
+	{"ass-cache-size", &ass_cache_size, CONF_TYPE_INT, CONF_RANGE, 1, 1024, NULL},
 #endif
 #ifdef HAVE_FONTCONFIG
 	{"fontconfig", &font_fontconfig, CONF_TYPE_FLAG, 0, 0, 1, NULL},
@@ -371,17 +391,26 @@ extern char *cookies_file;
 extern int network_prefer_ipv4;
 extern int network_ipv4_only_proxy;
 extern int reuse_socket;
+extern int udp_rcvbuf;     /* stream/udp.c */
+extern int udp_ring_size;  /* stream/udp_recv.c */
+extern int http_range_size; /* stream/http.c */
+extern int http_prefetch;   /* stream/http.c */
 
 #endif
 
 #if defined(USE_DVDREAD) || defined(USE_DVDNAV)
 extern int dvd_speed; /* stream/stream_dvd.c */
 #endif
+#ifdef USE_DVDREAD
+extern int dvd_readahead_size; /* stream/dvd_readahead.c */
+#endif
 
 extern float a52_drc_level;
 
 /* defined in libmpdemux: */
 extern int hr_mp3_seek;
+extern int mkv_cluster_index_enabled; /* libmpdemux/mkv_cluster_index.c */
+extern int mkv_cluster_index_cache;
 extern m_option_t demux_rawaudio_opts[];
 extern m_option_t demux_rawvideo_opts[];
 extern m_option_t cdda_opts[];
@@ -432,6 +461,7 @@ m_option_t tvopts_conf[]={
 	{"norm", &tv_param_norm, CONF_TYPE_STRING, 0, 0, 0, NULL},
 #ifdef HAVE_TV_V4L2
 	{"normid", &tv_param_normid, CONF_TYPE_INT, 0, 0, 0, NULL},
+	{"zerocopy", &tv_param_zerocopy, CONF_TYPE_FLAG, 0, 0, 1, NULL},
 #endif
 	{"width", &tv_param_width, CONF_TYPE_INT, 0, 0, 4096, NULL},
 	{"height", &tv_param_height, CONF_TYPE_INT, 0, 0, 4096, NULL},
@@ -10,6 +10,10 @@ extern int fakemono; // defined in dec_audio.c
 #endif
 
 extern int sws_flags;
+extern int file_write_buffer_size; /* stream/file_write.c */
+extern int file_write_thread;
+extern int file_write_direct;
+extern int file_write_prealloc;
 extern int readPPOpt(void *, char *arg);
 extern void revertPPOpt(void *conf, char* opt);
 extern char *pp_help;
@@ -200,6 +204,14 @@ m_option_t mencoder_opts[]={
 	{"ofps", &force_ofps, CONF_TYPE_FLOAT, CONF_MIN|CONF_GLOBAL, 0, 0, NULL},
 	{"o", &out_filename, CONF_TYPE_STRING, CONF_GLOBAL, 0, 0, NULL},
 
+	// buffering of the output file
+	{"file-write-buffer", &file_write_buffer_size, CONF_TYPE_INT, CONF_RANGE|CONF_GLOBAL, 0, 65536, NULL},
+	{"file-write-thread", &file_write_thread, CONF_TYPE_FLAG, CONF_GLOBAL, 0, 1, NULL},
+	{"nofile-write-thread", &file_write_thread, CONF_TYPE_FLAG, CONF_GLOBAL, 1, 0, NULL},
+	{"file-direct", &file_write_direct, CONF_TYPE_FLAG, CONF_GLOBAL, 0, 1, NULL},
+	{"nofile-direct", &file_write_direct, CONF_TYPE_FLAG, CONF_GLOBAL, 1, 0, NULL},
+	{"file-prealloc", &file_write_prealloc, CONF_TYPE_INT, CONF_MIN|CONF_GLOBAL, 0, 0, NULL},
+
 	// limit number of skippable frames after a non-skipped one
 	{"skiplimit", &skip_limit, CONF_TYPE_INT, 0, 0, 0, NULL},
 	{"noskiplimit", &skip_limit, CONF_TYPE_FLAG, 0, 0, -1, NULL},
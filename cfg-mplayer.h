@@ -102,6 +102,11 @@ extern char* pp_help;
 extern int enable_mouse_movements;
 extern int use_filedir_conf;
 
+/* libmpdemux/demux_thread.c */
+extern int demux_thread_enabled;
+extern int demux_thread_bytes;
+extern float demux_thread_secs;
+
 m_option_t vd_conf[]={
 	{"help", "Use MPlayer with an appropriate video file instead of live partners to avoid vd.\n", CONF_TYPE_PRINT, CONF_NOCFG|CONF_GLOBAL, 0, 0, NULL},
 	{NULL, NULL, 0, 0, 0, 0, NULL}
@@ -308,6 +313,17 @@ m_option_t mplayer_opts[]={
 	{"autoq", &auto_quality, CONF_TYPE_INT, CONF_RANGE, 0, 100, NULL},
 
 	{"benchmark", &benchmark, CONF_TYPE_FLAG, 0, 0, 1, NULL},
+	{"thumbnails", &thumbnail_count, CONF_TYPE_INT, CONF_MIN, 0, 0, NULL},
+
+	// demux ahead of the decoders in a thread
+	{"demuxer-thread", &demux_thread_enabled, CONF_TYPE_FLAG, 0, 0, 1, NULL},
+	{"nodemuxer-thread", &demux_thread_enabled, CONF_TYPE_FLAG, 0, 1, 0, NULL},
+	{"demuxer-thread-size", &demux_thread_bytes, CONF_TYPE_INT, CONF_MIN, 64, 0, NULL},
+	{"demuxer-thread-secs", &demux_thread_secs, CONF_TYPE_FLOAT, CONF_MIN, 0, 0, NULL},
+
+	// live TV: start at the first keyframe, fill the cache while playing
+	{"live", &demuxer_live, CONF_TYPE_FLAG, 0, 0, 1, NULL},
+	{"nolive", &demuxer_live, CONF_TYPE_FLAG, 0, 1, 0, NULL},
 
 	// dump some stream out instead of playing the file
 	// this really should be in MEncoder instead of MPlayer... -> TODO
@@ -8,6 +8,7 @@
 #include "stream/stream.h"
 #include "libmpdemux/demuxer.h"
 #include "libmpdemux/stheader.h"
+#include "libmpdemux/demux_thread.h"
 #include "mplayer.h"
 #include "libvo/sub.h"
 #include "m_option.h"
@@ -220,7 +221,9 @@ static int mp_property_stream_pos(m_option_t * prop, int action, void *arg,
 	return M_PROPERTY_OK;
     case M_PROPERTY_SET:
 	M_PROPERTY_CLAMP(prop, *(off_t *) arg);
+	demux_thread_pause(mpctx->demuxer);
 	stream_seek(mpctx->demuxer->stream, *(off_t *) arg);
+	demux_thread_resume(mpctx->demuxer);
 	return M_PROPERTY_OK;
     }
     return M_PROPERTY_NOT_IMPLEMENTED;
@@ -269,6 +272,52 @@ static int mp_property_stream_length(m_option_t * prop, int action,
     return M_PROPERTY_NOT_IMPLEMENTED;
 }
 
+/// Bytes between the read position and the end of a growing stream (RO)
+static int mp_property_stream_live_edge(m_option_t * prop, int action,
+					void *arg, MPContext * mpctx)
+{
+    stream_t *s;
+    if (!mpctx->demuxer || !(s = mpctx->demuxer->stream) ||
+	!(s->flags & STREAM_GROWING))
+	return M_PROPERTY_UNAVAILABLE;
+    switch (action) {
+    case M_PROPERTY_GET:
+	if (!arg)
+	    return M_PROPERTY_ERROR;
+	demux_thread_pause(mpctx->demuxer);
+	stream_update_size(s);
+	*(off_t *) arg = s->end_pos - stream_tell(s);
+	demux_thread_resume(mpctx->demuxer);
+	if (*(off_t *) arg < 0)
+	    *(off_t *) arg = 0;
+	return M_PROPERTY_OK;
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
+/// Seconds queued ahead by the demuxer thread (RO)
+static int mp_property_demuxer_readahead(m_option_t * prop, int action,
+					 void *arg, MPContext * mpctx)
+{
+    double secs;
+    int bytes;
+
+    if (!mpctx->demuxer || !demux_thread_fill(mpctx->demuxer, &secs, &bytes))
+	return M_PROPERTY_UNAVAILABLE;
+    if (!arg)
+	return M_PROPERTY_ERROR;
+    switch (action) {
+    case M_PROPERTY_GET:
+	*(double *) arg = secs;
+	return M_PROPERTY_OK;
+    case M_PROPERTY_PRINT:
+	*(char **) arg = malloc(32);
+	sprintf(*(char **) arg, "%.1f s, %d kB", secs, bytes / 1024);
+	return M_PROPERTY_OK;
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
 /// Media length in seconds (RO)
 static int mp_property_length(m_option_t * prop, int action, void *arg,
 			      MPContext * mpctx)
@@ -1085,6 +1134,9 @@ static int mp_property_sub(m_option_t * prop, int action, void *arg,
     subdata = NULL;
     vo_sub_last = vo_sub = NULL;
 
+    // the demuxer thread must not queue packets for the old stream meanwhile
+    if (mpctx->demuxer)
+	demux_thread_pause(mpctx->demuxer);
     vobsub_id = -1;
     dvdsub_id = -1;
     if (d_sub) {
@@ -1161,6 +1213,8 @@ static int mp_property_sub(m_option_t * prop, int action, void *arg,
 	d_sub->id = dvdsub_id;
     }
 #endif
+    if (mpctx->demuxer)
+	demux_thread_resume(mpctx->demuxer);
     update_subtitles(mpctx->sh_video, d_sub, 1);
 
     return M_PROPERTY_OK;
@@ -1313,6 +1367,10 @@ static m_option_t mp_properties[] = {
      M_OPT_MIN, 0, 0, NULL },
     { "stream_length", mp_property_stream_length, CONF_TYPE_POSITION,
      M_OPT_MIN, 0, 0, NULL },
+    { "stream_live_edge", mp_property_stream_live_edge, CONF_TYPE_POSITION,
+     M_OPT_MIN, 0, 0, NULL },
+    { "demuxer_readahead", mp_property_demuxer_readahead, CONF_TYPE_DOUBLE,
+     0, 0, 0, NULL },
     { "length", mp_property_length, CONF_TYPE_DOUBLE,
      0, 0, 0, NULL },
 
@@ -2333,6 +2391,47 @@ int run_command(MPContext * mpctx, mp_cmd_t * cmd)
 	    }
 	    break;
 
+	case MP_CMD_SEEK_KEYFRAME:{
+		/* seek to a video keyframe: relative seeks go to the first
+		 * keyframe beyond the target, absolute ones to the nearest */
+		float v = cmd->args[0].v.f;
+		int abs = (cmd->nargs > 1) ? cmd->args[1].v.i : 0;
+		double target;
+		int dir;
+		demux_keyframe_t kf;
+
+		if (!sh_video)
+		    break;
+		if (abs) {
+		    target = v;
+		    dir = KEYFRAME_NEAREST;
+		} else if (v < 0) {
+		    target = sh_video->pts + v - 0.001;
+		    dir = KEYFRAME_BEFORE;
+		} else {
+		    target = sh_video->pts + v + 0.001;
+		    dir = KEYFRAME_AFTER;
+		}
+		if (!demuxer_find_keyframe(mpctx->demuxer, target, dir, &kf)) {
+		    /* no keyframe known there, seek like "seek" does */
+		    if (abs) {
+			abs_seek_pos = 1;
+			rel_seek_secs = v;
+		    } else
+			rel_seek_secs += v;
+		} else {
+		    mp_msg(MSGT_CPLAYER, MSGL_V,
+			   "Keyframe at %.3f (file position %"PRId64")\n",
+			   kf.pts, (int64_t)kf.pos);
+		    abs_seek_pos = 1;
+		    rel_seek_secs = kf.pts;
+		}
+		mpctx->osd_function = (abs ? v > sh_video->pts : v >= 0) ?
+		    OSD_FFW : OSD_REW;
+		brk_cmd = 1;
+	    }
+	    break;
+
 	case MP_CMD_SET_MOUSE_POS:{
 		int button = -1, pointer_x, pointer_y;
 		double dx, dy;
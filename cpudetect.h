@@ -34,6 +34,14 @@
 #  define REG_BP "ebp"
 #endif
 
+/* asm that writes SSE registers lists them as clobbers with this, the
+ * compiler only knows their names when it generates SSE code itself */
+#ifdef __SSE__
+#  define XMM_CLOBBERS(...) __VA_ARGS__,
+#else
+#  define XMM_CLOBBERS(...)
+#endif
+
 typedef struct cpucaps_s {
 	int cpuType;
 	int cpuModel;
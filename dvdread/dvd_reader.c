@@ -142,11 +142,40 @@ void SetUDFCacheHandle(dvd_reader_t *device, void *cache)
 
 
 
-/* Loop over all titles and call dvdcss_title to crack the keys. */
+/* Time since t in milliseconds. */
+static long elapsed_ms( struct timeval *t )
+{
+    struct timeval now;
+    gettimeofday( &now, NULL );
+    return ( now.tv_sec - t->tv_sec ) * 1000
+	+ ( now.tv_usec - t->tv_usec ) / 1000;
+}
+
+/* Get the CSS key of one title VOB, report it if it was not quick. */
+static void initCSSKey( dvd_reader_t *dvd, const char *filename,
+			uint32_t start )
+{
+    struct timeval t_s;
+    long ms;
+
+    gettimeofday( &t_s, NULL );
+    if( dvdinput_title( dvd->dev, (int)start ) < 0 ) {
+	fprintf( stderr, "libdvdread: Error cracking CSS key for %s (0x%08x)\n",
+		 filename, start );
+    }
+    /* Keys from the libdvdcss cache take no time, only report the others */
+    ms = elapsed_ms( &t_s );
+    if( ms >= 100 ) {
+	fprintf( stderr, "libdvdread: Got key for %s at 0x%08x in %ld ms\n",
+		 filename, start, ms );
+    }
+}
+
+/* Loop over all titles and call dvdcss_title to get the keys in one pass,
+ * libdvdcss keeps them in its key cache for the next time. */
 static int initAllCSSKeys( dvd_reader_t *dvd )
 {
-    struct timeval all_s, all_e;
-    struct timeval t_s, t_e;
+    struct timeval all_s;
     char filename[ MAX_UDF_FILE_NAME_LEN ];
     uint32_t start, len;
     int title;
@@ -155,15 +184,9 @@ static int initAllCSSKeys( dvd_reader_t *dvd )
     if(nokeys_str != NULL)
       return 0;
     
-    fprintf( stderr, "\n" );
-    fprintf( stderr, "libdvdread: Attempting to retrieve all CSS keys\n" );
-    fprintf( stderr, "libdvdread: This can take a _long_ time, "
-	     "please be patient\n\n" );
-	
     gettimeofday(&all_s, NULL);
 	
     for( title = 0; title < 100; title++ ) {
-	gettimeofday( &t_s, NULL );
 	if( title == 0 ) {
 	    sprintf( filename, "/VIDEO_TS/VIDEO_TS.VOB" );
 	} else {
@@ -172,39 +195,22 @@ static int initAllCSSKeys( dvd_reader_t *dvd )
 	start = UDFFindFile( dvd, filename, &len );
 	if( start != 0 && len != 0 ) {
 	    /* Perform CSS key cracking for this title. */
-	    fprintf( stderr, "libdvdread: Get key for %s at 0x%08x\n", 
-		     filename, start );
-	    if( dvdinput_title( dvd->dev, (int)start ) < 0 ) {
-		fprintf( stderr, "libdvdread: Error cracking CSS key for %s (0x%08x)\n", filename, start);
-	    }
-	    gettimeofday( &t_e, NULL );
-	    fprintf( stderr, "libdvdread: Elapsed time %ld\n",  
-		     (long int) t_e.tv_sec - t_s.tv_sec );
+	    initCSSKey( dvd, filename, start );
 	}
 	    
 	if( title == 0 ) continue;
 	    
-	gettimeofday( &t_s, NULL );
 	sprintf( filename, "/VIDEO_TS/VTS_%02d_%d.VOB", title, 1 );
 	start = UDFFindFile( dvd, filename, &len );
 	if( start == 0 || len == 0 ) break;
 	    
 	/* Perform CSS key cracking for this title. */
-	fprintf( stderr, "libdvdread: Get key for %s at 0x%08x\n", 
-		 filename, start );
-	if( dvdinput_title( dvd->dev, (int)start ) < 0 ) {
-	    fprintf( stderr, "libdvdread: Error cracking CSS key for %s (0x%08x)!!\n", filename, start);
-	}
-	gettimeofday( &t_e, NULL );
-	fprintf( stderr, "libdvdread: Elapsed time %ld\n",  
-		 (long int) t_e.tv_sec - t_s.tv_sec );
+	initCSSKey( dvd, filename, start );
     }
     title--;
     
-    fprintf( stderr, "libdvdread: Found %d VTS's\n", title );
-    gettimeofday(&all_e, NULL);
-    fprintf( stderr, "libdvdread: Elapsed time %ld\n",  
-	     (long int) all_e.tv_sec - all_s.tv_sec );
+    fprintf( stderr, "libdvdread: CSS keys for %d VTS's in %ld ms\n",
+	     title, elapsed_ms( &all_s ) );
     
     return 0;
 }
@@ -653,8 +659,8 @@ static dvd_file_t *DVDOpenVOBUDF( dvd_reader_t *dvd, int title, int menu )
     }
     
     if( dvd->css_state == 1 /* Need key init */ ) {
-//        initAllCSSKeys( dvd );
-//	dvd->css_state = 2;
+        initAllCSSKeys( dvd );
+	dvd->css_state = 2;
     }
     /*    
     if( dvdinput_title( dvd_file->dvd->dev, (int)start ) < 0 ) {
@@ -51,7 +51,7 @@ void step_sub(sub_data *subd, float pts, int movement) {
     sub_delay = subs[current_sub].start / (subd->sub_uses_time ? 100 : sub_fps) - pts;
 }
 
-void find_sub(sub_data* subd,int key){
+static void find_sub_pos(sub_data* subd,int key){
     subtitle *subs;
     int i,j;
     
@@ -149,3 +149,10 @@ void find_sub(sub_data* subd,int key){
 
     vo_sub=NULL; // no sub here
 }
+
+void find_sub(sub_data* subd,int key){
+    find_sub_pos(subd,key);
+    // with -sub-lazy the text is read when the subtitle is shown
+    if (subd && subd->lazy && vo_sub)
+        sub_lazy_load(subd, vo_sub - subd->subtitles);
+}
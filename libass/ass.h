@@ -37,6 +37,15 @@ typedef struct ass_image_s {
 	struct ass_image_s* next; // linked list
 } ass_image_t;
 
+/// glyph and font cache counters, see ass_get_cache_stats()
+typedef struct ass_cache_stats_s {
+	unsigned glyph_hits, glyph_misses, glyph_evictions;
+	int glyph_items; // number of cached glyphs
+	int glyph_bytes; // memory used by cached glyph bitmaps
+	unsigned font_hits, font_misses, font_evictions;
+	int font_items; // number of cached fonts
+} ass_cache_stats_t;
+
 /**
  * \brief initialize the library
  * \return library handle or NULL if failed
@@ -59,6 +68,20 @@ void ass_set_extract_fonts(ass_library_t* priv, int extract);
 
 void ass_set_style_overrides(ass_library_t* priv, char** list);
 
+/**
+ * \brief set cache limits
+ * \param glyph_max_bytes memory budget for rendered glyph bitmaps, 0 = default
+ * \param font_max maximum number of cached fonts, 0 = default
+ * Least recently used entries are dropped at the end of a frame when
+ * the limits are exceeded.
+ */
+void ass_set_cache_limits(ass_library_t* priv, int glyph_max_bytes, int font_max);
+
+/**
+ * \brief get glyph and font cache counters
+ */
+void ass_get_cache_stats(ass_library_t* priv, ass_cache_stats_t* stats);
+
 /**
  * \brief initialize the renderer
  * \param priv library handle
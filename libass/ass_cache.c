@@ -29,15 +29,27 @@
 
 #include "mputils.h"
 #include "ass.h"
+#include "ass_library.h"
 #include "ass_fontconfig.h"
 #include "ass_font.h"
 #include "ass_bitmap.h"
 #include "ass_cache.h"
 
-#define MAX_FONT_CACHE_SIZE 100
+#define FONT_CACHE_ALLOC_STEP 16
 
-static ass_font_t** font_cache;
+typedef struct font_cache_item_s {
+	ass_font_t* font;
+	unsigned last_used; // cache_frame of the last lookup
+} font_cache_item_t;
+
+static ass_library_t* cache_library; // limits and statistics
+static unsigned cache_frame = 1; // items used in this frame are never evicted
+
+static font_cache_item_t* font_cache;
 static int font_cache_size;
+static int font_cache_alloc;
+
+static void glyph_cache_purge_font(ass_font_t* font);
 
 static int font_compare(ass_font_desc_t* a, ass_font_desc_t* b) {
 	if (strcmp(a->family, b->family) != 0)
@@ -59,9 +71,13 @@ ass_font_t* ass_font_cache_find(ass_font_desc_t* desc)
 	int i;
 	
 	for (i=0; i<font_cache_size; ++i)
-		if (font_compare(desc, &(font_cache[i]->desc)))
-			return font_cache[i];
+		if (font_compare(desc, &(font_cache[i].font->desc))) {
+			font_cache[i].last_used = cache_frame;
+			cache_library->cache_stats.font_hits++;
+			return font_cache[i].font;
+		}
 
+	cache_library->cache_stats.font_misses++;
 	return 0;
 }
 
@@ -71,31 +87,59 @@ ass_font_t* ass_font_cache_find(ass_font_desc_t* desc)
 */
 void ass_font_cache_add(ass_font_t* font)
 {
-	if (font_cache_size == MAX_FONT_CACHE_SIZE) {
-		mp_msg(MSGT_ASS, MSGL_FATAL, MSGTR_LIBASS_TooManyFonts);
-		// FIXME: possible memory leak
-		return;
+	if (font_cache_size == font_cache_alloc) {
+		font_cache_alloc += FONT_CACHE_ALLOC_STEP;
+		font_cache = realloc(font_cache, font_cache_alloc * sizeof(font_cache_item_t));
 	}
 
-	font_cache[font_cache_size] = font;
+	font_cache[font_cache_size].font = font;
+	font_cache[font_cache_size].last_used = cache_frame;
 	font_cache_size++;
+	cache_library->cache_stats.font_items = font_cache_size;
 }
 
-void ass_font_cache_init(void)
+/**
+ * \brief Drop the least recently used fonts above the configured limit.
+ * Glyphs rendered with an evicted font are dropped as well, their keys
+ * would otherwise match a new font allocated at the same address.
+ */
+static void font_cache_trim(void)
 {
-	font_cache = calloc(MAX_FONT_CACHE_SIZE, sizeof(ass_font_t*));
+	while (font_cache_size > cache_library->font_cache_max) {
+		int i, lru = -1;
+		for (i = 0; i < font_cache_size; ++i)
+			if (font_cache[i].last_used != cache_frame &&
+			    (lru < 0 || font_cache[i].last_used < font_cache[lru].last_used))
+				lru = i;
+		if (lru < 0) // all of them are in use
+			break;
+		glyph_cache_purge_font(font_cache[lru].font);
+		ass_font_free(font_cache[lru].font);
+		font_cache[lru] = font_cache[--font_cache_size];
+		cache_library->cache_stats.font_evictions++;
+	}
+	cache_library->cache_stats.font_items = font_cache_size;
+}
+
+void ass_font_cache_init(ass_library_t* library)
+{
+	cache_library = library;
+	font_cache = 0;
 	font_cache_size = 0;
+	font_cache_alloc = 0;
 }
 
 void ass_font_cache_done(void)
 {
 	int i;
 	for (i = 0; i < font_cache_size; ++i) {
-		ass_font_t* item = font_cache[i];
+		ass_font_t* item = font_cache[i].font;
 		ass_font_free(item);
 	}
 	free(font_cache);
+	font_cache = 0;
 	font_cache_size = 0;
+	font_cache_alloc = 0;
 }
 
 //---------------------------------
@@ -107,12 +151,20 @@ typedef struct glyph_hash_item_s {
 	glyph_hash_key_t key;
 	glyph_hash_val_t val;
 	struct glyph_hash_item_s* next;
+	// LRU list, most recently used first
+	struct glyph_hash_item_s* lru_prev;
+	struct glyph_hash_item_s* lru_next;
+	int size; // bytes accounted for this item
+	unsigned last_used; // cache_frame of the last lookup
 } glyph_hash_item_t;
 
 typedef glyph_hash_item_t* glyph_hash_item_p;
 
 static glyph_hash_item_p* glyph_hash_root;
 static int glyph_hash_size;
+static int glyph_hash_bytes;
+static glyph_hash_item_t* lru_head;
+static glyph_hash_item_t* lru_tail;
 
 static int glyph_compare(glyph_hash_key_t* a, glyph_hash_key_t* b) {
 	if (memcmp(a, b, sizeof(glyph_hash_key_t)) == 0)
@@ -128,8 +180,8 @@ static unsigned glyph_hash(glyph_hash_key_t* key) {
 		val += *(unsigned char *)(&(key->font) + i);
 	val <<= 21;
 	
-	if (key->bitmap)   val &= 0x80000000;
-	if (key->be) val &= 0x40000000;
+	if (key->bitmap)   val |= 0x80000000;
+	if (key->be) val |= 0x40000000;
 	val += key->ch;
 	val += key->size << 8;
 	val += key->outline << 3;
@@ -143,31 +195,77 @@ static unsigned glyph_hash(glyph_hash_key_t* key) {
 	return val;
 }
 
+static int bitmap_size(bitmap_t* bm)
+{
+	return bm ? sizeof(bitmap_t) + bm->w * bm->h : 0;
+}
+
+static void lru_unlink(glyph_hash_item_t* item)
+{
+	if (item->lru_prev) item->lru_prev->lru_next = item->lru_next;
+	else lru_head = item->lru_next;
+	if (item->lru_next) item->lru_next->lru_prev = item->lru_prev;
+	else lru_tail = item->lru_prev;
+}
+
+static void lru_push_front(glyph_hash_item_t* item)
+{
+	item->lru_prev = 0;
+	item->lru_next = lru_head;
+	if (lru_head) lru_head->lru_prev = item;
+	else lru_tail = item;
+	lru_head = item;
+}
+
+/**
+ * \brief Remove a glyph from hash table and LRU list and free its bitmaps.
+ */
+static void glyph_cache_remove(glyph_hash_item_t* item)
+{
+	glyph_hash_item_t** next = glyph_hash_root + (glyph_hash(&item->key) % GLYPH_HASH_SIZE);
+	while (*next != item)
+		next = &((*next)->next);
+	*next = item->next;
+	lru_unlink(item);
+
+	if (item->val.bm) ass_free_bitmap(item->val.bm);
+	if (item->val.bm_o) ass_free_bitmap(item->val.bm_o);
+	if (item->val.bm_s) ass_free_bitmap(item->val.bm_s);
+	glyph_hash_size --;
+	glyph_hash_bytes -= item->size;
+	free(item);
+}
+
 /**
  * \brief Add a glyph to glyph cache.
  * \param key hash key
  * \param val hash val: 2 bitmap glyphs + some additional info
+ * \return the cached val, differs from val if the glyph was cached already
 */ 
-void cache_add_glyph(glyph_hash_key_t* key, glyph_hash_val_t* val)
+glyph_hash_val_t* cache_add_glyph(glyph_hash_key_t* key, glyph_hash_val_t* val)
 {
 	unsigned hash = glyph_hash(key);
 	glyph_hash_item_t** next = glyph_hash_root + (hash % GLYPH_HASH_SIZE);
+	glyph_hash_item_t* item;
 	while (*next) {
 		if (glyph_compare(key, &((*next)->key)))
-			return;
+			return &((*next)->val);
 		next = &((*next)->next);
 		assert(next);
 	}
-	(*next) = malloc(sizeof(glyph_hash_item_t));
-//	(*next)->desc = glyph_key_copy(key, &((*next)->key));
-	memcpy(&((*next)->key), key, sizeof(glyph_hash_key_t));
-	memcpy(&((*next)->val), val, sizeof(glyph_hash_val_t));
-	(*next)->next = 0;
+	item = malloc(sizeof(glyph_hash_item_t));
+	memcpy(&(item->key), key, sizeof(glyph_hash_key_t));
+	memcpy(&(item->val), val, sizeof(glyph_hash_val_t));
+	item->next = 0;
+	item->size = sizeof(glyph_hash_item_t) + bitmap_size(val->bm) +
+		bitmap_size(val->bm_o) + bitmap_size(val->bm_s);
+	item->last_used = cache_frame;
+	lru_push_front(item);
+	*next = item;
 
 	glyph_hash_size ++;
-/*	if (glyph_hash_size  && (glyph_hash_size % 25 == 0)) {
-		printf("\nGlyph cache: %d entries, %d bytes\n", glyph_hash_size, glyph_hash_size * sizeof(glyph_hash_item_t));
-	} */
+	glyph_hash_bytes += item->size;
+	return &(item->val);
 }
 
 /**
@@ -181,40 +279,80 @@ glyph_hash_val_t* cache_find_glyph(glyph_hash_key_t* key)
 	glyph_hash_item_t* item = glyph_hash_root[hash % GLYPH_HASH_SIZE];
 	while (item) {
 		if (glyph_compare(key, &(item->key))) {
+			if (item != lru_head) {
+				lru_unlink(item);
+				lru_push_front(item);
+			}
+			item->last_used = cache_frame;
+			cache_library->cache_stats.glyph_hits++;
 			return &(item->val);
 		}
 		item = item->next;
 	}
+	cache_library->cache_stats.glyph_misses++;
 	return 0;
 }
 
-void ass_glyph_cache_init(void)
+/**
+ * \brief Drop all glyphs rendered with the given font.
+ */
+static void glyph_cache_purge_font(ass_font_t* font)
+{
+	glyph_hash_item_t* item = lru_head;
+	while (item) {
+		glyph_hash_item_t* next = item->lru_next;
+		if (item->key.font == font)
+			glyph_cache_remove(item);
+		item = next;
+	}
+}
+
+/**
+ * \brief Drop the least recently used glyphs until the cache fits its budget.
+ * Glyphs looked up in the current frame are kept, their bitmaps are
+ * referenced by the images returned to the caller.
+ */
+static void glyph_cache_trim(void)
+{
+	while (glyph_hash_bytes > cache_library->cache_max_bytes &&
+	       lru_tail && lru_tail->last_used != cache_frame) {
+		glyph_cache_remove(lru_tail);
+		cache_library->cache_stats.glyph_evictions++;
+	}
+}
+
+void ass_glyph_cache_init(ass_library_t* library)
 {
+	cache_library = library;
 	glyph_hash_root = calloc(GLYPH_HASH_SIZE, sizeof(glyph_hash_item_p));
 	glyph_hash_size = 0;
+	glyph_hash_bytes = 0;
+	lru_head = lru_tail = 0;
 }
 
 void ass_glyph_cache_done(void)
 {
-	int i;
-	for (i = 0; i < GLYPH_HASH_SIZE; ++i) {
-		glyph_hash_item_t* item = glyph_hash_root[i];
-		while (item) {
-			glyph_hash_item_t* next = item->next;
-			if (item->val.bm) ass_free_bitmap(item->val.bm);
-			if (item->val.bm_o) ass_free_bitmap(item->val.bm_o);
-			if (item->val.bm_s) ass_free_bitmap(item->val.bm_s);
-			free(item);
-			item = next;
-		}
-	}
+	while (lru_head)
+		glyph_cache_remove(lru_head);
 	free(glyph_hash_root);
 	glyph_hash_size = 0;
+	glyph_hash_bytes = 0;
 }
 
 void ass_glyph_cache_reset(void)
 {
 	ass_glyph_cache_done();
-	ass_glyph_cache_init();
+	ass_glyph_cache_init(cache_library);
 }
 
+/**
+ * \brief Enforce cache limits at the end of a frame and start a new one.
+ */
+void ass_cache_trim(void)
+{
+	font_cache_trim();
+	glyph_cache_trim();
+	cache_library->cache_stats.glyph_items = glyph_hash_size;
+	cache_library->cache_stats.glyph_bytes = glyph_hash_bytes;
+	cache_frame++;
+}
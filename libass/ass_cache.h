@@ -21,7 +21,7 @@
 #ifndef __ASS_CACHE_H__
 #define __ASS_CACHE_H__
 
-void ass_font_cache_init(void);
+void ass_font_cache_init(ass_library_t* library);
 ass_font_t* ass_font_cache_find(ass_font_desc_t* desc);
 void ass_font_cache_add(ass_font_t* font);
 void ass_font_cache_done(void);
@@ -52,11 +52,13 @@ typedef struct glyph_hash_val_s {
 	FT_Vector advance; // 26.6, advance distance to the next glyph in line
 } glyph_hash_val_t;
 
-void ass_glyph_cache_init(void);
-void cache_add_glyph(glyph_hash_key_t* key, glyph_hash_val_t* val);
+void ass_glyph_cache_init(ass_library_t* library);
+glyph_hash_val_t* cache_add_glyph(glyph_hash_key_t* key, glyph_hash_val_t* val);
 glyph_hash_val_t* cache_find_glyph(glyph_hash_key_t* key);
 void ass_glyph_cache_reset(void);
 void ass_glyph_cache_done(void);
 
+void ass_cache_trim(void);
+
 #endif
 
@@ -27,9 +27,15 @@
 #include "ass_library.h"
 
 
+#define GLYPH_CACHE_MAX_BYTES (32 * 1024 * 1024)
+#define FONT_CACHE_MAX 100
+
 ass_library_t* ass_library_init(void)
 {
-	return calloc(1, sizeof(ass_library_t));
+	ass_library_t* priv = calloc(1, sizeof(ass_library_t));
+	if (priv)
+		ass_set_cache_limits(priv, 0, 0);
+	return priv;
 }
 
 void ass_library_done(ass_library_t* priv)
@@ -76,6 +82,17 @@ void ass_set_style_overrides(ass_library_t* priv, char** list)
 	priv->style_overrides[cnt] = NULL;
 }
 
+void ass_set_cache_limits(ass_library_t* priv, int glyph_max_bytes, int font_max)
+{
+	priv->cache_max_bytes = glyph_max_bytes > 0 ? glyph_max_bytes : GLYPH_CACHE_MAX_BYTES;
+	priv->font_cache_max = font_max > 0 ? font_max : FONT_CACHE_MAX;
+}
+
+void ass_get_cache_stats(ass_library_t* priv, ass_cache_stats_t* stats)
+{
+	*stats = priv->cache_stats;
+}
+
 static void grow_array(void **array, int nelem, size_t elsize)
 {
 	if (!(nelem & 31))
@@ -34,6 +34,10 @@ struct ass_library_s {
 
 	ass_fontdata_t* fontdata;
 	int num_fontdata;
+
+	int cache_max_bytes; // glyph bitmap cache budget
+	int font_cache_max; // max number of cached fonts
+	ass_cache_stats_t cache_stats;
 };
 
 #endif
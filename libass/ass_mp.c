@@ -50,6 +50,7 @@ int ass_use_margins = 0;
 char* ass_color = NULL;
 char* ass_border_color = NULL;
 char* ass_styles_file = NULL;
+int ass_cache_size = 0;
 
 #ifdef HAVE_FONTCONFIG
 extern int font_fontconfig;
@@ -204,6 +205,7 @@ ass_track_t* ass_read_subdata(ass_library_t* library, sub_data* subdata, double
 	track = ass_default_track(library);
 	track->name = subdata->filename ? strdup(subdata->filename) : 0;
 
+	sub_load_all(subdata);
 	for (i = 0; i < subdata->sub_num; ++i) {
 		int eid = ass_process_subtitle(track, subdata->subtitles + i);
 		if (eid < 0)
@@ -247,6 +249,7 @@ ass_library_t* ass_init(void) {
 	ass_set_fonts_dir(priv, path);
 	ass_set_extract_fonts(priv, extract_embedded_fonts);
 	ass_set_style_overrides(priv, ass_force_style_list);
+	ass_set_cache_limits(priv, ass_cache_size * 1024 * 1024, 0);
 	free(path);
 	return priv;
 }
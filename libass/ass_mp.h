@@ -35,6 +35,7 @@ extern int ass_use_margins;
 extern char* ass_color;
 extern char* ass_border_color;
 extern char* ass_styles_file;
+extern int ass_cache_size;
 
 ass_track_t* ass_default_track(ass_library_t* library);
 int ass_process_subtitle(ass_track_t* track, subtitle* sub);
@@ -251,8 +251,8 @@ ass_renderer_t* ass_renderer_init(ass_library_t* library)
 	priv->ftlibrary = ft;
 	// images_root and related stuff is zero-filled in calloc
 	
-	ass_font_cache_init();
-	ass_glyph_cache_init();
+	ass_font_cache_init(library);
+	ass_glyph_cache_init(library);
 
 	text_info.glyphs = calloc(MAX_GLYPHS, sizeof(glyph_info_t));
 	
@@ -265,6 +265,13 @@ ass_init_exit:
 
 void ass_renderer_done(ass_renderer_t* priv)
 {
+	if (priv && priv->library) {
+		ass_cache_stats_t* st = &priv->library->cache_stats;
+		mp_msg(MSGT_ASS, MSGL_V, "[ass] glyph cache: %u hits, %u misses, %u evictions; "
+		       "font cache: %u hits, %u misses, %u evictions\n",
+		       st->glyph_hits, st->glyph_misses, st->glyph_evictions,
+		       st->font_hits, st->font_misses, st->font_evictions);
+	}
 	ass_font_cache_done();
 	ass_glyph_cache_done();
 	if (render_context.stroker) {
@@ -387,6 +394,7 @@ static ass_image_t* render_text(text_info_t* text_info, int dst_x, int dst_y)
 	int i, error;
 	bitmap_t* bm;
 	glyph_hash_val_t hash_val;
+	glyph_hash_val_t* val;
 	ass_image_t* head;
 	ass_image_t** tail = &head;
 
@@ -411,7 +419,16 @@ static ass_image_t* render_text(text_info_t* text_info, int dst_x, int dst_y)
 			hash_val.bm_s = text_info->glyphs[i].bm_s;
 			hash_val.advance.x = text_info->glyphs[i].advance.x;
 			hash_val.advance.y = text_info->glyphs[i].advance.y;
-			cache_add_glyph(&(text_info->glyphs[i].hash_key), &hash_val);
+			val = cache_add_glyph(&(text_info->glyphs[i].hash_key), &hash_val);
+			if (val->bm != hash_val.bm || val->bm_o != hash_val.bm_o || val->bm_s != hash_val.bm_s) {
+				// the same glyph occurs earlier in this event and is cached already
+				if (hash_val.bm) ass_free_bitmap(hash_val.bm);
+				if (hash_val.bm_o) ass_free_bitmap(hash_val.bm_o);
+				if (hash_val.bm_s) ass_free_bitmap(hash_val.bm_s);
+				text_info->glyphs[i].bm = val->bm;
+				text_info->glyphs[i].bm_o = val->bm_o;
+				text_info->glyphs[i].bm_s = val->bm_s;
+			}
 
 		}
 	}
@@ -2334,6 +2351,9 @@ ass_image_t* ass_render_frame(ass_renderer_t *priv, ass_track_t* track, long lon
 	ass_free_images(priv->prev_images_root);
 	priv->prev_images_root = 0;
 
+	// no bitmap of the previous images is referenced any more
+	ass_cache_trim();
+
 	return ass_renderer->images_root;
 }
 
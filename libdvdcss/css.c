@@ -48,6 +48,9 @@
 #   include <unistd.h>
 #endif
 #include <fcntl.h>
+#ifdef HAVE_DIRENT_H
+#   include <dirent.h>
+#endif
 
 #ifdef HAVE_LIMITS_H
 #   include <limits.h>
@@ -67,6 +70,10 @@
  *****************************************************************************/
 static void PrintKey        ( dvdcss_t, char *, uint8_t const * );
 
+static void InsertTitle     ( dvdcss_t, int, dvd_key_t );
+static int  ReadCacheKey    ( dvdcss_t, dvd_key_t );
+static void WriteCacheKey   ( dvdcss_t, int, dvd_key_t );
+
 static int  GetBusKey       ( dvdcss_t );
 static int  GetASF          ( dvdcss_t );
 
@@ -134,9 +141,9 @@ int _dvdcss_test( dvdcss_t dvdcss )
 int _dvdcss_title ( dvdcss_t dvdcss, int i_block )
 {
     dvd_title_t *p_title;
-    dvd_title_t *p_newtitle;
     dvd_key_t    p_title_key;
-    int          i_fd, i_ret = -1, b_cache = 0;
+    unsigned int i_start;
+    int          i_ret = -1, b_cache = 0;
 
     if( ! dvdcss->b_scrambled )
     {
@@ -160,45 +167,34 @@ int _dvdcss_title ( dvdcss_t dvdcss, int i_block )
         return 0;
     }
 
-    /* Check whether the key is in our disk cache */
+    /* Check whether the key is in our disk cache. The keys that were
+     * there at dvdcss_open() time are in the list already, but another
+     * process may have added this one since. */
     if( dvdcss->psz_cachefile[0] )
     {
         /* XXX: be careful, we use sprintf and not snprintf */
         sprintf( dvdcss->psz_block, "%.10x", i_block );
-        i_fd = open( dvdcss->psz_cachefile, O_RDONLY );
         b_cache = 1;
 
-        if( i_fd >= 0 )
+        if( ReadCacheKey( dvdcss, p_title_key ) == 0 )
         {
-            char psz_key[KEY_SIZE * 3];
-            unsigned int k0, k1, k2, k3, k4;
-
-            psz_key[KEY_SIZE * 3 - 1] = '\0';
-
-            if( read( i_fd, psz_key, KEY_SIZE * 3 - 1 ) == KEY_SIZE * 3 - 1
-                 && sscanf( psz_key, "%x:%x:%x:%x:%x",
-                            &k0, &k1, &k2, &k3, &k4 ) == 5 )
-            {
-                p_title_key[0] = k0;
-                p_title_key[1] = k1;
-                p_title_key[2] = k2;
-                p_title_key[3] = k3;
-                p_title_key[4] = k4;
-                PrintKey( dvdcss, "title key found in cache ", p_title_key );
-
-                /* Don't try to save it again */
-                b_cache = 0;
-                i_ret = 1;
-            }
+            PrintKey( dvdcss, "title key found in cache ", p_title_key );
 
-            close( i_fd );
+            /* Don't try to save it again */
+            b_cache = 0;
+            i_ret = 1;
+            dvdcss->i_keys_cache++;
         }
     }
 
     /* Crack or decrypt CSS title key for current VTS */
     if( i_ret < 0 )
     {
+        i_start = _dvdcss_clock();
         i_ret = _dvdcss_titlekey( dvdcss, i_block, p_title_key );
+        dvdcss->i_time_titlekeys += _dvdcss_clock() - i_start;
+        print_debug( dvdcss, "title key at block %i took %u ms", i_block,
+                     _dvdcss_clock() - i_start );
 
         if( i_ret < 0 )
         {
@@ -214,21 +210,83 @@ int _dvdcss_title ( dvdcss_t dvdcss, int i_block )
     }
 
     /* Key is valid, we store it on disk. */
-    if( dvdcss->psz_cachefile[0] && b_cache )
+    if( b_cache )
     {
-        i_fd = open( dvdcss->psz_cachefile, O_RDWR|O_CREAT, 0644 );
-        if( i_fd >= 0 )
-        {
-            char psz_key[KEY_SIZE * 3 + 2];
+        WriteCacheKey( dvdcss, i_block, p_title_key );
+    }
 
-            sprintf( psz_key, "%02x:%02x:%02x:%02x:%02x\r\n",
-                              p_title_key[0], p_title_key[1], p_title_key[2],
-                              p_title_key[3], p_title_key[4] );
+    InsertTitle( dvdcss, i_block, p_title_key );
 
-            write( i_fd, psz_key, KEY_SIZE * 3 + 1 );
-            close( i_fd );
+    memcpy( dvdcss->css.p_title_key, p_title_key, KEY_SIZE );
+    return 0;
+}
+
+/*****************************************************************************
+ * _dvdcss_loadkeys: read all title keys of the disc cache directory
+ *****************************************************************************
+ * This builds the in-memory index of the cached keys in one pass when the
+ * disc is opened, so that _dvdcss_title() finds them in the title list
+ * instead of opening one file per title.
+ *****************************************************************************/
+int _dvdcss_loadkeys( dvdcss_t dvdcss )
+{
+#ifdef HAVE_DIRENT_H
+    DIR *p_dir;
+    struct dirent *p_entry;
+    dvd_key_t p_key;
+    unsigned int i_start = _dvdcss_clock();
+    int i_keys = 0;
+
+    if( !dvdcss->psz_cachefile[0] )
+    {
+        return -1;
+    }
+
+    *dvdcss->psz_block = '\0';
+    p_dir = opendir( dvdcss->psz_cachefile );
+    if( p_dir == NULL )
+    {
+        return -1;
+    }
+
+    while( ( p_entry = readdir( p_dir ) ) != NULL )
+    {
+        /* Key files are named after their block number in 10 hex digits,
+         * anything else (temporary files) is not a key */
+        if( strlen( p_entry->d_name ) != 10
+             || strspn( p_entry->d_name, "0123456789abcdef" ) != 10 )
+        {
+            continue;
+        }
+
+        strcpy( dvdcss->psz_block, p_entry->d_name );
+        if( ReadCacheKey( dvdcss, p_key ) == 0 )
+        {
+            InsertTitle( dvdcss, (int)strtoul( p_entry->d_name, NULL, 16 ),
+                         p_key );
+            i_keys++;
         }
     }
+    closedir( p_dir );
+
+    dvdcss->i_keys_cache += i_keys;
+    dvdcss->i_time_index = _dvdcss_clock() - i_start;
+    print_debug( dvdcss, "%i title keys in cache, read in %u ms",
+                 i_keys, dvdcss->i_time_index );
+
+    return i_keys;
+#else
+    return -1;
+#endif
+}
+
+/*****************************************************************************
+ * InsertTitle: add a title key to the sorted list of known keys
+ *****************************************************************************/
+static void InsertTitle( dvdcss_t dvdcss, int i_block, dvd_key_t p_title_key )
+{
+    dvd_title_t *p_title;
+    dvd_title_t *p_newtitle;
 
     /* Find our spot in the list */
     p_newtitle = NULL;
@@ -244,6 +302,10 @@ int _dvdcss_title ( dvdcss_t dvdcss, int i_block )
 
     /* Write in the new title and its key */
     p_newtitle = malloc( sizeof( dvd_title_t ) );
+    if( p_newtitle == NULL )
+    {
+        return;
+    }
     p_newtitle->i_startlb = i_block;
     memcpy( p_newtitle->p_key, p_title_key, KEY_SIZE );
 
@@ -259,9 +321,78 @@ int _dvdcss_title ( dvdcss_t dvdcss, int i_block )
         p_newtitle->p_next = p_title->p_next;
         p_title->p_next = p_newtitle;
     }
+}
 
-    memcpy( dvdcss->css.p_title_key, p_title_key, KEY_SIZE );
-    return 0;
+/*****************************************************************************
+ * ReadCacheKey: read the key file psz_cachefile points to
+ *****************************************************************************/
+static int ReadCacheKey( dvdcss_t dvdcss, dvd_key_t p_title_key )
+{
+    char psz_key[KEY_SIZE * 3];
+    unsigned int k0, k1, k2, k3, k4;
+    int i_fd, i_ret = -1;
+
+    i_fd = open( dvdcss->psz_cachefile, O_RDONLY );
+    if( i_fd < 0 )
+    {
+        return -1;
+    }
+
+    psz_key[KEY_SIZE * 3 - 1] = '\0';
+
+    if( read( i_fd, psz_key, KEY_SIZE * 3 - 1 ) == KEY_SIZE * 3 - 1
+         && sscanf( psz_key, "%x:%x:%x:%x:%x",
+                    &k0, &k1, &k2, &k3, &k4 ) == 5 )
+    {
+        p_title_key[0] = k0;
+        p_title_key[1] = k1;
+        p_title_key[2] = k2;
+        p_title_key[3] = k3;
+        p_title_key[4] = k4;
+        i_ret = 0;
+    }
+
+    close( i_fd );
+    return i_ret;
+}
+
+/*****************************************************************************
+ * WriteCacheKey: store a title key in the cache directory
+ *****************************************************************************
+ * The key is written to a temporary file which is then renamed, so that an
+ * interrupted write never leaves a truncated key behind.
+ *****************************************************************************/
+static void WriteCacheKey( dvdcss_t dvdcss, int i_block,
+                           dvd_key_t p_title_key )
+{
+    char psz_tmpfile[PATH_MAX];
+    char psz_key[KEY_SIZE * 3 + 2];
+    int i_fd, i_ret;
+
+    sprintf( dvdcss->psz_block, "%.10x.tmp", i_block );
+    strcpy( psz_tmpfile, dvdcss->psz_cachefile );
+    sprintf( dvdcss->psz_block, "%.10x", i_block );
+
+    i_fd = open( psz_tmpfile, O_RDWR|O_CREAT|O_TRUNC, 0644 );
+    if( i_fd < 0 )
+    {
+        print_debug( dvdcss, "cannot write title key to cache" );
+        return;
+    }
+
+    sprintf( psz_key, "%02x:%02x:%02x:%02x:%02x\r\n",
+                      p_title_key[0], p_title_key[1], p_title_key[2],
+                      p_title_key[3], p_title_key[4] );
+
+    i_ret = write( i_fd, psz_key, KEY_SIZE * 3 + 1 );
+    close( i_fd );
+
+    if( i_ret != KEY_SIZE * 3 + 1
+         || rename( psz_tmpfile, dvdcss->psz_cachefile ) < 0 )
+    {
+        print_debug( dvdcss, "cannot write title key to cache" );
+        unlink( psz_tmpfile );
+    }
 }
 
 /*****************************************************************************
@@ -443,6 +574,7 @@ int _dvdcss_titlekey( dvdcss_t dvdcss, int i_pos, dvd_key_t p_title_key )
             /* All went well either there wasn't a key or we have it now. */
             memcpy( p_title_key, p_key, KEY_SIZE );
             PrintKey( dvdcss, "title key is ", p_title_key );
+            dvdcss->i_keys_drive++;
 
             return i_ret;
         }
@@ -464,6 +596,10 @@ int _dvdcss_titlekey( dvdcss_t dvdcss, int i_pos, dvd_key_t p_title_key )
 
     /* For now, the read limit is 9Gb / 2048 =  4718592 sectors. */
     i_ret = CrackTitleKey( dvdcss, i_pos, 4718592, p_key );
+    if( i_ret >= 0 )
+    {
+        dvdcss->i_keys_cracked++;
+    }
 
     memcpy( p_title_key, p_key, KEY_SIZE );
     PrintKey( dvdcss, "title key is ", p_title_key );
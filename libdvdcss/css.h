@@ -50,6 +50,7 @@ typedef struct css_s
  *****************************************************************************/
 int   _dvdcss_test        ( dvdcss_t );
 int   _dvdcss_title       ( dvdcss_t, int );
+int   _dvdcss_loadkeys    ( dvdcss_t );
 int   _dvdcss_disckey     ( dvdcss_t );
 int   _dvdcss_titlekey    ( dvdcss_t, int , dvd_key_t );
 int   _dvdcss_unscramble  ( uint8_t *, uint8_t * );
@@ -90,7 +90,9 @@
  *     manufacturing date. If DVDCSS_CACHE is not set or is empty, \e libdvdcss
  *     will use the default value which is "${HOME}/.dvdcss/" under Unix and
  *     "C:\Documents and Settings\$USER\Application Data\dvdcss\" under Win32.
- *     The special value "off" disables caching.
+ *     If that directory cannot be used, the keys are cached in
+ *     "${TMPDIR}/dvdcss-${UID}/" (or "%TEMP%\dvdcss\" under Win32) rather than
+ *     cracked again at every open. The special value "off" disables caching.
  */
 
 /*
@@ -124,6 +126,12 @@
 #   include <direct.h>
 #endif
 
+#if defined( WIN32 ) && !defined( SYS_CYGWIN )
+#   include <windows.h>
+#else
+#   include <sys/time.h>
+#endif
+
 #include "dvdcss/dvdcss.h"
 
 #include "common.h"
@@ -145,6 +153,10 @@
 LIBDVDCSS_EXPORT char * dvdcss_interface_2;
 char * dvdcss_interface_2 = VERSION;
 
+static char *FallbackCacheDir( char *psz_buffer );
+static int CreateCacheDir( dvdcss_t dvdcss, char const *psz_cache,
+                           char const *psz_id );
+
 /**
  * \brief Open a DVD device or directory and return a dvdcss instance.
  *
@@ -162,6 +174,8 @@ char * dvdcss_interface_2 = VERSION;
 LIBDVDCSS_EXPORT dvdcss_t dvdcss_open ( char *psz_target )
 {
     char psz_buffer[PATH_MAX];
+    char psz_fallback[PATH_MAX];
+    unsigned int i_start = _dvdcss_clock();
     int i_ret;
 
     char *psz_method = getenv( "DVDCSS_METHOD" );
@@ -195,6 +209,12 @@ LIBDVDCSS_EXPORT dvdcss_t dvdcss_open ( char *psz_target )
     dvdcss->psz_cachefile[0] = '\0';
     dvdcss->b_debug = 0;
     dvdcss->b_errors = 0;
+    dvdcss->i_keys_cache = 0;
+    dvdcss->i_keys_drive = 0;
+    dvdcss->i_keys_cracked = 0;
+    dvdcss->i_time_disckey = 0;
+    dvdcss->i_time_index = 0;
+    dvdcss->i_time_titlekeys = 0;
 
     /*
      *  Find verbosity from DVDCSS_VERBOSE environment variable
@@ -312,6 +332,12 @@ LIBDVDCSS_EXPORT dvdcss_t dvdcss_open ( char *psz_target )
             psz_cache = psz_buffer;
         }
 #endif
+
+        /* Without a home directory, do not crack keys again every time */
+        if( psz_cache == NULL )
+        {
+            psz_cache = FallbackCacheDir( psz_fallback );
+        }
     }
 
     /*
@@ -324,7 +350,7 @@ LIBDVDCSS_EXPORT dvdcss_t dvdcss_open ( char *psz_target )
             psz_cache = NULL;
         }
         /* Check that we can add the ID directory and the block filename */
-        else if( strlen( psz_cache ) + 1 + 32 + 1 + (KEY_SIZE * 2) + 10 + 1
+        else if( strlen( psz_cache ) + 1 + 32 + 1 + (KEY_SIZE * 2) + 10 + 4 + 1
                   > PATH_MAX )
         {
             print_error( dvdcss, "cache directory name is too long" );
@@ -368,7 +394,10 @@ LIBDVDCSS_EXPORT dvdcss_t dvdcss_open ( char *psz_target )
     /* If disc is CSS protected and the ioctls work, authenticate the drive */
     if( dvdcss->b_scrambled && dvdcss->b_ioctls )
     {
+        unsigned int i_disckey = _dvdcss_clock();
+
         i_ret = _dvdcss_disckey( dvdcss );
+        dvdcss->i_time_disckey = _dvdcss_clock() - i_disckey;
 
         if( i_ret < 0 )
         {
@@ -379,31 +408,13 @@ LIBDVDCSS_EXPORT dvdcss_t dvdcss_open ( char *psz_target )
         }
     }
 
-    /* If the cache is enabled, write the cache directory tag */
-    if( psz_cache )
-    {
-        char *psz_tag = "Signature: 8a477f597d28d172789f06886806bc55\r\n"
-            "# This file is a cache directory tag created by libdvdcss.\r\n"
-            "# For information about cache directory tags, see:\r\n"
-            "#   http://www.brynosaurus.com/cachedir/\r\n";
-        char psz_tagfile[PATH_MAX + 1 + 12 + 1];
-        int i_fd;
-
-        sprintf( psz_tagfile, "%s/CACHEDIR.TAG", psz_cache );
-        i_fd = open( psz_tagfile, O_RDWR|O_CREAT, 0644 );
-        if( i_fd >= 0 )
-        {
-            write( i_fd, psz_tag, strlen(psz_tag) );
-            close( i_fd );
-        }
-    }
-
     /* If the cache is enabled, extract a unique disc ID */
     if( psz_cache )
     {
         uint8_t p_sector[DVDCSS_BLOCK_SIZE];
         char psz_debug[PATH_MAX + 30];
         char psz_key[1 + KEY_SIZE * 2 + 1];
+        char psz_id[32 + 1 + 16 + 1 + KEY_SIZE * 2 + 1];
         char *psz_title, *psz_serial;
         int i;
 
@@ -498,43 +509,36 @@ LIBDVDCSS_EXPORT dvdcss_t dvdcss_open ( char *psz_target )
         }
 
         /* We have a disc name or ID, we can create the cache dir */
-        i = sprintf( dvdcss->psz_cachefile, "%s", psz_cache );
-#if !defined( WIN32 ) || defined( SYS_CYGWIN )
-        i_ret = mkdir( dvdcss->psz_cachefile, 0755 );
-#else
-        i_ret = mkdir( dvdcss->psz_cachefile );
-#endif
-        if( i_ret < 0 && errno != EEXIST )
+        snprintf( psz_id, sizeof(psz_id), "%s-%s%s",
+                  psz_title, psz_serial, psz_key );
+        i_ret = CreateCacheDir( dvdcss, psz_cache, psz_id );
+
+        /* Rather use a temporary directory than none at all */
+        if( i_ret < 0 && psz_cache != psz_fallback
+             && FallbackCacheDir( psz_fallback ) != NULL )
         {
-            print_error( dvdcss, "failed creating cache directory" );
-            dvdcss->psz_cachefile[0] = '\0';
-            goto nocache;
+            i_ret = CreateCacheDir( dvdcss, psz_fallback, psz_id );
         }
-
-        i += sprintf( dvdcss->psz_cachefile + i, "/%s-%s%s", psz_title,
-                      psz_serial, psz_key );
-#if !defined( WIN32 ) || defined( SYS_CYGWIN )
-        i_ret = mkdir( dvdcss->psz_cachefile, 0755 );
-#else
-        i_ret = mkdir( dvdcss->psz_cachefile );
-#endif
-        if( i_ret < 0 && errno != EEXIST )
+        if( i_ret < 0 )
         {
-            print_error( dvdcss, "failed creating cache subdirectory" );
-            dvdcss->psz_cachefile[0] = '\0';
             goto nocache;
         }
-        i += sprintf( dvdcss->psz_cachefile + i, "/");
-
-        /* Pointer to the filename we will use. */
-        dvdcss->psz_block = dvdcss->psz_cachefile + i;
 
         sprintf( psz_debug, "using CSS key cache dir: %s",
                             dvdcss->psz_cachefile );
         print_debug( dvdcss, psz_debug );
+
+        /* Read all the keys we know for this disc in one go */
+        if( dvdcss->b_scrambled )
+        {
+            _dvdcss_loadkeys( dvdcss );
+        }
     }
     nocache:
 
+    print_debug( dvdcss, "opened in %u ms, disc key took %u ms",
+                 _dvdcss_clock() - i_start, dvdcss->i_time_disckey );
+
 #ifndef WIN32
     if( psz_raw_device != NULL )
     {
@@ -764,6 +768,12 @@ LIBDVDCSS_EXPORT int dvdcss_close ( dvdcss_t dvdcss )
     dvd_title_t *p_title;
     int i_ret;
 
+    print_debug( dvdcss, "title keys: %i from cache (read in %u ms), "
+                 "%i from the drive, %i cracked, %u ms spent getting keys",
+                 dvdcss->i_keys_cache, dvdcss->i_time_index,
+                 dvdcss->i_keys_drive, dvdcss->i_keys_cracked,
+                 dvdcss->i_time_titlekeys );
+
     /* Free our list of keys */
     p_title = dvdcss->p_titles;
     while( p_title )
@@ -795,3 +805,127 @@ LIBDVDCSS_EXPORT int dvdcss_title ( dvdcss_t dvdcss, int i_block )
     return _dvdcss_title( dvdcss, i_block );
 }
 
+/*
+ *  Milliseconds from an arbitrary origin, only differences are meaningful.
+ */
+unsigned int _dvdcss_clock( void )
+{
+#if defined( WIN32 ) && !defined( SYS_CYGWIN )
+    return GetTickCount();
+#else
+    struct timeval tv;
+
+    gettimeofday( &tv, NULL );
+    return (unsigned int)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+#endif
+}
+
+/*
+ *  Per-user cache directory in the temporary directory, for when the
+ *  home directory is missing or not writable.
+ */
+static char *FallbackCacheDir( char *psz_buffer )
+{
+    char *psz_tmp = getenv( "TMPDIR" );
+
+#if defined( WIN32 ) && !defined( SYS_CYGWIN )
+    if( psz_tmp == NULL )
+    {
+        psz_tmp = getenv( "TEMP" );
+    }
+    if( psz_tmp == NULL )
+    {
+        return NULL;
+    }
+    snprintf( psz_buffer, PATH_MAX, "%s/dvdcss", psz_tmp );
+#else
+    struct stat st;
+
+    if( psz_tmp == NULL || psz_tmp[0] == '\0' )
+    {
+        psz_tmp = "/tmp";
+    }
+    snprintf( psz_buffer, PATH_MAX, "%s/dvdcss-%u", psz_tmp,
+              (unsigned int)getuid() );
+
+    /* The temporary directory is shared, only trust a directory we own */
+    mkdir( psz_buffer, 0700 );
+    if( lstat( psz_buffer, &st ) < 0 || !S_ISDIR( st.st_mode )
+         || st.st_uid != getuid() )
+    {
+        return NULL;
+    }
+#endif
+    psz_buffer[PATH_MAX-1] = '\0';
+
+    if( strlen( psz_buffer ) + 1 + 32 + 1 + (KEY_SIZE * 2) + 10 + 4 + 1
+         > PATH_MAX )
+    {
+        return NULL;
+    }
+
+    return psz_buffer;
+}
+
+/*
+ *  Create the cache directory psz_cache with its tag and the subdirectory
+ *  psz_id for the disc, and point psz_cachefile and psz_block to them.
+ */
+static int CreateCacheDir( dvdcss_t dvdcss, char const *psz_cache,
+                           char const *psz_id )
+{
+    char *psz_tag = "Signature: 8a477f597d28d172789f06886806bc55\r\n"
+        "# This file is a cache directory tag created by libdvdcss.\r\n"
+        "# For information about cache directory tags, see:\r\n"
+        "#   http://www.brynosaurus.com/cachedir/\r\n";
+    int i, i_ret, i_fd;
+
+    i = sprintf( dvdcss->psz_cachefile, "%s", psz_cache );
+#if !defined( WIN32 ) || defined( SYS_CYGWIN )
+    i_ret = mkdir( dvdcss->psz_cachefile, 0755 );
+#else
+    i_ret = mkdir( dvdcss->psz_cachefile );
+#endif
+    if( i_ret < 0 && errno != EEXIST )
+    {
+        print_error( dvdcss, "failed creating cache directory" );
+        dvdcss->psz_cachefile[0] = '\0';
+        return -1;
+    }
+
+    /* Write the cache directory tag */
+    sprintf( dvdcss->psz_cachefile + i, "/CACHEDIR.TAG" );
+    i_fd = open( dvdcss->psz_cachefile, O_RDWR|O_CREAT, 0644 );
+    if( i_fd >= 0 )
+    {
+        write( i_fd, psz_tag, strlen(psz_tag) );
+        close( i_fd );
+    }
+
+    i += sprintf( dvdcss->psz_cachefile + i, "/%s", psz_id );
+#if !defined( WIN32 ) || defined( SYS_CYGWIN )
+    i_ret = mkdir( dvdcss->psz_cachefile, 0755 );
+#else
+    i_ret = mkdir( dvdcss->psz_cachefile );
+#endif
+    if( i_ret < 0 && errno != EEXIST )
+    {
+        print_error( dvdcss, "failed creating cache subdirectory" );
+        dvdcss->psz_cachefile[0] = '\0';
+        return -1;
+    }
+
+    /* Keys we could not write would have to be cracked again next time */
+    if( access( dvdcss->psz_cachefile, W_OK ) < 0 )
+    {
+        print_error( dvdcss, "cache subdirectory is not writable" );
+        dvdcss->psz_cachefile[0] = '\0';
+        return -1;
+    }
+    i += sprintf( dvdcss->psz_cachefile + i, "/");
+
+    /* Pointer to the filename we will use. */
+    dvdcss->psz_block = dvdcss->psz_cachefile + i;
+
+    return 0;
+}
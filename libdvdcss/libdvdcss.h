@@ -51,6 +51,14 @@ struct dvdcss_s
     char   psz_cachefile[PATH_MAX];
     char * psz_block;
 
+    /* Where the time goes, in milliseconds */
+    int    i_keys_cache;
+    int    i_keys_drive;
+    int    i_keys_cracked;
+    unsigned int i_time_disckey;
+    unsigned int i_time_index;
+    unsigned int i_time_titlekeys;
+
     /* Error management */
     char * psz_error;
     int    b_errors;
@@ -101,4 +109,5 @@ __forceinline void print_debug(dvdcss_t dvdcss, const char *msg,...)
 #endif
 
 void _print_error ( dvdcss_t, char * );
+unsigned int _dvdcss_clock ( void );
 
@@ -0,0 +1,360 @@
+// -*- c-basic-offset: 8; indent-tabs-mode: t -*-
+// vim:ts=8:sw=8:noet:ai:
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+
+#include "mp_msg.h"
+#include "cpudetect.h"
+#include "libavutil/common.h"
+
+#include "ass_blend.h"
+
+#define _r(c)  ((c)>>24)
+#define _g(c)  (((c)>>16)&0xFF)
+#define _b(c)  (((c)>>8)&0xFF)
+#define _a(c)  ((c)&0xFF)
+#define rgba2y(c)  ( (( 263*_r(c)  + 516*_g(c) + 100*_b(c)) >> 10) + 16  )
+#define rgba2u(c)  ( ((-152*_r(c) - 298*_g(c) + 450*_b(c)) >> 10) + 128 )
+#define rgba2v(c)  ( (( 450*_r(c) - 376*_g(c) -  73*_b(c)) >> 10) + 128 )
+
+// x / 255 for 0 <= x <= 255*255, exact
+#define DIV255(x) (((x) + 1 + (((x) + 1) >> 8)) >> 8)
+
+// a merged image may be at most this many times larger than its parts
+#define MERGE_MAX_WASTE 2
+
+#if defined(ARCH_X86) && (defined(HAVE_SSE2) || defined(RUNTIME_CPUDETECT))
+#define COMPILE_SSE2
+#endif
+
+static void blend_plane_C(unsigned char* dst, int dst_stride,
+			  const unsigned char* mask, int mask_stride,
+			  int w, int h, unsigned opacity, unsigned val)
+{
+	int i, j;
+	for (i = 0; i < h; ++i) {
+		for (j = 0; j < w; ++j) {
+			unsigned k = ((unsigned)mask[j]) * opacity / 255;
+			dst[j] = (k*val + (255-k)*dst[j]) / 255;
+		}
+		mask += mask_stride;
+		dst += dst_stride;
+	}
+}
+
+#ifdef COMPILE_SSE2
+#define DIV255_SSE2(x, t) \
+	"paddw %%xmm3, %%"x"            \n\t" \
+	"movdqa %%"x", %%"t"            \n\t" \
+	"psrlw $8, %%"t"                \n\t" \
+	"paddw %%"t", %%"x"             \n\t" \
+	"psrlw $8, %%"x"                \n\t"
+
+/**
+ * \brief same as blend_plane_C, 8 pixels at a time in 16 bit lanes
+ * Groups of 8 pixels with an empty mask are skipped.
+ */
+static void blend_plane_SSE2(unsigned char* dst, int dst_stride,
+			     const unsigned char* mask, int mask_stride,
+			     int w, int h, unsigned opacity, unsigned val)
+{
+	int i, j;
+	long w8 = w & ~7;
+	for (i = 0; i < h; ++i) {
+		long x = 0;
+		if (w8) asm volatile(
+			"pxor %%xmm7, %%xmm7            \n\t"
+			"pcmpeqw %%xmm3, %%xmm3         \n\t"
+			"psrlw $15, %%xmm3              \n\t" // 1
+			"movdqa %%xmm3, %%xmm4          \n\t"
+			"psllw $8, %%xmm4               \n\t"
+			"psubw %%xmm3, %%xmm4           \n\t" // 255
+			"movd %4, %%xmm6                \n\t"
+			"pshuflw $0, %%xmm6, %%xmm6     \n\t"
+			"punpcklqdq %%xmm6, %%xmm6      \n\t" // opacity
+			"movd %5, %%xmm5                \n\t"
+			"pshuflw $0, %%xmm5, %%xmm5     \n\t"
+			"punpcklqdq %%xmm5, %%xmm5      \n\t" // val
+			ASMALIGN(4)
+			"1:                             \n\t"
+			"movq (%1,%0), %%xmm0           \n\t" // mask
+			"movdqa %%xmm0, %%xmm1          \n\t"
+			"pcmpeqb %%xmm7, %%xmm1         \n\t"
+			"pmovmskb %%xmm1, %%eax         \n\t"
+			"cmpl $0xFFFF, %%eax            \n\t"
+			" je 2f                         \n\t"
+			"punpcklbw %%xmm7, %%xmm0       \n\t"
+			"pmullw %%xmm6, %%xmm0          \n\t"
+			DIV255_SSE2("xmm0", "xmm1")           // k
+			"movq (%2,%0), %%xmm2           \n\t" // dst
+			"punpcklbw %%xmm7, %%xmm2       \n\t"
+			"movdqa %%xmm4, %%xmm1          \n\t"
+			"psubw %%xmm0, %%xmm1           \n\t"
+			"pmullw %%xmm1, %%xmm2          \n\t" // (255-k)*dst
+			"pmullw %%xmm5, %%xmm0          \n\t" // k*val
+			"paddw %%xmm2, %%xmm0           \n\t"
+			DIV255_SSE2("xmm0", "xmm1")
+			"packuswb %%xmm0, %%xmm0        \n\t"
+			"movq %%xmm0, (%2,%0)           \n\t"
+			"2:                             \n\t"
+			"add $8, %0                     \n\t"
+			"cmp %3, %0                     \n\t"
+			" jb 1b                         \n\t"
+			: "+r" (x)
+			: "r" (mask), "r" (dst), "m" (w8), "m" (opacity), "m" (val)
+			: XMM_CLOBBERS("xmm0", "xmm1", "xmm2", "xmm3",
+			               "xmm4", "xmm5", "xmm6", "xmm7")
+			  "%eax", "memory");
+		for (j = w8; j < w; ++j) {
+			unsigned k = ((unsigned)mask[j]) * opacity / 255;
+			dst[j] = (k*val + (255-k)*dst[j]) / 255;
+		}
+		mask += mask_stride;
+		dst += dst_stride;
+	}
+}
+#endif
+
+void ass_blend_init(ass_blend_t* ctx, int flags)
+{
+	memset(ctx, 0, sizeof(ass_blend_t));
+	ctx->flags = flags;
+	ctx->blend_plane = blend_plane_C;
+#ifdef COMPILE_SSE2
+	if ((flags & ASS_BLEND_SIMD) && gCpuCaps.hasSSE2)
+		ctx->blend_plane = blend_plane_SSE2;
+#endif
+	mp_msg(MSGT_ASS, MSGL_V, "[ass] %s blending%s\n",
+	       ctx->blend_plane == blend_plane_C ? "C" : "SSE2",
+	       flags & ASS_BLEND_MERGE ? ", merging adjacent images" : "");
+}
+
+void ass_blend_uninit(ass_blend_t* ctx)
+{
+	free(ctx->merged);
+	free(ctx->bitmaps);
+	free(ctx->mask);
+	memset(ctx, 0, sizeof(ass_blend_t));
+}
+
+/**
+ * \brief find the run of images starting at img that can be merged
+ * \param bbox returns x1, y1, x2, y2 of the run
+ * \return first image after the run
+ */
+static const ass_image_t* merge_run(const ass_image_t* img, int bbox[4], int* count)
+{
+	const ass_image_t* p;
+	int area = img->w * img->h;
+
+	bbox[0] = img->dst_x;
+	bbox[1] = img->dst_y;
+	bbox[2] = img->dst_x + img->w;
+	bbox[3] = img->dst_y + img->h;
+	*count = 1;
+	for (p = img->next; p; p = p->next) {
+		int x1 = FFMIN(bbox[0], p->dst_x);
+		int y1 = FFMIN(bbox[1], p->dst_y);
+		int x2 = FFMAX(bbox[2], p->dst_x + p->w);
+		int y2 = FFMAX(bbox[3], p->dst_y + p->h);
+		int touching = p->dst_x <= bbox[2] && p->dst_x + p->w >= bbox[0] &&
+			       p->dst_y <= bbox[3] && p->dst_y + p->h >= bbox[1];
+		int overlapping = p->dst_x < bbox[2] && p->dst_x + p->w > bbox[0] &&
+				  p->dst_y < bbox[3] && p->dst_y + p->h > bbox[1];
+		if (p->color != img->color || !touching)
+			break;
+		// combining translucent masks is not the same as blending twice
+		if (_a(img->color) && overlapping)
+			break;
+		if ((x2 - x1) * (y2 - y1) > MERGE_MAX_WASTE * (area + p->w * p->h))
+			break;
+		bbox[0] = x1; bbox[1] = y1; bbox[2] = x2; bbox[3] = y2;
+		area += p->w * p->h;
+		++*count;
+	}
+	return p;
+}
+
+ass_image_t* ass_blend_merge(ass_blend_t* ctx, const ass_image_t* img)
+{
+	const ass_image_t *p, *end;
+	int bbox[4], count;
+	int n = 0, size = 0;
+	unsigned char* bitmap;
+	ass_image_t* out;
+
+	if (!img)
+		return NULL;
+
+	for (p = img; p; p = end) {
+		end = merge_run(p, bbox, &count);
+		if (count > 1)
+			size += ((bbox[2] - bbox[0] + 15) & ~15) * (bbox[3] - bbox[1]);
+		++n;
+	}
+	if (ctx->merged_alloc < n) {
+		ctx->merged_alloc = n;
+		ctx->merged = realloc(ctx->merged, n * sizeof(ass_image_t));
+	}
+	if (ctx->bitmaps_size < size) {
+		ctx->bitmaps_size = size;
+		ctx->bitmaps = realloc(ctx->bitmaps, size);
+	}
+
+	out = ctx->merged;
+	bitmap = ctx->bitmaps;
+	for (p = img; p; p = end, ++out) {
+		end = merge_run(p, bbox, &count);
+		*out = *p;
+		out->next = out + 1;
+		if (count > 1) {
+			const ass_image_t* q;
+			out->dst_x = bbox[0];
+			out->dst_y = bbox[1];
+			out->w = bbox[2] - bbox[0];
+			out->h = bbox[3] - bbox[1];
+			out->stride = (out->w + 15) & ~15;
+			out->bitmap = bitmap;
+			bitmap += out->stride * out->h;
+			memset(out->bitmap, 0, out->stride * out->h);
+			// bbox of the images copied so far, everything outside it is still empty
+			bbox[0] = bbox[1] = INT_MAX;
+			bbox[2] = bbox[3] = INT_MIN;
+			for (q = p; q != end; q = q->next) {
+				unsigned char* dst = out->bitmap + (q->dst_y - out->dst_y) * out->stride + q->dst_x - out->dst_x;
+				unsigned char* src = q->bitmap;
+				int i, j;
+				if (q->dst_x >= bbox[2] || q->dst_x + q->w <= bbox[0] ||
+				    q->dst_y >= bbox[3] || q->dst_y + q->h <= bbox[1]) {
+					for (i = 0; i < q->h; ++i)
+						memcpy(dst + i * out->stride, src + i * q->stride, q->w);
+				} else {
+					for (i = 0; i < q->h; ++i) {
+						for (j = 0; j < q->w; ++j) {
+							unsigned a = dst[j], b = src[j];
+							dst[j] = a + b - DIV255(a * b);
+						}
+						dst += out->stride;
+						src += q->stride;
+					}
+				}
+				bbox[0] = FFMIN(bbox[0], q->dst_x);
+				bbox[1] = FFMIN(bbox[1], q->dst_y);
+				bbox[2] = FFMAX(bbox[2], q->dst_x + q->w);
+				bbox[3] = FFMAX(bbox[3], q->dst_y + q->h);
+			}
+		}
+	}
+	out[-1].next = NULL;
+	return ctx->merged;
+}
+
+/**
+ * \brief average the 2x2 mask samples covering each chroma pixel of img
+ */
+static void subsample_mask(ass_blend_t* ctx, const ass_image_t* img, int cw, int ch)
+{
+	int ox = img->dst_x & 1;
+	int oy = img->dst_y & 1;
+	int i, j;
+
+	if (ctx->mask_size < cw * ch) {
+		ctx->mask_size = cw * ch;
+		free(ctx->mask);
+		ctx->mask = malloc(ctx->mask_size);
+	}
+	for (i = 0; i < ch; ++i) {
+		int y0 = 2 * i - oy;
+		const unsigned char* r0 = y0 >= 0 ? img->bitmap + y0 * img->stride : NULL;
+		const unsigned char* r1 = y0 + 1 < img->h ? img->bitmap + (y0 + 1) * img->stride : NULL;
+		unsigned char* dst = ctx->mask + i * cw;
+		for (j = 0; j < cw; ++j) {
+			int x0 = 2 * j - ox;
+			unsigned sum = 0;
+			if (r0) {
+				if (x0 >= 0) sum += r0[x0];
+				if (x0 + 1 < img->w) sum += r0[x0 + 1];
+			}
+			if (r1) {
+				if (x0 >= 0) sum += r1[x0];
+				if (x0 + 1 < img->w) sum += r1[x0 + 1];
+			}
+			dst[j] = (sum + 2) >> 2;
+		}
+	}
+}
+
+static void blend_image(ass_blend_t* ctx, unsigned char* planes[3], int stride[3], const ass_image_t* img)
+{
+	unsigned char y = rgba2y(img->color);
+	unsigned char u = rgba2u(img->color);
+	unsigned char v = rgba2v(img->color);
+	unsigned opacity = 255 - _a(img->color);
+	int cx = img->dst_x >> 1;
+	int cy = img->dst_y >> 1;
+	int cw = ((img->dst_x + img->w + 1) >> 1) - cx;
+	int ch = ((img->dst_y + img->h + 1) >> 1) - cy;
+
+	if (img->w <= 0 || img->h <= 0)
+		return;
+	ctx->blend_plane(planes[0] + img->dst_y * stride[0] + img->dst_x, stride[0],
+			 img->bitmap, img->stride, img->w, img->h, opacity, y);
+	subsample_mask(ctx, img, cw, ch);
+	ctx->blend_plane(planes[1] + cy * stride[1] + cx, stride[1],
+			 ctx->mask, cw, cw, ch, opacity, u);
+	ctx->blend_plane(planes[2] + cy * stride[2] + cx, stride[2],
+			 ctx->mask, cw, cw, ch, opacity, v);
+}
+
+void ass_blend_frame(ass_blend_t* ctx, unsigned char* planes[3], int stride[3],
+		     const ass_image_t* img)
+{
+	if (ctx->flags & ASS_BLEND_MERGE)
+		img = ass_blend_merge(ctx, img);
+	for (; img; img = img->next)
+		blend_image(ctx, planes, stride, img);
+}
+
+void ass_dump_header(FILE* f, int w, int h)
+{
+	int32_t dim[2] = {w, h};
+	fwrite(ASS_DUMP_MAGIC, 1, 8, f);
+	fwrite(dim, sizeof(int32_t), 2, f);
+}
+
+void ass_dump_frame(FILE* f, const ass_image_t* img)
+{
+	const ass_image_t* p;
+	int32_t n = 0;
+	for (p = img; p; p = p->next)
+		++n;
+	fwrite(&n, sizeof(int32_t), 1, f);
+	for (p = img; p; p = p->next) {
+		int32_t hdr[5] = {p->w, p->h, p->dst_x, p->dst_y, p->color};
+		int i;
+		fwrite(hdr, sizeof(int32_t), 5, f);
+		for (i = 0; i < p->h; ++i)
+			fwrite(p->bitmap + i * p->stride, 1, p->w, f);
+	}
+}
@@ -0,0 +1,74 @@
+// -*- c-basic-offset: 8; indent-tabs-mode: t -*-
+// vim:ts=8:sw=8:noet:ai:
+/*
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef __ASS_BLEND_H__
+#define __ASS_BLEND_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "libass/ass.h"
+
+#define ASS_BLEND_SIMD  1 ///< use SSE2 kernels when the cpu has them
+#define ASS_BLEND_MERGE 2 ///< merge adjacent images of the same color first
+
+/// state for blending ass_image_t lists onto YV12/I420 frames
+typedef struct ass_blend_s {
+	int flags;
+
+	ass_image_t* merged; // storage for the merged image list
+	int merged_alloc;
+	unsigned char* bitmaps; // bitmaps of merged images
+	int bitmaps_size;
+	unsigned char* mask; // chroma-subsampled mask of one image
+	int mask_size;
+
+	void (*blend_plane)(unsigned char* dst, int dst_stride,
+			    const unsigned char* mask, int mask_stride,
+			    int w, int h, unsigned opacity, unsigned val);
+} ass_blend_t;
+
+void ass_blend_init(ass_blend_t* ctx, int flags);
+void ass_blend_uninit(ass_blend_t* ctx);
+
+/**
+ * \brief merge runs of adjacent images with the same color
+ * \return a list owned by ctx that is valid until the next call
+ */
+ass_image_t* ass_blend_merge(ass_blend_t* ctx, const ass_image_t* img);
+
+/**
+ * \brief blend an image list onto a YV12/I420 frame
+ * Luma uses the bitmaps as they are, chroma a 2x2 averaged mask.
+ */
+void ass_blend_frame(ass_blend_t* ctx, unsigned char* planes[3], int stride[3],
+		     const ass_image_t* img);
+
+/*
+ * Image list recordings (vf ass=dump=<file>, read by TOOLS/ass_blend_bench):
+ *   header: ASS_DUMP_MAGIC, int32 frame width, int32 frame height
+ *   frame:  int32 image count, then per image
+ *           int32 w, h, dst_x, dst_y, uint32 color, w*h bitmap bytes
+ * All integers are stored in host byte order.
+ */
+#define ASS_DUMP_MAGIC "MPASSIM1"
+
+void ass_dump_header(FILE* f, int w, int h);
+void ass_dump_frame(FILE* f, const ass_image_t* img);
+
+#endif
@@ -139,6 +139,13 @@ void resync_video_stream(sh_video_t *sh_video)
     if(mpvdec) mpvdec->control(sh_video, VDCTRL_RESYNC_STREAM, NULL);
 }
 
+int set_video_skip_nonref(sh_video_t *sh_video, int on)
+{
+    if (!mpvdec)
+	return 0;
+    return mpvdec->control(sh_video, VDCTRL_SET_SKIP_NONREF, &on) == CONTROL_TRUE;
+}
+
 int get_current_video_decoder_lag(sh_video_t *sh_video)
 {
     int ret;
@@ -165,6 +165,15 @@ static int control(sh_video_t *sh,int cmd,void* arg,...){
 	return CONTROL_TRUE;
     case VDCTRL_QUERY_UNSEEN_FRAMES:
 	return avctx->has_b_frames + 10;
+    case VDCTRL_SET_SKIP_NONREF:
+        if (*(int *)arg) {
+            avctx->skip_frame = AVDISCARD_NONREF;
+            avctx->skip_loop_filter = AVDISCARD_ALL;
+        } else {
+            avctx->skip_frame = str2AVDiscard(lavc_param_skip_frame_str);
+            avctx->skip_loop_filter = str2AVDiscard(lavc_param_skip_loop_filter_str);
+        }
+        return CONTROL_TRUE;
     }
     return CONTROL_UNKNOWN;
 }
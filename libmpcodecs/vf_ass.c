@@ -24,7 +24,6 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
-#include <assert.h>
 
 #include "config.h"
 #include "mp_msg.h"
@@ -41,15 +40,7 @@
 
 #include "libass/ass.h"
 #include "libass/ass_mp.h"
-
-#define _r(c)  ((c)>>24)
-#define _g(c)  (((c)>>16)&0xFF)
-#define _b(c)  (((c)>>8)&0xFF)
-#define _a(c)  ((c)&0xFF)
-#define rgba2y(c)  ( (( 263*_r(c)  + 516*_g(c) + 100*_b(c)) >> 10) + 16  )
-#define rgba2u(c)  ( ((-152*_r(c) - 298*_g(c) + 450*_b(c)) >> 10) + 128 )
-#define rgba2v(c)  ( (( 450*_r(c) - 376*_g(c) -  73*_b(c)) >> 10) + 128 )
-
+#include "ass_blend.h"
 
 static struct vf_priv_s {
 	int outh, outw;
@@ -60,10 +51,16 @@ static struct vf_priv_s {
 	// 0 = insert always
 	int auto_insert;
 
+	// merge adjacent images of the same color before blending
+	int merge;
+
+	// record the rendered image lists for TOOLS/ass_blend_bench
+	char* dump_file;
+	FILE* dump;
+
 	ass_renderer_t* ass_priv;
 
-	unsigned char* planes[3];
-	unsigned char* dirty_rows;
+	ass_blend_t blend;
 } const vf_priv_dflt;
 
 extern int opt_screen_size_x;
@@ -87,10 +84,14 @@ static int config(struct vf_instance_s* vf,
 		d_height = d_height * vf->priv->outh / height;
 	} 
 
-	vf->priv->planes[1] = malloc(vf->priv->outw * vf->priv->outh);
-	vf->priv->planes[2] = malloc(vf->priv->outw * vf->priv->outh);
-	vf->priv->dirty_rows = malloc(vf->priv->outh);
-	
+	if (vf->priv->dump_file && !vf->priv->dump) {
+		vf->priv->dump = fopen(vf->priv->dump_file, "wb");
+		if (vf->priv->dump)
+			ass_dump_header(vf->priv->dump, vf->priv->outw, vf->priv->outh);
+		else
+			mp_msg(MSGT_ASS, MSGL_WARN, "[ass] Cannot open %s for writing.\n", vf->priv->dump_file);
+	}
+
 	if (vf->priv->ass_priv) {
 		ass_configure(vf->priv->ass_priv, vf->priv->outw, vf->priv->outh);
 		ass_set_aspect_ratio(vf->priv->ass_priv, ((double)d_width) / d_height);
@@ -203,122 +204,10 @@ static int prepare_image(struct vf_instance_s* vf, mp_image_t *mpi)
 	return 0;
 }
 
-/**
- * \brief Copy specified rows from render_context.dmpi to render_context.planes, upsampling to 4:4:4
- */
-static void copy_from_image(struct vf_instance_s* vf, int first_row, int last_row)
-{
-	int pl;
-	int i, j, k;
-	unsigned char val;
-	int chroma_rows;
-
-	first_row -= (first_row % 2);
-	last_row += (last_row % 2);
-	chroma_rows = (last_row - first_row) / 2;
-
-	for (pl = 1; pl < 3; ++pl) {
-		int dst_stride = vf->priv->outw;
-		int src_stride = vf->dmpi->stride[pl];
-		
-		unsigned char* src = vf->dmpi->planes[pl] + (first_row/2) * src_stride;
-		unsigned char* dst = vf->priv->planes[pl] + first_row * dst_stride;
-		unsigned char* dst_next = dst + dst_stride;
-		for(i = 0; i < chroma_rows; ++i)
-		{
-			if ((vf->priv->dirty_rows[first_row + i*2] == 0) ||
-				(vf->priv->dirty_rows[first_row + i*2 + 1] == 0)) {
-				for (j = 0, k = 0; j < vf->dmpi->chroma_width; ++j, k+=2) {
-					val = *(src + j);
-					*(dst + k) = val;
-					*(dst + k + 1) = val;
-					*(dst_next + k) = val;
-					*(dst_next + k + 1) = val;
-				}
-			}
-			src += src_stride;
-			dst = dst_next + dst_stride;
-			dst_next = dst + dst_stride;
-		}
-	}
-	for (i = first_row; i < last_row; ++i)
-		vf->priv->dirty_rows[i] = 1;
-}
-
-/**
- * \brief Copy all previously copied rows back to render_context.dmpi
- */
-static void copy_to_image(struct vf_instance_s* vf)
-{
-	int pl;
-	int i, j, k;
-	for (pl = 1; pl < 3; ++pl) {
-		int dst_stride = vf->dmpi->stride[pl];
-		int src_stride = vf->priv->outw;
-		
-		unsigned char* dst = vf->dmpi->planes[pl];
-		unsigned char* src = vf->priv->planes[pl];
-		unsigned char* src_next = vf->priv->planes[pl] + src_stride;
-		for(i = 0; i < vf->dmpi->chroma_height; ++i)
-		{
-			if ((vf->priv->dirty_rows[i*2] == 1)) {
-				assert(vf->priv->dirty_rows[i*2 + 1] == 1);
-				for (j = 0, k = 0; j < vf->dmpi->chroma_width; ++j, k+=2) {
-					unsigned val = 0;
-					val += *(src + k);
-					val += *(src + k + 1);
-					val += *(src_next + k);
-					val += *(src_next + k + 1);
-					*(dst + j) = val >> 2;
-				}
-			}
-			dst += dst_stride;
-			src = src_next + src_stride;
-			src_next = src + src_stride;
-		}
-	}
-}
-
-static void my_draw_bitmap(struct vf_instance_s* vf, unsigned char* bitmap, int bitmap_w, int bitmap_h, int stride, int dst_x, int dst_y, unsigned color)
-{
-	unsigned char y = rgba2y(color);
-	unsigned char u = rgba2u(color);
-	unsigned char v = rgba2v(color);
-	unsigned char opacity = 255 - _a(color);
-	unsigned char *src, *dsty, *dstu, *dstv;
-	int i, j;
-	mp_image_t* dmpi = vf->dmpi;
-
-	src = bitmap;
-	dsty = dmpi->planes[0] + dst_x + dst_y * dmpi->stride[0];
-	dstu = vf->priv->planes[1] + dst_x + dst_y * vf->priv->outw;
-	dstv = vf->priv->planes[2] + dst_x + dst_y * vf->priv->outw;
-	for (i = 0; i < bitmap_h; ++i) {
-		for (j = 0; j < bitmap_w; ++j) {
-			unsigned k = ((unsigned)src[j]) * opacity / 255;
-			dsty[j] = (k*y + (255-k)*dsty[j]) / 255;
-			dstu[j] = (k*u + (255-k)*dstu[j]) / 255;
-			dstv[j] = (k*v + (255-k)*dstv[j]) / 255;
-		}
-		src += stride;
-		dsty += dmpi->stride[0];
-		dstu += vf->priv->outw;
-		dstv += vf->priv->outw;
-	} 
-}
-
 static int render_frame(struct vf_instance_s* vf, mp_image_t *mpi, const ass_image_t* img)
 {
-	if (img) {
-		memset(vf->priv->dirty_rows, 0, vf->priv->outh); // reset dirty rows
-		while (img) {
-			copy_from_image(vf, img->dst_y, img->dst_y + img->h);
-			my_draw_bitmap(vf, img->bitmap, img->w, img->h, img->stride,
-					img->dst_x, img->dst_y, img->color);
-			img = img->next;
-		}
-		copy_to_image(vf);
-	}
+	if (img)
+		ass_blend_frame(&vf->priv->blend, vf->dmpi->planes, vf->dmpi->stride, img);
 	return 0;
 }
 
@@ -327,6 +216,8 @@ static int put_image(struct vf_instance_s* vf, mp_image_t *mpi, double pts)
 	ass_image_t* images = 0;
 	if (sub_visibility && vf->priv->ass_priv && ass_track && (pts != MP_NOPTS_VALUE))
 		images = ass_render_frame(vf->priv->ass_priv, ass_track, (pts+sub_delay) * 1000 + .5, NULL);
+	if (vf->priv->dump)
+		ass_dump_frame(vf->priv->dump, images);
 	
 	prepare_image(vf, mpi);
 	if (images) render_frame(vf, mpi, images);
@@ -364,12 +255,9 @@ static void uninit(struct vf_instance_s* vf)
 {
 	if (vf->priv->ass_priv)
 		ass_renderer_done(vf->priv->ass_priv);
-	if (vf->priv->planes[1])
-		free(vf->priv->planes[1]);
-	if (vf->priv->planes[2])
-		free(vf->priv->planes[2]);
-	if (vf->priv->dirty_rows)
-		free(vf->priv->dirty_rows);
+	if (vf->priv->dump)
+		fclose(vf->priv->dump);
+	ass_blend_uninit(&vf->priv->blend);
 }
 
 static unsigned int fmt_list[]={
@@ -393,6 +281,9 @@ static int open(vf_instance_t *vf, char* args)
 	
 	if (vf->priv->auto_insert)
 		mp_msg(MSGT_ASS, MSGL_INFO, "[ass] auto-open\n");
+
+	ass_blend_init(&vf->priv->blend, ASS_BLEND_SIMD |
+		       (vf->priv->merge ? ASS_BLEND_MERGE : 0));
 	
 	vf->config = config;
 	vf->query_format = query_format;
@@ -407,6 +298,8 @@ static int open(vf_instance_t *vf, char* args)
 #define ST_OFF(f) M_ST_OFF(struct vf_priv_s,f)
 static m_option_t vf_opts_fields[] = {
 	{"auto", ST_OFF(auto_insert), CONF_TYPE_FLAG, 0 , 0, 1, NULL},
+	{"merge", ST_OFF(merge), CONF_TYPE_FLAG, 0 , 0, 1, NULL},
+	{"dump", ST_OFF(dump_file), CONF_TYPE_STRING, 0, 0, 0, NULL},
 	{ NULL, NULL, 0, 0, 0, 0,  NULL }
 };
 
@@ -3,8 +3,14 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include "config.h"
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 #include "mp_msg.h"
 #include "help_mp.h"
 
@@ -14,6 +20,7 @@
 
 #include "aviheader.h"
 #include "libavutil/common.h"
+#include "osdep/timer.h"
 
 static MainAVIHeader avih;
 
@@ -42,12 +49,265 @@ static int odml_get_vstream_id(int id, unsigned char res[])
     return 0;
 }
 
+/// upper bound of the entries in the standard indices of cx, from their sizes
+static int odml_stdidx_estimate(avisuperindex_chunk *cx)
+{
+    int j, n = 0;
+    // writers differ on whether dwSize counts the 8 byte chunk header
+    for (j = 0; j < cx->nEntriesInUse; j++)
+	if (cx->aIndex[j].dwSize > 24)
+	    n += (cx->aIndex[j].dwSize - 24) / sizeof(avistdindex_entry);
+    return n > 0 ? n : 1;
+}
+
+/// read the standard index j of cx, 0 if it is broken
+static int odml_read_stdidx(stream_t *s, avisuperindex_chunk *cx, int j)
+{
+    avistdindex_chunk *sic = &cx->stdidx[j];
+    int k;
+
+    memset(sic, 0, 32);
+    if (stream_seek(s, (off_t)cx->aIndex[j].qwOffset) != 1 ||
+	stream_read(s, (char *)sic, 32) != 32)
+	return 0;
+    le2me_AVISTDIDXCHUNK(sic);
+    if (sic->nEntriesInUse == 0)
+	return 0;
+    print_avistdindex_chunk(sic,MSGL_V);
+    sic->aIndex = malloc(sic->nEntriesInUse*sizeof(avistdindex_entry));
+    if (!sic->aIndex)
+	return 0;
+    stream_read(s, (char *)sic->aIndex, sic->nEntriesInUse*sizeof(avistdindex_entry));
+    for (k=0;k<sic->nEntriesInUse; k++)
+	le2me_AVISTDIDXENTRY(&sic->aIndex[k]);
+    sic->dwReserved3 = 0;
+    return 1;
+}
+
 int avi_idx_cmp(const void *elem1,const void *elem2) {
   register off_t a = AVI_IDX_OFFSET((AVIINDEXENTRY *)elem1);
   register off_t b = AVI_IDX_OFFSET((AVIINDEXENTRY *)elem2);
   return (a > b) - (b > a);
 }
 
+/// state of an OpenDML index that is merged as far as it is needed
+typedef struct {
+    struct { int chunk, entry; } *pos; // next entry of each super index
+    int cap, chunks, sorted;
+    uint64_t last_off;
+    uint32_t db, db_fix;               // ##db fcc and the fcc the file uses
+    unsigned int time;                 // ms spent merging
+} odml_merge_t;
+
+/**
+ * Merge the OpenDML index until it has more than n entries.
+ * \return -1 if a standard index is broken, 0 when the index is complete,
+ *         1 if there is more to merge
+ */
+static int odml_merge(demuxer_t *demuxer, int n)
+{
+    avi_priv_t *priv = demuxer->priv;
+    odml_merge_t *m = priv->odml;
+    avisuperindex_chunk *cx;
+    int i;
+
+    while (priv->idx_size <= n) {
+	avistdindex_chunk *sic;
+	avistdindex_entry *sie;
+	AVIINDEXENTRY *idx;
+	uint64_t off = 0;
+	int best = -1;
+
+	for (cx = &priv->suidx[0], i=0; i<priv->suidx_size; cx++, i++) {
+	    uint64_t o;
+	    if (m->pos[i].chunk >= cx->nEntriesInUse)
+		continue;
+	    sic = &cx->stdidx[m->pos[i].chunk];
+	    o = sic->qwBaseOffset + sic->aIndex[m->pos[i].entry].dwOffset - 8;
+	    if (best < 0 || o < off) {
+		best = i;
+		off = o;
+	    }
+	}
+	if (best < 0)
+	    return 0;
+
+	if (priv->idx_size == m->cap) {
+	    idx = realloc(priv->idx, 2 * m->cap * sizeof(AVIINDEXENTRY));
+	    if (!idx)
+		return -1;
+	    priv->idx = idx;
+	    m->cap *= 2;
+	}
+	cx = &priv->suidx[best];
+	sic = &cx->stdidx[m->pos[best].chunk];
+	sie = &sic->aIndex[m->pos[best].entry];
+	idx = &((AVIINDEXENTRY *)priv->idx)[priv->idx_size++];
+	memcpy(&idx->ckid, sic->dwChunkId, 4);
+	idx->dwChunkOffset = off;
+	idx->dwFlags = (off >> 32) << 16;
+	idx->dwChunkLength = sie->dwSize & 0x7fffffff;
+	idx->dwFlags |= (sie->dwSize&0x80000000)?0x0:AVIIF_KEYFRAME; // bit 31 denotes !keyframe
+	if (m->db_fix && idx->ckid == m->db && !(idx->dwFlags & AVIIF_KEYFRAME))
+	    idx->ckid = m->db_fix;
+	if (off < m->last_off)
+	    m->sorted = 0;
+	m->last_off = off;
+
+	if (++m->pos[best].entry == sic->nEntriesInUse) {
+	    free(sic->aIndex);
+	    sic->aIndex = NULL;
+	    sic->nEntriesInUse = 0;
+	    m->pos[best].entry = 0;
+	    m->chunks++;
+	    if (++m->pos[best].chunk < cx->nEntriesInUse &&
+		!odml_read_stdidx(demuxer->stream, cx, m->pos[best].chunk))
+		return -1;
+	}
+    }
+    return 1;
+}
+
+void avi_idx_free_odml(avi_priv_t *priv)
+{
+    avisuperindex_chunk *cx;
+    int i, j;
+
+    for (cx = &priv->suidx[0], i=0; i<priv->suidx_size; cx++, i++) {
+	for (j=0;j<cx->nEntriesInUse;j++)
+	    if (cx->stdidx[j].nEntriesInUse) free(cx->stdidx[j].aIndex);
+	free(cx->aIndex);
+	free(cx->stdidx);
+    }
+    free(priv->suidx);
+    priv->suidx = NULL;
+    priv->suidx_size = 0;
+    if (priv->odml)
+	free(((odml_merge_t *)priv->odml)->pos);
+    free(priv->odml);
+    priv->odml = NULL;
+}
+
+/// the OpenDML index is complete, drop what was needed to merge it
+static void odml_finish(avi_priv_t *priv)
+{
+    odml_merge_t *m = priv->odml;
+
+    mp_msg(MSGT_HEADER, MSGL_V, "AVI: OpenDML index of %d chunks from %d standard indices built in %u ms%s\n",
+	   priv->idx_size, m->chunks, m->time, m->sorted ? "" : " (sorted)");
+    if (priv->idx_size < m->cap)
+	priv->idx = realloc(priv->idx, FFMAX(priv->idx_size, 1) * sizeof(AVIINDEXENTRY));
+    avi_idx_free_odml(priv);
+}
+
+/**
+ * Make sure index entry n exists, merging more of an OpenDML index.
+ * \return 1 if the entry exists
+ */
+int avi_idx_extend(demuxer_t *demuxer, int n)
+{
+    avi_priv_t *priv = demuxer->priv;
+    odml_merge_t *m = priv->odml;
+    unsigned int start;
+    int ret, sorted, i;
+
+    if (n < priv->idx_size || !m)
+	return n < priv->idx_size;
+    start = GetTimerMS();
+    sorted = m->sorted;
+    // merge ahead, reading a standard index seeks away from the chunks
+    ret = odml_merge(demuxer, n < INT_MAX - 1024 ? n + 1024 : n);
+    if (sorted && !m->sorted) {
+	// a later standard index is out of order, sort all that is not read yet
+	off_t first = priv->idx_pos;
+	AVIINDEXENTRY *idx;
+	if (demuxer->type == DEMUXER_TYPE_AVI_NI)
+	    first = FFMIN(first, FFMIN(priv->idx_pos_a, priv->idx_pos_v));
+	if (ret > 0)
+	    ret = odml_merge(demuxer, INT_MAX);
+	idx = priv->idx;
+	if (first < priv->idx_size)
+	    qsort(idx + first, priv->idx_size - first, sizeof(AVIINDEXENTRY), avi_idx_cmp);
+	// the keyframes of the sorted entries are registered again
+	for (i = first; i < priv->kf_pos; i++)
+	    if (avi_stream_id(idx[i].ckid) == demuxer->video->id)
+		priv->kf_frames--;
+	priv->kf_pos = FFMIN(priv->kf_pos, first);
+    }
+    m->time += GetTimerMS() - start;
+    if (ret < 0)
+	mp_msg(MSGT_HEADER, MSGL_WARN, "AVI: ODML: Broken standard index, the index ends after %d chunks.\n",
+	       priv->idx_size);
+    if (ret <= 0)
+	odml_finish(priv);
+    return n < priv->idx_size;
+}
+
+/*
+ * Index files start with "MPIDX2", the file size of the AVI the index
+ * belongs to and the number of entries, the AVIINDEXENTRYs follow in
+ * native byte order.  They are mapped into memory instead of being read,
+ * so a large index costs neither the time to read it nor memory of its own.
+ * The older "MPIDX1" files have only the count and are still read.
+ */
+typedef struct {
+    char magic[8];
+    int64_t file_size;
+    uint32_t count;
+    uint32_t reserved;
+} mpidx2_header_t;
+
+static int load_idx2(demuxer_t *demuxer, FILE *fp, const char *name)
+{
+    avi_priv_t *priv = demuxer->priv;
+    mpidx2_header_t hdr;
+    struct stat st;
+    size_t len;
+
+    rewind(fp);
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || fstat(fileno(fp), &st)) {
+	mp_msg(MSGT_HEADER,MSGL_ERR, MSGTR_MPDEMUX_AVIHDR_PrematureEOF, name);
+	return 0;
+    }
+    if (hdr.file_size != demuxer->stream->end_pos) {
+	mp_msg(MSGT_HEADER,MSGL_ERR, "Index file %s belongs to a file of another size.\n", name);
+	return 0;
+    }
+    len = sizeof(hdr) + (size_t)hdr.count * sizeof(AVIINDEXENTRY);
+    if (hdr.count > INT_MAX / sizeof(AVIINDEXENTRY) || st.st_size < len) {
+	mp_msg(MSGT_HEADER,MSGL_ERR, MSGTR_MPDEMUX_AVIHDR_PrematureEOF, name);
+	return 0;
+    }
+    if (!hdr.count)
+	return 0;
+
+#ifdef HAVE_SYS_MMAN_H
+    // private and writable, so it behaves like a malloc()ed index
+    priv->idx_mmap = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_PRIVATE, fileno(fp), 0);
+    if (priv->idx_mmap != MAP_FAILED) {
+	priv->idx_mmap_len = len;
+	priv->idx = (char *)priv->idx_mmap + sizeof(hdr);
+	priv->idx_size = hdr.count;
+	return 1;
+    }
+    priv->idx_mmap = NULL;
+#endif
+
+    priv->idx = malloc(hdr.count * sizeof(AVIINDEXENTRY));
+    if (!priv->idx) {
+	mp_msg(MSGT_HEADER,MSGL_ERR, MSGTR_MPDEMUX_AVIHDR_FailedMallocForIdxFile, name);
+	return 0;
+    }
+    if (fread(priv->idx, sizeof(AVIINDEXENTRY), hdr.count, fp) != hdr.count) {
+	mp_msg(MSGT_HEADER,MSGL_ERR, MSGTR_MPDEMUX_AVIHDR_PrematureEOF, name);
+	free(priv->idx);
+	priv->idx = NULL;
+	return 0;
+    }
+    priv->idx_size = hdr.count;
+    return 1;
+}
+
 void read_avi_header(demuxer_t *demuxer,int index_mode){
 sh_audio_t *sh_audio=NULL;
 sh_video_t *sh_video=NULL;
@@ -446,10 +706,11 @@ if (priv->suidx_size > 0 && priv->idx_size == 0) {
 }
 
 if (priv->isodml && (index_mode==-1 || index_mode==0 || index_mode==1)) {
-    int i, j, k;
-
+    int i, ret;
+    odml_merge_t *m;
     avisuperindex_chunk *cx;
     AVIINDEXENTRY *idx;
+    unsigned int start;
 
 
     if (priv->idx_size) free(priv->idx);
@@ -459,61 +720,47 @@ if (priv->isodml && (index_mode==-1 || index_mode==0 || index_mode==1)) {
 
     mp_msg(MSGT_HEADER, MSGL_INFO, MSGTR_MPDEMUX_AVIHDR_BuildingODMLidx, priv->suidx_size);
 
-    // read the standard indices
-    for (cx = &priv->suidx[0], i=0; i<priv->suidx_size; cx++, i++) {
-	stream_reset(demuxer->stream);
-	for (j=0; j<cx->nEntriesInUse; j++) {
-	    int ret1, ret2;
-	    memset(&cx->stdidx[j], 0, 32);
-	    ret1 = stream_seek(demuxer->stream, (off_t)cx->aIndex[j].qwOffset);
-	    ret2 = stream_read(demuxer->stream, (char *)&cx->stdidx[j], 32);
-	    if (ret1 != 1 || ret2 != 32 || cx->stdidx[j].nEntriesInUse==0) {
-		// this is a broken file (probably incomplete) let the standard
-		// gen_index routine handle this
-		priv->isodml = 0;
-		priv->idx_size = 0;
-		mp_msg(MSGT_HEADER, MSGL_WARN, MSGTR_MPDEMUX_AVIHDR_BrokenODMLfile);
-		goto freeout;
-	    }
-
-	    le2me_AVISTDIDXCHUNK(&cx->stdidx[j]);
-	    print_avistdindex_chunk(&cx->stdidx[j],MSGL_V);
-	    priv->idx_size += cx->stdidx[j].nEntriesInUse;
-	    cx->stdidx[j].aIndex = malloc(cx->stdidx[j].nEntriesInUse*sizeof(avistdindex_entry));
-	    stream_read(demuxer->stream, (char *)cx->stdidx[j].aIndex, 
-		    cx->stdidx[j].nEntriesInUse*sizeof(avistdindex_entry));
-	    for (k=0;k<cx->stdidx[j].nEntriesInUse; k++)
-		le2me_AVISTDIDXENTRY(&cx->stdidx[j].aIndex[k]);
-
-	    cx->stdidx[j].dwReserved3 = 0;
-
-	}
-    }
-
     /*
      * We convert the index by translating all entries into AVIINDEXENTRYs
-     * and sorting them by offset.  The result should be the same index
-     * we would get with -forceidx.
+     * sorted by offset.  The result should be the same index we would get
+     * with -forceidx.  The entries of each stream are in file order
+     * already, so the streams are merged and only the standard index in
+     * use of each stream is kept in memory.  Only the first standard
+     * index of each stream is merged here, avi_idx_extend() reads the
+     * others when playback or seeking gets there.
      */
-
-    idx = priv->idx = malloc(priv->idx_size * sizeof (AVIINDEXENTRY));
-
-    for (cx = priv->suidx; cx != &priv->suidx[priv->suidx_size]; cx++) {
-	avistdindex_chunk *sic;
-	for (sic = cx->stdidx; sic != &cx->stdidx[cx->nEntriesInUse]; sic++) {
-	    avistdindex_entry *sie;
-	    for (sie = sic->aIndex; sie != &sic->aIndex[sic->nEntriesInUse]; sie++) {
-		uint64_t off = sic->qwBaseOffset + sie->dwOffset - 8;
-		memcpy(&idx->ckid, sic->dwChunkId, 4);
-		idx->dwChunkOffset = off;
-		idx->dwFlags = (off >> 32) << 16;
-		idx->dwChunkLength = sie->dwSize & 0x7fffffff;
-		idx->dwFlags |= (sie->dwSize&0x80000000)?0x0:AVIIF_KEYFRAME; // bit 31 denotes !keyframe
-		idx++;
-	    }
-	}
+    start = GetTimerMS();
+    m = priv->odml = calloc(1, sizeof(odml_merge_t));
+    if (!m)
+	goto broken;
+    m->sorted = 1;
+    m->pos = calloc(priv->suidx_size, sizeof(*m->pos));
+    if (!m->pos)
+	goto broken;
+    stream_reset(demuxer->stream);
+    for (cx = &priv->suidx[0], i=0; i<priv->suidx_size; cx++, i++) {
+	m->cap += odml_stdidx_estimate(cx);
+	if (cx->nEntriesInUse && !odml_read_stdidx(demuxer->stream, cx, 0))
+	    goto broken;
     }
-    qsort(priv->idx, priv->idx_size, sizeof(AVIINDEXENTRY), avi_idx_cmp);
+    priv->idx = malloc(m->cap * sizeof(AVIINDEXENTRY));
+    if (!priv->idx)
+	goto broken;
+
+    // a loaded index file replaces this one, do not keep any state for it
+    ret = odml_merge(demuxer, index_file_load ? INT_MAX : 0);
+    for (i=0; ret>0 && i<priv->suidx_size; i++)
+	while (ret>0 && !m->pos[i].chunk && priv->suidx[i].nEntriesInUse)
+	    ret = odml_merge(demuxer, priv->idx_size);
+    // some muxers do not write the chunks of a stream in index order,
+    // such an index is sorted as a whole before it is used
+    if (ret>0 && !m->sorted)
+	ret = odml_merge(demuxer, INT_MAX);
+    if (ret < 0)
+	goto broken;
+    if (!m->sorted)
+	qsort(priv->idx, priv->idx_size, sizeof(AVIINDEXENTRY), avi_idx_cmp);
+    m->time = GetTimerMS() - start;
 
     /*
        Hack to work around a "wrong" index in some divx odml files
@@ -543,10 +790,14 @@ if (priv->isodml && (index_mode==-1 || index_mode==0 || index_mode==1)) {
 	if (i<priv->idx_size && db) {
 	    stream_seek(demuxer->stream, AVI_IDX_OFFSET(idx));
 	    id = stream_read_dword_le(demuxer->stream);
-	    if (id && id != db) // index fcc and real fcc differ? fix it.
+	    if (id && id != db) { // index fcc and real fcc differ? fix it.
 		for (idx = &((AVIINDEXENTRY *)priv->idx)[0], i=0; i<priv->idx_size; i++, idx++){
 		    if (!(idx->dwFlags & AVIIF_KEYFRAME) && idx->ckid == db)
 			idx->ckid = id;
+		}
+		// and in the entries merged later
+		m->db = db;
+		m->db_fix = id;
 	    }
 	}
     }
@@ -554,19 +805,23 @@ if (priv->isodml && (index_mode==-1 || index_mode==0 || index_mode==1)) {
     if ( mp_msg_test(MSGT_HEADER,MSGL_DBG2) ) print_index(priv->idx, priv->idx_size,MSGL_DBG2);
 
     demuxer->movi_end=demuxer->stream->end_pos;
-
-freeout:
-
-    // free unneeded stuff
-    cx = &priv->suidx[0];
-    do {
-	for (j=0;j<cx->nEntriesInUse;j++)
-	    if (cx->stdidx[j].nEntriesInUse) free(cx->stdidx[j].aIndex);
-	free(cx->stdidx);
-
-    } while (cx++ != &priv->suidx[priv->suidx_size-1]);
-    free(priv->suidx);
-
+    if (ret > 0)
+	mp_msg(MSGT_HEADER, MSGL_V, "AVI: OpenDML index of %d chunks merged in %u ms, the rest follows when needed\n",
+	       priv->idx_size, m->time);
+    else
+	odml_finish(priv);
+    goto odml_done;
+
+broken:
+    // this is a broken file (probably incomplete) let the standard
+    // gen_index routine handle this
+    free(priv->idx);
+    priv->idx = NULL;
+    priv->isodml = 0;
+    priv->idx_size = 0;
+    mp_msg(MSGT_HEADER, MSGL_WARN, MSGTR_MPDEMUX_AVIHDR_BrokenODMLfile);
+    avi_idx_free_odml(priv);
+odml_done: ;
 }
 
 /* Read a saved index file */
@@ -580,6 +835,14 @@ if (index_file_load) {
     goto gen_index;
   }
   fread(&magic, 6, 1, fp);
+  if (!strncmp(magic, "MPIDX2", 6)) {
+    int ret = load_idx2(demuxer, fp, index_file_load);
+    fclose(fp);
+    if (!ret)
+      goto gen_index;
+    mp_msg(MSGT_HEADER,MSGL_INFO, MSGTR_MPDEMUX_AVIHDR_IdxFileLoaded, index_file_load);
+    goto gen_index; // skipped with an index
+  }
   if (strncmp(magic, "MPIDX1", 6)) {
     mp_msg(MSGT_HEADER,MSGL_ERR, MSGTR_MPDEMUX_AVIHDR_NotValidMPidxFile, index_file_load);
     goto gen_index;
@@ -612,6 +875,12 @@ if(index_mode>=2 || (priv->idx_size==0 && index_mode==1)){
   stream_reset(demuxer->stream);
   stream_seek(demuxer->stream,demuxer->movi_start);
   
+#ifdef HAVE_SYS_MMAN_H
+  if (priv->idx_mmap) {
+    munmap(priv->idx_mmap, priv->idx_mmap_len);
+    priv->idx_mmap = NULL;
+  }
+#endif
   priv->idx_pos=0;
   priv->idx_size=0;
   priv->idx=NULL;
@@ -696,18 +965,18 @@ skip_chunk:
   /* Write generated index to a file */
   if (index_file_save) {
     FILE *fp;
-    unsigned int i;
+    mpidx2_header_t hdr;
 
     if ((fp=fopen(index_file_save, "w")) == NULL) {
       mp_msg(MSGT_HEADER,MSGL_ERR, MSGTR_MPDEMUX_AVIHDR_Failed2WriteIdxFile, index_file_save, strerror(errno));
       return;
     }
-    fwrite("MPIDX1", 6, 1, fp);
-    fwrite(&priv->idx_size, sizeof(priv->idx_size), 1, fp);
-    for (i=0; i<priv->idx_size; i++) {
-      AVIINDEXENTRY *idx = &((AVIINDEXENTRY *)priv->idx)[i];
-      fwrite(idx, sizeof(AVIINDEXENTRY), 1, fp);
-    }
+    memcpy(hdr.magic, "MPIDX2\0\0", 8);
+    hdr.file_size = demuxer->stream->end_pos;
+    hdr.count = priv->idx_size;
+    hdr.reserved = 0;
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+    fwrite(priv->idx, sizeof(AVIINDEXENTRY), priv->idx_size, fp);
     fclose(fp);
     mp_msg(MSGT_HEADER,MSGL_INFO, MSGTR_MPDEMUX_AVIHDR_IdxFileSaved, index_file_save);
   }
@@ -326,6 +326,8 @@ typedef struct {
   // index stuff:
   void* idx;
   int idx_size;
+  void* idx_mmap;    // index file mapped by -loadidx, idx points into it
+  size_t idx_mmap_len;
   off_t idx_pos;
   off_t idx_pos_a;
   off_t idx_pos_v;
@@ -347,6 +349,9 @@ typedef struct {
   avisuperindex_chunk *suidx;
   int suidx_size;
   int isodml;
+  void* odml;        // merge state while the OpenDML index is incomplete
+  int kf_pos;        // keyframes are registered up to this index entry
+  int kf_frames;     // video frames before kf_pos, -1 before the first
 } avi_priv_t;
 
 #define AVI_PRIV ((avi_priv_t*)(demuxer->priv))
@@ -3,8 +3,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <limits.h>
 
 #include "config.h"
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 #include "mp_msg.h"
 #include "help_mp.h"
 
@@ -165,6 +169,32 @@ static int demux_avi_read_packet(demuxer_t *demux,demux_stream_t *ds,unsigned in
   return ds?1:0;
 }
 
+int avi_idx_extend(demuxer_t *demuxer, int n);
+void avi_idx_free_odml(avi_priv_t *priv);
+
+/// register the keyframes of the index entries not looked at yet
+static void add_keyframes(demuxer_t *demuxer){
+    avi_priv_t *priv=demuxer->priv;
+    sh_video_t *sh_video=demuxer->video->sh;
+    for(;priv->kf_pos<priv->idx_size;priv->kf_pos++){
+      AVIINDEXENTRY *idx=&((AVIINDEXENTRY *)priv->idx)[priv->kf_pos];
+      if(avi_stream_id(idx->ckid)!=demuxer->video->id) continue;
+      if(idx->dwFlags&AVIIF_KEYFRAME)
+        demuxer_add_keyframe(demuxer,(double)priv->kf_frames*sh_video->video.dwScale/sh_video->video.dwRate,
+                             (off_t)priv->idx_offset+AVI_IDX_OFFSET(idx));
+      ++priv->kf_frames;
+    }
+}
+
+/// 1 if index entry n exists, merges more of an OpenDML index if needed
+static int idx_has(demuxer_t *demuxer,int n){
+    avi_priv_t *priv=demuxer->priv;
+    if(n<priv->idx_size) return 1;
+    avi_idx_extend(demuxer,n);
+    if(priv->kf_frames>=0) add_keyframes(demuxer);
+    return n<priv->idx_size;
+}
+
 // return value:
 //     0 = EOF or no stream found
 //     1 = successfully read a packet
@@ -178,7 +208,7 @@ demux_stream_t *ds;
 do{
   int flags=1;
   AVIINDEXENTRY *idx=NULL;
-  if(priv->idx_size>0 && priv->idx_pos<priv->idx_size){
+  if(priv->idx_size>0 && idx_has(demux,priv->idx_pos)){
     off_t pos;
     
     idx=&((AVIINDEXENTRY *)priv->idx)[priv->idx_pos++];
@@ -278,7 +308,7 @@ do{
   if(ds==demux->audio) idx_pos=priv->idx_pos_a++; else
                        idx_pos=priv->idx_pos++;
   
-  if(priv->idx_size>0 && idx_pos<priv->idx_size){
+  if(priv->idx_size>0 && idx_has(demux,idx_pos)){
     off_t pos;
     idx=&((AVIINDEXENTRY *)priv->idx)[idx_pos];
     
@@ -403,6 +433,11 @@ static demuxer_t* demux_open_avi(demuxer_t* demuxer){
   priv->isodml = 0;
   priv->suidx_size = 0;
   priv->suidx = NULL;
+  priv->odml = NULL;
+  priv->kf_pos = 0;
+  priv->kf_frames = -1;
+  priv->idx_mmap = NULL;
+  priv->idx_mmap_len = 0;
 
   demuxer->priv=(void*)priv;
 
@@ -511,8 +546,9 @@ static demuxer_t* demux_open_avi(demuxer_t* demuxer){
     size_t asamples=0;
     int i;
     for(i=0;i<priv->idx_size;i++){ 
-      int id=avi_stream_id(((AVIINDEXENTRY *)priv->idx)[i].ckid);
-      int len=((AVIINDEXENTRY *)priv->idx)[i].dwChunkLength;
+      AVIINDEXENTRY *idx=&((AVIINDEXENTRY *)priv->idx)[i];
+      int id=avi_stream_id(idx->ckid);
+      int len=idx->dwChunkLength;
       if(sh_video->ds->id == id) {
         vsize+=len;
         ++vsamples;
@@ -524,6 +560,19 @@ static demuxer_t* demux_open_avi(demuxer_t* demuxer){
     }
     mp_msg(MSGT_DEMUX,MSGL_V,"AVI video size=%"PRId64" (%u) audio size=%"PRId64" (%u)\n",vsize,vsamples,asize,asamples);
     priv->numberofframes=vsamples;
+    if(priv->odml){
+      // the index is merged only partly yet, the super index has the length
+      unsigned int frames=0;
+      for(i=0;i<priv->suidx_size;i++)
+        if(avi_stream_id(*(uint32_t *)priv->suidx[i].dwChunkId)==sh_video->ds->id){
+          int j;
+          for(j=0;j<priv->suidx[i].nEntriesInUse;j++)
+            frames+=priv->suidx[i].aIndex[j].dwDuration;
+        }
+      if(frames>vsamples) priv->numberofframes=frames;
+    }
+    priv->kf_frames=0;
+    add_keyframes(demuxer);
     sh_video->i_bps=((float)vsize/(float)vsamples)*(float)sh_video->video.dwRate/(float)sh_video->video.dwScale;
     if(sh_audio) sh_audio->i_bps=((float)asize/(float)asamples)*(float)sh_audio->audio.dwRate/(float)sh_audio->audio.dwScale;
   } else {
@@ -571,6 +620,10 @@ void demux_seek_avi(demuxer_t *demuxer,float rel_seek_secs,float audio_delay,int
     int video_chunk_pos=d_video->pos;
     int i;
 
+      // non-interleaved files look for the audio in the whole index
+      if(demuxer->type!=DEMUXER_TYPE_AVI)
+        avi_idx_extend(demuxer,INT_MAX);
+
       if(flags&1){
 	// seek absolute
 	video_chunk_pos=0;
@@ -587,7 +640,7 @@ void demux_seek_avi(demuxer_t *demuxer,float rel_seek_secs,float audio_delay,int
       // find nearest video keyframe chunk pos:
       if(rel_seek_frames>0){
         // seek forward
-        while(video_chunk_pos<priv->idx_size-1){
+        while(idx_has(demuxer,video_chunk_pos+1)){
           int id=((AVIINDEXENTRY *)priv->idx)[video_chunk_pos].ckid;
           if(avi_stream_id(id)==d_video->id){  // video frame
             if((--rel_seek_frames)<0 && ((AVIINDEXENTRY *)priv->idx)[video_chunk_pos].dwFlags&AVIIF_KEYFRAME) break;
@@ -666,7 +719,7 @@ void demux_seek_avi(demuxer_t *demuxer,float rel_seek_secs,float audio_delay,int
 	    audio_chunk_pos=0;
 	    
         // find audio chunk pos:
-          for(i=0;i<priv->idx_size && chunks>0;i++){
+          for(i=0;idx_has(demuxer,i) && chunks>0;i++){
             int id=((AVIINDEXENTRY *)priv->idx)[i].ckid;
             if(avi_stream_id(id)==d_audio->id){
                 len=((AVIINDEXENTRY *)priv->idx)[i].dwChunkLength;
@@ -736,8 +789,14 @@ void demux_close_avi(demuxer_t *demuxer) {
   if(!priv)
     return;
 
+#ifdef HAVE_SYS_MMAN_H
+  if(priv->idx_mmap)
+    munmap(priv->idx_mmap, priv->idx_mmap_len);
+  else
+#endif
   if(priv->idx_size > 0)
     free(priv->idx);
+  avi_idx_free_odml(priv);
   free(priv);
 }
 
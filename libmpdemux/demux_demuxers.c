@@ -121,6 +121,11 @@ static int demux_demuxers_control(demuxer_t *demuxer,int cmd, void *arg){
     case DEMUXER_CTRL_GET_PERCENT_POS:
       *((int *)arg) = demuxer_get_percent_pos(priv->vd);
       return DEMUXER_CTRL_OK;
+    case DEMUXER_CTRL_GET_KEYFRAME: {
+      demux_keyframe_query_t *q = arg;
+      return demuxer_find_keyframe(priv->vd, q->pts, q->dir, &q->kf) ?
+             DEMUXER_CTRL_OK : DEMUXER_CTRL_DONTKNOW;
+    }
   }
   return DEMUXER_CTRL_NOTIMPL;
 }
@@ -460,6 +460,7 @@ static int demux_lavf_fill_buffer(demuxer_t *demux, demux_stream_t *dsds){
         dp->refcount=1;
         dp->master=NULL;
         dp->buffer=pkt.data;
+        dp->free_buffer=NULL;
         pkt.destruct= NULL;
     }else{
         dp=new_demux_packet(pkt.size);
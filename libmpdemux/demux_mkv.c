@@ -18,9 +18,11 @@
 #include "stheader.h"
 #include "ebml.h"
 #include "matroska.h"
+#include "mkv_cluster_index.h"
 
 #include "mp_msg.h"
 #include "help_mp.h"
+#include "osdep/timer.h"
 
 #include "subreader.h"
 #include "libvo/sub.h"
@@ -144,7 +146,8 @@ typedef struct mkv_attachment
   char* name;
   char* mime;
   uint64_t uid;
-  void* data;
+  void* data;                   /* NULL until the data is needed */
+  off_t data_pos;
   unsigned int data_size;
 } mkv_attachment_t;
 
@@ -174,6 +177,7 @@ typedef struct mkv_demuxer
 
   uint64_t *cluster_positions;
   int num_cluster_pos;
+  mkv_cluster_index_t *cluster_index;  /* clusters indexed in the background */
 
   int64_t skip_to_timecode;
   int v_skip_to_keyframe, a_skip_to_keyframe;
@@ -185,6 +189,8 @@ typedef struct mkv_demuxer
   
   mkv_attachment_t *attachments;
   int num_attachments;
+
+  off_t chapters_pos;           /* chapters not read yet, 0 if none */
 } mkv_demuxer_t;
 
 
@@ -272,10 +278,15 @@ extern int dvdsub_id;
  * \param array array to grow
  * \param nelem current number of elements in array
  * \param elsize size of one array element
+ *
+ * The space doubles from 32 elements on, so that large cue tables are not
+ * copied around again every 32 entries.
  */
 static void grow_array(void **array, int nelem, size_t elsize) {
-  if (!(nelem & 31))
-    *array = realloc(*array, (nelem + 32) * elsize);
+  if (!nelem)
+    *array = realloc(*array, 32 * elsize);
+  else if (nelem >= 32 && !(nelem & (nelem - 1)))
+    *array = realloc(*array, 2 * nelem * elsize);
 }
 
 static mkv_track_t *
@@ -1528,7 +1539,7 @@ demux_mkv_read_attachments (demuxer_t *demuxer)
               char* name = NULL;
               char* mime = NULL;
               uint64_t uid = 0;
-              char* data = NULL;
+              off_t data_pos = 0;
               int data_size = 0;
 
               len = ebml_read_length (s, &i);
@@ -1568,16 +1579,13 @@ demux_mkv_read_attachments (demuxer_t *demuxer)
 
                     case MATROSKA_ID_FILEDATA:
                       {
+                        /* read only when needed, see demux_mkv_load_fonts */
                         int x;
                         uint64_t num = ebml_read_length (s, &x);
                         l = x + num;
-                        free(data);
-                        data = malloc (num);
-                        if (stream_read(s, data, num) != (int) num)
-                        {
-                          free(data);
+                        data_pos = stream_tell (s);
+                        if (!stream_skip (s, num))
                           return 0;
-                        }
                         data_size = num;
                         mp_msg (MSGT_DEMUX, MSGL_V, "[mkv] |  + FileData, length "
                                 "%u\n", data_size);
@@ -1594,18 +1602,13 @@ demux_mkv_read_attachments (demuxer_t *demuxer)
               mkv_d->attachments[mkv_d->num_attachments].name = name;
               mkv_d->attachments[mkv_d->num_attachments].mime = mime;
               mkv_d->attachments[mkv_d->num_attachments].uid = uid;
-              mkv_d->attachments[mkv_d->num_attachments].data = data;
+              mkv_d->attachments[mkv_d->num_attachments].data = NULL;
+              mkv_d->attachments[mkv_d->num_attachments].data_pos = data_pos;
               mkv_d->attachments[mkv_d->num_attachments].data_size = data_size;
               mkv_d->num_attachments ++;
               mp_msg(MSGT_DEMUX, MSGL_V,
                      "[mkv] Attachment: %s, %s, %u bytes\n",
                      name, mime, data_size);
-#ifdef USE_ASS
-              if (extract_embedded_fonts && name && data && data_size &&
-                  mime && (strcmp(mime, "application/x-truetype-font") == 0 ||
-                  strcmp(mime, "application/x-font") == 0))
-                ass_add_font(ass_library, name, data, data_size);
-#endif
               break;
             }
 
@@ -1725,7 +1728,12 @@ demux_mkv_read_seekhead (demuxer_t *demuxer)
                 break;
 
               case MATROSKA_ID_CHAPTERS:
-                if (demux_mkv_read_chapters (demuxer))
+                /* behind the clusters, read them when they are asked for
+                   unless -chapter needs them right away */
+                if (!demuxer->chapters && dvd_chapter <= 1
+                    && dvd_last_chapter <= 0)
+                  mkv_d->chapters_pos = stream_tell (s) - il;
+                else if (demux_mkv_read_chapters (demuxer))
                   res = 1;
                 break;
               }
@@ -2427,6 +2435,67 @@ static int demux_mkv_reverse_id(mkv_demuxer_t *d, int num, int type)
   return -1;
 }
 
+/**
+ * \brief read the chapters demux_mkv_read_seekhead left for later
+ */
+static void
+demux_mkv_load_chapters (demuxer_t *demuxer)
+{
+  mkv_demuxer_t *mkv_d = (mkv_demuxer_t *) demuxer->priv;
+  stream_t *s = demuxer->stream;
+  off_t pos = stream_tell (s);
+  int i;
+
+  if (!mkv_d->chapters_pos)
+    return;
+  if (stream_seek (s, mkv_d->chapters_pos)
+      && ebml_read_id (s, NULL) == MATROSKA_ID_CHAPTERS)
+    demux_mkv_read_chapters (demuxer);
+  mkv_d->chapters_pos = 0;
+  for (i=0; i < (int)demuxer->num_chapters; i++)
+    {
+      demuxer->chapters[i].start -= mkv_d->first_tc;
+      demuxer->chapters[i].end -= mkv_d->first_tc;
+    }
+  stream_seek (s, pos);
+}
+
+#ifdef USE_ASS
+/**
+ * \brief read the font attachments and hand them to libass
+ */
+static void
+demux_mkv_load_fonts (demuxer_t *demuxer)
+{
+  mkv_demuxer_t *mkv_d = (mkv_demuxer_t *) demuxer->priv;
+  stream_t *s = demuxer->stream;
+  off_t pos = stream_tell (s);
+  int i;
+
+  for (i = 0; i < mkv_d->num_attachments; i++)
+    {
+      mkv_attachment_t *a = mkv_d->attachments + i;
+
+      if (!a->name || !a->data_size || !a->mime ||
+          (strcmp(a->mime, "application/x-truetype-font") &&
+           strcmp(a->mime, "application/x-font")))
+        continue;
+      a->data = malloc (a->data_size);
+      if (!a->data)
+        continue;
+      if (!stream_seek (s, a->data_pos) ||
+          stream_read (s, a->data, a->data_size) != (int) a->data_size)
+        {
+          free (a->data);
+          a->data = NULL;
+          continue;
+        }
+      ass_add_font (ass_library, a->name, a->data, a->data_size);
+    }
+  stream_seek (s, pos);
+}
+#endif
+
 static int
 demux_mkv_open (demuxer_t *demuxer)
 {
@@ -2435,6 +2504,7 @@ demux_mkv_open (demuxer_t *demuxer)
   mkv_track_t *track;
   int i, version, cont = 0;
   char *str;
+  unsigned int start_time = GetTimerMS (), unread = 0;
 
   stream_seek(s, s->start_pos);
   str = ebml_read_header (s, &version);
@@ -2499,16 +2569,20 @@ demux_mkv_open (demuxer_t *demuxer)
 
         case MATROSKA_ID_CLUSTER:
           {
-            int p, l;
+            off_t p;
+            uint64_t l;
             mp_msg (MSGT_DEMUX, MSGL_V, "[mkv] |+ found cluster, headers are "
                     "parsed completely :)\n");
             /* get the first cluster timecode */
             p = stream_tell(s);
             l = ebml_read_length (s, NULL);
+            if (l == EBML_UINT_INVALID)  /* unknown size, written live */
+              /* up to the end of the file, if it has one */
+              l = s->end_pos > p ? s->end_pos - p : INT64_MAX - p;
             while (ebml_read_id (s, NULL) != MATROSKA_ID_CLUSTERTIMECODE)
               {
                 ebml_read_skip (s, NULL);
-                if (stream_tell (s) >= p + l)
+                if (s->eof || stream_tell (s) >= p + l)
                   break;
               }
             if (stream_tell (s) < p + l)
@@ -2534,6 +2608,16 @@ demux_mkv_open (demuxer_t *demuxer)
 
   display_create_tracks (demuxer);
 
+#ifdef USE_ASS
+  /* fonts are only of use to the ASS renderer */
+  if (ass_enabled && extract_embedded_fonts)
+    demux_mkv_load_fonts (demuxer);
+#endif
+
+  /* the loop above stopped at the first cluster */
+  if (mkv_d->indexes == NULL && index_mode != 0)
+    mkv_d->cluster_index = mkv_cluster_index_new (s, stream_tell (s));
+
   /* select video track */
   track = NULL;
   if (demuxer->video->id == -1)  /* automatically select a video track */
@@ -2676,7 +2760,8 @@ demux_mkv_open (demuxer_t *demuxer)
         }
     }
 
-  if (s->end_pos == 0 || (mkv_d->indexes == NULL && index_mode < 0))
+  if (s->end_pos == 0 ||
+      (mkv_d->indexes == NULL && index_mode < 0 && !mkv_d->cluster_index))
     demuxer->seekable = 0;
   else
     {
@@ -2695,6 +2780,13 @@ demux_mkv_open (demuxer_t *demuxer)
         }
     }
 
+  for (i = 0; i < mkv_d->num_attachments; i++)
+    if (!mkv_d->attachments[i].data)
+      unread += mkv_d->attachments[i].data_size;
+  mp_msg (MSGT_DEMUX, MSGL_V, "[mkv] Headers read in %u ms, %u bytes of "
+          "attachments%s left in the file\n", GetTimerMS () - start_time,
+          unread, mkv_d->chapters_pos ? " and the chapters" : "");
+
   return DEMUXER_TYPE_MATROSKA;
 }
 
@@ -2707,6 +2799,7 @@ demux_close_mkv (demuxer_t *demuxer)
     {
       int i;
       free_cached_dps (demuxer);
+      mkv_cluster_index_free (mkv_d->cluster_index);
       if (mkv_d->tracks)
         {
           for (i=0; i<mkv_d->num_tracks; i++)
@@ -3277,6 +3370,10 @@ handle_block (demuxer_t *demuxer, uint8_t *block, uint64_t length,
     {
       mkv_d->last_pts = current_pts;
       mkv_d->last_filepos = demuxer->filepos;
+      /* without Cues the keyframes are learned while playing */
+      if (ds == demuxer->video && !mkv_d->indexes &&
+          (simpleblock ? flags & 0x80 : !block_bref && !block_fref))
+        demuxer_add_keyframe (demuxer, current_pts, demuxer->filepos);
 
       for (i=0; i < laces; i++)
         {
@@ -3430,18 +3527,34 @@ demux_mkv_fill_buffer (demuxer_t *demuxer, demux_stream_t *ds)
                 case MATROSKA_ID_SIMPLEBLOCK:
                   {
                     int res;
+                    uint8_t *borrowed = NULL;
                     block_length = ebml_read_length (s, &tmp);
-                    block = malloc (block_length);
                     demuxer->filepos = stream_tell (s);
-                    if (stream_read (s,block,block_length) != (int) block_length)
-                    {
-                      free(block);
-                      return 0;
-                    }
+                    /* nothing reads the stream until handle_block is done,
+                       so a block already in the stream buffer is used in
+                       place instead of being copied out first */
+                    if (block_length < STREAM_MAX_BUFFER_SIZE)
+                      borrowed = stream_borrow (s, block_length,
+                                                LZO_INPUT_PADDING);
+                    if (borrowed)
+                      block = borrowed;
+                    else
+                      {
+                        if (block_length > SIZE_MAX - LZO_INPUT_PADDING)
+                          return 0;
+                        block = malloc (block_length + LZO_INPUT_PADDING);
+                        if (stream_read (s,block,block_length) != (int) block_length)
+                        {
+                          free(block);
+                          return 0;
+                        }
+                      }
                     l = tmp + block_length;
                     res = handle_block (demuxer, block, block_length,
                                         block_duration, block_bref, block_fref, 1);
-                    free (block);
+                    if (!borrowed)
+                      free (block);
+                    block = NULL;
                     mkv_d->cluster_size -= l + il;
                     if (res < 0)
                       return 0;
@@ -3470,6 +3583,31 @@ demux_mkv_fill_buffer (demuxer_t *demuxer, demux_stream_t *ds)
   return 0;
 }
 
+/**
+ * \brief seek to the cluster the background index has for target_timecode
+ * \return 0 if the index does not reach that far
+ */
+static int
+demux_mkv_seek_cluster_index (demuxer_t *demuxer, int64_t target_timecode)
+{
+  mkv_demuxer_t *mkv_d = (mkv_demuxer_t *) demuxer->priv;
+  uint64_t timecode;
+  off_t pos;
+
+  timecode = (target_timecode + mkv_d->first_tc) * 1000000.0 / mkv_d->tc_scale;
+  if (!mkv_cluster_index_find (mkv_d->cluster_index, timecode, &pos))
+    {
+      /* let the linear search start behind the indexed clusters */
+      if (pos > 0 && (mkv_d->num_cluster_pos == 0 || (uint64_t) pos >
+          mkv_d->cluster_positions[mkv_d->num_cluster_pos-1]))
+        add_cluster_position (mkv_d, pos);
+      return 0;
+    }
+  mkv_d->cluster_size = mkv_d->blockgroup_size = 0;
+  stream_seek (demuxer->stream, pos);
+  return 1;
+}
+
 static void
 demux_mkv_seek (demuxer_t *demuxer, float rel_seek_secs, float audio_delay, int flags)
 {
@@ -3487,7 +3625,12 @@ demux_mkv_seek (demuxer_t *demuxer, float rel_seek_secs, float audio_delay, int
       if (target_timecode < 0)
         target_timecode = 0;
 
-      if (mkv_d->indexes == NULL)  /* no index was found */
+      if (mkv_d->indexes == NULL && mkv_d->cluster_index != NULL
+          && demux_mkv_seek_cluster_index (demuxer, target_timecode))
+        {
+          /* found in the clusters indexed in the background */
+        }
+      else if (mkv_d->indexes == NULL)  /* no index was found */
         {
           uint64_t target_filepos, cluster_pos, max_pos;
 
@@ -3633,6 +3776,47 @@ demux_mkv_seek (demuxer_t *demuxer, float rel_seek_secs, float audio_delay, int
     }
 }
 
+/** \brief answer DEMUXER_CTRL_GET_KEYFRAME from the Cues of the video track */
+static int
+mkv_find_keyframe (demuxer_t *demuxer, demux_keyframe_query_t *q)
+{
+  mkv_demuxer_t *mkv_d = (mkv_demuxer_t *) demuxer->priv;
+  mkv_index_t *before = NULL, *after = NULL, *index;
+  double target = q->pts * 1000.0 + mkv_d->first_tc;
+  double before_tc = 0, after_tc = 0;
+  int i;
+
+  if (mkv_d->indexes == NULL || demuxer->video->id < 0)
+    return DEMUXER_CTRL_DONTKNOW;
+  for (i=0; i < mkv_d->num_indexes; i++)
+    {
+      double tc;
+      if (mkv_d->indexes[i].tnum != demuxer->video->id)
+        continue;
+      tc = mkv_d->indexes[i].timecode * mkv_d->tc_scale / 1000000.0;
+      if (tc <= target && (!before || tc > before_tc))
+        before = mkv_d->indexes + i, before_tc = tc;
+      if (tc >= target && (!after || tc < after_tc))
+        after = mkv_d->indexes + i, after_tc = tc;
+    }
+
+  if (q->dir == KEYFRAME_BEFORE)
+    index = before;
+  else if (q->dir == KEYFRAME_AFTER || !before)
+    index = after;
+  else if (!after || target - before_tc <= after_tc - target)
+    index = before;
+  else
+    index = after;
+  if (index == NULL)
+    return DEMUXER_CTRL_DONTKNOW;
+  q->kf.pts = (index->timecode * mkv_d->tc_scale / 1000000.0 - mkv_d->first_tc) / 1000.0;
+  if (q->kf.pts < 0)
+    q->kf.pts = 0;
+  q->kf.pos = index->filepos;
+  return DEMUXER_CTRL_OK;
+}
+
 static int
 demux_mkv_control (demuxer_t *demuxer, int cmd, void *arg)
 {
@@ -3647,6 +3831,13 @@ demux_mkv_control (demuxer_t *demuxer, int cmd, void *arg)
       *((double *)arg) = (double)mkv_d->duration;
       return DEMUXER_CTRL_OK;
 
+    case DEMUXER_CTRL_LOAD_CHAPTERS:
+      demux_mkv_load_chapters (demuxer);
+      return DEMUXER_CTRL_OK;
+
+    case DEMUXER_CTRL_GET_KEYFRAME:
+      return mkv_find_keyframe (demuxer, arg);
+
     case DEMUXER_CTRL_GET_PERCENT_POS:
       if (mkv_d->duration == 0)
         {
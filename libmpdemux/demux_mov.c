@@ -86,6 +86,8 @@ typedef struct {
 typedef struct {
     unsigned int num;
     unsigned int dur;
+    unsigned int first;  // number of the first sample with this duration
+    unsigned int pts;    // and its pts
 } mov_durmap_t;
 
 typedef struct {
@@ -132,7 +134,12 @@ typedef struct {
     int stream_header_len; // if >0, this header should be sent before the 1st frame
     //
     int samples_size;
-    mov_sample_t* samples;
+    unsigned int* sample_sizes; // from stsz, NULL if all are sample_size_fixed
+    unsigned int sample_size_fixed;
+    mov_sample_t* samples;  // samples_start.. expanded from the tables,
+    int samples_start;      // samples_len of them
+    int samples_len;
+    unsigned int samples_expanded; // statistics
     int chunks_size;
     mov_chunk_t* chunks;
     int chunkmap_size;
@@ -148,6 +155,97 @@ typedef struct {
     void* desc; // image/sound/etc description (pointer to ImageDescription etc)
 } mov_track_t;
 
+// number of samples expanded at a time from the sample tables
+#define MOV_SAMPLES_WINDOW 1024
+
+/// the chunk containing sample n
+static int mov_sample_chunk(mov_track_t* trak, unsigned int n){
+    int lo=0, hi=trak->chunks_size;
+    while(hi-lo>1){
+	int mid=(lo+hi)/2;
+	if(trak->chunks[mid].sample<=n) lo=mid; else hi=mid;
+    }
+    return lo;
+}
+
+/// the durmap entry of sample n
+static int mov_sample_durmap(mov_track_t* trak, unsigned int n){
+    int lo=0, hi=trak->durmap_size;
+    while(hi-lo>1){
+	int mid=(lo+hi)/2;
+	if(trak->durmap[mid].first<=n) lo=mid; else hi=mid;
+    }
+    return lo;
+}
+
+static unsigned int mov_sample_size(mov_track_t* trak, unsigned int n){
+    return trak->sample_sizes ? trak->sample_sizes[n] : trak->sample_size_fixed;
+}
+
+/// pts of sample n, the end of the track for n==samples_size
+static unsigned int mov_sample_pts(mov_track_t* trak, unsigned int n){
+    mov_durmap_t* d;
+    if(!trak->durmap_size) return 0;
+    d=&trak->durmap[mov_sample_durmap(trak,n)];
+    if(n-d->first>d->num) n=d->first+d->num; // beyond the table
+    return d->pts+(n-d->first)*d->dur;
+}
+
+/// first sample with a pts of at least pts, samples_size if there is none
+static int mov_pts_sample(mov_track_t* trak, double pts){
+    int lo=0, hi=trak->samples_size;
+    while(lo<hi){
+	int mid=(lo+hi)/2;
+	if(mov_sample_pts(trak,mid)<pts) lo=mid+1; else hi=mid;
+    }
+    return lo;
+}
+
+/// sample n, expanded along with the ones after it on demand, the
+/// pointer is valid until the next call
+static mov_sample_t* mov_sample(mov_track_t* trak, int n){
+    int i, c, d;
+    unsigned int pts;
+    off_t pos;
+
+    if(n>=trak->samples_start && n<trak->samples_start+trak->samples_len)
+	return &trak->samples[n-trak->samples_start];
+
+    if(!trak->samples){
+	trak->samples=malloc(MOV_SAMPLES_WINDOW*sizeof(mov_sample_t));
+	if(!trak->samples) return NULL;
+    }
+    c=mov_sample_chunk(trak,n);
+    d=mov_sample_durmap(trak,n);
+    pts=mov_sample_pts(trak,n);
+    pos=0;
+    if(trak->chunks_size){
+	pos=trak->chunks[c].pos;
+	for(i=trak->chunks[c].sample;i<n;i++)
+	    pos+=mov_sample_size(trak,i);
+    }
+
+    trak->samples_start=n;
+    trak->samples_len=FFMIN(MOV_SAMPLES_WINDOW,trak->samples_size-n);
+    for(i=0;i<trak->samples_len;i++,n++){
+	mov_sample_t* s=&trak->samples[i];
+	while(c+1<trak->chunks_size && n>=trak->chunks[c+1].sample)
+	    pos=trak->chunks[++c].pos;
+	while(d+1<trak->durmap_size && n>=trak->durmap[d+1].first)
+	    pts=trak->durmap[++d].pts;
+	s->pts=pts;
+	s->size=mov_sample_size(trak,n);
+	s->pos=pos;
+	mp_msg(MSGT_DEMUX, MSGL_DBG3, "Sample %5d: pts=%8d  off=0x%08X  size=%d\n",n,
+	    s->pts,(int)s->pos,s->size);
+	pos+=s->size;
+	if(d<trak->durmap_size && n<trak->durmap[d].first+trak->durmap[d].num)
+	    pts+=trak->durmap[d].dur;
+    }
+    trak->samples_expanded+=trak->samples_len;
+    return trak->samples;
+}
+
 void mov_build_index(mov_track_t* trak,int timescale){
     int i,j,s;
     int last=trak->chunks_size;
@@ -210,9 +308,7 @@ void mov_build_index(mov_track_t* trak,int timescale){
     // workaround for fixed-size video frames (dv and uncompressed)
     if(!trak->samples_size && trak->type!=MOV_TRAK_AUDIO){
 	trak->samples_size=s;
-	trak->samples=calloc(s, sizeof(mov_sample_t));
-	for(i=0;i<s;i++)
-	    trak->samples[i].size=trak->samplesize;
+	trak->sample_size_fixed=trak->samplesize;
 	trak->samplesize=0;
     }
 
@@ -228,33 +324,22 @@ void mov_build_index(mov_track_t* trak,int timescale){
       mp_msg(MSGT_DEMUX, MSGL_WARN,
              "MOV: durmap or chunkmap bigger than sample count (%i vs %i)\n",
              s, trak->samples_size);
+      if (trak->sample_sizes) {
+        trak->sample_sizes = realloc_struct(trak->sample_sizes, s, sizeof(unsigned int));
+        memset(trak->sample_sizes + trak->samples_size, 0,
+               (s - trak->samples_size) * sizeof(unsigned int));
+      }
       trak->samples_size = s;
-      trak->samples = realloc_struct(trak->samples, s, sizeof(mov_sample_t));
     }
 
-    // calc pts:
+    // calc pts of durmap entries, samples are expanded from the tables
+    // only when they are needed:
     s=0;
     for(j=0;j<trak->durmap_size;j++){
-	for(i=0;i<trak->durmap[j].num;i++){
-	    trak->samples[s].pts=pts;
-	    ++s;
-	    pts+=trak->durmap[j].dur;
-	}
-    }
-    
-    // calc sample offsets
-    s=0;
-    for(j=0;j<trak->chunks_size;j++){
-	off_t pos=trak->chunks[j].pos;
-	for(i=0;i<trak->chunks[j].size;i++){
-	    trak->samples[s].pos=pos;
-	    mp_msg(MSGT_DEMUX, MSGL_DBG3, "Sample %5d: pts=%8d  off=0x%08X  size=%d\n",s,
-		trak->samples[s].pts,
-		(int)trak->samples[s].pos,
-		trak->samples[s].size);
-	    pos+=trak->samples[s].size;
-	    ++s;
-	}
+	trak->durmap[j].first=s;
+	trak->durmap[j].pts=pts;
+	s+=trak->durmap[j].num;
+	pts+=trak->durmap[j].num*trak->durmap[j].dur;
     }
 
     // precalc editlist entries
@@ -263,7 +348,7 @@ void mov_build_index(mov_track_t* trak,int timescale){
 	int e_pts=0;
 	for(i=0;i<trak->editlist_size;i++){
 	    mov_editlist_t* el=&trak->editlist[i];
-	    int sample=0;
+	    int sample;
 	    int pts=el->pos;
 	    el->start_frame=frame;
 	    if(pts<0){
@@ -271,17 +356,13 @@ void mov_build_index(mov_track_t* trak,int timescale){
 		el->frames=0; continue;
 	    }
 	    // find start sample
-	    for(;sample<trak->samples_size;sample++){
-		if(pts<=trak->samples[sample].pts) break;
-	    }
+	    sample=mov_pts_sample(trak,pts);
 	    el->start_sample=sample;
-	    el->pts_offset=((long long)e_pts*(long long)trak->timescale)/(long long)timescale-trak->samples[sample].pts;
+	    el->pts_offset=((long long)e_pts*(long long)trak->timescale)/(long long)timescale-mov_sample_pts(trak,sample);
 	    pts+=((long long)el->dur*(long long)trak->timescale)/(long long)timescale;
 	    e_pts+=el->dur;
 	    // find end sample
-	    for(;sample<trak->samples_size;sample++){
-		if(pts<trak->samples[sample].pts) break;
-	    }
+	    sample=FFMAX(sample,mov_pts_sample(trak,pts+1.0));
 	    el->frames=sample-el->start_sample;
 	    frame+=el->frames;
 	    mp_msg(MSGT_DEMUX,MSGL_V,"EL#%d: pts=%d  1st_sample=%d  frames=%d (%5.3fs)  pts_offs=%d\n",i,
@@ -535,6 +616,10 @@ static void demux_close_mov(demuxer_t *demuxer) {
       free(track->tkdata);
       free(track->stdata);
       free(track->stream_header);
+      if (track->samples_size)
+        mp_msg(MSGT_DEMUX, MSGL_V, "MOV track #%d: %u of %d samples expanded\n",
+               track->id, track->samples_expanded, track->samples_size);
+      free(track->sample_sizes);
       free(track->samples);
       free(track->chunks);
       free(track->chunkmap);
@@ -1329,12 +1414,13 @@ quit_vorbis_block:
 	
 		for (i=0; i<trak->samples_size; i++)
 		{
-		    char buf[trak->samples[i].size];
-		    stream_seek(demuxer->stream, trak->samples[i].pos);
+		    mov_sample_t *s = mov_sample(trak, i);
+		    char buf[s->size];
+		    stream_seek(demuxer->stream, s->pos);
 		    snprintf((char *)&name[0], 20, "samp%d", i);
 		    fd = open((char *)&name[0], O_CREAT|O_WRONLY);
-		    stream_read(demuxer->stream, &buf[0], trak->samples[i].size);
-		    write(fd, &buf[0], trak->samples[i].size);
+		    stream_read(demuxer->stream, &buf[0], s->size);
+		    write(fd, &buf[0], s->size);
 		    close(fd);
 		 }
 		for (i=0; i<trak->chunks_size; i++)
@@ -1772,10 +1858,10 @@ static int lschunks_intrak(demuxer_t* demuxer, int level, unsigned int id,
       trak->samplesize = ss;
       if (!ss) {
         // variable samplesize
-        trak->samples = realloc_struct(trak->samples, entries, sizeof(mov_sample_t));
+        trak->sample_sizes = realloc_struct(trak->sample_sizes, entries, sizeof(unsigned int));
         trak->samples_size = entries;
         for (i = 0; i < entries; i++)
-          trak->samples[i].size = stream_read_dword(demuxer->stream);
+          trak->sample_sizes[i] = stream_read_dword(demuxer->stream);
       }
       break;
     }
@@ -1988,9 +2074,10 @@ static demuxer_t* mov_read_header(demuxer_t* demuxer){
 		mp_msg(MSGT_DEMUX, MSGL_INFO, "MOV: Track #%d: Extracting %d data chunks to files\n",t_no,trak->samples_size);
 		for (i=0; i<trak->samples_size; i++)
 		{
-		    int len=trak->samples[i].size;
+		    mov_sample_t* s=mov_sample(trak,i);
+		    int len=s->size;
 		    char buf[len];
-		    stream_seek(demuxer->stream, trak->samples[i].pos);
+		    stream_seek(demuxer->stream, s->pos);
 		    snprintf(name, 20, "t%02d-s%03d.%s", t_no,i,
 			(trak->media_handler==MOV_FOURCC('f','l','s','h')) ?
 			    "swf":"dump");
@@ -2069,6 +2156,7 @@ static int demux_mov_fill_buffer(demuxer_t *demuxer,demux_stream_t* ds){
     float pts;
     int x;
     off_t pos;
+    mov_sample_t* sample;
     
     if (ds->eof) return 0;
     trak = stream_track(priv, ds);
@@ -2126,17 +2214,22 @@ if(trak->samplesize){
 	// calc real frame index:
 	frame-=trak->editlist[trak->editlist_pos].start_frame;
 	frame+=trak->editlist[trak->editlist_pos].start_sample;
+	if(frame>=trak->samples_size) return 0; // EOF
+	sample=mov_sample(trak,frame);
+	if(!sample) return 0;
 	// calc pts:
-	pts=(float)(trak->samples[frame].pts+
+	pts=(float)(sample->pts+
 	    trak->editlist[trak->editlist_pos].pts_offset)/(float)trak->timescale;
     } else {
 	if(frame>=trak->samples_size) return 0; // EOF
-	pts=(float)trak->samples[frame].pts/(float)trak->timescale;
+	sample=mov_sample(trak,frame);
+	if(!sample) return 0;
+	pts=(float)sample->pts/(float)trak->timescale;
     }
     // read sample:
-    stream_seek(demuxer->stream,trak->samples[frame].pos);
-    x=trak->samples[frame].size;
-    pos=trak->samples[frame].pos;
+    stream_seek(demuxer->stream,sample->pos);
+    x=sample->size;
+    pos=sample->pos;
 }
 if(trak->pos==0 && trak->stream_header_len>0){
     // we have to append the stream header...
@@ -2159,20 +2252,14 @@ if(trak->pos==0 && trak->stream_header_len>0){
     if (demuxer->sub->id >= 0 && demuxer->sub->id < priv->track_db)
       trak = priv->tracks[demuxer->sub->id];
     if (trak) {
-      int samplenr = 0;
-      while (samplenr < trak->samples_size) {
-        double subpts = (double)trak->samples[samplenr].pts / (double)trak->timescale;
-        if (subpts >= pts) break;
-        samplenr++;
-      }
-      samplenr--;
+      int samplenr = mov_pts_sample(trak, (double)pts * trak->timescale) - 1;
       if (samplenr < 0)
         vo_sub = NULL;
-      else if (samplenr != priv->current_sub) {
+      else if (samplenr != priv->current_sub && (sample = mov_sample(trak, samplenr))) {
         sh_sub_t *sh = demuxer->sub->sh;
-        off_t pos = trak->samples[samplenr].pos;
-        int len = trak->samples[samplenr].size;
-        double subpts = (double)trak->samples[samplenr].pts / (double)trak->timescale;
+        off_t pos = sample->pos;
+        int len = sample->size;
+        double subpts = (double)sample->pts / (double)trak->timescale;
         stream_seek(demuxer->stream, pos);
         if (sh->type != 'v') {
           stream_skip(demuxer->stream, 2); // size
@@ -2199,25 +2286,26 @@ if(trak->samplesize){
     int sample=pts/trak->duration;
 //    printf("MOV track seek - chunk: %d  (pts: %5.3f  dur=%d)  \n",sample,pts,trak->duration);
     if(!(flags&1)) sample+=trak->chunks[trak->pos].sample; // relative
-    trak->pos=0;
-    while(trak->pos<trak->chunks_size && trak->chunks[trak->pos].sample<sample) ++trak->pos;
+    if(sample<0) sample=0;
+    // first chunk starting at sample or later:
+    trak->pos=mov_sample_chunk(trak,sample);
+    if(trak->pos<trak->chunks_size && trak->chunks[trak->pos].sample<sample) ++trak->pos;
     if (trak->pos == trak->chunks_size) return -1;
     pts=(float)(trak->chunks[trak->pos].sample*trak->duration)/(float)trak->timescale;
 } else {
     unsigned int ipts;
-    if(!(flags&1)) pts+=trak->samples[trak->pos].pts;
+    if(!(flags&1)) pts+=mov_sample_pts(trak,trak->pos);
     if(pts<0) pts=0;
     ipts=pts;
     //printf("MOV track seek - sample: %d  \n",ipts);
-    for(trak->pos=0;trak->pos<trak->samples_size;++trak->pos){
-	if(trak->samples[trak->pos].pts>=ipts) break; // found it!
-    }
+    trak->pos=mov_pts_sample(trak,ipts);
     if (trak->pos == trak->samples_size) return -1;
     if(trak->keyframes_size){
 	// find nearest keyframe
-	int i;
-	for(i=0;i<trak->keyframes_size;i++){
-	    if(trak->keyframes[i]>=trak->pos) break;
+	int i=0, hi=trak->keyframes_size;
+	while(i<hi){
+	    int mid=(i+hi)/2;
+	    if(trak->keyframes[mid]<trak->pos) i=mid+1; else hi=mid;
 	}
 	if (i == trak->keyframes_size) return -1;
 	if(i>0 && (trak->keyframes[i]-trak->pos) > (trak->pos-trak->keyframes[i-1]))
@@ -2225,7 +2313,7 @@ if(trak->samplesize){
 	trak->pos=trak->keyframes[i];
 //	printf("nearest keyframe: %d  \n",trak->pos);
     }
-    pts=(float)trak->samples[trak->pos].pts/(float)trak->timescale;
+    pts=(float)mov_sample_pts(trak,trak->pos)/(float)trak->timescale;
 }
 
 //    printf("MOV track seek done:  %5.3f  \n",pts);
@@ -2262,6 +2350,46 @@ static void demux_seek_mov(demuxer_t *demuxer,float pts,float audio_delay,int fl
 
 }
 
+/// answer DEMUXER_CTRL_GET_KEYFRAME from the sync sample table of trak
+static int mov_find_keyframe(mov_track_t* trak, demux_keyframe_query_t* q){
+    double target, offset=0;
+    int n, before, after, s;
+    mov_sample_t* sample;
+
+    if(trak->samplesize || !trak->samples_size || trak->editlist_size>1)
+	return DEMUXER_CTRL_DONTKNOW;
+    if(trak->editlist_size==1) offset=trak->editlist[0].pts_offset;
+    target=q->pts*trak->timescale-offset;
+    n=mov_pts_sample(trak,target);
+    if(trak->keyframes_size){
+	int lo=0, hi=trak->keyframes_size;
+	while(lo<hi){
+	    int mid=(lo+hi)/2;
+	    if(trak->keyframes[mid]<n) lo=mid+1; else hi=mid;
+	}
+	after=lo<trak->keyframes_size ? trak->keyframes[lo] : -1;
+	before=lo>0 ? trak->keyframes[lo-1] : -1;
+    } else {
+	// every sample is a keyframe
+	after=n<trak->samples_size ? n : -1;
+	before=n-1;
+    }
+    if(after>=0 && mov_sample_pts(trak,after)<=target) before=after;
+
+    switch(q->dir){
+    case KEYFRAME_BEFORE: s=before; break;
+    case KEYFRAME_AFTER: s=after; break;
+    default:
+	if(before<0 || after<0) s=before<0 ? after : before;
+	else s=target-mov_sample_pts(trak,before)<=mov_sample_pts(trak,after)-target ? before : after;
+    }
+    if(s<0) return DEMUXER_CTRL_DONTKNOW;
+    q->kf.pts=(mov_sample_pts(trak,s)+offset)/trak->timescale;
+    sample=mov_sample(trak,s);
+    q->kf.pos=sample ? sample->pos : -1;
+    return DEMUXER_CTRL_OK;
+}
+
 static int demux_mov_control(demuxer_t *demuxer, int cmd, void *arg){
   mov_track_t* track;
 
@@ -2289,6 +2417,11 @@ static int demux_mov_control(demuxer_t *demuxer, int cmd, void *arg){
         *((int *)arg) = (int)(100 * pos / track->length);
         return DEMUXER_CTRL_OK;
       }
+
+    case DEMUXER_CTRL_GET_KEYFRAME:
+      if (track != stream_track(demuxer->priv, demuxer->video))
+        return DEMUXER_CTRL_DONTKNOW;
+      return mov_find_keyframe(track, arg);
   }
   return DEMUXER_CTRL_NOTIMPL;
 }
@@ -2,12 +2,14 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <math.h>
 
 #include "config.h"
 #include "mp_msg.h"
 #include "help_mp.h"
+#include "osdep/timer.h"
 
 #include "stream/stream.h"
 #include "demuxer.h"
@@ -28,6 +30,13 @@
 #define AUDIO_LPCM_BE   0x10001
 #define AUDIO_AAC       mmioFOURCC('M', 'P', '4', 'A')
 
+typedef struct {
+  off_t pos;                    // position of a video packet
+  float pts;                    // and its pts
+  int discont;                  // timestamps jump between the previous entry and this one
+  int linked;                   // or are known to be continuous
+} mpg_index_t;
+
 typedef struct mpg_demuxer {
   float last_pts;
   float first_pts;              // first pts found in stream
@@ -37,6 +46,15 @@ typedef struct mpg_demuxer {
   unsigned int es_map[0x40];	//es map of stream types (associated to the pes id) from 0xb0 to 0xef
   int num_a_streams;
   int a_stream_ids[MAX_A_STREAMS];
+  // sparse pts->position map for seeking, sorted by position, learned
+  // from the video packets read during playback and seek probes
+  mpg_index_t *index;
+  int index_len, index_size;
+  off_t index_spacing;
+  off_t run_pos;                // last video pts read in sequence and where,
+  float run_pts;                // run_pos is -1 after a seek
+  off_t run_start;              // where this run started
+  off_t run_added;              // position of the last entry of this run
 } mpg_demuxer_t;
 
 extern char* dvdsub_lang;
@@ -111,10 +129,135 @@ static int parse_psm(demuxer_t *demux, int len) {
 //1.0 is a wild guess
 #define MAX_PTS_DIFF_FOR_CONSECUTIVE 1.0
 
-//returns the first pts found within TIME_STAMP_PROBE_LEN bytes after stream_pos in demuxer's stream.
+//the seek index gets an entry about every MPG_INDEX_SPACING bytes of
+//playback, the spacing doubles whenever it reaches MPG_INDEX_MAX entries
+#define MPG_INDEX_SPACING (256*1024)
+#define MPG_INDEX_MAX 16384
+
+//seeking bisects until the target pts is within MPG_SEEK_PRECISION seconds
+//or MPG_SEEK_WINDOW bytes, with at most MPG_SEEK_MAX_READS probes of
+//MPG_SEEK_PROBE_LEN bytes
+#define MPG_SEEK_PRECISION 0.5
+#define MPG_SEEK_WINDOW (256*1024)
+#define MPG_SEEK_MAX_READS 10
+#define MPG_SEEK_PROBE_LEN (128*1024)
+
+//less than MPG_MIN_BYTE_RATE bytes per second between two index entries
+//means the timestamps jump forward in between
+#define MPG_MIN_BYTE_RATE 2000
+
+//the byte rate on both sides of a seek probe differing by a larger factor
+//hints at a discontinuity, the gap is bisected further then
+#define MPG_MAX_RATE_CHANGE 3
+
+/// number of index entries at or before pos
+static int index_find(mpg_demuxer_t *d, off_t pos)
+{
+  int lo = 0, hi = d->index_len;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (d->index[mid].pos <= pos)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/// drop every other entry, keeping the ones around discontinuities
+static void index_thin(mpg_demuxer_t *d)
+{
+  int i, n = 0, linked = 1;
+  for (i = 0; i < d->index_len; i++) {
+    linked &= d->index[i].linked;
+    if (!(i & 1) || d->index[i].discont ||
+        (i + 1 < d->index_len && d->index[i + 1].discont)) {
+      d->index[n] = d->index[i];
+      d->index[n++].linked = linked;
+      linked = 1;
+    }
+  }
+  d->index_len = n;
+  d->index_spacing *= 2;
+}
+
+/// add an entry, returns its number or -1
+static int index_add(mpg_demuxer_t *d, off_t pos, float pts, int discont)
+{
+  int i = index_find(d, pos);
+  if (i > 0 && d->index[i - 1].pos == pos) {
+    d->index[i - 1].discont |= discont;
+    return i - 1;
+  }
+  if (d->index_len == MPG_INDEX_MAX) {
+    index_thin(d);
+    i = index_find(d, pos);
+  }
+  if (d->index_len == d->index_size) {
+    int size = d->index_size ? 2 * d->index_size : 256;
+    mpg_index_t *index = realloc(d->index, size * sizeof(mpg_index_t));
+    if (!index)
+      return -1;
+    d->index = index;
+    d->index_size = size;
+  }
+  memmove(d->index + i + 1, d->index + i, (d->index_len - i) * sizeof(mpg_index_t));
+  d->index_len++;
+  d->index[i].pos = pos;
+  d->index[i].pts = pts;
+  d->index[i].discont = discont;
+  // a gap known to be continuous stays so when split
+  d->index[i].linked = i + 1 < d->index_len && d->index[i + 1].linked &&
+                       !d->index[i + 1].discont;
+  return i;
+}
+
+/// note the pts of a video packet at pos in the index
+static void index_learn(mpg_demuxer_t *d, off_t pos, float pts)
+{
+  int i = -1;
+
+  if (d->run_pos < 0 || pos <= d->run_pos || pos - d->run_pos > MPG_INDEX_SPACING) {
+    // first pts after a seek
+    i = index_add(d, pos, pts, 0);
+    d->run_start = d->run_added = pos;
+  } else if (fabsf(pts - d->run_pts) > MAX_PTS_DIFF_FOR_CONSECUTIVE) {
+    // pts reset or jump, remember both sides
+    index_add(d, d->run_pos, d->run_pts, 0);
+    i = index_add(d, pos, pts, 1);
+    if (i > 0)
+      d->index[i - 1].linked = 1;
+    d->run_start = d->run_added = pos;
+  } else if (pos - d->run_added >= d->index_spacing) {
+    i = index_find(d, pos);
+    // skip it when playing a part of the stream a second time
+    if ((i == 0 || pos - d->index[i - 1].pos >= d->index_spacing / 2) &&
+        (i == d->index_len || d->index[i].pos - pos >= d->index_spacing / 2))
+      i = index_add(d, pos, pts, 0);
+    else
+      i = i - 1;
+    d->run_added = pos;
+  }
+  // everything since the start of the run was read in sequence
+  for (; i > 0 && !d->index[i].linked && d->index[i - 1].pos >= d->run_start; i--)
+    d->index[i].linked = 1;
+  d->run_pos = pos;
+  d->run_pts = pts;
+}
+
+/// whether the timestamps are discontinuous between entries i-1 and i
+static int index_discont(mpg_demuxer_t *d, int i)
+{
+  mpg_index_t *a = &d->index[i - 1], *b = &d->index[i];
+  float diff = b->pts - a->pts;
+  return b->discont || diff < -MAX_PTS_DIFF_FOR_CONSECUTIVE ||
+         (diff > MAX_PTS_DIFF_FOR_CONSECUTIVE && diff * MPG_MIN_BYTE_RATE > b->pos - a->pos);
+}
+
+//returns the first pts found within probe_len bytes after stream_pos in demuxer's stream.
 //if no pts is found or an error occurs, -1.0 is returned.
 //Packs are freed.
-static float read_first_mpeg_pts_at_position(demuxer_t* demuxer, off_t stream_pos)
+static float read_first_mpeg_pts_at_position(demuxer_t* demuxer, off_t stream_pos, off_t probe_len)
 {
   stream_t *s = demuxer->stream;
   mpg_demuxer_t *mpg_d = demuxer->priv;
@@ -129,6 +272,7 @@ static float read_first_mpeg_pts_at_position(demuxer_t* demuxer, off_t stream_po
 
   found_pts3 = found_pts2 = found_pts1 = mpg_d->last_pts;
   stream_seek(s, stream_pos);
+  mpg_d->run_pos = -1;
 
   //We look for pts.
   //However, we do not stop at the first found one, as timestamps may reset
@@ -138,7 +282,7 @@ static float read_first_mpeg_pts_at_position(demuxer_t* demuxer, off_t stream_po
   while(found<3 && !s->eof
    && (fabsf(found_pts2-found_pts1) < MAX_PTS_DIFF_FOR_CONSECUTIVE)
    && (fabsf(found_pts3-found_pts2) < MAX_PTS_DIFF_FOR_CONSECUTIVE)
-   && (stream_tell(s) < stream_pos + TIMESTAMP_PROBE_LEN)
+   && (stream_tell(s) < stream_pos + probe_len)
    && ds_fill_buffer(demuxer->video))
   {
     if(mpg_d->last_pts != found_pts1)
@@ -177,6 +321,8 @@ static demuxer_t* demux_mpg_open(demuxer_t* demuxer) {
     demuxer->priv = mpg_d;
     mpg_d->last_pts = -1.0;
     mpg_d->first_pts = -1.0;
+    mpg_d->index_spacing = MPG_INDEX_SPACING;
+    mpg_d->run_pos = -1;
 
     //if seeking is allowed set has_valid_timestamps if appropriate
     if(demuxer->seekable
@@ -193,13 +339,13 @@ static demuxer_t* demux_mpg_open(demuxer_t* demuxer) {
 
       //The position where the stream is now
       off_t pos = stream_tell(s);
-      float first_pts = read_first_mpeg_pts_at_position(demuxer, demuxer->movi_start);
+      float first_pts = read_first_mpeg_pts_at_position(demuxer, demuxer->movi_start, TIMESTAMP_PROBE_LEN);
       if(first_pts != -1.0)
       {
-        float middle_pts = read_first_mpeg_pts_at_position(demuxer, (demuxer->movi_end + demuxer->movi_start)/2);
+        float middle_pts = read_first_mpeg_pts_at_position(demuxer, (demuxer->movi_end + demuxer->movi_start)/2, TIMESTAMP_PROBE_LEN);
         if(middle_pts != -1.0)
         {
-          float final_pts = read_first_mpeg_pts_at_position(demuxer, demuxer->movi_end - TIMESTAMP_PROBE_LEN);
+          float final_pts = read_first_mpeg_pts_at_position(demuxer, demuxer->movi_end - TIMESTAMP_PROBE_LEN, TIMESTAMP_PROBE_LEN);
           if(final_pts != -1.0)
           {
             // found proper first, middle, and final pts.
@@ -229,7 +375,10 @@ static demuxer_t* demux_mpg_open(demuxer_t* demuxer) {
 
 static void demux_close_mpg(demuxer_t* demuxer) {
   mpg_demuxer_t* mpg_d = demuxer->priv;
-  if (mpg_d) free(mpg_d);
+  if (mpg_d) {
+    free(mpg_d->index);
+    free(mpg_d);
+  }
 }
 
 
@@ -553,6 +702,7 @@ static int demux_mpg_read_packet(demuxer_t *demux,int id){
       dp->stream_pts = stream_pts;
     ds_add_packet(ds,dp);
     if (demux->priv && set_pts) ((mpg_demuxer_t*)demux->priv)->last_pts = pts/90000.0f;
+    if (priv && set_pts && ds == demux->video) index_learn(priv, demux->filepos, pts/90000.0f);
 //    if(ds==demux->sub) parse_dvdsub(ds->last->buffer,ds->last->len);
     return 1;
   }
@@ -845,6 +995,111 @@ do{
 
 extern void skip_audio_frame(sh_audio_t *sh_audio);
 
+/// bytes per second in index entries s..e, or a guess
+static float index_rate(demuxer_t *demuxer, int s, int e)
+{
+  mpg_demuxer_t *d = demuxer->priv;
+  sh_video_t *sh_video = demuxer->video->sh;
+  if (e > s && d->index[e].pts - d->index[s].pts > MAX_PTS_DIFF_FOR_CONSECUTIVE)
+    return (d->index[e].pos - d->index[s].pos) / (d->index[e].pts - d->index[s].pts);
+  if (sh_video && sh_video->i_bps)
+    return sh_video->i_bps;
+  return 2324*75; // 174.3 kbyte/sec
+}
+
+/// position of the packet with pts target, found with the seek index and
+/// by bisecting where its entries are too far apart; target refers to the
+/// timestamps around from, it continues across discontinuities
+/// \return -1 if nothing is known about the stream yet
+static off_t seek_pts(demuxer_t *demuxer, float target, off_t from, int *reads)
+{
+  mpg_demuxer_t *d = demuxer->priv;
+  int crossed = 0;
+
+  *reads = 0;
+  while (d->index_len) {
+    int c, s, e, i, k, len;
+    off_t lo, hi, pos;
+
+    // the segment of continuous timestamps around from
+    c = s = e = FFMAX(index_find(d, from) - 1, 0);
+    while (s > 0 && !index_discont(d, s))
+      s--;
+    while (e + 1 < d->index_len && !index_discont(d, e + 1))
+      e++;
+
+    if (target < d->index[s].pts) {
+      k = s;
+      lo = s > 0 ? d->index[s - 1].pos : demuxer->movi_start;
+      hi = d->index[s].pos;
+      pos = hi - (d->index[s].pts - target) * index_rate(demuxer, s, e);
+    } else if (target > d->index[e].pts) {
+      k = e;
+      lo = d->index[e].pos;
+      hi = e + 1 < d->index_len ? d->index[e + 1].pos : demuxer->movi_end;
+      pos = lo + (target - d->index[e].pts) * index_rate(demuxer, s, e);
+    } else {
+      for (k = s; k < e && d->index[k + 1].pts <= target; k++) ;
+      lo = hi = pos = d->index[k].pos;
+      if (k < e && target - d->index[k].pts >= MPG_SEEK_PRECISION) {
+        hi = d->index[k + 1].pos;
+        pos = lo + (hi - lo) * (target - d->index[k].pts) / (d->index[k + 1].pts - d->index[k].pts);
+      }
+    }
+
+    // gaps between from and the target may hide a discontinuity,
+    // check the ones that were never read through first; gap i lies
+    // between entries i-1 and i, the open ones before the first and
+    // after the last entry are only probed below
+    if (hi > lo && k >= c && target >= d->index[s].pts)
+      k = FFMIN(k + 1, d->index_len - 1); // the target is inside gap k+1
+    for (i = c < k ? c + 1 : c; i != (c < k ? k + 1 : k); i += c < k ? 1 : -1)
+      if (!d->index[i].linked && d->index[i].pos - d->index[i - 1].pos > MPG_SEEK_WINDOW)
+        break;
+    if (i != (c < k ? k + 1 : k)) {
+      lo = d->index[i - 1].pos;
+      hi = d->index[i].pos;
+      pos = (lo + hi) / 2;
+    } else if (hi - lo <= MPG_SEEK_WINDOW) {
+      if (target < d->index[s].pts && s > 0 && crossed++ < d->index_len) {
+        // the segment starts here, go on in the one before it
+        target = d->index[s - 1].pts - (d->index[s].pts - target);
+        from = d->index[s - 1].pos;
+        continue;
+      }
+      if (target > d->index[e].pts && e + 1 < d->index_len && crossed++ < d->index_len) {
+        // the segment ends here, go on in the one after it
+        target = d->index[e + 1].pts + (target - d->index[e].pts);
+        from = d->index[e + 1].pos;
+        continue;
+      }
+      return FFMIN(FFMAX(pos, lo), hi);
+    }
+
+    // probe inside the gap, not too close to its ends
+    pos = FFMAX(pos, lo + (hi - lo) / 8);
+    pos = FFMIN(pos, hi - (hi - lo) / 8);
+    if (*reads == MPG_SEEK_MAX_READS)
+      return pos;
+    len = d->index_len;
+    read_first_mpeg_pts_at_position(demuxer, pos, MPG_SEEK_PROBE_LEN);
+    (*reads)++;
+    if (d->index_len <= len)
+      return pos; // learned nothing new
+    // pts in order and at a similar rate on both sides: take the gap as continuous
+    i = index_find(d, pos - 1);
+    if (i > 0 && i + 1 < d->index_len && !d->index[i].linked) {
+      mpg_index_t *a = &d->index[i - 1], *m = &d->index[i], *b = &d->index[i + 1];
+      if (a->pts < m->pts && m->pts < b->pts) {
+        float r = (m->pos - a->pos) / (m->pts - a->pts) * (b->pts - m->pts) / (b->pos - m->pos);
+        if (r < MPG_MAX_RATE_CHANGE && r > 1.0 / MPG_MAX_RATE_CHANGE)
+          m->linked = b->linked = 1;
+      }
+    }
+  }
+  return -1;
+}
+
 void demux_seek_mpg(demuxer_t *demuxer,float rel_seek_secs,float audio_delay, int flags){
     demux_stream_t *d_audio=demuxer->audio;
     demux_stream_t *d_video=demuxer->video;
@@ -852,6 +1107,8 @@ void demux_seek_mpg(demuxer_t *demuxer,float rel_seek_secs,float audio_delay, in
     sh_video_t *sh_video=d_video->sh;
     mpg_demuxer_t *mpg_d=(mpg_demuxer_t*)demuxer->priv;
     int precision = 1;
+    int indexed = 0, reads = 0;
+    unsigned int start;
     float oldpts = 0;
     off_t oldpos = demuxer->filepos;
     float newpts = 0; 
@@ -860,6 +1117,7 @@ void demux_seek_mpg(demuxer_t *demuxer,float rel_seek_secs,float audio_delay, in
     if(mpg_d)
       oldpts = mpg_d->last_pts;
     newpts = (flags & 1) ? 0.0 : oldpts;
+    start = GetTimerMS();
   //================= seek in MPEG ==========================
   //calculate the pts to seek to
     if(flags & 2) {
@@ -887,6 +1145,19 @@ void demux_seek_mpg(demuxer_t *demuxer,float rel_seek_secs,float audio_delay, in
           newpos+=sh_video->i_bps*rel_seek_secs;
     }
 
+    // time seek: bisect on the timestamps instead, starting from what the index knows
+    if (!(flags & 2) && mpg_d && demuxer->seekable) {
+      off_t pos = seek_pts(demuxer, newpts, (flags & 1) ? demuxer->movi_start : oldpos, &reads);
+      demuxer->stream->eof=0;
+      d_video->eof=0;
+      d_audio->eof=0;
+      if (pos >= 0) {
+        newpos = pos;
+        precision = 0;
+        indexed = 1;
+      }
+    }
+
     while (1) {
         if(newpos<demuxer->movi_start){
 	    if(demuxer->stream->type!=STREAMTYPE_VCD) demuxer->movi_start=0; // for VCD
@@ -894,6 +1165,7 @@ void demux_seek_mpg(demuxer_t *demuxer,float rel_seek_secs,float audio_delay, in
 	}
 
         stream_seek(demuxer->stream,newpos);
+        if (mpg_d) mpg_d->run_pos = -1;
 
         // re-sync video:
         videobuf_code_len=0; // reset ES stream buffer
@@ -951,6 +1223,9 @@ void demux_seek_mpg(demuxer_t *demuxer,float rel_seek_secs,float audio_delay, in
         d_audio->eof=0;
 	}
     }
+    if (indexed)
+      mp_msg(MSGT_DEMUX,MSGL_V,"MPG: seek to %.2f found %.2f at 0x%"PRIX64" with %d probes in %u ms, %d index entries\n",
+             newpts, mpg_d->last_pts, (int64_t)newpos, reads, GetTimerMS() - start, mpg_d->index_len);
 }
 
 int demux_mpg_control(demuxer_t *demuxer,int cmd, void *arg){
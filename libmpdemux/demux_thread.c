@@ -0,0 +1,313 @@
+/*
+ * Demuxing ahead of the decoders in a thread of its own.
+ *
+ * Without it the demuxer runs inside ds_fill_buffer() when a decoder
+ * wants a packet, so every slow read of the stream delays the decoder.
+ * Here a thread calls the fill_buffer() of the demuxer ahead of time and
+ * the packets wait in the demux_stream_t queues, until a byte or time
+ * budget is reached. ds_fill_buffer() takes packets from the queues and
+ * only waits when they run empty.
+ *
+ * The queues are shared under a lock, everything else in the demuxer
+ * belongs to the thread while it runs. Seeks, stream switches and demuxer
+ * controls pause the thread, which waits for the fill_buffer() call in
+ * progress to return, and run with the demuxer to themselves.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+#include "mp_msg.h"
+#include "osdep/timer.h"
+#include "stream/stream.h"
+#include "demuxer.h"
+#include "demux_thread.h"
+
+int demux_thread_enabled = 0;
+int demux_thread_bytes = 16384;
+float demux_thread_secs = 10;
+
+#ifdef HAVE_PTHREADS
+
+struct demux_thread_s {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int quit;
+  int paused;             /* nesting count of demux_thread_pause() */
+  int busy;               /* the thread is inside the demuxer */
+  int eof;                /* the demuxer found no more packets */
+  demux_stream_t *wanted; /* the player waits for a packet of this stream */
+  double last_pts;        /* pts of the last packet queued for the main stream */
+
+  /* statistics */
+  unsigned int fills, waits, wait_time;
+};
+
+/// the stream the time budget is measured on
+static demux_stream_t *main_stream(demuxer_t *demuxer)
+{
+  return demuxer->video->sh ? demuxer->video : demuxer->audio;
+}
+
+/// the ds_fill_buffer() limits are reached, with t->lock held
+static int overflow(demuxer_t *demuxer)
+{
+  return demuxer->audio->packs >= MAX_PACKS ||
+         demuxer->audio->bytes >= MAX_PACK_BYTES ||
+         demuxer->video->packs >= MAX_PACKS ||
+         demuxer->video->bytes >= MAX_PACK_BYTES;
+}
+
+static int queued_bytes(demuxer_t *demuxer)
+{
+  return demuxer->audio->bytes + demuxer->video->bytes + demuxer->sub->bytes;
+}
+
+/**
+ * Measured on the queue, ds->pts is written by the player without the lock
+ * and MPEG video resets it to 0 at every picture.
+ */
+static double queued_secs(demuxer_t *demuxer)
+{
+  demux_thread_t *t = demuxer->thread;
+  demux_packet_t *dp;
+  if (t->last_pts <= 0)
+    return 0;
+  // many packets of PS streams carry no pts
+  for (dp = main_stream(demuxer)->first; dp && dp->pts <= 0; dp = dp->next) ;
+  if (!dp || t->last_pts <= dp->pts)
+    return 0;
+  return t->last_pts - dp->pts;
+}
+
+/// enough is queued ahead, with t->lock held
+static int full(demuxer_t *demuxer)
+{
+  return overflow(demuxer) ||
+         queued_bytes(demuxer) >= demux_thread_bytes * 1024 ||
+         (demux_thread_secs > 0 && queued_secs(demuxer) >= demux_thread_secs);
+}
+
+/// the stream to read for, demuxers that do not interleave need one
+static demux_stream_t *next_stream(demuxer_t *demuxer)
+{
+  demux_stream_t *v = demuxer->video, *a = demuxer->audio;
+  if (v->sh && a->sh)
+    return a->bytes < v->bytes ? a : v;
+  return a->sh ? a : v;
+}
+
+static void *demux_thread(void *arg)
+{
+  demuxer_t *demuxer = arg;
+  demux_thread_t *t = demuxer->thread;
+
+  pthread_mutex_lock(&t->lock);
+  while (!t->quit) {
+    demux_stream_t *ds = t->wanted, *m;
+    int ret;
+    if (t->paused || t->eof || (ds ? overflow(demuxer) : full(demuxer))) {
+      pthread_cond_wait(&t->cond, &t->lock);
+      continue;
+    }
+    if (!ds)
+      ds = next_stream(demuxer);
+    t->busy = 1;
+    pthread_mutex_unlock(&t->lock);
+    ret = demux_fill_buffer(demuxer, ds);
+    pthread_mutex_lock(&t->lock);
+    t->busy = 0;
+    t->fills++;
+    if (!ret)
+      t->eof = 1;
+    m = main_stream(demuxer);
+    if (m->last && m->last->pts > 0)
+      t->last_pts = m->last->pts;
+    pthread_cond_broadcast(&t->cond);
+  }
+  pthread_mutex_unlock(&t->lock);
+  return NULL;
+}
+
+static int in_thread(demux_thread_t *t)
+{
+  return pthread_equal(pthread_self(), t->thread);
+}
+
+void demux_thread_start(demuxer_t *demuxer)
+{
+  demux_thread_t *t;
+  sigset_t sigs, oldsigs;
+  int err;
+
+  if (!demux_thread_enabled || demuxer->thread)
+    return;
+  if (demuxer->type == DEMUXER_TYPE_DEMUXERS) {
+    // the streams belong to the demuxers inside, which have no thread
+    mp_msg(MSGT_DEMUXER, MSGL_V, "[demux] No thread for separate audio or subtitle files\n");
+    return;
+  }
+  t = calloc(1, sizeof(*t));
+  if (!t)
+    return;
+  pthread_mutex_init(&t->lock, NULL);
+  pthread_cond_init(&t->cond, NULL);
+  demuxer->thread = t;
+  /* signals must go to the player, which cleans up on them,
+   * the lock keeps the thread waiting until t->thread is set */
+  sigfillset(&sigs);
+  pthread_sigmask(SIG_SETMASK, &sigs, &oldsigs);
+  pthread_mutex_lock(&t->lock);
+  err = pthread_create(&t->thread, NULL, demux_thread, demuxer);
+  pthread_mutex_unlock(&t->lock);
+  pthread_sigmask(SIG_SETMASK, &oldsigs, NULL);
+  if (err) {
+    mp_msg(MSGT_DEMUXER, MSGL_WARN, "[demux] Cannot start the demuxer thread\n");
+    demuxer->thread = NULL;
+    pthread_cond_destroy(&t->cond);
+    pthread_mutex_destroy(&t->lock);
+    free(t);
+    return;
+  }
+  mp_msg(MSGT_DEMUXER, MSGL_V, "[demux] Reading ahead up to %d kB or %.1f s in a thread\n",
+         demux_thread_bytes, demux_thread_secs);
+}
+
+void demux_thread_stop(demuxer_t *demuxer)
+{
+  demux_thread_t *t = demuxer->thread;
+  if (!t)
+    return;
+  pthread_mutex_lock(&t->lock);
+  t->quit = 1;
+  pthread_cond_broadcast(&t->cond);
+  pthread_mutex_unlock(&t->lock);
+  pthread_join(t->thread, NULL);
+  pthread_cond_destroy(&t->cond);
+  pthread_mutex_destroy(&t->lock);
+  mp_msg(MSGT_DEMUXER, MSGL_V,
+         "[demux] Thread read %u times, the player waited %u times for %u ms\n",
+         t->fills, t->waits, t->wait_time);
+  demuxer->thread = NULL;
+  free(t);
+}
+
+void demux_thread_pause(demuxer_t *demuxer)
+{
+  demux_thread_t *t = demuxer->thread;
+  if (!t || in_thread(t))
+    return;
+  pthread_mutex_lock(&t->lock);
+  t->paused++;
+  while (t->busy)
+    pthread_cond_wait(&t->cond, &t->lock);
+  pthread_mutex_unlock(&t->lock);
+}
+
+void demux_thread_resume(demuxer_t *demuxer)
+{
+  demux_thread_t *t = demuxer->thread;
+  if (!t || in_thread(t))
+    return;
+  pthread_mutex_lock(&t->lock);
+  if (!--t->paused) {
+    demux_stream_t *m = main_stream(demuxer);
+    // after a seek there is something to read again
+    t->eof = 0;
+    // the queues may have changed, not only by a seek
+    t->last_pts = m->last && m->last->pts > 0 ? m->last->pts : 0;
+  }
+  pthread_cond_broadcast(&t->cond);
+  pthread_mutex_unlock(&t->lock);
+}
+
+int demux_thread_wait(demux_stream_t *ds)
+{
+  demux_thread_t *t = ds->demuxer->thread;
+  unsigned int start = 0;
+
+  if (!t || t->paused || in_thread(t))
+    return -1;
+  pthread_mutex_lock(&t->lock);
+  while (!ds->first && !t->eof && !overflow(ds->demuxer)) {
+    if (!start) {
+      start = GetTimerMS();
+      t->waits++;
+    }
+    t->wanted = ds;
+    pthread_cond_broadcast(&t->cond);
+    pthread_cond_wait(&t->cond, &t->lock);
+  }
+  t->wanted = NULL;
+  if (start)
+    t->wait_time += GetTimerMS() - start;
+  return ds->first != NULL;
+}
+
+int demux_thread_lock(demuxer_t *demuxer)
+{
+  demux_thread_t *t = demuxer->thread;
+  if (!t)
+    return 0;
+  pthread_mutex_lock(&t->lock);
+  return 1;
+}
+
+void demux_thread_unlock(demuxer_t *demuxer)
+{
+  demux_thread_t *t = demuxer->thread;
+  // there is a packet more for the player or room for the thread
+  pthread_cond_broadcast(&t->cond);
+  pthread_mutex_unlock(&t->lock);
+}
+
+int demux_thread_fill(demuxer_t *demuxer, double *secs, int *bytes)
+{
+  demux_thread_t *t = demuxer->thread;
+  if (!t)
+    return 0;
+  pthread_mutex_lock(&t->lock);
+  *secs = queued_secs(demuxer);
+  *bytes = queued_bytes(demuxer);
+  pthread_mutex_unlock(&t->lock);
+  return 1;
+}
+
+#else
+
+void demux_thread_start(demuxer_t *demuxer)
+{
+  if (demux_thread_enabled)
+    mp_msg(MSGT_DEMUXER, MSGL_WARN, "[demux] No thread support, demuxing directly\n");
+}
+
+void demux_thread_stop(demuxer_t *demuxer) {}
+void demux_thread_pause(demuxer_t *demuxer) {}
+void demux_thread_resume(demuxer_t *demuxer) {}
+int demux_thread_wait(demux_stream_t *ds) { return -1; }
+int demux_thread_lock(demuxer_t *demuxer) { return 0; }
+void demux_thread_unlock(demuxer_t *demuxer) {}
+int demux_thread_fill(demuxer_t *demuxer, double *secs, int *bytes) { return 0; }
+
+#endif /* HAVE_PTHREADS */
@@ -0,0 +1,55 @@
+#ifndef DEMUX_THREAD_H
+#define DEMUX_THREAD_H
+
+#include "demuxer.h"
+
+/// demux in a thread of its own ahead of the decoders
+extern int demux_thread_enabled;
+/// read ahead until this many kB are queued
+extern int demux_thread_bytes;
+/// or until this many seconds are queued for the video (or audio) stream
+extern float demux_thread_secs;
+
+typedef struct demux_thread_s demux_thread_t;
+
+/**
+ * \brief start demuxing in a thread of its own
+ *
+ * Call it once the streams to play are selected. From then on the thread
+ * queues packets ahead into the demux_stream_t queues and ds_fill_buffer()
+ * waits for it instead of calling the demuxer.
+ */
+void demux_thread_start(demuxer_t *demuxer);
+void demux_thread_stop(demuxer_t *demuxer);
+
+/**
+ * \brief wait for the thread to leave the demuxer and keep it out
+ *
+ * Seeks, stream switches and controls run between pause and resume,
+ * calls may nest. Resuming restarts reading ahead after an end of file.
+ */
+void demux_thread_pause(demuxer_t *demuxer);
+void demux_thread_resume(demuxer_t *demuxer);
+
+/**
+ * \brief wait until the thread has queued a packet for ds
+ * \return -1 if the caller has to call the demuxer itself (no thread,
+ *         paused or called from the thread), otherwise 1 if ds has a
+ *         packet and 0 if the thread stopped without one, the queues are
+ *         locked then until demux_thread_unlock()
+ */
+int demux_thread_wait(demux_stream_t *ds);
+
+/// lock the packet queues, \return 0 if there is no thread to lock against
+int demux_thread_lock(demuxer_t *demuxer);
+void demux_thread_unlock(demuxer_t *demuxer);
+
+/**
+ * \brief how much is queued ahead
+ * \param secs seconds queued for the video (or audio) stream
+ * \param bytes bytes queued for all streams
+ * \return 0 if there is no thread
+ */
+int demux_thread_fill(demuxer_t *demuxer, double *secs, int *bytes);
+
+#endif /* DEMUX_THREAD_H */
@@ -504,6 +504,28 @@ static inline int32_t progid_for_pid(ts_priv_t *priv, int pid, int32_t req)		//f
 }
 
 
+//tells whether the PMT of progid lists audio and video, leaves them alone while it is not known
+static void prog_has_av(ts_priv_t *priv, int32_t progid, int *audio, int *video)
+{
+	int32_t idx = progid_idx_in_pmt(priv, progid);
+	pmt_t *pmt;
+	int j;
+
+	if(idx == -1 || priv->pmt[idx].es == NULL)
+		return;
+	pmt = &(priv->pmt[idx]);
+	*audio = *video = 0;
+	for(j = 0; j < pmt->es_cnt; j++)
+	{
+		//a private stream without descriptor may still turn out to be A52
+		if(IS_AUDIO(pmt->es[j].type) || pmt->es[j].type == UNKNOWN)
+			*audio = 1;
+		else if(IS_VIDEO(pmt->es[j].type))
+			*video = 1;
+	}
+}
+
+
 static inline int pid_match_lang(ts_priv_t *priv, uint16_t pid, char *lang)
 {
 	uint16_t i, j;
@@ -807,6 +829,17 @@ static off_t ts_detect_streams(demuxer_t *demuxer, tsdemux_init_t *param)
 			if(audio_found && (param->apid == es.pid) && (! video_found))
 				num_packets++;
 
+			//live: start as soon as the streams of the program are known
+			if(demuxer_live)
+			{
+				int has_audio = 1, has_video = 1;
+				if(param->prog > 0)
+					prog_has_av(priv, param->prog, &has_audio, &has_video);
+				if((video_found || !has_video || req_vpid == -2) &&
+				   (audio_found || !has_audio || req_apid == -2))
+					break;
+			}
+
 			if((has_tables==0) && (video_found && audio_found) && (pos >= 1000000))
 				break;
 		}
@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <math.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -17,13 +18,16 @@
 
 #include "stream/stream.h"
 #include "demuxer.h"
+#include "demux_thread.h"
 #include "stheader.h"
 #include "mf.h"
 
 #include "libaf/af_format.h"
+#include "osdep/timer.h"
 
 extern void resync_video_stream(sh_video_t *sh_video);
 extern void resync_audio_stream(sh_audio_t *sh_audio);
+extern int mp_msg_levels[MSGT_MAX];
 
 // Demuxer list
 extern demuxer_desc_t demuxer_desc_rawaudio;
@@ -282,6 +286,7 @@ void free_sh_video(sh_video_t* sh){
 void free_demuxer(demuxer_t *demuxer){
     int i;
     mp_msg(MSGT_DEMUXER,MSGL_DBG2,"DEMUXER: freeing demuxer at %p\n",demuxer);
+    demux_thread_stop(demuxer);
     if(demuxer->desc->close)
       demuxer->desc->close(demuxer);
     // Very ugly hack to make it behave like old implementation
@@ -310,6 +315,8 @@ skip_streamfree:
           free(demuxer->chapters[i].name);
       free(demuxer->chapters);
     }
+    if (demuxer->keyframes)
+      free(demuxer->keyframes);
     free(demuxer);
 }
 
@@ -319,6 +326,7 @@ void ds_add_packet(demux_stream_t *ds,demux_packet_t* dp){
 //    stream_read(stream,dp->buffer,len);
 //    dp->pts=pts; //(float)pts/90000.0f;
 //    dp->pos=pos;
+    int locked=demux_thread_lock(ds->demuxer);
     // append packet to DS stream:
     ++ds->packs;
     ds->bytes+=dp->len;
@@ -330,6 +338,7 @@ void ds_add_packet(demux_stream_t *ds,demux_packet_t* dp){
       // first packet in stream
       ds->first=ds->last=dp;
     }
+    if(locked) demux_thread_unlock(ds->demuxer);
     mp_dbg(MSGT_DEMUXER,MSGL_DBG2,"DEMUX: Append packet to %s, len=%d  pts=%5.3f  pos=%u  [packs: A=%d V=%d]\n",
         (ds==ds->demuxer->audio)?"d_audio":"d_video",
         dp->len,dp->pts,(unsigned int)dp->pos,ds->demuxer->audio->packs,ds->demuxer->video->packs);
@@ -369,6 +378,8 @@ int ds_fill_buffer(demux_stream_t *ds){
                          mp_dbg(MSGT_DEMUXER,MSGL_DBG3,"ds_fill_buffer(unknown 0x%X) called\n",(unsigned int)ds);
   }
   while(1){
+    // with a demuxer thread wait for it, the queue is locked then
+    int threaded=demux_thread_wait(ds);
     if(ds->packs){
       demux_packet_t *p=ds->first;
       // copy useful data:
@@ -391,8 +402,10 @@ int ds_fill_buffer(demux_stream_t *ds){
       ds->first=p->next;
       if(!ds->first) ds->last=NULL;
       --ds->packs;
+      if(threaded>=0) demux_thread_unlock(demux);
       return 1; //ds->buffer_size;
     }
+    if(threaded>=0) demux_thread_unlock(demux);
     if(demux->audio->packs>=MAX_PACKS || demux->audio->bytes>=MAX_PACK_BYTES){
       mp_msg(MSGT_DEMUXER,MSGL_ERR,MSGTR_TooManyAudioInBuffer,demux->audio->packs,demux->audio->bytes);
       mp_msg(MSGT_DEMUXER,MSGL_HINT,MSGTR_MaybeNI);
@@ -403,7 +416,7 @@ int ds_fill_buffer(demux_stream_t *ds){
       mp_msg(MSGT_DEMUXER,MSGL_HINT,MSGTR_MaybeNI);
       break;
     }
-    if(!demux_fill_buffer(demux,ds)){
+    if(threaded>=0 || !demux_fill_buffer(demux,ds)){
        mp_dbg(MSGT_DEMUXER,MSGL_DBG2,"ds_fill_buffer()->demux_fill_buffer() failed\n");
        break; // EOF
     }
@@ -486,6 +499,7 @@ int demux_pattern_3(demux_stream_t *ds, unsigned char *mem, int maxlen,
 }
 
 void ds_free_packs(demux_stream_t *ds){
+  int locked=demux_thread_lock(ds->demuxer);
   demux_packet_t *dp=ds->first;
   while(dp){
     demux_packet_t *dn=dp->next;
@@ -501,6 +515,7 @@ void ds_free_packs(demux_stream_t *ds){
   ds->first=ds->last=NULL;
   ds->packs=0; // !!!!!
   ds->bytes=0;
+  if(locked) demux_thread_unlock(ds->demuxer);
   if(ds->current) free_demux_packet(ds->current);
   ds->current=NULL;
   ds->buffer=NULL;
@@ -564,6 +579,10 @@ int ds_get_packet_sub(demux_stream_t *ds,unsigned char **start){
 double ds_get_next_pts(demux_stream_t *ds)
 {
   demuxer_t* demux = ds->demuxer;
+  // only the player takes packets, ds->first stays once the thread queued it
+  int threaded = demux_thread_wait(ds);
+  if (threaded >= 0)
+    demux_thread_unlock(demux);
   while(!ds->first) {
     if(demux->audio->packs>=MAX_PACKS || demux->audio->bytes>=MAX_PACK_BYTES){
       mp_msg(MSGT_DEMUXER,MSGL_ERR,MSGTR_TooManyAudioInBuffer,demux->audio->packs,demux->audio->bytes);
@@ -575,7 +594,7 @@ double ds_get_next_pts(demux_stream_t *ds)
       mp_msg(MSGT_DEMUXER,MSGL_HINT,MSGTR_MaybeNI);
       return MP_NOPTS_VALUE;
     }
-    if(!demux_fill_buffer(demux,ds))
+    if(threaded>=0 || !demux_fill_buffer(demux,ds))
       return MP_NOPTS_VALUE;
   }
   return ds->first->pts;
@@ -649,6 +668,128 @@ int get_demuxer_type_from_name(char *demuxer_name, int *force)
 
 int extension_parsing=1; // 0=off 1=mixed (used only for unstable formats)
 
+int demuxer_probe=1;
+
+int demuxer_live=0;
+
+#define PROBE_SIZE (64*1024)
+// enough for the checks of the formats that are streamed live
+#define LIVE_PROBE_SIZE (16*1024)
+
+/*
+ * Format detection runs the check_file of one demuxer after the other,
+ * each on a fresh demuxer that seeks the stream back to the start.  The
+ * probe reads the start of the file once and runs each check on a stream
+ * that serves only these bytes from memory first.  A check that fails
+ * there without reading past them cannot succeed on the file either, so
+ * the check on the real stream is skipped.  Checks that succeed or want
+ * more data run on the real stream as before, so the detection order and
+ * result do not change.
+ */
+typedef struct {
+  stream_t *s;          // serves data, never reads or seeks on its own
+  unsigned char *data;
+  int len;
+  int eof;              // data reaches the end of the file
+  signed char *result;  // per demuxer_list entry: -1 not probed yet,
+                        // 0 no match, 1 match or undecided
+} demuxer_probe_t;
+
+static demuxer_probe_t *probe_new(stream_t *stream) {
+  demuxer_probe_t *p;
+  int size = demuxer_live ? LIVE_PROBE_SIZE : PROBE_SIZE;
+  int i;
+
+  if (!demuxer_probe || stream->type == STREAMTYPE_DS)
+    return NULL;
+  // reading ahead is only harmless if the checks can seek back afterwards
+  if (!(stream->flags & STREAM_SEEK_BW) && !stream->cache_pid)
+    return NULL;
+  p = calloc(1, sizeof(*p));
+  for (i = 0; demuxer_list[i]; i++);
+  p->result = malloc(i);
+  p->data = malloc(size);
+  p->s = calloc(1, sizeof(stream_t));
+  if (!p->result || !p->data || !p->s)
+    goto fail;
+  memset(p->result, -1, i);
+  stream_reset(stream);
+  stream_seek(stream, stream->start_pos);
+  p->len = stream_read(stream, p->data, size);
+  if (p->len <= 0)
+    goto fail;
+  p->eof = p->len < size || stream_eof(stream);
+  // checks may look at the type, the size and the name of the stream
+  p->s->fd = -1;
+  p->s->type = stream->type;
+  p->s->flags = stream->flags;
+  p->s->start_pos = stream->start_pos;
+  p->s->end_pos = stream->end_pos;
+  p->s->url = stream->url;
+  return p;
+
+fail:
+  free(p->result);
+  free(p->data);
+  free(p->s);
+  free(p);
+  return NULL;
+}
+
+static void probe_free(demuxer_probe_t *p) {
+  if (!p)
+    return;
+  free(p->result);
+  free(p->data);
+  free(p->s);
+  free(p);
+}
+
+/// 0 if the check_file of demuxer_list[i] cannot match, 1 if it has to run
+static int probe_check(demuxer_probe_t *p, int i, int audio_id, int video_id,
+                       int dvdsub_id, char *filename) {
+  demuxer_desc_t *desc = demuxer_list[i];
+  demuxer_t *demuxer;
+  stream_t *s;
+  unsigned int t;
+  int fformat, overrun, j;
+  int levels[MSGT_MAX];
+
+  if (!p)
+    return 1;
+  if (p->result[i] >= 0)
+    return p->result[i];
+  // these demuxers check by opening, doing that twice costs more than it saves
+  if (!desc->open)
+    return p->result[i] = 1;
+
+  s = p->s;
+  s->buffer = p->data;
+  s->buffer_size = p->len;
+  s->buf_pos = 0;
+  s->buf_len = p->len;
+  s->pos = s->start_pos + p->len;
+  s->eof = 0;
+  // the messages of a check, -identify output included, come from the
+  // check on the real stream
+  for (j = 0; j < MSGT_MAX; j++) {
+    levels[j] = mp_msg_levels[j];
+    mp_msg_levels[j] = MSGL_FATAL;
+  }
+  t = GetTimer();
+  demuxer = new_demuxer(s, desc->type, audio_id, video_id, dvdsub_id, filename);
+  fformat = desc->check_file(demuxer);
+  free_demuxer(demuxer);
+  t = GetTimer() - t;
+  memcpy(mp_msg_levels, levels, sizeof(levels));
+  // any read or seek past the data empties the buffer for good
+  overrun = s->buf_len != p->len && !p->eof;
+  p->result[i] = fformat != 0 || overrun;
+  mp_msg(MSGT_DEMUXER, MSGL_V, "demuxer: probe %-9s %-8s %6u us\n", desc->name,
+         fformat ? "match" : overrun ? "more data" : "no", t);
+  return p->result[i];
+}
+
 int correct_pts=0;
 
 /*
@@ -675,6 +816,7 @@ demuxer_t *demuxer=NULL;
 sh_video_t *sh_video=NULL;
 
 demuxer_desc_t *demuxer_desc;
+demuxer_probe_t *probe = NULL;
 int fformat;
 int i;
 
@@ -712,8 +854,10 @@ if (file_format) {
 }
 
 // Test demuxers with safe file checks
+probe = probe_new(stream);
 for (i = 0; (demuxer_desc = demuxer_list[i]); i++) {
-  if (demuxer_desc->safe_check) {
+  if (demuxer_desc->safe_check &&
+      probe_check(probe, i, audio_id, video_id, dvdsub_id, filename)) {
     demuxer = new_demuxer(stream,demuxer_desc->type,audio_id,video_id,dvdsub_id,filename);
     if ((fformat = demuxer_desc->check_file(demuxer)) != 0) {
       if (fformat == demuxer_desc->type) {
@@ -725,13 +869,18 @@ for (i = 0; (demuxer_desc = demuxer_list[i]); i++) {
           goto dmx_open;
         }
       } else {
-        if (fformat == DEMUXER_TYPE_PLAYLIST)
+        if (fformat == DEMUXER_TYPE_PLAYLIST) {
+          probe_free(probe);
           return demuxer; // handled in mplayer.c
+        }
         // Format changed after check, recurse
         free_demuxer(demuxer);
         demuxer=demux_open_stream(stream, fformat, force,
                   audio_id, video_id, dvdsub_id, filename);
-        if(demuxer) return demuxer; // done!
+        if(demuxer) {
+          probe_free(probe);
+          return demuxer; // done!
+        }
         file_format = DEMUXER_TYPE_UNKNOWN;
       }
     }
@@ -750,7 +899,10 @@ if(file_format==DEMUXER_TYPE_UNKNOWN && filename && extension_parsing==1){
     // we like recursion :)
     demuxer=demux_open_stream(stream, file_format, force,
               audio_id, video_id, dvdsub_id, filename);
-    if(demuxer) return demuxer; // done!
+    if(demuxer) {
+      probe_free(probe);
+      return demuxer; // done!
+    }
     file_format=DEMUXER_TYPE_UNKNOWN; // continue fuzzy guessing...
     mp_msg(MSGT_DEMUXER,MSGL_V,"demuxer: continue fuzzy content-based format guessing...\n");
   }
@@ -758,7 +910,8 @@ if(file_format==DEMUXER_TYPE_UNKNOWN && filename && extension_parsing==1){
 
 // Try detection for all other demuxers
 for (i = 0; (demuxer_desc = demuxer_list[i]); i++) {
-  if (!demuxer_desc->safe_check && demuxer_desc->check_file) {
+  if (!demuxer_desc->safe_check && demuxer_desc->check_file &&
+      probe_check(probe, i, audio_id, video_id, dvdsub_id, filename)) {
     demuxer = new_demuxer(stream,demuxer_desc->type,audio_id,video_id,dvdsub_id,filename);
     if ((fformat = demuxer_desc->check_file(demuxer)) != 0) {
       if (fformat == demuxer_desc->type) {
@@ -770,13 +923,18 @@ for (i = 0; (demuxer_desc = demuxer_list[i]); i++) {
           goto dmx_open;
         }
       } else {
-        if (fformat == DEMUXER_TYPE_PLAYLIST)
+        if (fformat == DEMUXER_TYPE_PLAYLIST) {
+          probe_free(probe);
           return demuxer; // handled in mplayer.c
+        }
         // Format changed after check, recurse
         free_demuxer(demuxer);
         demuxer=demux_open_stream(stream, fformat, force,
                   audio_id, video_id, dvdsub_id, filename);
-        if(demuxer) return demuxer; // done!
+        if(demuxer) {
+          probe_free(probe);
+          return demuxer; // done!
+        }
         file_format = DEMUXER_TYPE_UNKNOWN;
       }
     }
@@ -785,9 +943,11 @@ for (i = 0; (demuxer_desc = demuxer_list[i]); i++) {
   }
 }
 
+probe_free(probe);
 return NULL;
 //====== File format recognized, set up these for compatibility: =========
 dmx_open:
+probe_free(probe);
 
 demuxer->file_format=file_format;
 
@@ -898,6 +1058,65 @@ demuxer_t* demux_open(stream_t *vs,int file_format,int audio_id,int video_id,int
 }
 
 
+/// drop the packets queued in front of dp, all of them if dp is NULL
+static void ds_drop_packs(demux_stream_t *ds, demux_packet_t *dp){
+  int locked=demux_thread_lock(ds->demuxer);
+  while(ds->first!=dp){
+    demux_packet_t *dn=ds->first->next;
+    --ds->packs;
+    ds->bytes-=ds->first->len;
+    free_demux_packet(ds->first);
+    ds->first=dn;
+  }
+  if(!ds->first) ds->last=NULL;
+  if(locked) demux_thread_unlock(ds->demuxer);
+  if(ds->current) free_demux_packet(ds->current);
+  ds->current=NULL;
+  ds->buffer=NULL;
+  ds->buffer_pos=ds->buffer_size;
+  ds->pts=0; ds->pts_bytes=0;
+}
+
+/**
+ * \brief seek forward inside what the demuxer thread queued ahead
+ *
+ * Drops the packets up to the first video keyframe after the target, or up
+ * to the target without video, as a seek of the demuxer would.
+ * \return 0 if that packet is not queued, nothing is dropped then
+ */
+static int seek_queued(demuxer_t *demuxer, float rel_seek_secs){
+    demux_stream_t *d_audio=demuxer->audio;
+    demux_stream_t *d_video=demuxer->video;
+    demux_packet_t *dv=NULL, *da=NULL, *dp;
+    demux_keyframe_t kf;
+    double pts;
+
+    // the first queued packet with a pts, ds->pts is 0 for most MPEG video
+    dp=d_video->sh ? d_video->first : d_audio->first;
+    while(dp && dp->pts<=0) dp=dp->next;
+    if(!dp)
+      return 0;
+    pts=dp->pts + rel_seek_secs;
+    if(d_video->sh){
+      if(!demuxer_find_keyframe(demuxer, pts, KEYFRAME_AFTER, &kf))
+        return 0;
+      for(dv=d_video->first; dv && fabs(dv->pts - kf.pts) >= 0.001; dv=dv->next) ;
+      if(!dv)
+        return 0;
+      pts=kf.pts;
+    }
+    if(d_audio->sh){
+      // keep the audio packet playing at pts
+      for(da=d_audio->first; da && da->next && da->next->pts <= pts; da=da->next) ;
+      if(!d_video->sh && !(da && da->next))
+        return 0;
+      ds_drop_packs(d_audio, da);
+    }
+    if(d_video->sh)
+      ds_drop_packs(d_video, dv);
+    return 1;
+}
+
 int demux_seek(demuxer_t *demuxer,float rel_seek_secs,float audio_delay,int flags){
     demux_stream_t *d_audio=demuxer->audio;
     demux_stream_t *d_video=demuxer->video;
@@ -905,6 +1124,8 @@ int demux_seek(demuxer_t *demuxer,float rel_seek_secs,float audio_delay,int flag
     sh_video_t *sh_video=d_video->sh;
     double tmp = 0;
     double pts;
+    double ahead;
+    int ahead_bytes;
 
 if(!demuxer->seekable){
     if(demuxer->file_format==DEMUXER_TYPE_AVI)
@@ -918,6 +1139,20 @@ if(!demuxer->seekable){
     return 0;
 }
 
+    demux_thread_pause(demuxer);
+    if(!(flags & 3) && demux_thread_fill(demuxer, &ahead, &ahead_bytes) && ahead > 0) {
+      // the target was read already, a seek back would end before it
+      if(rel_seek_secs > 0 && rel_seek_secs <= ahead && seek_queued(demuxer, rel_seek_secs)) {
+        if(sh_audio){ sh_audio->a_buffer_len=0; resync_audio_stream(sh_audio); }
+        if(sh_video) sh_video->timer=0;
+        demux_thread_resume(demuxer);
+        return 1;
+      }
+      // demuxers seek relative to the last packet they read, which the
+      // thread read ahead, AVI to the chunk the player took last
+      if(demuxer->file_format!=DEMUXER_TYPE_AVI)
+        rel_seek_secs -= ahead;
+    }
     // clear demux buffers:
     if(sh_audio){ ds_free_packs(d_audio);sh_audio->a_buffer_len=0;}
     ds_free_packs(d_video);
@@ -926,6 +1161,13 @@ if(!demuxer->seekable){
     demuxer->video->eof=0;
     demuxer->audio->eof=0;
 
+    if(demuxer->stream->flags & STREAM_GROWING){
+      // let percentage seeks cover what was written since the last time
+      off_t end=demuxer->stream->end_pos;
+      stream_update_size(demuxer->stream);
+      if(demuxer->movi_end==end) demuxer->movi_end=demuxer->stream->end_pos;
+    }
+
 #if 0
     if(sh_audio) sh_audio->timer=sh_video->timer;
 #else
@@ -949,6 +1191,7 @@ if(!demuxer->seekable){
 
     if(stream_control(demuxer->stream, STREAM_CTRL_SEEK_TO_TIME, &pts) != STREAM_UNSUPORTED) {
       demux_control(demuxer, DEMUXER_CTRL_RESYNC, NULL);
+      demux_thread_resume(demuxer);
       return 1;
     }
 
@@ -958,6 +1201,7 @@ if (demuxer->desc->seek)
 
     if (sh_audio) resync_audio_stream(sh_audio);
 
+demux_thread_resume(demuxer);
 return 1;
 }
 
@@ -1019,11 +1263,17 @@ char* demux_info_get(demuxer_t *demuxer, char *opt) {
 }
 
 int demux_control(demuxer_t *demuxer, int cmd, void *arg) {
+    int ret;
 
-    if (demuxer->desc->control)
+    if (!demuxer->desc->control)
+      return DEMUXER_CTRL_NOTIMPL;
+    // these only read what the demuxer keeps, the others may read the stream
+    if (cmd == DEMUXER_CTRL_GET_TIME_LENGTH || cmd == DEMUXER_CTRL_GET_PERCENT_POS)
       return demuxer->desc->control(demuxer,cmd,arg);
-
-    return DEMUXER_CTRL_NOTIMPL;
+    demux_thread_pause(demuxer);
+    ret = demuxer->desc->control(demuxer,cmd,arg);
+    demux_thread_resume(demuxer);
+    return ret;
 }
 
 
@@ -1114,12 +1364,14 @@ int demuxer_add_chapter(demuxer_t* demuxer, const char* name, uint64_t start, ui
  * \return -1 on error, current chapter if successful
  */
 
-int demuxer_seek_chapter(demuxer_t *demuxer, int chapter, int mode, float *seek_pts, int *num_chapters, char **chapter_name) {
+static int seek_chapter(demuxer_t *demuxer, int chapter, int mode, float *seek_pts, int *num_chapters, char **chapter_name) {
     int ris;
     int current, total;
     sh_video_t *sh_video = demuxer->video->sh;
     sh_audio_t *sh_audio = demuxer->audio->sh;
 
+    if (!demuxer->chapters)
+        demux_control(demuxer, DEMUXER_CTRL_LOAD_CHAPTERS, NULL);
     if (!demuxer->num_chapters || !demuxer->chapters) {
         if(!mode) {
             ris = stream_control(demuxer->stream, STREAM_CTRL_GET_CURRENT_CHAPTER, &current);
@@ -1202,3 +1454,109 @@ int demuxer_seek_chapter(demuxer_t *demuxer, int chapter, int mode, float *seek_
         return current;
     }
 }
+
+int demuxer_seek_chapter(demuxer_t *demuxer, int chapter, int mode, float *seek_pts, int *num_chapters, char **chapter_name) {
+    int ret;
+    demux_thread_pause(demuxer);
+    ret = seek_chapter(demuxer, chapter, mode, seek_pts, num_chapters, chapter_name);
+    demux_thread_resume(demuxer);
+    return ret;
+}
+
+/**
+ * \brief add a video keyframe to demuxer->keyframes, which is kept sorted
+ * \param pts presentation time of the keyframe in seconds
+ * \param pos file position to seek to for it, -1 if unknown
+ *
+ * Demuxers call this while reading their index and while playing, so a
+ * keyframe that is already known (within 1 ms) is ignored.
+ */
+void demuxer_add_keyframe(demuxer_t *demuxer, double pts, off_t pos) {
+    demux_keyframe_t *kf = demuxer->keyframes;
+    int n = demuxer->num_keyframes;
+    int lo = 0, hi = n;
+
+    if (pts < 0 || pts == MP_NOPTS_VALUE)
+        return;
+    // usually keyframes come in order, appending needs no search
+    if (n && pts < kf[n-1].pts + 0.001) {
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (kf[mid].pts < pts) lo = mid + 1;
+            else hi = mid;
+        }
+        if (lo > 0 && pts - kf[lo-1].pts < 0.001)
+            lo--;
+        if (lo < n && kf[lo].pts - pts < 0.001) {
+            if (kf[lo].pos < 0)
+                kf[lo].pos = pos;
+            return;
+        }
+    } else
+        lo = n;
+
+    if (n == demuxer->keyframes_alloc) {
+        int alloc = demuxer->keyframes_alloc ? 2 * demuxer->keyframes_alloc : 256;
+        kf = realloc(demuxer->keyframes, alloc * sizeof(*kf));
+        if (!kf)
+            return;
+        demuxer->keyframes = kf;
+        demuxer->keyframes_alloc = alloc;
+    }
+    if (lo < n)
+        memmove(kf + lo + 1, kf + lo, (n - lo) * sizeof(*kf));
+    kf[lo].pts = pts;
+    kf[lo].pos = pos;
+    demuxer->num_keyframes++;
+}
+
+/**
+ * \brief find the video keyframe next to pts
+ * \param dir KEYFRAME_BEFORE, KEYFRAME_AFTER or KEYFRAME_NEAREST
+ * \param kf set to the keyframe found
+ * \return 1 if one was found, 0 if the demuxer knows no keyframes there
+ *
+ * Demuxers that can look up their own index answer DEMUXER_CTRL_GET_KEYFRAME,
+ * the others are served from demuxer->keyframes.
+ */
+static int find_keyframe(demuxer_t *demuxer, double pts, int dir, demux_keyframe_t *kf) {
+    demux_keyframe_query_t q;
+    demux_keyframe_t *k = demuxer->keyframes;
+    int n = demuxer->num_keyframes;
+    int lo = 0, hi = n;
+
+    q.pts = pts;
+    q.dir = dir;
+    if (demux_control(demuxer, DEMUXER_CTRL_GET_KEYFRAME, &q) == DEMUXER_CTRL_OK) {
+        *kf = q.kf;
+        return 1;
+    }
+    if (!n)
+        return 0;
+    // k[lo] is the first keyframe after pts, k[lo-1] the last one at or before it
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (k[mid].pts <= pts) lo = mid + 1;
+        else hi = mid;
+    }
+    if (dir == KEYFRAME_NEAREST)
+        dir = lo == n || (lo > 0 && pts - k[lo-1].pts <= k[lo].pts - pts) ?
+              KEYFRAME_BEFORE : KEYFRAME_AFTER;
+    if (dir == KEYFRAME_BEFORE || (lo > 0 && k[lo-1].pts == pts)) {
+        if (lo == 0)
+            return 0;
+        lo--;
+    } else if (lo == n)
+        return 0;
+    *kf = k[lo];
+    return 1;
+}
+
+int demuxer_find_keyframe(demuxer_t *demuxer, double pts, int dir, demux_keyframe_t *kf) {
+    int ret;
+    // the demuxer thread adds to demuxer->keyframes
+    demux_thread_pause(demuxer);
+    ret = find_keyframe(demuxer, pts, dir, kf);
+    demux_thread_resume(demuxer);
+    return ret;
+}
@@ -80,6 +80,8 @@
 #define DEMUXER_CTRL_RESYNC 13
 #define DEMUXER_CTRL_SWITCH_VIDEO 14
 #define DEMUXER_CTRL_IDENTIFY_PROGRAM 15
+#define DEMUXER_CTRL_LOAD_CHAPTERS 16  // read chapters left for when they are needed
+#define DEMUXER_CTRL_GET_KEYFRAME 17   // demux_keyframe_query_t
 
 // Holds one packet/frame/whatever
 typedef struct demux_packet_st {
@@ -93,6 +95,10 @@ typedef struct demux_packet_st {
   int refcount;   //refcounter for the master packet, if 0, buffer can be free()d
   struct demux_packet_st* master; //pointer to the master packet if this one is a cloned one
   struct demux_packet_st* next;
+  // releases a buffer that is not ours to free(), e.g. a capture driver's
+  // buffer handed out without copying; such packets must not be resized
+  void (*free_buffer)(void *ctx, unsigned char *buffer);
+  void *free_buffer_ctx;
 } demux_packet_t;
 
 typedef struct {
@@ -172,6 +178,24 @@ typedef struct demux_chapter_s
   char* name;
 } demux_chapter_t;
 
+typedef struct demux_keyframe_s
+{
+  double pts;   ///< presentation time in seconds
+  off_t pos;    ///< file position of the frame or its cluster, -1 if unknown
+} demux_keyframe_t;
+
+#define KEYFRAME_BEFORE  1 ///< the last keyframe at or before pts
+#define KEYFRAME_AFTER   2 ///< the first keyframe at or after pts
+#define KEYFRAME_NEAREST 3
+
+/// argument of DEMUXER_CTRL_GET_KEYFRAME
+typedef struct demux_keyframe_query_s
+{
+  double pts;
+  int dir;              ///< KEYFRAME_BEFORE, KEYFRAME_AFTER or KEYFRAME_NEAREST
+  demux_keyframe_t kf;  ///< the keyframe found
+} demux_keyframe_query_t;
+
 typedef struct demuxer_st {
   demuxer_desc_t *desc;  ///< Demuxer description structure
   off_t filepos; // input stream current pos.
@@ -196,6 +220,13 @@ typedef struct demuxer_st {
 
   demux_chapter_t* chapters;
   int num_chapters;
+
+  /// video keyframes by pts, from the index of the file or found while playing
+  demux_keyframe_t* keyframes;
+  int num_keyframes, keyframes_alloc;
+
+  /// reads ahead in a thread of its own with -demuxer-thread, see demux_thread.h
+  struct demux_thread_s* thread;
   
   void* priv;  // fileformat-dependent data
   char** info;
@@ -220,6 +251,7 @@ inline static demux_packet_t* new_demux_packet(int len){
   dp->refcount=1;
   dp->master=NULL;
   dp->buffer=NULL;
+  dp->free_buffer=NULL;
   if (len > 0 && (dp->buffer = (unsigned char *)malloc(len + 8)))
     memset(dp->buffer + len, 0, 8);
   else
@@ -260,7 +292,8 @@ inline static void free_demux_packet(demux_packet_t* dp){
   if (dp->master==NULL){  //dp is a master packet
     dp->refcount--;
     if (dp->refcount==0){
-      if (dp->buffer) free(dp->buffer);
+      if (dp->free_buffer) dp->free_buffer(dp->free_buffer_ctx, dp->buffer);
+      else if (dp->buffer) free(dp->buffer);
       free(dp);
     }
     return;
@@ -358,6 +391,11 @@ extern int force_ni;
 extern int pts_from_bps;
 
 extern int extension_parsing;
+/// run the format checks on the start of the file in memory first
+extern int demuxer_probe;
+/// the stream is watched as it comes in: probe as little as possible and
+/// start the video at its first keyframe
+extern int demuxer_live;
 
 int demux_info_add(demuxer_t *demuxer, const char *opt, const char *param);
 char* demux_info_get(demuxer_t *demuxer, char *opt);
@@ -387,3 +425,6 @@ extern int get_demuxer_type_from_name(char *demuxer_name, int *force);
 int demuxer_add_chapter(demuxer_t* demuxer, const char* name, uint64_t start, uint64_t end);
 int demuxer_seek_chapter(demuxer_t *demuxer, int chapter, int mode, float *seek_pts, int *num_chapters, char **chapter_name);
 
+void demuxer_add_keyframe(demuxer_t *demuxer, double pts, off_t pos);
+int demuxer_find_keyframe(demuxer_t *demuxer, double pts, int dir, demux_keyframe_t *kf);
+
@@ -0,0 +1,439 @@
+/*
+ * Background cluster index for Matroska files without Cues.
+ *
+ * Without Cues the Matroska demuxer only knows the clusters it has read,
+ * a seek further into the file has to walk all the clusters up to the
+ * target. Here a thread walks the file from the first cluster and notes
+ * the position and timecode of each cluster. Only the element headers are
+ * read, the block data in between is skipped with the EBML sizes, so the
+ * whole file is indexed in a fraction of the time it takes to read it.
+ * The thread runs at idle priority on a file descriptor of its own.
+ *
+ * Clusters of unknown size, as written by live muxers, are walked
+ * element by element up to the next top level element.
+ *
+ * The finished index can be kept in a file next to the media file, it is
+ * used as long as size and modification time of the media file match.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _GNU_SOURCE /* SCHED_IDLE */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#endif
+
+#include "mp_msg.h"
+#include "osdep/timer.h"
+#include "stream/stream.h"
+#include "ebml.h"
+#include "mkv_cluster_index.h"
+
+int mkv_cluster_index_enabled = 1;
+int mkv_cluster_index_cache = 0;
+
+#define CACHE_MAGIC "MPMKV1"
+#define HEADER_LEN 12 /* longest ID and size */
+
+typedef struct {
+  off_t pos;
+  uint64_t timecode;
+} cluster_entry_t;
+
+struct mkv_cluster_index_s {
+  int fd;
+  off_t first_cluster;
+  off_t end;
+  struct stat st;              /* of the media file */
+  char *cache_name;
+
+  cluster_entry_t *entries;
+  int num_entries;
+  int done;                    /* the thread is through, complete or not */
+  int complete;                /* the index covers the whole file */
+  int loaded;                  /* read from the cache file */
+  int quit;
+  int waiting;                 /* the demuxer waits on cond */
+#ifdef HAVE_PTHREADS
+  int threaded;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+#endif
+
+  /* statistics */
+  unsigned int headers;        /* element headers read */
+  unsigned int scan_time, wait_time; /* ms */
+};
+
+/// read up to len bytes at pos, the rest of buf is cleared
+static int read_at(mkv_cluster_index_t *ci, off_t pos, uint8_t *buf, int len) {
+  int got = 0;
+  while (got < len) {
+    ssize_t r = pread(ci->fd, buf + got, len - got, pos + got);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      break;
+    got += r;
+  }
+  memset(buf + got, 0, len - got);
+  return got;
+}
+
+/**
+ * \brief read the element header at pos
+ * \param size content size, EBML_UINT_INVALID if unknown
+ * \return header length, 0 if there is no valid header
+ */
+static int read_header(mkv_cluster_index_t *ci, off_t pos, uint32_t *id, uint64_t *size) {
+  uint8_t buf[HEADER_LEN];
+  int i, il, sl, len_mask = 0x80;
+
+  ci->headers++;
+  if (read_at(ci, pos, buf, HEADER_LEN) < 2)
+    return 0;
+  for (i = 0; i < 4 && !(buf[0] & len_mask); i++)
+    len_mask >>= 1;
+  if (i >= 4 || !buf[i + 1])
+    return 0;
+  il = i + 1;
+  for (*id = 0, i = 0; i < il; i++)
+    *id = (*id << 8) | buf[i];
+  *size = ebml_read_vlen_uint(buf + il, &sl);
+  return il + sl;
+}
+
+static int is_top_level(uint32_t id) {
+  switch (id) {
+  case MATROSKA_ID_CLUSTER:
+  case MATROSKA_ID_CUES:
+  case MATROSKA_ID_TAGS:
+  case MATROSKA_ID_SEEKHEAD:
+  case MATROSKA_ID_CHAPTERS:
+  case MATROSKA_ID_ATTACHMENTS:
+  case MATROSKA_ID_INFO:
+  case MATROSKA_ID_TRACKS:
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * \brief look for the timecode of the cluster with content at pos
+ * \param size content size, EBML_UINT_INVALID if unknown
+ * \param next set to the position of the element after the cluster
+ * \return 1 if the timecode was found
+ */
+static int scan_cluster(mkv_cluster_index_t *ci, off_t pos, uint64_t size,
+                        uint64_t *timecode, off_t *next) {
+  off_t end = size == EBML_UINT_INVALID ? ci->end : pos + (off_t)size;
+  int found = 0;
+
+  *next = end;
+  while (pos < end && !ci->quit) {
+    uint32_t id;
+    uint64_t len;
+    int hl = read_header(ci, pos, &id, &len);
+    if (!hl)
+      break;
+    if (size == EBML_UINT_INVALID && is_top_level(id)) {
+      *next = pos;
+      break;
+    }
+    if (id == MATROSKA_ID_CLUSTERTIMECODE && len <= 8) {
+      uint8_t buf[8];
+      int i;
+      read_at(ci, pos + hl, buf, len);
+      for (*timecode = 0, i = 0; i < (int)len; i++)
+        *timecode = (*timecode << 8) | buf[i];
+      found = 1;
+      // the rest of a cluster of known size does not matter
+      if (size != EBML_UINT_INVALID)
+        break;
+    }
+    if (len == EBML_UINT_INVALID)
+      break;
+    pos += hl + len;
+  }
+  return found;
+}
+
+#ifdef HAVE_PTHREADS
+
+/// \return 0 if there is no memory for the entry
+static int add_entry(mkv_cluster_index_t *ci, off_t pos, uint64_t timecode) {
+  pthread_mutex_lock(&ci->lock);
+  if (!(ci->num_entries & 1023)) {
+    cluster_entry_t *e = realloc(ci->entries, (ci->num_entries + 1024) * sizeof(cluster_entry_t));
+    if (!e) {
+      pthread_mutex_unlock(&ci->lock);
+      return 0;
+    }
+    ci->entries = e;
+  }
+  ci->entries[ci->num_entries].pos = pos;
+  ci->entries[ci->num_entries].timecode = timecode;
+  ci->num_entries++;
+  if (ci->waiting)
+    pthread_cond_broadcast(&ci->cond);
+  pthread_mutex_unlock(&ci->lock);
+  return 1;
+}
+
+static void *index_thread(void *arg) {
+  mkv_cluster_index_t *ci = arg;
+  off_t pos = ci->first_cluster;
+  unsigned int start = GetTimerMS();
+#ifdef SCHED_IDLE
+  struct sched_param param = {0};
+  pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+
+  while (pos < ci->end && !ci->quit) {
+    uint32_t id;
+    uint64_t size, timecode;
+    off_t next;
+    int hl = read_header(ci, pos, &id, &size);
+    if (!hl)
+      break;
+    if (id == MATROSKA_ID_CLUSTER) {
+      // out of memory, pos < ci->end leaves the index incomplete
+      if (scan_cluster(ci, pos + hl, size, &timecode, &next) &&
+          !add_entry(ci, pos, timecode))
+        break;
+      if (next <= pos)
+        break;
+      pos = next;
+    } else {
+      if (size == EBML_UINT_INVALID)
+        break;
+      pos += hl + size;
+    }
+  }
+
+  pthread_mutex_lock(&ci->lock);
+  ci->complete = pos >= ci->end;
+  ci->done = 1;
+  ci->scan_time = GetTimerMS() - start;
+  pthread_cond_broadcast(&ci->cond);
+  pthread_mutex_unlock(&ci->lock);
+  return NULL;
+}
+
+static int start_thread(mkv_cluster_index_t *ci) {
+  sigset_t sigs, oldsigs;
+  int err;
+
+  pthread_mutex_init(&ci->lock, NULL);
+  pthread_cond_init(&ci->cond, NULL);
+  /* signals must go to the player, which cleans up on them */
+  sigfillset(&sigs);
+  pthread_sigmask(SIG_SETMASK, &sigs, &oldsigs);
+  err = pthread_create(&ci->thread, NULL, index_thread, ci);
+  pthread_sigmask(SIG_SETMASK, &oldsigs, NULL);
+  if (err) {
+    pthread_cond_destroy(&ci->cond);
+    pthread_mutex_destroy(&ci->lock);
+    mp_msg(MSGT_DEMUX, MSGL_V, "[mkv] Cannot start the cluster index thread\n");
+    return 0;
+  }
+  return 1;
+}
+
+#endif /* HAVE_PTHREADS */
+
+static int load_cache(mkv_cluster_index_t *ci) {
+  FILE *fp = fopen(ci->cache_name, "rb");
+  char magic[6];
+  int64_t hdr[3];
+  int32_t n;
+  struct stat st;
+
+  if (!fp)
+    return 0;
+  if (fread(magic, 6, 1, fp) != 1 || memcmp(magic, CACHE_MAGIC, 6) ||
+      fread(hdr, sizeof(hdr), 1, fp) != 1 || fread(&n, sizeof(n), 1, fp) != 1 ||
+      hdr[0] != (int64_t)ci->st.st_size || hdr[1] != (int64_t)ci->st.st_mtime ||
+      hdr[2] != (int64_t)ci->first_cluster || n <= 0)
+    goto fail;
+  // no more entries than the file holds, which also keeps the size in range
+  if (fstat(fileno(fp), &st) ||
+      n > (st.st_size - 6 - (off_t)sizeof(hdr) - (off_t)sizeof(n)) / (off_t)sizeof(cluster_entry_t))
+    goto fail;
+  ci->entries = malloc(n * sizeof(cluster_entry_t));
+  if (!ci->entries || fread(ci->entries, sizeof(cluster_entry_t), n, fp) != (size_t)n)
+    goto fail;
+  fclose(fp);
+  ci->num_entries = n;
+  ci->done = ci->complete = ci->loaded = 1;
+  mp_msg(MSGT_DEMUX, MSGL_V, "[mkv] %d clusters from %s\n", n, ci->cache_name);
+  return 1;
+
+fail:
+  mp_msg(MSGT_DEMUX, MSGL_V, "[mkv] %s does not belong to this file\n", ci->cache_name);
+  free(ci->entries);
+  ci->entries = NULL;
+  fclose(fp);
+  return 0;
+}
+
+static void save_cache(mkv_cluster_index_t *ci) {
+  FILE *fp = fopen(ci->cache_name, "wb");
+  int64_t hdr[3];
+  int32_t n = ci->num_entries;
+
+  if (!fp) {
+    mp_msg(MSGT_DEMUX, MSGL_V, "[mkv] Cannot write %s: %s\n", ci->cache_name, strerror(errno));
+    return;
+  }
+  hdr[0] = ci->st.st_size;
+  hdr[1] = ci->st.st_mtime;
+  hdr[2] = ci->first_cluster;
+  fwrite(CACHE_MAGIC, 6, 1, fp);
+  fwrite(hdr, sizeof(hdr), 1, fp);
+  fwrite(&n, sizeof(n), 1, fp);
+  fwrite(ci->entries, sizeof(cluster_entry_t), n, fp);
+  if (fclose(fp))
+    unlink(ci->cache_name);
+  else
+    mp_msg(MSGT_DEMUX, MSGL_V, "[mkv] Cluster index saved to %s\n", ci->cache_name);
+}
+
+mkv_cluster_index_t *mkv_cluster_index_new(stream_t *s, off_t first_cluster) {
+  mkv_cluster_index_t *ci;
+  const char *name = s->url;
+  struct stat st;
+
+  if (!mkv_cluster_index_enabled || s->type != STREAMTYPE_FILE || s->fd < 0 ||
+      !name || !s->end_pos)
+    return NULL;
+  if (!strncmp(name, "file://", 7))
+    name += 7;
+  ci = calloc(1, sizeof(*ci));
+  if (!ci)
+    return NULL;
+  // a descriptor of our own, pread() on the demuxer's would upset its read-ahead
+  ci->fd = open(name, O_RDONLY);
+  if (ci->fd < 0 || fstat(ci->fd, &ci->st) || fstat(s->fd, &st) ||
+      st.st_dev != ci->st.st_dev || st.st_ino != ci->st.st_ino)
+    goto fail;
+  ci->first_cluster = first_cluster;
+  ci->end = s->end_pos;
+  ci->cache_name = malloc(strlen(name) + 8);
+  if (!ci->cache_name)
+    goto fail;
+  sprintf(ci->cache_name, "%s.mkvidx", name);
+
+  if (mkv_cluster_index_cache && load_cache(ci)) {
+    close(ci->fd);
+    ci->fd = -1;
+    return ci;
+  }
+#ifdef HAVE_PTHREADS
+  ci->threaded = start_thread(ci);
+  if (ci->threaded) {
+    mp_msg(MSGT_DEMUX, MSGL_V, "[mkv] No cues, indexing the clusters in the background\n");
+    return ci;
+  }
+#endif
+
+fail:
+  if (ci->fd >= 0)
+    close(ci->fd);
+  free(ci->cache_name);
+  free(ci);
+  return NULL;
+}
+
+int mkv_cluster_index_find(mkv_cluster_index_t *ci, uint64_t timecode, off_t *pos) {
+  int lo = 0, hi, found = 0;
+
+#ifdef HAVE_PTHREADS
+  if (ci->threaded) {
+    unsigned int start = GetTimerMS();
+    pthread_mutex_lock(&ci->lock);
+    while (!ci->done && (!ci->num_entries ||
+                         ci->entries[ci->num_entries - 1].timecode <= timecode)) {
+      ci->waiting = 1;
+      pthread_cond_wait(&ci->cond, &ci->lock);
+    }
+    ci->waiting = 0;
+    ci->wait_time += GetTimerMS() - start;
+  }
+#endif
+  hi = ci->num_entries;
+  *pos = -1;
+  if (hi && !ci->complete && ci->entries[hi - 1].timecode <= timecode) {
+    *pos = ci->entries[hi - 1].pos;
+  } else if (hi) {
+    // last entry with a timecode <= timecode, the first if there is none
+    while (hi - lo > 1) {
+      int mid = (lo + hi) / 2;
+      if (ci->entries[mid].timecode <= timecode)
+        lo = mid;
+      else
+        hi = mid;
+    }
+    *pos = ci->entries[lo].pos;
+    found = 1;
+  }
+#ifdef HAVE_PTHREADS
+  if (ci->threaded)
+    pthread_mutex_unlock(&ci->lock);
+#endif
+  return found;
+}
+
+void mkv_cluster_index_free(mkv_cluster_index_t *ci) {
+  if (!ci)
+    return;
+#ifdef HAVE_PTHREADS
+  if (ci->threaded) {
+    // do not wait for the scan, an incomplete index is just not cached
+    ci->quit = 1;
+    pthread_join(ci->thread, NULL);
+    pthread_cond_destroy(&ci->cond);
+    pthread_mutex_destroy(&ci->lock);
+  }
+#endif
+  if (!ci->loaded)
+    mp_msg(MSGT_DEMUX, MSGL_V,
+           "[mkv] Indexed %d clusters%s, %u headers read in %u ms, %u ms waiting for the index\n",
+           ci->num_entries, ci->complete ? "" : " (incomplete)",
+           ci->headers, ci->scan_time, ci->wait_time);
+  if (mkv_cluster_index_cache && ci->complete && !ci->loaded && ci->num_entries)
+    save_cache(ci);
+  if (ci->fd >= 0)
+    close(ci->fd);
+  free(ci->entries);
+  free(ci->cache_name);
+  free(ci);
+}
@@ -0,0 +1,39 @@
+#ifndef MKV_CLUSTER_INDEX_H
+#define MKV_CLUSTER_INDEX_H
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include "stream/stream.h"
+
+/// index the clusters of files without Cues in the background
+extern int mkv_cluster_index_enabled;
+/// keep the index in <file>.mkvidx for the next time
+extern int mkv_cluster_index_cache;
+
+typedef struct mkv_cluster_index_s mkv_cluster_index_t;
+
+/**
+ * \brief start indexing the clusters of the file behind s
+ * \param first_cluster file position of the first cluster
+ * \return NULL if disabled or s is not a local file
+ *
+ * A thread of its own reads only the element headers through a file
+ * descriptor of its own, so it does not disturb the reads of the demuxer.
+ */
+mkv_cluster_index_t *mkv_cluster_index_new(stream_t *s, off_t first_cluster);
+
+/**
+ * \brief find the last cluster that starts at or before timecode
+ * \param timecode cluster timecode, in units of the TimecodeScale
+ * \param pos the file position of the cluster, or if 0 is returned that of
+ *            the last cluster indexed, -1 if there is none
+ * \return 1 if the cluster was found, 0 if the index stopped before it
+ *
+ * Waits for the thread while it has not got that far into the file yet.
+ */
+int mkv_cluster_index_find(mkv_cluster_index_t *ci, uint64_t timecode, off_t *pos);
+
+void mkv_cluster_index_free(mkv_cluster_index_t *ci);
+
+#endif /* MKV_CLUSTER_INDEX_H */
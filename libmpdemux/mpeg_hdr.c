@@ -397,6 +397,54 @@ int h264_parse_sps(mp_mpeg_header_t * picture, unsigned char * buf, int len)
   return n;
 }
 
+// next byte of a NAL unit without the emulation prevention bytes, -1 at the end
+static int nal_byte(unsigned char *buf, int len, int *i, int *zeros)
+{
+  int c;
+
+  if(*i >= len)
+    return -1;
+  c = buf[(*i)++];
+  if(*zeros >= 2 && c == 3)
+  {
+    *zeros = 0;
+    if(*i >= len)
+      return -1;
+    c = buf[(*i)++];
+  }
+  *zeros = c ? 0 : *zeros + 1;
+  return c;
+}
+
+// whether one of the messages of a SEI NAL unit is a recovery point,
+// buffering periods and the like may come before it
+int h264_sei_recovery_point(unsigned char * buf, int len)
+{
+  int i = 0, zeros = 0;
+
+  // up to the rbsp trailing bits
+  while(i < len && buf[i] != 0x80)
+  {
+    int type = 0, size = 0, c;
+    do {
+      if((c = nal_byte(buf, len, &i, &zeros)) < 0)
+        return 0;
+      type += c;
+    } while(c == 0xFF);
+    do {
+      if((c = nal_byte(buf, len, &i, &zeros)) < 0)
+        return 0;
+      size += c;
+    } while(c == 0xFF);
+    if(type == 6)
+      return 1;
+    while(size-- > 0)
+      if(nal_byte(buf, len, &i, &zeros) < 0)
+        return 0;
+  }
+  return 0;
+}
+
 static int mp_unescape03(unsigned char *buf, int len)
 {
   unsigned char *dest;
@@ -42,6 +42,24 @@ static mp_mpeg_header_t picture;
 static int telecine=0;
 static float telecine_cnt=-2.5;
 
+// -live: drop the MPEG-1/2 and H.264 frames before the first keyframe,
+// the decoder cannot show anything sensible for them
+static int keyframe_wait=0;
+static int keyframe_dropped=0;
+// but not for longer than this, some streams have no keyframes at all
+#define KEYFRAME_WAIT_SECS 5
+
+// drop another frame while waiting for the first keyframe?
+static int keyframe_drop(sh_video_t *sh_video){
+  float fps = sh_video->fps > 0 ? sh_video->fps : 25;
+  if(keyframe_dropped >= KEYFRAME_WAIT_SECS * fps){
+    mp_msg(MSGT_DECVIDEO,MSGL_V,"No keyframe in %d frames, decoding without one.\n",keyframe_dropped);
+    return 0;
+  }
+  keyframe_dropped++;
+  return 1;
+}
+
 int video_read_properties(sh_video_t *sh_video){
 demux_stream_t *d_video=sh_video->ds;
 
@@ -79,7 +97,10 @@ if((d_video->demuxer->file_format == DEMUXER_TYPE_PVA) ||
     video_codec = VIDEO_VC1;
   else
     video_codec = VIDEO_OTHER;
-    
+
+  keyframe_wait = demuxer_live && (video_codec == VIDEO_MPEG12 || video_codec == VIDEO_H264);
+  keyframe_dropped = 0;
+
 // Determine image properties:
 switch(video_codec){
  case VIDEO_OTHER: {
@@ -408,7 +429,9 @@ int video_read_frame(sh_video_t* sh_video,float* frame_time_ptr,unsigned char**
     float pts1=d_video->pts;
     float pts=0;
     int picture_coding_type=0;
+    off_t picture_pos=-1;
     int in_size=0;
+    int first_keyframe;
     
     *start=NULL;
 
@@ -426,6 +449,7 @@ int video_read_frame(sh_video_t* sh_video,float* frame_time_ptr,unsigned char**
         int in_frame=0;
         //float newfps;
         //videobuf_len=0;
+read_mpeg12_frame:
         while(videobuf_len<VIDEOBUFFER_SIZE-MAX_VIDEO_PACKET_SIZE){
           int i=sync_video_packet(d_video);
 	  //void* buffer=&videobuffer[videobuf_len+4];
@@ -439,6 +463,7 @@ int video_read_frame(sh_video_t* sh_video,float* frame_time_ptr,unsigned char**
 	    if(i==0x100){
 		pts=d_video->pts;
 		d_video->pts=0;
+		picture_pos=d_video->pos;
 	    }
             if(i>=0x101 && i<0x1B0) in_frame=1; // picture startcode
             else if(!i) return -1; // EOF
@@ -455,6 +480,17 @@ int video_read_frame(sh_video_t* sh_video,float* frame_time_ptr,unsigned char**
 
 	*start=videobuffer; in_size=videobuf_len;
 
+	if(keyframe_wait && picture_coding_type!=1 && keyframe_drop(sh_video)){
+	    videobuf_len=0;
+	    in_frame=0;
+	    pts=0;
+	    goto read_mpeg12_frame;
+	}
+
+	// I-frames with a pts of their own, these streams have no index
+	if(picture_coding_type==1 && pts)
+	    demuxer_add_keyframe(demuxer,pts,picture_pos);
+
 #if 1
     // get mpeg fps:
     if(sh_video->fps!=picture.fps) if(!force_fps && !telecine){
@@ -503,11 +539,17 @@ int video_read_frame(sh_video_t* sh_video,float* frame_time_ptr,unsigned char**
             ((demuxer->file_format==DEMUXER_TYPE_MPEG_PS) && (sh_video->format==0x10000005))
   ){
         int in_picture = 0;
+        int random_access = 0;
+read_h264_frame:
         while(videobuf_len<VIDEOBUFFER_SIZE-MAX_VIDEO_PACKET_SIZE){
           int i=sync_video_packet(d_video);
           int pos = videobuf_len+4;
           if(!i) return -1;
           if(!read_video_packet(d_video)) return -1; // EOF
+          // IDR slice, or SEI with a recovery point
+          if((i&~0x60) == 0x105 || ((i&~0x60) == 0x106 && keyframe_wait &&
+             h264_sei_recovery_point(&videobuffer[pos], videobuf_len - pos)))
+            random_access = 1;
           if((i&~0x60) == 0x107 && i != 0x107) {
             h264_parse_sps(&picture, &(videobuffer[pos]), videobuf_len - pos);
             if(picture.fps > 0) {
@@ -540,6 +582,11 @@ int video_read_frame(sh_video_t* sh_video,float* frame_time_ptr,unsigned char**
             }
           }
         }
+	if(keyframe_wait && !random_access && keyframe_drop(sh_video)){
+	    videobuf_len=0;
+	    in_picture=0;
+	    goto read_h264_frame;
+	}
 	*start=videobuffer; in_size=videobuf_len;
 	videobuf_len=0;
 
@@ -562,6 +609,12 @@ int video_read_frame(sh_video_t* sh_video,float* frame_time_ptr,unsigned char**
 
 //------------------------ frame decoded. --------------------
 
+    first_keyframe=keyframe_wait;
+    if(keyframe_wait){
+	mp_msg(MSGT_DECVIDEO,MSGL_V,"Dropped %d frames before the first keyframe.\n",keyframe_dropped);
+	keyframe_wait=0;
+    }
+
     // Increase video timers:
     sh_video->num_frames+=frame_time;
     ++sh_video->num_frames_decoded;
@@ -637,6 +690,8 @@ int video_read_frame(sh_video_t* sh_video,float* frame_time_ptr,unsigned char**
 		}
 	    }
 	}
+	// nothing comes before the frame the stream was joined at
+	if(first_keyframe && pts) sh_video->pts=pts;
     } else
 	sh_video->pts=d_video->pts;
     
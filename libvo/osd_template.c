@@ -29,6 +29,64 @@
 
 static inline void RENAME(vo_draw_alpha_yv12)(int w,int h, unsigned char* src, unsigned char *srca, int srcstride, unsigned char* dstbase,int dststride){
     int y;
+#ifdef HAVE_SSE2
+    // 16 pixels per step, pixels with zero alpha are left untouched and the
+    // remaining (w&15) pixels are done in C so we never write beyond w
+    for(y=0;y<h;y++){
+        long x=0;
+        long w16=w&~15;
+        if(w16) asm volatile(
+		"pcmpeqb %%xmm7, %%xmm7\n\t" // F..F
+		"movdqa %%xmm7, %%xmm4\n\t"
+		"movdqa %%xmm7, %%xmm5\n\t"
+		"psrlw $8, %%xmm4\n\t"	//00FF00FF00FF
+		"psllw $8, %%xmm5\n\t"	//FF00FF00FF00
+		"pxor %%xmm6, %%xmm6\n\t"
+		"1:\n\t"
+		"movdqu	(%1,%0), %%xmm2\n\t"	//srca
+		"movdqa	%%xmm2, %%xmm3\n\t"
+		"pcmpeqb %%xmm6, %%xmm3\n\t"
+		"pmovmskb %%xmm3, %%eax\n\t"
+		"cmpl $0xFFFF, %%eax\n\t"
+		" je 2f\n\t"
+		"movdqu	(%3,%0), %%xmm0\n\t"	//dstbase
+		"movdqa	%%xmm0, %%xmm1\n\t"
+		"pand %%xmm4, %%xmm0\n\t"	//0Y0Y0Y0Y
+		"psrlw $8, %%xmm1\n\t"	//0Y0Y0Y0Y
+		"paddb	%%xmm7, %%xmm2\n\t"
+		"movdqa %%xmm2, %%xmm3\n\t"
+		"pand %%xmm4, %%xmm2\n\t"	//0G0E0C0A
+		"psrlw $8, %%xmm3\n\t"	//0H0F0D0B
+		"pmullw	%%xmm2, %%xmm0\n\t"
+		"pmullw	%%xmm3, %%xmm1\n\t"
+		"psrlw	$8, %%xmm0\n\t"
+		"pand %%xmm5, %%xmm1\n\t"
+		"por %%xmm1, %%xmm0\n\t"
+		"movdqu	(%2,%0), %%xmm2\n\t"	//src
+		"paddb	%%xmm2, %%xmm0\n\t"
+		"movdqu	(%1,%0), %%xmm2\n\t"	//keep dst where srca==0
+		"pcmpeqb %%xmm6, %%xmm2\n\t"
+		"movdqu	(%3,%0), %%xmm1\n\t"
+		"pand %%xmm2, %%xmm1\n\t"
+		"pandn %%xmm0, %%xmm2\n\t"
+		"por %%xmm1, %%xmm2\n\t"
+		"movdqu	%%xmm2, (%3,%0)\n\t"
+		"2:\n\t"
+		"add $16, %0\n\t"
+		"cmp %4, %0\n\t"
+		" jb 1b\n\t"
+		: "+r" (x)
+		: "r" (srca), "r" (src), "r" (dstbase), "m" (w16)
+		: XMM_CLOBBERS("xmm0", "xmm1", "xmm2", "xmm3",
+		               "xmm4", "xmm5", "xmm6", "xmm7")
+		  "%eax", "memory");
+        for(;x<w;x++)
+            if(srca[x]) dstbase[x]=((dstbase[x]*srca[x])>>8)+src[x];
+        src+=srcstride;
+        srca+=srcstride;
+        dstbase+=dststride;
+    }
+#else
 #if defined(FAST_OSD) && !defined(HAVE_MMX)
     w=w>>1;
 #endif
@@ -94,11 +152,65 @@ static inline void RENAME(vo_draw_alpha_yv12)(int w,int h, unsigned char* src, u
 #ifdef HAVE_MMX
 	asm volatile(EMMS:::"memory");
 #endif
+#endif //HAVE_SSE2
     return;
 }
 
 static inline void RENAME(vo_draw_alpha_yuy2)(int w,int h, unsigned char* src, unsigned char *srca, int srcstride, unsigned char* dstbase,int dststride){
     int y;
+#ifdef HAVE_SSE2
+    // 8 pixels per step, like the MMX version chroma is left untouched
+    for(y=0;y<h;y++){
+        long x=0;
+        long w8=w&~7;
+        if(w8) asm volatile(
+		"pxor %%xmm7, %%xmm7\n\t"
+		"pcmpeqb %%xmm5, %%xmm5\n\t" // F..F
+		"movdqa %%xmm5, %%xmm6\n\t"
+		"movdqa %%xmm5, %%xmm4\n\t"
+		"psllw $8, %%xmm5\n\t"	//FF00FF00FF00
+		"psrlw $8, %%xmm4\n\t"	//00FF00FF00FF
+		"1:\n\t"
+		"movq	(%1,%0), %%xmm2\n\t"	//srca 00000000HGFEDCBA
+		"movdqa	%%xmm2, %%xmm3\n\t"
+		"pcmpeqb %%xmm7, %%xmm3\n\t"
+		"pmovmskb %%xmm3, %%eax\n\t"
+		"cmpl $0xFFFF, %%eax\n\t"
+		" je 2f\n\t"
+		"movdqu	(%3,%0,2), %%xmm0\n\t"	//dstbase
+		"movdqa	%%xmm0, %%xmm1\n\t"
+		"pand %%xmm4, %%xmm0\n\t"	//0Y0Y0Y0Y
+		"paddb	%%xmm6, %%xmm2\n\t"
+		"punpcklbw %%xmm7, %%xmm2\n\t"	//srca 0H0G0F0E0D0C0B0A
+		"pmullw	%%xmm2, %%xmm0\n\t"
+		"psrlw	$8, %%xmm0\n\t"
+		"pand %%xmm5, %%xmm1\n\t"	//U0V0U0V0
+		"movq	(%2,%0), %%xmm2\n\t"	//src 00000000HGFEDCBA
+		"punpcklbw %%xmm7, %%xmm2\n\t"	//src 0H0G0F0E0D0C0B0A
+		"por %%xmm1, %%xmm0\n\t"
+		"paddb	%%xmm2, %%xmm0\n\t"
+		"punpcklbw %%xmm3, %%xmm3\n\t"	//keep dst where srca==0
+		"movdqu	(%3,%0,2), %%xmm1\n\t"
+		"pand %%xmm3, %%xmm1\n\t"
+		"pandn %%xmm0, %%xmm3\n\t"
+		"por %%xmm1, %%xmm3\n\t"
+		"movdqu	%%xmm3, (%3,%0,2)\n\t"
+		"2:\n\t"
+		"add $8, %0\n\t"
+		"cmp %4, %0\n\t"
+		" jb 1b\n\t"
+		: "+r" (x)
+		: "r" (srca), "r" (src), "r" (dstbase), "m" (w8)
+		: XMM_CLOBBERS("xmm0", "xmm1", "xmm2", "xmm3",
+		               "xmm4", "xmm5", "xmm6", "xmm7")
+		  "%eax", "memory");
+        for(;x<w;x++)
+            if(srca[x]) dstbase[2*x]=((dstbase[2*x]*srca[x])>>8)+src[x];
+        src+=srcstride;
+        srca+=srcstride;
+        dstbase+=dststride;
+    }
+#else
 #if defined(FAST_OSD) && !defined(HAVE_MMX)
     w=w>>1;
 #endif
@@ -166,6 +278,7 @@ static inline void RENAME(vo_draw_alpha_yuy2)(int w,int h, unsigned char* src, u
 #ifdef HAVE_MMX
 	asm volatile(EMMS:::"memory");
 #endif
+#endif //HAVE_SSE2
     return;
 }
 
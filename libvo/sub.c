@@ -138,15 +138,71 @@ static void alloc_buf(mp_osd_obj_t* obj)
     memset(obj->alpha_buffer, sub_bg_alpha, len);
 }
 
+#define OSD_RECT_MIN_HEIGHT 8
+
+// splits the rendered buffer into horizontal bands and shrinks each band to
+// the columns which have non-zero alpha, so that only these get blended
+static void calc_draw_rects(mp_osd_obj_t* obj)
+{
+    int w = obj->bbox.x2 - obj->bbox.x1;
+    int h = obj->bbox.y2 - obj->bbox.y1;
+    int band = (h + MAX_OSD_RECTS - 1) / MAX_OSD_RECTS;
+    int y, y0;
+
+    obj->num_rects = 0;
+    if (w <= 0 || h <= 0) return;
+    if (band < OSD_RECT_MIN_HEIGHT) band = OSD_RECT_MIN_HEIGHT;
+
+    for (y0 = 0; y0 < h; y0 += band) {
+	int y1 = FFMIN(y0 + band, h);
+	int x1 = w, x2 = 0, top = -1, bottom = 0;
+	mp_osd_bbox_t *r;
+
+	for (y = y0; y < y1; y++) {
+	    unsigned char *a = obj->alpha_buffer + y * obj->stride;
+	    int l = 0, e = w;
+	    while (l < w && !a[l]) l++;
+	    if (l == w) continue;
+	    while (!a[e-1]) e--;
+	    if (l < x1) x1 = l;
+	    if (e > x2) x2 = e;
+	    if (top < 0) top = y;
+	    bottom = y + 1;
+	}
+	if (top < 0) continue;
+	// keep the 8 pixel alignment of alloc_buf(), the MMX blenders
+	// work in 8 pixel steps and must not run past the buffer stride
+	x1 &= ~7;
+
+	r = obj->num_rects ? &obj->rects[obj->num_rects-1] : NULL;
+	if (r && r->y2 == obj->bbox.y1 + top &&
+	    r->x1 == obj->bbox.x1 + x1 && r->x2 == obj->bbox.x1 + x2) {
+	    r->y2 = obj->bbox.y1 + bottom;
+	    continue;
+	}
+	r = &obj->rects[obj->num_rects++];
+	r->x1 = obj->bbox.x1 + x1;
+	r->x2 = obj->bbox.x1 + x2;
+	r->y1 = obj->bbox.y1 + top;
+	r->y2 = obj->bbox.y1 + bottom;
+    }
+    mp_msg(MSGT_OSD,MSGL_DBG2,"OSD rects: %d for %dx%d\n",obj->num_rects,w,h);
+}
+
 // renders the buffer
 inline static void vo_draw_text_from_buffer(mp_osd_obj_t* obj,void (*draw_alpha)(int x0,int y0, int w,int h, unsigned char* src, unsigned char *srca, int stride)){
+    int i;
     if (obj->allocated > 0) {
-	draw_alpha(obj->bbox.x1,obj->bbox.y1,
-		   obj->bbox.x2-obj->bbox.x1,
-		   obj->bbox.y2-obj->bbox.y1,
-		   obj->bitmap_buffer,
-		   obj->alpha_buffer,
-		   obj->stride);
+	for (i = 0; i < obj->num_rects; i++) {
+	    mp_osd_bbox_t *r = &obj->rects[i];
+	    int offset = (r->y1-obj->bbox.y1)*obj->stride + (r->x1-obj->bbox.x1);
+	    draw_alpha(r->x1,r->y1,
+		       r->x2-r->x1,
+		       r->y2-r->y1,
+		       obj->bitmap_buffer+offset,
+		       obj->alpha_buffer+offset,
+		       obj->stride);
+	}
     }
 }
 
@@ -889,6 +945,9 @@ int vo_update_osd(int dxs,int dys){
 		obj->bbox.x1,obj->bbox.y1,obj->bbox.x2-obj->bbox.x1,
 		obj->bbox.y2-obj->bbox.y1);
 	}
+	// find the parts of the freshly rendered buffer worth blending:
+	if((obj->flags&OSDFLAG_VISIBLE) && obj->type!=OSDTYPE_SPU && obj->allocated>0)
+	    calc_draw_rects(obj);
 	// check if visibility changed:
 	if(vis != (obj->flags&OSDFLAG_VISIBLE) ) obj->flags|=OSDFLAG_CHANGED;
 	// remove the cause of automatic update:
@@ -21,6 +21,8 @@ typedef struct mp_osd_bbox_s {
 #define MAX_UCS 1600
 #define MAX_UCSLINES 16
 
+#define MAX_OSD_RECTS 16
+
 typedef struct mp_osd_obj_s {
     struct mp_osd_obj_s* next;
     unsigned char type;
@@ -46,6 +48,9 @@ typedef struct mp_osd_obj_s {
     int allocated;
     unsigned char *alpha_buffer;
     unsigned char *bitmap_buffer;
+
+    int num_rects;
+    mp_osd_bbox_t rects[MAX_OSD_RECTS]; // parts of bbox with non-zero alpha
 } mp_osd_obj_t;
 
 
@@ -298,6 +298,8 @@ static int edl_seek(edl_record_ptr next_edl_record, demuxer_t* demuxer, demux_st
 #include "vobsub.h"
 
 #include "libao2/audio_out.h"
+static stream_t* ostream=NULL;
+
 /* FIXME */
 static void mencoder_exit(int level, const char *how)
 {
@@ -306,6 +308,11 @@ static void mencoder_exit(int level, const char *how)
     else
 	mp_msg(MSGT_MENCODER, MSGL_INFO, MSGTR_Exiting);
 
+    // the output is buffered, write out what was muxed so far
+    if (ostream) {
+	free_stream(ostream);
+	ostream = NULL;
+    }
     exit(level);
 }
 
@@ -368,7 +375,6 @@ extern void print_wave_header(WAVEFORMATEX *h, int verbose_level);
 int main(int argc,char* argv[]){
 
 stream_t* stream=NULL;
-stream_t* ostream=NULL;
 demuxer_t* demuxer=NULL;
 stream_t* stream2=NULL;
 demuxer_t* demuxer2=NULL;
@@ -1555,6 +1561,8 @@ if(sh_audio){ uninit_audio(sh_audio);sh_audio=NULL; }
 if(sh_video){ uninit_video(sh_video);sh_video=NULL; }
 if(demuxer) free_demuxer(demuxer);
 if(stream) free_stream(stream); // kill cache thread
+free_stream(ostream); // write out what is still buffered
+ostream=NULL;
 
 return interrupted;
 }
@@ -163,6 +163,7 @@ static int max_framesize=0;
 #include "stream/stream.h"
 #include "libmpdemux/demuxer.h"
 #include "libmpdemux/stheader.h"
+#include "libmpdemux/demux_thread.h"
 //#include "parse_es.h"
 #include "libmpdemux/matroska.h"
 
@@ -281,6 +282,7 @@ int file_filter=1;
        int stream_cache_size=-1;
 #ifdef USE_STREAM_CACHE
 extern int cache_fill_status;
+extern int cache_underruns;
 
 float stream_cache_min_percent=20.0;
 float stream_cache_seek_min_percent=50.0;
@@ -307,6 +309,7 @@ static int audio_output_format=-1; // AF_FORMAT_UNKNOWN
        int frame_dropping=0; // option  0=no drop  1= drop vo  2= drop decode
 static int play_n_frames=-1;
 static int play_n_frames_mf=-1;
+static int thumbnail_count=0;
 
 // screen info:
 char** video_driver_list=NULL;
@@ -1885,6 +1888,126 @@ static int sleep_until_update(float *time_frame, float *aq_sleep_time)
     return frame_time_remaining;
 }
 
+/*
+ * How long starting a file, or switching DVB channels, took until the
+ * first frame was shown (or the first audio played), step by step.
+ * Printed with -v, and always with -live, where it is the zap time.
+ */
+enum {
+    ZAP_START, ZAP_STREAM, ZAP_CACHE, ZAP_DEMUX, ZAP_VIDEO, ZAP_AUDIO,
+    ZAP_FRAME, ZAP_OUTPUT, ZAP_STEPS
+};
+static const char * const zap_step_names[ZAP_STEPS] = {
+    NULL, "stream", "cache", "demux", "video init", "audio init",
+    "first frame", "output"
+};
+static unsigned int zap_time[ZAP_STEPS];
+static int zap_pending;
+
+static void zap_mark(int step)
+{
+    if (step == ZAP_START) {
+	memset(zap_time, 0, sizeof(zap_time));
+	zap_pending = 1;
+    }
+    if (zap_pending)
+	zap_time[step] = GetTimerMS();
+}
+
+/// mark the first output and print the steps
+static void zap_done(void)
+{
+    char buf[256];
+    unsigned int last = zap_time[ZAP_START];
+    int i, len = 0;
+
+    if (!zap_pending)
+	return;
+    zap_mark(ZAP_OUTPUT);
+    zap_pending = 0;
+    buf[0] = 0;
+    for (i = ZAP_STREAM; i < ZAP_STEPS && len < sizeof(buf); i++) {
+	if (!zap_time[i])
+	    continue;
+	len += snprintf(buf + len, sizeof(buf) - len, "%s %s %u",
+			len ? "," : "", zap_step_names[i], zap_time[i] - last);
+	last = zap_time[i];
+    }
+    mp_msg(MSGT_CPLAYER, demuxer_live ? MSGL_INFO : MSGL_V,
+	   "Started in %u ms:%s\n", last - zap_time[ZAP_START], buf);
+#ifdef USE_STREAM_CACHE
+    // waiting for the first keyframe at the live edge does not count
+    cache_underruns = 0;
+#endif
+}
+
+/**
+ * \brief -live: throw away the audio before the first video frame
+ *
+ * The video starts at its first keyframe, usually well after the audio.
+ * Dropping the audio up to it starts both in sync, instead of letting the
+ * A-V correction catch up a few ms per frame.
+ */
+static void live_drop_audio(double v_pts)
+{
+    sh_audio_t * const sh_audio = mpctx->sh_audio;
+    int frame = ao_data.bps / ao_data.samplerate;
+    double dropped = 0;
+
+    while (1) {
+	double a_pts = written_audio_pts(sh_audio, mpctx->d_audio);
+	double len = sh_audio->a_out_buffer_len * playback_speed / (double)ao_data.bps;
+	int ret;
+	if (a_pts >= v_pts)
+	    break;
+	if (a_pts + len > v_pts) {
+	    int bytes = (v_pts - a_pts) / playback_speed * ao_data.bps;
+	    bytes -= bytes % frame;
+	    sh_audio->a_out_buffer_len -= bytes;
+	    memmove(sh_audio->a_out_buffer, &sh_audio->a_out_buffer[bytes],
+		    sh_audio->a_out_buffer_len);
+	    dropped += bytes * playback_speed / (double)ao_data.bps;
+	    break;
+	}
+	dropped += len;
+	sh_audio->a_out_buffer_len = 0;
+	ret = decode_audio(sh_audio, sh_audio->a_out_buffer, ao_data.outburst,
+			   sh_audio->a_out_buffer_size);
+	if (ret <= 0)
+	    break;
+	sh_audio->a_out_buffer_len = ret;
+    }
+    mp_msg(MSGT_CPLAYER, MSGL_V, "Dropped %.3f s of audio before the first video frame.\n",
+	   dropped);
+}
+
+#ifdef USE_STREAM_CACHE
+/**
+ * \brief -live: the cache ran empty, wait until it holds more than last time
+ *
+ * Playback starts with whatever has arrived. Each time the cache runs dry
+ * afterwards, playback pauses until it is filled to the -cache-min level,
+ * doubled on every further underrun.
+ */
+static int live_cache_min;
+
+static void live_refill_cache(void)
+{
+    mp_msg(MSGT_CPLAYER, MSGL_INFO, "Cache empty, refilling %d kB.\n", live_cache_min / 1024);
+    if (mpctx->audio_out && mpctx->sh_audio)
+	mpctx->audio_out->pause();
+    if (!stream_cache_refill(mpctx->stream, live_cache_min))
+	mpctx->eof = libmpdemux_was_interrupted(PT_NEXT_ENTRY);
+    if (mpctx->audio_out && mpctx->sh_audio)
+	mpctx->audio_out->resume();
+    (void)GetRelativeTime(); // ignore the time spent refilling
+    cache_underruns = 0;
+    // half the cache is kept for seeking back
+    if (live_cache_min * 2 < stream_cache_size * 1024 / 2)
+	live_cache_min *= 2;
+}
+#endif
+
 int reinit_video_chain(void) {
     sh_video_t * const sh_video = mpctx->sh_video;
     //================== Init VIDEO (codec & libvo) ==========================
@@ -2271,6 +2394,70 @@ static int seek(MPContext *mpctx, double amount, int style)
     return 0;
 }
 
+/**
+ * \brief write count stills from keyframes evenly spread over the file
+ *
+ * Each still is the first frame decoded after a seek to the keyframe
+ * before its time, B-frames and loop filters are skipped where the decoder
+ * allows it. The images go through the filter chain to the video output,
+ * so -vf scale and -vo jpeg/png decide their size and format.
+ */
+static void make_thumbnails(MPContext *mpctx, int count)
+{
+    sh_video_t * const sh_video = mpctx->sh_video;
+    double len = demuxer_get_time_length(mpctx->demuxer);
+    unsigned int start_time = GetTimerMS();
+    int i, done = 0;
+
+    if (!mpctx->demuxer->seekable) {
+	mp_msg(MSGT_CPLAYER, MSGL_ERR, "Thumbnails need a seekable file.\n");
+	return;
+    }
+    set_video_skip_nonref(sh_video, 1);
+    for (i = 0; i < count; i++) {
+	double t = (i + 0.5) / count;
+	double pts = MP_NOPTS_VALUE;
+	demux_keyframe_t kf;
+	int frames, res;
+
+	if (len <= 0) // seek by file position
+	    res = seek(mpctx, t, 3);
+	else if (demuxer_find_keyframe(mpctx->demuxer, t * len,
+				       KEYFRAME_BEFORE, &kf)) {
+	    res = seek(mpctx, kf.pts, 1);
+	    pts = kf.pts;
+	} else
+	    res = seek(mpctx, t * len, 1);
+	if (res < 0)
+	    break;
+	// MPEG video sets it to the pts of the first I/P-frame read
+	sh_video->i_pts = 0;
+	// decoders with delay return the keyframe once the next one is in
+	for (frames = 0; frames < 50; frames++) {
+	    unsigned char *start;
+	    float frame_time;
+	    void *decoded;
+	    int in_size = video_read_frame(sh_video, &frame_time, &start,
+					   force_fps);
+	    if (in_size < 0)
+		break;
+	    if (pts == MP_NOPTS_VALUE)
+		pts = sh_video->i_pts ? sh_video->i_pts : sh_video->pts;
+	    decoded = decode_video(sh_video, start, in_size, 0, sh_video->pts);
+	    if (decoded) {
+		if (filter_video(sh_video, decoded, pts) && vo_config_count)
+		    mpctx->video_out->flip_page();
+		mp_msg(MSGT_IDENTIFY, MSGL_INFO, "ID_THUMBNAIL_%d=%.3f\n",
+		       ++done, pts);
+		break;
+	    }
+	}
+    }
+    set_video_skip_nonref(sh_video, 0);
+    mp_msg(MSGT_CPLAYER, MSGL_V, "%d thumbnails in %u ms\n",
+	   done, GetTimerMS() - start_time);
+}
+
 int main(int argc,char* argv[]){
 
 
@@ -2845,12 +3032,14 @@ if (edl_output_filename) {
   mpctx->sh_video=NULL;
 
   current_module="open_stream";
+  zap_mark(ZAP_START);
   mpctx->stream=open_stream(filename,0,&mpctx->file_format);
   if(!mpctx->stream) { // error...
     mpctx->eof = libmpdemux_was_interrupted(PT_NEXT_ENTRY);
     goto goto_next_file;
   }
   inited_flags|=INITED_STREAM;
+  zap_mark(ZAP_STREAM);
 
 #ifdef HAVE_NEW_GUI
   if ( use_gui ) guiGetEvent( guiSetStream,(char *)mpctx->stream );
@@ -2930,12 +3119,19 @@ if(mpctx->stream->type==STREAMTYPE_DVDNAV){
 // CACHE2: initial prefill: 20%  later: 5%  (should be set by -cacheopts)
 goto_enable_cache:
 if(stream_cache_size>0){
+  int prefill = stream_cache_size*1024*(stream_cache_min_percent / 100.0);
   current_module="enable_cache";
-  if(!stream_enable_cache(mpctx->stream,stream_cache_size*1024,
-                          stream_cache_size*1024*(stream_cache_min_percent / 100.0),
+#ifdef USE_STREAM_CACHE
+  // live: start with what has arrived, fill the cache when it runs dry
+  live_cache_min = prefill;
+  if (demuxer_live)
+    prefill = 0;
+#endif
+  if(!stream_enable_cache(mpctx->stream,stream_cache_size*1024,prefill,
                           stream_cache_size*1024*(stream_cache_seek_min_percent / 100.0)))
     if((mpctx->eof = libmpdemux_was_interrupted(PT_NEXT_ENTRY))) goto goto_next_file;
 }
+zap_mark(ZAP_CACHE);
 
 //============ Open DEMUXERS --- DETECT file type =======================
 current_module="demux_open";
@@ -3002,6 +3198,7 @@ if (mpctx->demuxer && mpctx->demuxer->type==DEMUXER_TYPE_PLAYLIST)
 if(!mpctx->demuxer) 
   goto goto_next_file;
 inited_flags|=INITED_DEMUXER;
+zap_mark(ZAP_DEMUX);
 
 if (mpctx->stream->type != STREAMTYPE_DVD && mpctx->stream->type != STREAMTYPE_DVDNAV) {
   int i;
@@ -3220,6 +3417,7 @@ if(!reinit_video_chain()) {
     goto main; // exit_player(MSGTR_Exit_error);
   }
 }
+zap_mark(ZAP_VIDEO);
 
    if(vo_flags & 0x08 && vo_spudec)
       spudec_set_hw_spu(vo_spudec,mpctx->video_out);
@@ -3263,6 +3461,7 @@ if(mpctx->sh_audio){
   reinit_audio_chain();
   if (mpctx->sh_audio && mpctx->sh_audio->codec)
     mp_msg(MSGT_IDENTIFY,MSGL_INFO, "ID_AUDIO_CODEC=%s\n", mpctx->sh_audio->codec->name);
+  zap_mark(ZAP_AUDIO);
 }
 
 current_module="av_init";
@@ -3329,6 +3528,13 @@ if(play_n_frames==0){
   mpctx->eof=PT_NEXT_ENTRY; goto goto_next_file;
 }
 
+if(thumbnail_count>0 && mpctx->sh_video){
+  make_thumbnails(mpctx, thumbnail_count);
+  mpctx->eof=PT_NEXT_ENTRY; goto goto_next_file;
+}
+
+demux_thread_start(mpctx->demuxer);
+
 if (seek_to_sec) {
     seek(mpctx, seek_to_sec, 1);
     end_at.pos += seek_to_sec;
@@ -3348,13 +3554,23 @@ if(!mpctx->sh_audio && mpctx->d_audio->sh) {
   reinit_audio_chain();
 }
 
+#ifdef USE_STREAM_CACHE
+if (demuxer_live && cache_underruns && !zap_pending && mpctx->stream->cache_pid &&
+    !mpctx->demuxer->thread)
+    live_refill_cache();
+#endif
+
 /*========================== PLAY AUDIO ============================*/
 
-if (mpctx->sh_audio)
+// -live: the audio waits for the first video frame, see live_drop_audio()
+if (mpctx->sh_audio && !(demuxer_live && zap_pending && mpctx->sh_video)) {
     if (!fill_audio_out_buffers())
 	// at eof, all audio at least written to ao
 	if (!mpctx->sh_video)
 	    mpctx->eof = PT_NEXT_ENTRY;
+    if (!mpctx->sh_video)
+	zap_done();
+}
 
 
 if(!mpctx->sh_video) {
@@ -3390,6 +3606,8 @@ if(!mpctx->sh_video) {
 	  // might return with !eof && !blit_frame if !correct_pts
 	  mpctx->num_buffered_frames += blit_frame;
 	  time_frame += frame_time / playback_speed;  // for nosound
+	  if (blit_frame && zap_pending && !zap_time[ZAP_FRAME])
+	      zap_mark(ZAP_FRAME);
       }
   }
 
@@ -3412,7 +3630,13 @@ if(!mpctx->sh_video) {
     }
 #endif
 
-    frame_time_remaining = sleep_until_update(&time_frame, &aq_sleep_time);
+    if (demuxer_live && zap_pending && blit_frame) {
+	// show the first frame right away, the audio starts with it
+	frame_time_remaining = 0;
+	time_frame = 0;
+	(void)GetRelativeTime();
+    } else
+	frame_time_remaining = sleep_until_update(&time_frame, &aq_sleep_time);
 
 //====================== FLIP PAGE (VIDEO BLT): =========================
 
@@ -3424,6 +3648,11 @@ if(!mpctx->sh_video) {
 	   mpctx->num_buffered_frames--;
 
 	   vout_time_usage += (GetTimer() - t2) * 0.000001;
+	   if (zap_pending) {
+	       if (demuxer_live && mpctx->sh_audio)
+		   live_drop_audio(mpctx->sh_video->pts + audio_delay);
+	       zap_done();
+	   }
         }
 //====================== A-V TIMESTAMP CORRECTION: =========================
 
@@ -3583,9 +3812,11 @@ mp_msg(MSGT_GLOBAL,MSGL_V,"EOF code: %d  \n",mpctx->eof);
 if(mpctx->dvbin_reopen)
 {
   mpctx->eof = 0;
+  zap_mark(ZAP_START);
   uninit_player(INITED_ALL-(INITED_GUI|INITED_STREAM|INITED_INPUT|INITED_GETCH2|(fixed_vo?INITED_VO:0)));
   cache_uninit(mpctx->stream);
   mpctx->dvbin_reopen = 0;
+  zap_mark(ZAP_STREAM);
   goto goto_enable_cache;
 }
 #endif
@@ -57,9 +57,50 @@ struct packet_t {
   unsigned int start_row, end_row;
   unsigned int width, height, stride;
   unsigned int start_pts, end_pts;
+  unsigned int size;		/* size of the packet data */
+  int prefetched;		/* already looked up in / added to the image cache */
   packet_t *next;
 };
 
+/* Decoded images of recently shown packets and of the next queued one are
+   kept, so that repeated packets (DVD menus, seeking back in VOBsub files)
+   skip RLE decoding and rescaling, and a new packet is usually decoded
+   before it is due. The scaled image is kept for the last display size. */
+#define SPU_CACHE_SIZE 8
+
+/* everything the decoded image depends on, besides the packet data */
+typedef struct {
+  unsigned int cmap[4], alpha[4];
+  unsigned int current_nibble[2];
+  unsigned int control_start;
+  unsigned int start_col, start_row;
+  unsigned int width, height, stride;
+  unsigned int size;
+} spu_key_t;
+
+/* image state, swapped with the one in spudec_handle_t */
+typedef struct {
+  unsigned int start_col, end_col;
+  unsigned int start_row, end_row;
+  unsigned int width, height, stride;
+  size_t image_size;
+  unsigned char *image;
+  unsigned char *aimage;
+  unsigned int scaled_frame_width, scaled_frame_height;
+  unsigned int scaled_start_col, scaled_start_row;
+  unsigned int scaled_width, scaled_height, scaled_stride;
+  size_t scaled_image_size;
+  unsigned char *scaled_image;
+  unsigned char *scaled_aimage;
+} spu_image_t;
+
+typedef struct {
+  spu_key_t key;
+  unsigned char *data;		/* copy of the packet data */
+  unsigned int last_used;	/* 0 for an unused entry */
+  spu_image_t img;		/* empty while the image is in the handle */
+} spu_cache_t;
+
 typedef struct {
   packet_t *queue_head;
   packet_t *queue_tail;
@@ -94,6 +135,10 @@ typedef struct {
   int spu_changed;
   unsigned int forced_subs_only;     /* flag: 0=display all subtitle, !0 display only forced subtitles */
   unsigned int is_forced_sub;         /* true if current subtitle is a forced subtitle */
+  spu_cache_t cache[SPU_CACHE_SIZE];
+  int cache_cur;			/* entry of the current image, -1 if none */
+  unsigned int cache_clock;
+  unsigned int cache_hits, cache_misses;
 } spudec_handle_t;
 
 static void spudec_queue_packet(spudec_handle_t *this, packet_t *packet)
@@ -215,11 +260,118 @@ static inline void spudec_cut_image(spudec_handle_t *this)
   }
 }
 
-static void spudec_process_data(spudec_handle_t *this, packet_t *packet)
+static void spudec_make_key(spudec_handle_t *this, packet_t *packet, spu_key_t *key)
 {
-  unsigned int cmap[4], alpha[4];
+  unsigned int i;
+
+  memset(key, 0, sizeof(*key));
+  for (i = 0; i < 4; ++i) {
+    key->alpha[i] = mkalpha(packet->alpha[i]);
+    if (key->alpha[i] == 0)
+      key->cmap[i] = 0;
+    else if (this->custom){
+      key->cmap[i] = ((this->cuspal[i] >> 16) & 0xff);
+      if (key->cmap[i] + key->alpha[i] > 255)
+	key->cmap[i] = 256 - key->alpha[i];
+    }
+    else {
+      key->cmap[i] = ((this->global_palette[packet->palette[i]] >> 16) & 0xff);
+      if (key->cmap[i] + key->alpha[i] > 255)
+	key->cmap[i] = 256 - key->alpha[i];
+    }
+  }
+  key->current_nibble[0] = packet->current_nibble[0];
+  key->current_nibble[1] = packet->current_nibble[1];
+  key->control_start = packet->control_start;
+  key->start_col = packet->start_col;
+  key->start_row = packet->start_row;
+  key->width = packet->width;
+  key->height = packet->height;
+  key->stride = packet->stride;
+  key->size = packet->size;
+}
+
+#define SWAP_FIELD(type, field) { type tmp = this->field; this->field = img->field; img->field = tmp; }
+
+static void spudec_swap_image(spudec_handle_t *this, spu_image_t *img)
+{
+  SWAP_FIELD(unsigned int, start_col);
+  SWAP_FIELD(unsigned int, end_col);
+  SWAP_FIELD(unsigned int, start_row);
+  SWAP_FIELD(unsigned int, end_row);
+  SWAP_FIELD(unsigned int, width);
+  SWAP_FIELD(unsigned int, height);
+  SWAP_FIELD(unsigned int, stride);
+  SWAP_FIELD(size_t, image_size);
+  SWAP_FIELD(unsigned char *, image);
+  SWAP_FIELD(unsigned char *, aimage);
+  SWAP_FIELD(unsigned int, scaled_frame_width);
+  SWAP_FIELD(unsigned int, scaled_frame_height);
+  SWAP_FIELD(unsigned int, scaled_start_col);
+  SWAP_FIELD(unsigned int, scaled_start_row);
+  SWAP_FIELD(unsigned int, scaled_width);
+  SWAP_FIELD(unsigned int, scaled_height);
+  SWAP_FIELD(unsigned int, scaled_stride);
+  SWAP_FIELD(size_t, scaled_image_size);
+  SWAP_FIELD(unsigned char *, scaled_image);
+  SWAP_FIELD(unsigned char *, scaled_aimage);
+}
+
+static void spudec_free_image(spu_image_t *img)
+{
+  if (img->image)
+    free(img->image);
+  if (img->scaled_image)
+    free(img->scaled_image);
+  memset(img, 0, sizeof(*img));
+}
+
+static int spudec_cache_find(spudec_handle_t *this, packet_t *packet, spu_key_t *key)
+{
+  int i;
+  for (i = 0; i < SPU_CACHE_SIZE; i++) {
+    spu_cache_t *e = &this->cache[i];
+    if (e->last_used && !memcmp(&e->key, key, sizeof(*key)) &&
+	!memcmp(e->data, packet->packet, key->size))
+      return i;
+  }
+  return -1;
+}
+
+/* Get an entry for a packet, dropping the least recently used image. */
+static int spudec_cache_alloc(spudec_handle_t *this, packet_t *packet, spu_key_t *key)
+{
+  int i, lru = -1;
+  spu_cache_t *e;
+
+  for (i = 0; i < SPU_CACHE_SIZE; i++) {
+    if (i == this->cache_cur)
+      continue;
+    if (lru < 0 || this->cache[i].last_used < this->cache[lru].last_used)
+      lru = i;
+  }
+  e = &this->cache[lru];
+  if (e->data)
+    free(e->data);
+  spudec_free_image(&e->img);
+  e->key = *key;
+  e->data = malloc(key->size);
+  if (e->data)
+    memcpy(e->data, packet->packet, key->size);
+  else
+    e->key.size = 0;
+  e->last_used = ++this->cache_clock;
+  return lru;
+}
+
+/* RLE decode a packet into the image of the handle. */
+static void spudec_decode_image(spudec_handle_t *this, packet_t *packet, spu_key_t *key)
+{
+  const unsigned int *cmap = key->cmap, *alpha = key->alpha;
   unsigned int i, x, y;
+  packet_t p = *packet;	/* decoding advances the nibble pointers */
 
+  packet = &p;
   this->scaled_frame_width = 0;
   this->scaled_frame_height = 0;
   this->start_col = packet->start_col;
@@ -229,21 +381,6 @@ static void spudec_process_data(spudec_handle_t *this, packet_t *packet)
   this->height = packet->height;
   this->width = packet->width;
   this->stride = packet->stride;
-  for (i = 0; i < 4; ++i) {
-    alpha[i] = mkalpha(packet->alpha[i]);
-    if (alpha[i] == 0)
-      cmap[i] = 0;
-    else if (this->custom){
-      cmap[i] = ((this->cuspal[i] >> 16) & 0xff);
-      if (cmap[i] + alpha[i] > 255)
-	cmap[i] = 256 - alpha[i];
-    }
-    else {
-      cmap[i] = ((this->global_palette[packet->palette[i]] >> 16) & 0xff);
-      if (cmap[i] + alpha[i] > 255)
-	cmap[i] = 256 - alpha[i];
-    }
-  }
 
   if (this->image_size < this->stride * this->height) {
     if (this->image != NULL) {
@@ -301,9 +438,37 @@ static void spudec_process_data(spudec_handle_t *this, packet_t *packet)
       ++y;
     }
   }
+  /* rows the RLE data did not reach would keep stale buffer contents */
+  if (y < this->height) {
+    memset(this->image + y * this->stride, 0, (this->height - y) * this->stride);
+    memset(this->aimage + y * this->stride, 0, (this->height - y) * this->stride);
+  }
   spudec_cut_image(this);
 }
 
+static void spudec_process_data(spudec_handle_t *this, packet_t *packet)
+{
+  spu_key_t key;
+  int i;
+
+  spudec_make_key(this, packet, &key);
+  i = spudec_cache_find(this, packet, &key);
+  /* move the current image back to its entry */
+  if (this->cache_cur >= 0)
+    spudec_swap_image(this, &this->cache[this->cache_cur].img);
+  this->cache_cur = -1;
+  if (i >= 0) {
+    this->cache_hits++;
+    spudec_swap_image(this, &this->cache[i].img);
+    this->cache[i].last_used = ++this->cache_clock;
+  } else {
+    this->cache_misses++;
+    i = spudec_cache_alloc(this, packet, &key);
+    spudec_decode_image(this, packet, &key);
+  }
+  this->cache_cur = i;
+}
+
 
 /*
   This function tries to create a usable palette.
@@ -341,6 +506,24 @@ static void compute_palette(spudec_handle_t *this, packet_t *packet)
   }
 }
 
+/* Decode the next queued packet into the cache before it is due. */
+static void spudec_prefetch(spudec_handle_t *this, packet_t *packet)
+{
+  spu_key_t key;
+  int i;
+
+  packet->prefetched = 1;
+  if (this->auto_palette)
+    compute_palette(this, packet);
+  spudec_make_key(this, packet, &key);
+  if (spudec_cache_find(this, packet, &key) >= 0)
+    return;
+  i = spudec_cache_alloc(this, packet, &key);
+  spudec_swap_image(this, &this->cache[i].img);
+  spudec_decode_image(this, packet, &key);
+  spudec_swap_image(this, &this->cache[i].img);
+}
+
 static void spudec_process_control(spudec_handle_t *this, unsigned int pts100)
 {
   int a,b; /* Temporary vars */
@@ -474,6 +657,7 @@ static void spudec_process_control(spudec_handle_t *this, unsigned int pts100)
       }
       packet->packet = malloc(this->packet_size);
       memcpy(packet->packet, this->packet, this->packet_size);
+      packet->size = this->packet_size;
       spudec_queue_packet(this, packet);
     }
   }
@@ -603,6 +787,8 @@ void spudec_heartbeat(void *this, unsigned int pts100)
     spudec_free_packet(packet);
     spu->spu_changed = 1;
   }
+  if (spu->queue_head != NULL && !spu->queue_head->prefetched)
+    spudec_prefetch(spu, spu->queue_head);
 }
 
 int spudec_visible(void *this){
@@ -1131,6 +1317,7 @@ void *spudec_new_scaled_vobsub(unsigned int *palette, unsigned int *cuspal, unsi
     this->packet = NULL;
     this->image = NULL;
     this->scaled_image = NULL;
+    this->cache_cur = -1;
     /* XXX Although the video frame is some size, the SPU frame is
        always maximum size i.e. 720 wide and 576 or 480 high */
     this->orig_frame_width = 720;
@@ -1165,8 +1352,16 @@ void spudec_free(void *this)
 {
   spudec_handle_t *spu = (spudec_handle_t*)this;
   if (spu) {
+    int i;
+    mp_msg(MSGT_SPUDEC, MSGL_V, "SPU: image cache: %u hits, %u misses\n",
+	   spu->cache_hits, spu->cache_misses);
     while (spu->queue_head)
       spudec_free_packet(spudec_dequeue_packet(spu));
+    for (i = 0; i < SPU_CACHE_SIZE; i++) {
+      if (spu->cache[i].data)
+	free(spu->cache[i].data);
+      spudec_free_image(&spu->cache[i].img);
+    }
     if (spu->packet)
       free(spu->packet);
     if (spu->scaled_image)
@@ -6,7 +6,8 @@
 
 #define READ_USLEEP_TIME 10000
 #define FILL_USLEEP_TIME 50000
-#define PREFILL_SLEEP_TIME 200
+#define PREFILL_SLEEP_TIME 20
+#define PREFILL_STATUS_TIME 200
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -58,6 +59,7 @@ typedef struct {
 static int min_fill=0;
 
 int cache_fill_status=0;
+int cache_underruns=0; // cache_read() calls that had to wait for data
 
 void cache_stats(cache_vars_t* s){
   int newb=s->max_filepos-s->read_filepos; // new bytes in the buffer
@@ -67,6 +69,7 @@ void cache_stats(cache_vars_t* s){
 
 int cache_read(cache_vars_t* s,unsigned char* buf,int size){
   int total=0;
+  int waited=0;
   while(size>0){
     int pos,newb,len;
 
@@ -75,6 +78,7 @@ int cache_read(cache_vars_t* s,unsigned char* buf,int size){
     if(s->read_filepos>=s->max_filepos || s->read_filepos<s->min_filepos){
 	// eof?
 	if(s->eof) break;
+	if(!waited++) cache_underruns++;
 	// waiting for buffer fill...
 	usec_sleep(READ_USLEEP_TIME); // 10ms
 	continue; // try again...
@@ -243,6 +247,32 @@ void cache_uninit(stream_t *s) {
 #endif
 }
 
+/// wait until min bytes are cached ahead of the reader, 0 if interrupted
+static int cache_wait_fill(cache_vars_t* s,int min){
+  int t=0;
+  while(s->read_filepos<s->min_filepos || s->max_filepos-s->read_filepos<min){
+	if(!(t++ % (PREFILL_STATUS_TIME/PREFILL_SLEEP_TIME)))
+	  mp_msg(MSGT_CACHE,MSGL_STATUS,MSGTR_CacheFill,
+	    100.0*(float)(s->max_filepos-s->read_filepos)/(float)(s->buffer_size),
+	    (int64_t)s->max_filepos-s->read_filepos
+	  );
+	if(s->eof) break; // file is smaller than prefill size
+	if(mp_input_check_interrupt(PREFILL_SLEEP_TIME))
+	  return 0;
+  }
+  mp_msg(MSGT_CACHE,MSGL_STATUS,"\n");
+  return 1;
+}
+
+int stream_cache_refill(stream_t *stream,int min){
+  cache_vars_t* s=stream->cache_data;
+  if(!stream->cache_pid) return 1;
+  // once playing, cache_fill() keeps back_size old bytes for seeking back
+  if (min > s->buffer_size - s->back_size - s->fill_limit)
+     min = s->buffer_size - s->back_size - s->fill_limit;
+  return cache_wait_fill(s,min);
+}
+
 static void exit_sighandler(int x){
   // close stream
   exit(0);
@@ -281,23 +311,15 @@ int stream_enable_cache(stream_t *stream,int size,int min,int seek_limit){
     DWORD threadId;
     stream_t* stream2=malloc(sizeof(stream_t));
     memcpy(stream2,s->stream,sizeof(stream_t));
+    if(stream2->buffer==s->stream->buffer_data)
+      stream2->buffer=stream2->buffer_data;
     s->stream=stream2;
     stream->cache_pid = CreateThread(NULL,0,ThreadProc,s,0,&threadId);
 #endif
     // wait until cache is filled at least prefill_init %
     mp_msg(MSGT_CACHE,MSGL_V,"CACHE_PRE_INIT: %"PRId64" [%"PRId64"] %"PRId64"  pre:%d  eof:%d  \n",
 	(int64_t)s->min_filepos,(int64_t)s->read_filepos,(int64_t)s->max_filepos,min,s->eof);
-    while(s->read_filepos<s->min_filepos || s->max_filepos-s->read_filepos<min){
-	mp_msg(MSGT_CACHE,MSGL_STATUS,MSGTR_CacheFill,
-	    100.0*(float)(s->max_filepos-s->read_filepos)/(float)(s->buffer_size),
-	    (int64_t)s->max_filepos-s->read_filepos
-	);
-	if(s->eof) break; // file is smaller than prefill size
-	if(mp_input_check_interrupt(PREFILL_SLEEP_TIME))
-	  return 0;
-    }
-    mp_msg(MSGT_CACHE,MSGL_STATUS,"\n");
-    return 1; // parent exits
+    return cache_wait_fill(s,min); // parent exits
   }
   
 #ifdef WIN32
@@ -25,6 +25,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <ctype.h>
 #include <sys/ioctl.h>
 #include <sys/poll.h>
@@ -101,6 +102,7 @@ int dvb_get_tuner_type(int fe_fd)
 }
 
 int dvb_set_ts_filt(int fd, uint16_t pid, dmx_pes_type_t pestype);
+int dvb_demux_stop(int fd);
 
 int dvb_open_devices(dvb_priv_t *priv, int n, int demux_cnt, int *pids)
 {
@@ -136,6 +138,7 @@ int dvb_open_devices(dvb_priv_t *priv, int n, int demux_cnt, int *pids)
 		else
 		{
 			mp_msg(MSGT_DEMUX, MSGL_V, "OPEN(%d), file %s: FD=%d, CNT=%d\n", i, dvb_demuxdev[n], priv->demux_fds[i], priv->demux_fds_cnt);
+			priv->demux_pids[i] = -1;
 			priv->demux_fds_cnt++;
 		}
 	}
@@ -152,37 +155,78 @@ int dvb_open_devices(dvb_priv_t *priv, int n, int demux_cnt, int *pids)
 }
 
 
-int dvb_fix_demuxes(dvb_priv_t *priv, int cnt, int *pids)
+/*
+ * Point the demux filters at pids: filters already on a wanted PID keep
+ * running untouched, the others are stopped and reused for the new PIDs,
+ * surplus demux devices are closed and missing ones opened.
+ * Returns the number of filters set, -1 on error.
+ */
+int dvb_swap_filters(dvb_priv_t *priv, int cnt, int *pids)
 {
-	int i;
-	
-	mp_msg(MSGT_DEMUX, MSGL_V, "FIX %d -> %d\n", priv->demux_fds_cnt, cnt);
-	if(priv->demux_fds_cnt >= cnt)
+	int fds[DMX_FILTER_SIZE], fds_pids[DMX_FILTER_SIZE], n = 0;
+	int spare[DMX_FILTER_SIZE], spare_cnt = 0;
+	int wanted[DMX_FILTER_SIZE], kept, i, j, fd, set = 0;
+	int devno = priv->config->cards[priv->card].devno;
+
+	for(j = 0; j < cnt; j++)
+		wanted[j] = 1;
+
+	for(i = 0; i < priv->demux_fds_cnt; i++)
 	{
-		for(i = priv->demux_fds_cnt-1; i >= cnt; i--)
+		kept = 0;
+		for(j = 0; j < cnt && !kept; j++)
 		{
-			mp_msg(MSGT_DEMUX, MSGL_V, "FIX, CLOSE fd(%d): %d\n", i, priv->demux_fds[i]);
-			close(priv->demux_fds[i]);
+			if(wanted[j] && priv->demux_pids[i] == pids[j])
+				wanted[j] = 0, kept = 1;
+		}
+		if(kept)
+		{
+			fds[n] = priv->demux_fds[i];
+			fds_pids[n++] = priv->demux_pids[i];
+		}
+		else
+		{
+			if(priv->demux_pids[i] >= 0)
+				dvb_demux_stop(priv->demux_fds[i]);
+			spare[spare_cnt++] = priv->demux_fds[i];
 		}
-		priv->demux_fds_cnt = cnt;
 	}
-	else if(priv->demux_fds_cnt < cnt)
+
+	for(j = 0; j < cnt; j++)
 	{
-		for(i = priv->demux_fds_cnt; i < cnt; i++)
+		if(! wanted[j])
+			continue;
+		if(spare_cnt > 0)
+			fd = spare[--spare_cnt];
+		else
 		{
-			priv->demux_fds[i] = open(dvb_demuxdev[priv->card], O_RDWR | O_NONBLOCK);
-			mp_msg(MSGT_DEMUX, MSGL_V, "FIX, OPEN fd(%d): %d\n", i, priv->demux_fds[i]);
-			if(priv->demux_fds[i] < 0)
+			fd = open(dvb_demuxdev[devno], O_RDWR | O_NONBLOCK);
+			mp_msg(MSGT_DEMUX, MSGL_V, "SWAP, OPEN fd: %d\n", fd);
+			if(fd < 0)
 			{
 				mp_msg(MSGT_DEMUX, MSGL_ERR, "ERROR OPENING DEMUX 0: %d\n", errno);
-				return 0;
+				break;
 			}
-			else
-				priv->demux_fds_cnt++;
-		}	
+		}
+		fds[n] = fd;
+		fds_pids[n++] = -1;
+		if(! dvb_set_ts_filt(fd, pids[j], DMX_PES_OTHER))
+			break;
+		fds_pids[n-1] = pids[j];
+		set++;
 	}
-	
-	return 1;
+
+	while(spare_cnt > 0)
+	{
+		mp_msg(MSGT_DEMUX, MSGL_V, "SWAP, CLOSE fd: %d\n", spare[spare_cnt-1]);
+		close(spare[--spare_cnt]);
+	}
+
+	memcpy(priv->demux_fds, fds, n * sizeof(int));
+	memcpy(priv->demux_pids, fds_pids, n * sizeof(int));
+	priv->demux_fds_cnt = n;
+
+	return (j < cnt) ? -1 : set;
 }
 
 int dvb_set_ts_filt(int fd, uint16_t pid, dmx_pes_type_t pestype)
@@ -71,6 +71,8 @@ typedef struct {
 	uint16_t NUM_CHANNELS;
 	uint16_t current;
 	dvb_channel_t *channels;
+	int *hash;		//channel numbers by name, -1 in empty slots
+	int hash_size;
 } dvb_channels_list;
 
 typedef struct {
@@ -91,6 +93,7 @@ typedef struct {
 	int fe_fd;
 	int sec_fd;
 	int demux_fd[3], demux_fds[DMX_FILTER_SIZE], demux_fds_cnt;
+	int demux_pids[DMX_FILTER_SIZE];	//PID filtered by each demux_fds, -1 if stopped
 	int dvr_fd;
 
 	dvb_config_t *config;
@@ -101,6 +104,8 @@ typedef struct {
 	int retry;
 	int timeout;
 	int last_freq;
+	char last_pol;
+	int last_diseqc;
 } dvb_priv_t;
 
 
@@ -111,6 +116,7 @@ typedef struct {
 
 extern int dvb_step_channel(dvb_priv_t *, int);
 extern int dvb_set_channel(dvb_priv_t *, int, int);
+extern int dvb_find_channel(dvb_channels_list *, const char *);
 extern dvb_config_t *dvb_get_config(void);
 
 #endif
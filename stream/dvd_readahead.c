@@ -0,0 +1,345 @@
+/*
+ * Asynchronous read-ahead for DVD titles.
+ *
+ * A thread reads the title VOBs ahead of playback into a FIFO of blocks,
+ * in requests of up to DVD_RA_BATCH blocks. It follows the VOBU chain the
+ * same way dvd_read_sector() does: the NAV pack at the start of each VOBU
+ * gives its length and the address of the next VOBU, the end of a cell
+ * continues with the next cell of the program chain. libdvdcss decrypts
+ * in the thread as well, so neither drive latency nor decryption reach
+ * the player as long as the FIFO is not empty.
+ *
+ * A read of a block the thread did not predict (a seek, an angle change)
+ * empties the FIFO and restarts the thread at that block.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "config.h"
+
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+#include "mp_msg.h"
+#include "stream.h"
+#include "dvd_readahead.h"
+
+int dvd_readahead_size = 2048;
+
+#define DVD_RA_BATCH 32 /* blocks per DVDReadBlocks() call */
+
+struct dvd_readahead_s {
+  dvd_priv_t *dvd;
+
+  /* FIFO of blocks, head is where the thread stores, tail where the
+   * reader takes, both count blocks and are used modulo slots */
+  unsigned char *data;
+  int *lba;
+  unsigned int slots;
+  unsigned int head, tail;
+
+  /* where the thread goes on reading, the PGC and angle are copied from
+   * the player on every restart, it changes them without the lock */
+  pgc_t *pgc;
+  int last_cell;
+  int angle;
+  int next;               /* next block to read */
+  int cell;               /* cell of next */
+  int vobu_end;           /* last block of the current VOBU, -1 if unknown */
+  int vobu_next;          /* first block of the following VOBU */
+  int busy_start, busy_end; /* blocks being read right now */
+  unsigned int gen;       /* incremented by every restart */
+  int idle;               /* nothing left to read in this title */
+  int error;              /* the last read failed */
+  int single;             /* read block by block until the next VOBU */
+  int quit;
+  int waiting;            /* the reader waits on cond */
+  pid_t pid;              /* process running the thread, 0 if none */
+#ifdef HAVE_PTHREADS
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+#endif
+
+  /* statistics */
+  unsigned int blocks, hits, restarts;
+};
+
+#ifdef HAVE_PTHREADS
+
+/// note the VOBU extent if lba is a NAV pack, with ra->lock held
+static void parse_nav(dvd_readahead_t *ra, int lba, unsigned char *data)
+{
+  dsi_t dsi;
+  int cell_end = ra->pgc->cell_playback[ra->cell].last_sector;
+
+  if (!dvd_parse_nav(data, &dsi) || dsi.dsi_gi.nv_pck_lbn != lba)
+    return;
+  ra->vobu_end = lba + dsi.dsi_gi.vobu_ea;
+  if (dsi.vobu_sri.next_vobu != SRI_END_OF_CELL)
+    ra->vobu_next = lba + (dsi.vobu_sri.next_vobu & 0x7fffffff);
+  else
+    ra->vobu_next = cell_end + 1;
+  ra->single = 0;
+}
+
+static void *readahead_thread(void *arg)
+{
+  dvd_readahead_t *ra = arg;
+
+  pthread_mutex_lock(&ra->lock);
+  while (!ra->quit) {
+    pgc_t *pgc = ra->pgc;
+    unsigned int gen, free_slots, pos;
+    int lba, n, got, i;
+
+    free_slots = ra->slots - (ra->head - ra->tail);
+    if (ra->idle || ra->error || free_slots == 0) {
+      pthread_cond_wait(&ra->cond, &ra->lock);
+      continue;
+    }
+
+    if (ra->next > (int)pgc->cell_playback[ra->cell].last_sector) {
+      int next = dvd_pgc_next_cell(pgc, ra->last_cell, ra->angle, ra->cell);
+      if (next < 0) {
+        ra->idle = 1;
+        continue;
+      }
+      ra->cell = next;
+      ra->next = pgc->cell_playback[next].first_sector;
+      ra->vobu_end = -1;
+    }
+
+    lba = ra->next;
+    n = ra->single ? 1 : DVD_RA_BATCH;
+    if (n > (int)free_slots)
+      n = free_slots;
+    pos = ra->head % ra->slots;
+    if (n > (int)(ra->slots - pos))
+      n = ra->slots - pos;
+    if (n > (int)pgc->cell_playback[ra->cell].last_sector - lba + 1)
+      n = pgc->cell_playback[ra->cell].last_sector - lba + 1;
+    if (ra->vobu_end >= lba && n > ra->vobu_end - lba + 1)
+      n = ra->vobu_end - lba + 1;
+
+    gen = ra->gen;
+    ra->busy_start = lba;
+    ra->busy_end = lba + n;
+    pthread_mutex_unlock(&ra->lock);
+    got = DVDReadBlocks(ra->dvd->title, lba, n, ra->data + pos * 2048);
+    pthread_mutex_lock(&ra->lock);
+    ra->busy_start = ra->busy_end = 0;
+
+    if (gen != ra->gen)
+      continue; // restarted meanwhile, the blocks are not wanted
+    if (got <= 0) {
+      // retry a failed batch block by block before giving up
+      if (n > 1)
+        ra->single = 1;
+      else
+        ra->error = 1;
+    } else {
+      for (i = 0; i < got; i++) {
+        ra->lba[(pos + i) % ra->slots] = lba + i;
+        parse_nav(ra, lba + i, ra->data + (pos + i) * 2048);
+      }
+      ra->head += got;
+      ra->blocks += got;
+      ra->next = lba + got;
+      if (ra->vobu_end >= 0 && ra->next > ra->vobu_end) {
+        ra->next = ra->vobu_next;
+        ra->vobu_end = -1;
+      }
+    }
+    if (ra->waiting)
+      pthread_cond_broadcast(&ra->cond);
+  }
+  pthread_mutex_unlock(&ra->lock);
+  return NULL;
+}
+
+static int start_thread(dvd_readahead_t *ra)
+{
+  sigset_t sigs, oldsigs;
+  int err;
+
+  if (ra->pid == getpid())
+    return ra->slots != 0;
+
+  /* a thread started before the cache forked did not come along,
+   * its FIFO is a private copy now and nobody else uses it */
+  free(ra->data);
+  free(ra->lba);
+  ra->data = NULL;
+  ra->lba = NULL;
+  ra->head = ra->tail = 0;
+  ra->idle = 1;
+  ra->error = ra->quit = ra->waiting = 0;
+  ra->pid = getpid();
+
+  ra->slots = dvd_readahead_size * 1024 / 2048;
+  if (ra->slots < DVD_RA_BATCH)
+    ra->slots = DVD_RA_BATCH;
+  ra->data = malloc(ra->slots * 2048);
+  ra->lba = malloc(ra->slots * sizeof(int));
+  if (!ra->data || !ra->lba)
+    goto fail;
+  pthread_mutex_init(&ra->lock, NULL);
+  pthread_cond_init(&ra->cond, NULL);
+  /* signals must go to the player, which cleans up on them */
+  sigfillset(&sigs);
+  pthread_sigmask(SIG_SETMASK, &sigs, &oldsigs);
+  err = pthread_create(&ra->thread, NULL, readahead_thread, ra);
+  pthread_sigmask(SIG_SETMASK, &oldsigs, NULL);
+  if (err) {
+    pthread_cond_destroy(&ra->cond);
+    pthread_mutex_destroy(&ra->lock);
+    goto fail;
+  }
+  mp_msg(MSGT_DVD, MSGL_V, "DVD: reading ahead up to %u blocks\n", ra->slots);
+  return 1;
+
+fail:
+  mp_msg(MSGT_DVD, MSGL_WARN, "DVD: cannot start the read-ahead thread, reading directly\n");
+  free(ra->data);
+  free(ra->lba);
+  ra->data = NULL;
+  ra->lba = NULL;
+  ra->slots = 0;
+  return 0;
+}
+
+/// look for lba in the FIFO, with ra->lock held
+static int find_block(dvd_readahead_t *ra, int lba, unsigned int *index)
+{
+  unsigned int i;
+  for (i = ra->tail; i != ra->head; i++)
+    if (ra->lba[i % ra->slots] == lba) {
+      *index = i;
+      return 1;
+    }
+  return 0;
+}
+
+static int readahead_read(dvd_readahead_t *ra, int lba, int cell, unsigned char *data)
+{
+  unsigned int i;
+  int ret = 0;
+
+  pthread_mutex_lock(&ra->lock);
+  for (;;) {
+    if (find_block(ra, lba, &i)) {
+      // blocks before it were read ahead for nothing
+      memcpy(data, ra->data + (i % ra->slots) * 2048, 2048);
+      ra->tail = i + 1;
+      ra->hits++;
+      ret = 1;
+      break;
+    }
+    if (ra->error && lba == ra->next) {
+      ra->error = 0;
+      break;
+    }
+    if ((lba >= ra->busy_start && lba < ra->busy_end) ||
+        (lba == ra->next && !ra->idle && !ra->error &&
+         ra->head - ra->tail < ra->slots)) {
+      ra->waiting = 1;
+      pthread_cond_wait(&ra->cond, &ra->lock);
+      ra->waiting = 0;
+      continue;
+    }
+    // not where the thread is heading, start over at lba
+    ra->tail = ra->head;
+    ra->gen++;
+    ra->next = lba;
+    ra->cell = cell;
+    ra->pgc = ra->dvd->cur_pgc;
+    ra->last_cell = ra->dvd->last_cell;
+    ra->angle = dvd_angle;
+    ra->vobu_end = -1;
+    ra->idle = ra->error = 0;
+    ra->single = 0;
+    ra->restarts++;
+    pthread_cond_broadcast(&ra->cond);
+  }
+  // wake the thread if it waits for room
+  pthread_cond_broadcast(&ra->cond);
+  pthread_mutex_unlock(&ra->lock);
+  return ret;
+}
+
+#else
+#define start_thread(ra) 0
+#define readahead_read(ra, lba, cell, data) 0
+#endif /* HAVE_PTHREADS */
+
+dvd_readahead_t *dvd_readahead_new(dvd_priv_t *d)
+{
+  dvd_readahead_t *ra;
+  if (dvd_readahead_size <= 0)
+    return NULL;
+  ra = calloc(1, sizeof(*ra));
+  if (!ra)
+    return NULL;
+  ra->dvd = d;
+  ra->vobu_end = -1;
+  return ra;
+}
+
+int dvd_readahead_read(dvd_readahead_t *ra, int lba, int cell, unsigned char *data)
+{
+  if (!start_thread(ra))
+    return DVDReadBlocks(ra->dvd->title, lba, 1, data) > 0;
+  return readahead_read(ra, lba, cell, data);
+}
+
+void dvd_readahead_free(dvd_readahead_t *ra)
+{
+  if (!ra)
+    return;
+#ifdef HAVE_PTHREADS
+  if (ra->pid == getpid() && ra->slots) {
+    int i;
+    /* when a signal interrupted the reader it may still hold the lock,
+     * the thread only holds it briefly */
+    for (i = 0; pthread_mutex_trylock(&ra->lock); i++) {
+      if (i == 100)
+        return; /* exiting anyway, leave the thread running */
+      usleep(1000);
+    }
+    ra->quit = 1;
+    pthread_cond_broadcast(&ra->cond);
+    pthread_mutex_unlock(&ra->lock);
+    pthread_join(ra->thread, NULL);
+    if (!ra->waiting) {
+      pthread_cond_destroy(&ra->cond);
+      pthread_mutex_destroy(&ra->lock);
+    }
+    mp_msg(MSGT_DVD, MSGL_V,
+           "DVD: read ahead %u blocks, %u used, %u restarts\n",
+           ra->blocks, ra->hits, ra->restarts);
+  }
+#endif
+  free(ra->data);
+  free(ra->lba);
+  free(ra);
+}
@@ -0,0 +1,30 @@
+#ifndef DVD_READAHEAD_H
+#define DVD_READAHEAD_H
+
+#include "stream_dvd.h"
+
+/// size of the read-ahead block cache in kB, 0 reads synchronously
+extern int dvd_readahead_size;
+
+typedef struct dvd_readahead_s dvd_readahead_t;
+
+/**
+ * \brief set up reading ahead in the title of d
+ * \return NULL if read-ahead is disabled
+ *
+ * The reader thread is started by the first read, in the process that
+ * does the reading, so that it also works behind the forked cache.
+ */
+dvd_readahead_t *dvd_readahead_new(dvd_priv_t *d);
+
+/**
+ * \brief read one block
+ * \param lba logical block in the title VOBs
+ * \param cell cell the block belongs to, the reader follows the cells after it
+ * \return 1 or 0 on error
+ */
+int dvd_readahead_read(dvd_readahead_t *ra, int lba, int cell, unsigned char *data);
+
+void dvd_readahead_free(dvd_readahead_t *ra);
+
+#endif /* DVD_READAHEAD_H */
@@ -0,0 +1,349 @@
+/*
+ * Buffered writing of output files.
+ *
+ * Muxers write headers, packs and chunks of a few bytes to a few kB each.
+ * They are collected in buffers that end on multiples of the buffer size
+ * in the file, so that after the first one all writes are large and
+ * aligned. A write to another position (the muxers seek back to fill in
+ * header fields) closes the current buffer and starts a new one.
+ *
+ * With a writer thread, full buffers are queued and written while the
+ * muxer fills the next one, it only waits when all buffers are queued.
+ * Aligned buffers can bypass the page cache with O_DIRECT, and disk space
+ * can be reserved ahead of the writes with fallocate().
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _GNU_SOURCE /* O_DIRECT, fallocate() */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_MALLOC_H
+#include <malloc.h>
+#endif
+
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+#include "mp_msg.h"
+#include "osdep/timer.h"
+#include "file_write.h"
+
+int file_write_buffer_size = 1024;
+int file_write_thread = 0;
+int file_write_direct = 0;
+int file_write_prealloc = 0;
+
+#define WRITE_ALIGN 4096 /* covers the logical block size of O_DIRECT */
+#define WRITE_BUFFERS 4  /* buffers with a writer thread */
+
+typedef struct {
+  unsigned char *data;
+  off_t pos;              /* file position of data[0] */
+  int len;
+  int size;               /* len at which the buffer is written */
+} write_buf_t;
+
+struct file_writer_s {
+  int fd;
+  int seekable;
+  int size;               /* bytes per buffer, a multiple of WRITE_ALIGN */
+
+  /* buf[head % nbufs] is being filled, the ones from tail to head are
+   * queued for the thread, both count buffers */
+  write_buf_t buf[WRITE_BUFFERS];
+  int nbufs;
+  unsigned int head, tail;
+
+  int error;              /* errno of the first failed write */
+  int direct;             /* O_DIRECT is usable */
+  int direct_on;          /* O_DIRECT is set on fd right now */
+  off_t prealloc;         /* bytes reserved per fallocate() */
+  off_t alloc_end;        /* end of the reserved space */
+#ifdef HAVE_PTHREADS
+  int threaded;
+  int quit;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+#endif
+
+  /* statistics */
+  unsigned int writes;
+  int64_t bytes;
+  unsigned int write_time, wait_time; /* ms */
+};
+
+static void set_direct(file_writer_t *w, int on) {
+#ifdef O_DIRECT
+  int flags;
+  if (on == w->direct_on)
+    return;
+  flags = fcntl(w->fd, F_GETFL);
+  if (flags == -1 ||
+      fcntl(w->fd, F_SETFL, on ? flags | O_DIRECT : flags & ~O_DIRECT) == -1) {
+    if (on) {
+      mp_msg(MSGT_STREAM, MSGL_V, "[file] O_DIRECT is not supported here\n");
+      w->direct = 0;
+    }
+    return;
+  }
+  w->direct_on = on;
+#endif
+}
+
+/// reserve disk space up to at least end
+static void preallocate(file_writer_t *w, off_t end) {
+#ifdef FALLOC_FL_KEEP_SIZE
+  while (w->prealloc && end > w->alloc_end) {
+    // KEEP_SIZE: the file does not grow and needs no truncating on errors
+    if (fallocate(w->fd, FALLOC_FL_KEEP_SIZE, w->alloc_end, w->prealloc) < 0) {
+      mp_msg(MSGT_STREAM, MSGL_V, "[file] Cannot preallocate: %s\n", strerror(errno));
+      w->prealloc = 0;
+      return;
+    }
+    w->alloc_end += w->prealloc;
+  }
+#endif
+}
+
+static void write_out(file_writer_t *w, write_buf_t *b) {
+  unsigned char *data = b->data;
+  off_t pos = b->pos;
+  int len = b->len;
+  unsigned int start = GetTimerMS();
+
+  if (w->error || !len)
+    return;
+  preallocate(w, pos + len);
+  if (w->direct)
+    set_direct(w, pos % WRITE_ALIGN == 0 && len % WRITE_ALIGN == 0);
+  while (len > 0) {
+    ssize_t r = w->seekable ? pwrite(w->fd, data, len, pos) :
+                              write(w->fd, data, len);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r < 0 && errno == EINVAL && w->direct_on) {
+      // the filesystem takes O_DIRECT at open but not for writes
+      set_direct(w, 0);
+      w->direct = 0;
+      continue;
+    }
+    if (r <= 0) {
+      w->error = r < 0 ? errno : ENOSPC;
+      mp_msg(MSGT_STREAM, MSGL_ERR, "[file] Write error at %"PRId64": %s\n",
+             (int64_t)pos, strerror(w->error));
+      break;
+    }
+    data += r;
+    pos += r;
+    len -= r;
+    w->writes++;
+    w->bytes += r;
+  }
+  w->write_time += GetTimerMS() - start;
+}
+
+#ifdef HAVE_PTHREADS
+
+static void *writer_thread(void *arg) {
+  file_writer_t *w = arg;
+
+  pthread_mutex_lock(&w->lock);
+  for (;;) {
+    write_buf_t *b;
+    if (w->tail == w->head) {
+      if (w->quit)
+        break;
+      pthread_cond_wait(&w->cond, &w->lock);
+      continue;
+    }
+    b = &w->buf[w->tail % w->nbufs];
+    pthread_mutex_unlock(&w->lock);
+    write_out(w, b);
+    pthread_mutex_lock(&w->lock);
+    w->tail++;
+    pthread_cond_broadcast(&w->cond);
+  }
+  pthread_mutex_unlock(&w->lock);
+  return NULL;
+}
+
+static int start_thread(file_writer_t *w) {
+  sigset_t sigs, oldsigs;
+  int err;
+
+  pthread_mutex_init(&w->lock, NULL);
+  pthread_cond_init(&w->cond, NULL);
+  /* signals must go to the encoder, which cleans up on them */
+  sigfillset(&sigs);
+  pthread_sigmask(SIG_SETMASK, &sigs, &oldsigs);
+  err = pthread_create(&w->thread, NULL, writer_thread, w);
+  pthread_sigmask(SIG_SETMASK, &oldsigs, NULL);
+  if (err) {
+    pthread_cond_destroy(&w->cond);
+    pthread_mutex_destroy(&w->lock);
+    mp_msg(MSGT_STREAM, MSGL_WARN, "[file] Cannot start the writer thread, writing directly\n");
+    return 0;
+  }
+  return 1;
+}
+
+#endif /* HAVE_PTHREADS */
+
+/// hand the current buffer to the thread or write it, start the next one
+static void submit(file_writer_t *w) {
+#ifdef HAVE_PTHREADS
+  if (w->threaded) {
+    unsigned int start = GetTimerMS();
+    pthread_mutex_lock(&w->lock);
+    w->head++;
+    pthread_cond_broadcast(&w->cond);
+    while (w->head - w->tail == w->nbufs)
+      pthread_cond_wait(&w->cond, &w->lock);
+    pthread_mutex_unlock(&w->lock);
+    w->wait_time += GetTimerMS() - start;
+    w->buf[w->head % w->nbufs].len = 0;
+    return;
+  }
+#endif
+  write_out(w, &w->buf[0]);
+  w->buf[0].len = 0;
+}
+
+static unsigned char *alloc_buffer(int size) {
+#ifdef HAVE_MEMALIGN
+  return memalign(WRITE_ALIGN, size);
+#else
+  return malloc(size);
+#endif
+}
+
+static void free_writer(file_writer_t *w) {
+  int i;
+  for (i = 0; i < WRITE_BUFFERS; i++)
+    free(w->buf[i].data);
+  free(w);
+}
+
+file_writer_t *file_writer_new(int fd, int seekable) {
+  file_writer_t *w;
+  int i;
+
+  if (file_write_buffer_size <= 0)
+    return NULL;
+  w = calloc(1, sizeof(*w));
+  if (!w)
+    return NULL;
+  w->fd = fd;
+  w->seekable = seekable;
+  w->size = (file_write_buffer_size * 1024 + WRITE_ALIGN - 1) & ~(WRITE_ALIGN - 1);
+  w->nbufs = 1;
+#ifdef HAVE_PTHREADS
+  if (file_write_thread)
+    w->nbufs = WRITE_BUFFERS;
+#endif
+  for (i = 0; i < w->nbufs; i++) {
+    w->buf[i].data = alloc_buffer(w->size);
+    if (!w->buf[i].data) {
+      free_writer(w);
+      return NULL;
+    }
+  }
+#if defined(O_DIRECT) && defined(HAVE_MEMALIGN)
+  w->direct = file_write_direct && seekable;
+#endif
+  if (seekable)
+    w->prealloc = (off_t)file_write_prealloc * 1024 * 1024;
+#ifdef HAVE_PTHREADS
+  if (w->nbufs > 1) {
+    w->threaded = start_thread(w);
+    if (!w->threaded)
+      w->nbufs = 1;
+  }
+#endif
+  mp_msg(MSGT_OPEN, MSGL_V, "[file] Writing in %d kB blocks%s%s%s\n", w->size / 1024,
+         w->nbufs > 1 ? " from a thread" : "", w->direct ? ", O_DIRECT" : "",
+         w->prealloc ? ", preallocating" : "");
+  return w;
+}
+
+int file_writer_write(file_writer_t *w, off_t pos, const unsigned char *data, int len) {
+  write_buf_t *b = &w->buf[w->head % w->nbufs];
+  int total = len;
+
+  if (b->len && pos != b->pos + b->len)
+    submit(w);
+  while (len > 0) {
+    int n;
+    b = &w->buf[w->head % w->nbufs];
+    if (!b->len) {
+      b->pos = pos;
+      // end on a multiple of the size, later buffers are aligned then
+      b->size = w->seekable ? w->size - pos % w->size : w->size;
+    }
+    n = b->size - b->len;
+    if (n > len)
+      n = len;
+    memcpy(b->data + b->len, data, n);
+    b->len += n;
+    data += n;
+    pos += n;
+    len -= n;
+    if (b->len == b->size)
+      submit(w);
+  }
+  return w->error ? -1 : total;
+}
+
+int file_writer_close(file_writer_t *w) {
+  int error;
+  struct stat st;
+
+  if (w->buf[w->head % w->nbufs].len)
+    submit(w);
+#ifdef HAVE_PTHREADS
+  if (w->threaded) {
+    pthread_mutex_lock(&w->lock);
+    w->quit = 1;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+    pthread_cond_destroy(&w->cond);
+    pthread_mutex_destroy(&w->lock);
+  }
+#endif
+  set_direct(w, 0);
+  // give back the space reserved beyond the end of the file
+  if (w->alloc_end && fstat(w->fd, &st) == 0 && st.st_size < w->alloc_end)
+    ftruncate(w->fd, st.st_size);
+  mp_msg(MSGT_STREAM, MSGL_V,
+         "[file] %"PRId64" bytes in %u writes, %u ms writing, %u ms waiting for the writer\n",
+         w->bytes, w->writes, w->write_time, w->wait_time);
+  error = w->error;
+  free_writer(w);
+  return error ? -1 : 0;
+}
@@ -0,0 +1,40 @@
+#ifndef FILE_WRITE_H
+#define FILE_WRITE_H
+
+#include <sys/types.h>
+
+/// size of the write buffers in kB, 0 writes directly
+extern int file_write_buffer_size;
+/// write from a separate thread so that the muxer does not wait for the disk
+extern int file_write_thread;
+/// bypass the page cache for aligned writes (O_DIRECT)
+extern int file_write_direct;
+/// reserve disk space in steps of this many MB ahead of the writes, 0 = off
+extern int file_write_prealloc;
+
+typedef struct file_writer_s file_writer_t;
+
+/**
+ * \brief set up buffered writing to fd
+ * \param seekable fd is a regular file, writes go to their position
+ *                 with pwrite(), otherwise they are appended in order
+ * \return NULL if buffering is disabled
+ */
+file_writer_t *file_writer_new(int fd, int seekable);
+
+/**
+ * \brief write len bytes at file position pos
+ *
+ * A write that does not continue the previous one starts a new buffer,
+ * buffers reach the file in the order they were written.
+ * \return len or -1 if an earlier write failed
+ */
+int file_writer_write(file_writer_t *w, off_t pos, const unsigned char *data, int len);
+
+/**
+ * \brief write out everything buffered and free w, fd is left open
+ * \return 0 or -1 if any write failed
+ */
+int file_writer_close(file_writer_t *w);
+
+#endif /* FILE_WRITE_H */
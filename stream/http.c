@@ -34,6 +34,14 @@ extern int network_bandwidth;
 
 extern int http_seek(stream_t *stream, off_t pos);
 
+/// size of the ranges requested after a seek in kB, 0 reconnects on every seek
+int http_range_size = 256;
+/// request the next range before the current one is consumed
+int http_prefetch = 1;
+
+#define HTTP_KA_BUFFER_SIZE (32*1024)
+#define HTTP_KA_MAX_RANGE (16*1024*1024)
+
 typedef struct {
   unsigned metaint;
   unsigned metapos;
@@ -862,10 +870,327 @@ out:
 	return res;
 }
 
+/**
+ * Seeking over a persistent connection.
+ *
+ * The response to the initial request is read until the first seek. After
+ * that the file is fetched in ranges starting at http_range_size kB and
+ * doubling while it is read sequentially, and the request for the next
+ * range is pipelined once half of the current one has been read. A seek
+ * only costs a round trip: the rest of the outstanding ranges is drained
+ * when that is cheaper than a new connection, short forward seeks are done
+ * by reading. Small reads are served from a HTTP_KA_BUFFER_SIZE buffer
+ * instead of one recv() each.
+ */
+typedef struct {
+  stream_t *stream;
+  int reuse;        ///< the server keeps the connection after this response
+  off_t pos;        ///< stream position of the next body byte
+  off_t size;       ///< file size from Content-Range, 0 if unknown
+  off_t left;       ///< body bytes of the current response not read yet
+  off_t req_end;    ///< end of the last requested range
+  off_t range;      ///< length of the next range to request
+  off_t pipe_pos;   ///< start of the pipelined request, -1 if there is none
+  int buf_pos;
+  int buf_len;
+  int requests;
+  int connects;
+  int skips;
+  char buf[HTTP_KA_BUFFER_SIZE];
+} http_ka_t;
+
+static void ka_disconnect(http_ka_t *ka) {
+  if (ka->stream->fd >= 0)
+    closesocket(ka->stream->fd);
+  ka->stream->fd = -1;
+  ka->left = 0;
+  ka->pipe_pos = -1;
+  ka->buf_pos = ka->buf_len = 0;
+}
+
+static int ka_fill(http_ka_t *ka) {
+  int ret;
+  if (ka->buf_pos > 0) {
+    memmove(ka->buf, ka->buf + ka->buf_pos, ka->buf_len - ka->buf_pos);
+    ka->buf_len -= ka->buf_pos;
+    ka->buf_pos = 0;
+  }
+  if (ka->buf_len == HTTP_KA_BUFFER_SIZE)
+    return -1;
+  ret = recv(ka->stream->fd, ka->buf + ka->buf_len,
+             HTTP_KA_BUFFER_SIZE - ka->buf_len, 0);
+  if (ret > 0)
+    ka->buf_len += ret;
+  return ret;
+}
+
+static int ka_request(http_ka_t *ka, off_t pos) {
+  stream_t *s = ka->stream;
+  off_t end = pos + ka->range;
+  if (ka->size && end > ka->size)
+    end = ka->size;
+  if (s->fd < 0) {
+    ka->buf_pos = ka->buf_len = 0;
+    ka->connects++;
+  }
+  s->fd = http_send_range_request(s->streaming_ctrl->url, s->fd, pos, end);
+  if (s->fd < 0)
+    return 0;
+  ka->requests++;
+  ka->req_end = end;
+  if (ka->range < HTTP_KA_MAX_RANGE)
+    ka->range *= 2;
+  return 1;
+}
+
+/// \return length of the response header at the start of buf or 0
+static int ka_header_len(const char *buf, int len) {
+  int i;
+  for (i = 1; i < len; i++)
+    if (buf[i] == '\n') {
+      if (buf[i - 1] == '\n')
+        return i + 1;
+      if (i >= 3 && !memcmp(buf + i - 3, "\r\n\r", 3))
+        return i + 1;
+    }
+  return 0;
+}
+
+/// read the header of the response starting at ka->pos
+static int ka_response(http_ka_t *ka) {
+  HTTP_header_t *http_hdr;
+  char *field;
+  int64_t first, last, total = 0;
+  int len, ret = 0;
+
+  while (!(len = ka_header_len(ka->buf + ka->buf_pos, ka->buf_len - ka->buf_pos)))
+    if (ka_fill(ka) <= 0)
+      return 0;
+  http_hdr = http_new_header();
+  if (!http_hdr)
+    return 0;
+  http_response_append(http_hdr, ka->buf + ka->buf_pos, len);
+  ka->buf_pos += len;
+  if (http_response_parse(http_hdr) < 0)
+    goto out;
+  if (mp_msg_test(MSGT_NETWORK, MSGL_DBG2))
+    http_debug_hdr(http_hdr);
+
+  field = http_get_field(http_hdr, "Connection");
+  if (field)
+    ka->reuse = strcasecmp(field, "close") != 0;
+  else
+    ka->reuse = http_hdr->http_minor_version > 0;
+
+  if (http_hdr->status_code == 416) { // past the end of the file
+    ka->size = ka->pos;
+    ka->left = 0;
+    ret = 1;
+    goto out;
+  }
+  if (http_hdr->status_code != 206) {
+    mp_msg(MSGT_NETWORK, MSGL_ERR, MSGTR_MPDEMUX_NW_ErrServerReturned,
+           http_hdr->status_code, http_hdr->reason_phrase);
+    goto out;
+  }
+  if (http_get_field(http_hdr, "Transfer-Encoding"))
+    goto out;
+  field = http_get_field(http_hdr, "Content-Range");
+  if (!field ||
+      sscanf(field, "bytes %"SCNd64"-%"SCNd64"/%"SCNd64, &first, &last, &total) < 2 ||
+      first != ka->pos || last < first) {
+    mp_msg(MSGT_NETWORK, MSGL_V, "http: unexpected Content-Range: %s\n",
+           field ? field : "none");
+    goto out;
+  }
+  ka->left = last - first + 1;
+  if (total > 0)
+    ka->size = total;
+  ret = 1;
+out:
+  http_free(http_hdr);
+  return ret;
+}
+
+/// start reading the response for ka->pos, requesting it if needed
+static int ka_next(http_ka_t *ka) {
+  int i;
+  for (i = 0; i < 2; i++) {
+    if (ka->pipe_pos < 0) {
+      if (!ka->reuse)
+        ka_disconnect(ka);
+      if (!ka_request(ka, ka->pos))
+        continue;
+    }
+    ka->pipe_pos = -1;
+    if (ka_response(ka))
+      return 1;
+    // the server may have dropped an idle connection, try a fresh one
+    ka_disconnect(ka);
+  }
+  return 0;
+}
+
+static void ka_prefetch(http_ka_t *ka) {
+  off_t next = ka->req_end;
+  if (!http_prefetch || !ka->reuse || ka->pipe_pos >= 0 ||
+      ka->left > ka->range / 4 ||   // half of the last requested range
+      (ka->size && next >= ka->size))
+    return;
+  if (ka_request(ka, next))
+    ka->pipe_pos = next;
+}
+
+/// read from the body of the current response
+static int ka_body(http_ka_t *ka, char *buffer, int size) {
+  int len = size < ka->left ? size : ka->left;
+  if (ka->buf_pos == ka->buf_len) {
+    if (len >= HTTP_KA_BUFFER_SIZE / 2)
+      len = recv(ka->stream->fd, buffer, len, 0);
+    else if (ka_fill(ka) <= 0)
+      return -1;
+  }
+  if (ka->buf_pos < ka->buf_len) {
+    if (len > ka->buf_len - ka->buf_pos)
+      len = ka->buf_len - ka->buf_pos;
+    memcpy(buffer, ka->buf + ka->buf_pos, len);
+    ka->buf_pos += len;
+  }
+  if (len > 0) {
+    ka->left -= len;
+    ka->pos += len;
+  }
+  return len;
+}
+
+static int http_ka_read(int fd, char *buffer, int size, streaming_ctrl_t *sc) {
+  http_ka_t *ka = sc->data;
+  int len, retry = 0;
+  for (;;) {
+    if (!ka->left) {
+      if (ka->size && ka->pos >= ka->size)
+        return 0;
+      if (!ka_next(ka) || !ka->left)
+        return 0;
+    }
+    ka_prefetch(ka);
+    len = ka_body(ka, buffer, size);
+    if (len > 0)
+      return len;
+    if (retry++)
+      return -1;
+    // connection lost in the middle of a response, resume from here
+    mp_msg(MSGT_NETWORK, MSGL_V, "http: connection lost, reconnecting\n");
+    ka_disconnect(ka);
+  }
+}
+
+/// finish the outstanding responses so the connection can be reused
+static int ka_drain(http_ka_t *ka) {
+  char tmp[4096];
+  while (ka->left > 0)
+    if (ka_body(ka, tmp, sizeof(tmp)) <= 0)
+      return 0;
+  if (ka->pipe_pos >= 0) {
+    ka->pos = ka->pipe_pos;
+    ka->pipe_pos = -1;
+    if (!ka_response(ka))
+      return 0;
+    while (ka->left > 0)
+      if (ka_body(ka, tmp, sizeof(tmp)) <= 0)
+        return 0;
+  }
+  return ka->reuse;
+}
+
+static void http_ka_close(stream_t *stream) {
+  http_ka_t *ka = stream->streaming_ctrl->data;
+  if (ka->requests)
+    mp_msg(MSGT_NETWORK, MSGL_V,
+           "http: %d range requests on %d connections, %d seeks done by reading\n",
+           ka->requests, ka->connects, ka->skips);
+  free(ka);
+  stream->streaming_ctrl->data = NULL;
+}
+
+static int http_ka_seek(stream_t *stream, off_t pos) {
+  streaming_ctrl_t *sc = stream->streaming_ctrl;
+  http_ka_t *ka = sc->data;
+  off_t limit = (off_t)http_range_size * 1024;
+  char tmp[4096];
+  int len;
+
+  if (pos >= ka->pos && pos - ka->pos <= HTTP_KA_BUFFER_SIZE) {
+    while (ka->pos < pos) {
+      len = pos - ka->pos < (off_t)sizeof(tmp) ? pos - ka->pos : sizeof(tmp);
+      if (http_ka_read(stream->fd, tmp, len, sc) <= 0)
+        break;
+    }
+    if (ka->pos == pos) {
+      ka->skips++;
+      stream->pos = pos;
+      return 1;
+    }
+    ka_disconnect(ka);
+  } else {
+    off_t outstanding = ka->left;
+    if (ka->pipe_pos >= 0)
+      outstanding += ka->req_end - ka->pipe_pos;
+    // a pipelined range may add another half range on top of the current one
+    if (!ka->reuse || outstanding > limit + limit / 2 || !ka_drain(ka))
+      ka_disconnect(ka);
+  }
+
+  ka->pos = pos;
+  ka->left = 0;
+  ka->pipe_pos = -1;
+  ka->range = limit;
+  if (!ka_next(ka)) {
+    mp_msg(MSGT_NETWORK, MSGL_V, "http: range requests failed, reconnecting on every seek\n");
+    ka_disconnect(ka);
+    http_ka_close(stream);
+    stream->close = NULL;
+    stream->seek = http_seek;
+    sc->streaming_read = nop_streaming_read;
+    return http_seek(stream, pos);
+  }
+  stream->pos = pos;
+  return 1;
+}
+
+/// take over the initial response, whose body is buffered in streaming_ctrl
+static void http_ka_open(stream_t *stream, off_t content_length) {
+  streaming_ctrl_t *sc = stream->streaming_ctrl;
+  int buffered = sc->buffer_size - sc->buffer_pos;
+  http_ka_t *ka;
+  if (buffered > HTTP_KA_BUFFER_SIZE || !(ka = calloc(1, sizeof(http_ka_t))))
+    return;
+  ka->stream = stream;
+  ka->pipe_pos = -1;
+  ka->range = (off_t)http_range_size * 1024;
+  // the initial request asked for the whole file and Connection: close
+  ka->size = ka->req_end = content_length;
+  ka->left = content_length > 0 ? content_length : INT64_MAX;
+  if (buffered > 0)
+    memcpy(ka->buf, sc->buffer + sc->buffer_pos, buffered);
+  ka->buf_len = buffered;
+  free(sc->buffer);
+  sc->buffer = NULL;
+  sc->buffer_size = sc->buffer_pos = 0;
+  // the response header is not needed any more, the size is taken
+  http_free(sc->data);
+  sc->data = ka;
+  sc->streaming_read = http_ka_read;
+  stream->seek = http_ka_seek;
+  stream->close = http_ka_close;
+}
+
 static int fixup_open(stream_t *stream,int seekable) {
 	HTTP_header_t *http_hdr = stream->streaming_ctrl->data;
 	int is_icy = http_hdr && http_get_field(http_hdr, "Icy-MetaInt");
 	int is_ultravox = strcasecmp(stream->streaming_ctrl->url->protocol, "unsv") == 0;
+	char *field = http_hdr ? http_get_field(http_hdr, "Content-Length") : NULL;
+	off_t content_length = field ? strtoll(field, NULL, 10) : 0;
 
 	stream->type = STREAMTYPE_STREAM;
 	if(!is_icy && !is_ultravox && seekable)
@@ -885,6 +1210,9 @@ static int fixup_open(stream_t *stream,int seekable) {
 		return STREAM_UNSUPORTED;
 	}
 
+	if(stream->seek == http_seek && http_range_size > 0)
+		http_ka_open(stream, content_length);
+
 	fixup_network_stream_cache(stream);
 	return STREAM_OK;
 }
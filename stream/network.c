@@ -175,12 +175,11 @@ check4proxies( URL_t *url ) {
 	return url_out;
 }
 
-int
-http_send_request( URL_t *url, off_t pos ) {
+static int
+http_send_request_full( URL_t *url, int fd, off_t pos, off_t end ) {
 	HTTP_header_t *http_hdr;
 	URL_t *server_url;
 	char str[256];
-	int fd = -1;
 	int ret;
 	int proxy = 0;		// Boolean
 
@@ -209,7 +208,12 @@ http_send_request( URL_t *url, off_t pos ) {
 
 	http_set_field(http_hdr, "Icy-MetaData: 1");
 
-	if(pos>0) { 
+	if(end>0) {
+	    // bounded range on a persistent connection
+	    http_hdr->http_minor_version = 1;
+	    snprintf(str, 256, "Range: bytes=%"PRId64"-%"PRId64, (int64_t)pos, (int64_t)end-1);
+	    http_set_field(http_hdr, str);
+	} else if(pos>0) { 
 	// Extend http_send_request with possibility to do partial content retrieval
 	    snprintf(str, 256, "Range: bytes=%"PRId64"-", (int64_t)pos);
 	    http_set_field(http_hdr, str);
@@ -217,7 +221,7 @@ http_send_request( URL_t *url, off_t pos ) {
 	    
 	if (network_cookies_enabled) cookies_set( http_hdr, server_url->hostname, server_url->url );
 	
-	http_set_field( http_hdr, "Connection: close");
+	http_set_field( http_hdr, end>0 ? "Connection: keep-alive" : "Connection: close");
 	http_add_basic_authentication( http_hdr, url->username, url->password );
 	if( http_build_request( http_hdr )==NULL ) {
 		goto err_out;
@@ -225,12 +229,14 @@ http_send_request( URL_t *url, off_t pos ) {
 
 	if( proxy ) {
 		if( url->port==0 ) url->port = 8080;			// Default port for the proxy server
-		fd = connect2Server( url->hostname, url->port,1 );
+		if( fd<0 )
+			fd = connect2Server( url->hostname, url->port,1 );
 		url_free( server_url );
 		server_url = NULL;
 	} else {
 		if( server_url->port==0 ) server_url->port = 80;	// Default port for the web server
-		fd = connect2Server( server_url->hostname, server_url->port,1 );
+		if( fd<0 )
+			fd = connect2Server( server_url->hostname, server_url->port,1 );
 	}
 	if( fd<0 ) {
 		goto err_out;
@@ -254,6 +260,16 @@ err_out:
 	return -1;
 }
 
+int
+http_send_request( URL_t *url, off_t pos ) {
+	return http_send_request_full( url, -1, pos, 0 );
+}
+
+int
+http_send_range_request( URL_t *url, int fd, off_t pos, off_t end ) {
+	return http_send_request_full( url, fd, pos, end );
+}
+
 HTTP_header_t *
 http_read_response( int fd ) {
 	HTTP_header_t *http_hdr;
@@ -341,6 +357,11 @@ http_seek( stream_t *stream, off_t pos ) {
 	if( stream==NULL ) return 0;
 
 	if( stream->fd>0 ) closesocket(stream->fd); // need to reconnect to seek in http-stream
+	// drop what is left of the previous response
+	free( stream->streaming_ctrl->buffer );
+	stream->streaming_ctrl->buffer = NULL;
+	stream->streaming_ctrl->buffer_size = 0;
+	stream->streaming_ctrl->buffer_pos = 0;
 	fd = http_send_request( stream->streaming_ctrl->url, pos ); 
 	if( fd<0 ) return 0;
 
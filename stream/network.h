@@ -58,6 +58,12 @@ int nop_streaming_seek( int fd, off_t pos, streaming_ctrl_t *stream_ctrl );
 void streaming_ctrl_free( streaming_ctrl_t *streaming_ctrl );
 
 int http_send_request(URL_t *url, off_t pos);
+/**
+ * \brief request the bytes [pos, end) over a persistent connection
+ * \param fd connection to reuse, a new one is opened if it is < 0
+ * \return the socket, or -1 after closing it on error
+ */
+int http_send_range_request(URL_t *url, int fd, off_t pos, off_t end);
 HTTP_header_t *http_read_response(int fd);
 
 int http_authenticate(HTTP_header_t *http_hdr, URL_t *url, int *auth_retry);
@@ -30,6 +30,7 @@
 #define DEBUG        1
 #include "mp_msg.h"
 #include "rtp.h"
+#include "udp_recv.h"
 
 // RTP reorder routines
 // Also handling of repeated UDP packets (a bug of ExtremeNetworks switches firmware)
@@ -63,6 +64,7 @@ struct rtpbuffer
 	unsigned short first;
 };
 static struct rtpbuffer rtpbuf;
+static udp_recv_t *receiver;
 
 static int getrtp2(int fd, struct rtpheader *rh, char** data, int* lengthData);
 
@@ -200,6 +202,10 @@ static int rtp_get_next(int fd, char *buffer, int length)
 }
 
 
+void rtp_set_receiver(udp_recv_t *r) {
+	receiver = r;
+}
+
 // Read next rtp packet using cache 
 int read_rtp_from_server(int fd, char *buffer, int length) {
 	// Following test is ASSERT (i.e. uneuseful if code is correct)
@@ -222,7 +228,10 @@ static int getrtp2(int fd, struct rtpheader *rh, char** data, int* lengthData) {
   char* charP = (char*) &intP;
   int headerSize;
   int lengthPacket;
-  lengthPacket=recv(fd,buf,1590,0);
+  if(receiver)
+    lengthPacket=udp_recv_packet(receiver,buf,1590);
+  else
+    lengthPacket=recv(fd,buf,1590,0);
   if (lengthPacket<0)
     mp_msg(MSGT_NETWORK,MSGL_ERR,"rtp: socket read error\n");
   else if (lengthPacket<12)
@@ -9,5 +9,8 @@
 #define _RTP_H
 
 int read_rtp_from_server(int fd, char *buffer, int length);
+struct udp_recv_s;
+// read packets through a receive thread instead of from the socket
+void rtp_set_receiver(struct udp_recv_s *r);
 
 #endif
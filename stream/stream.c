@@ -252,20 +252,20 @@ int stream_fill_buffer(stream_t *s){
   case STREAMTYPE_STREAM:
 #ifdef MPLAYER_NETWORK
     if( s->streaming_ctrl!=NULL ) {
-	    len=s->streaming_ctrl->streaming_read(s->fd,s->buffer,STREAM_BUFFER_SIZE, s->streaming_ctrl);break;
+	    len=s->streaming_ctrl->streaming_read(s->fd,s->buffer,s->buffer_size, s->streaming_ctrl);break;
     } else {
-      len=read(s->fd,s->buffer,STREAM_BUFFER_SIZE);break;
+      len=read(s->fd,s->buffer,s->buffer_size);break;
     }
 #else
-    len=read(s->fd,s->buffer,STREAM_BUFFER_SIZE);break;
+    len=read(s->fd,s->buffer,s->buffer_size);break;
 #endif
   case STREAMTYPE_DS:
-    len = demux_read_data((demux_stream_t*)s->priv,s->buffer,STREAM_BUFFER_SIZE);
+    len = demux_read_data((demux_stream_t*)s->priv,s->buffer,s->buffer_size);
     break;
   
     
   default: 
-    len= s->fill_buffer ? s->fill_buffer(s,s->buffer,STREAM_BUFFER_SIZE) : 0;
+    len= s->fill_buffer ? s->fill_buffer(s,s->buffer,s->buffer_size) : 0;
   }
   if(len<=0){ s->eof=1; s->buf_pos=s->buf_len=0; return 0; }
   s->buf_pos=0;
@@ -387,6 +387,14 @@ int stream_control(stream_t *s, int cmd, void *arg){
   return s->control(s, cmd, arg);
 }
 
+/// refresh end_pos of a stream that is still being written to
+void stream_update_size(stream_t *s){
+  off_t size;
+  if(!(s->flags & STREAM_GROWING)) return;
+  if(stream_control(s, STREAM_CTRL_GET_SIZE, &size) == STREAM_OK && size > s->end_pos)
+    s->end_pos = size;
+}
+
 stream_t* new_memory_stream(unsigned char* data,int len){
   stream_t *s;
 
@@ -396,6 +404,8 @@ stream_t* new_memory_stream(unsigned char* data,int len){
   memset(s,0,sizeof(stream_t));
   s->fd=-1;
   s->type=STREAMTYPE_MEMORY;
+  s->buffer=s->buffer_data;
+  s->buffer_size=len;
   s->buf_pos=0; s->buf_len=len;
   s->start_pos=0; s->end_pos=len;
   stream_reset(s);
@@ -419,6 +429,8 @@ stream_t* new_stream(int fd,int type){
   
   s->fd=fd;
   s->type=type;
+  s->buffer=s->buffer_data;
+  s->buffer_size=STREAM_BUFFER_SIZE;
   s->buf_pos=s->buf_len=0;
   s->start_pos=s->end_pos=0;
   s->priv=NULL;
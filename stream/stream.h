@@ -27,6 +27,7 @@
 #define STREAMTYPE_RADIO 19
 
 #define STREAM_BUFFER_SIZE 2048
+#define STREAM_MAX_BUFFER_SIZE (1024*1024)
 
 #define VCD_SECTOR_SIZE 2352
 #define VCD_SECTOR_OFFS 24
@@ -41,6 +42,8 @@
 #define STREAM_SEEK_BW  2
 #define STREAM_SEEK_FW  4
 #define STREAM_SEEK  (STREAM_SEEK_BW|STREAM_SEEK_FW)
+/// the stream is still being written to, see stream_update_size()
+#define STREAM_GROWING 8
 
 //////////// Open return code
 /// This can't open the requested protocol (used by stream wich have a
@@ -100,6 +103,8 @@ typedef struct stream_st {
   int flags;
   int sector_size; // sector size (seek will be aligned on this size if non 0)
   unsigned int buf_pos,buf_len;
+  unsigned char* buffer; // buffer_data unless the stream set up its own
+  int buffer_size; // max_len passed to fill_buffer
   off_t pos,start_pos,end_pos;
   int eof;
   int mode; //STREAM_READ or STREAM_WRITE
@@ -110,11 +115,14 @@ typedef struct stream_st {
 #ifdef MPLAYER_NETWORK
   streaming_ctrl_t *streaming_ctrl;
 #endif
-  unsigned char buffer[STREAM_BUFFER_SIZE>VCD_SECTOR_SIZE?STREAM_BUFFER_SIZE:VCD_SECTOR_SIZE];
+  // must stay last, new_memory_stream() allocates its data behind it
+  unsigned char buffer_data[STREAM_BUFFER_SIZE>VCD_SECTOR_SIZE?STREAM_BUFFER_SIZE:VCD_SECTOR_SIZE];
 } stream_t;
 
 #ifdef USE_STREAM_CACHE
 int stream_enable_cache(stream_t *stream,int size,int min,int prefill);
+/// wait until the cache holds min bytes ahead again, 0 if interrupted
+int stream_cache_refill(stream_t *stream,int min);
 int cache_stream_fill_buffer(stream_t *s);
 int cache_stream_seek_long(stream_t *s,off_t pos);
 #else
@@ -124,6 +132,7 @@ int stream_seek_long(stream_t *s,off_t pos);
 #define cache_stream_fill_buffer(x) stream_fill_buffer(x)
 #define cache_stream_seek_long(x,y) stream_seek_long(x,y)
 #define stream_enable_cache(x,y,z,w) 1
+#define stream_cache_refill(x,y) 1
 #endif
 void fixup_network_stream_cache(stream_t *stream);
 int stream_write_buffer(stream_t *s, unsigned char *buf, int len);
@@ -222,6 +231,42 @@ inline static int stream_read(stream_t *s,char* mem,int total){
   return total;
 }
 
+/**
+ * \brief look at the buffered data without consuming it
+ * \param len returns the number of bytes available at the pointer
+ * \return pointer into the stream buffer or NULL at EOF
+ *
+ * The buffer is only refilled when it is empty. The pointer stays valid
+ * until the next call that reads from or seeks the stream.
+ */
+inline static unsigned char* stream_peek(stream_t *s, int *len){
+  if(s->buf_pos>=s->buf_len && !cache_stream_fill_buffer(s)){
+    *len=0;
+    return NULL;
+  }
+  *len=s->buf_len-s->buf_pos;
+  return s->buffer+s->buf_pos;
+}
+
+/**
+ * \brief consume len bytes and return them in place, without a copy
+ * \param pad number of readable bytes needed after the data, e.g. for
+ *            decoders that read past the end of their input
+ * \return pointer into the stream buffer or NULL if the data is not
+ *         completely buffered, in that case nothing is consumed and the
+ *         caller should fall back to stream_read()
+ *
+ * The pointer stays valid until the next call that reads from or seeks
+ * the stream.
+ */
+inline static unsigned char* stream_borrow(stream_t *s, int len, int pad){
+  unsigned char* p;
+  int avail;
+  if(len<0 || !(p=stream_peek(s,&avail)) || avail-pad<len) return NULL;
+  s->buf_pos+=len;
+  return p;
+}
+
 inline static unsigned char* stream_read_line(stream_t *s,unsigned char* mem, int max) {
   int len;
   unsigned char* end,*ptr = mem;;
@@ -291,6 +336,7 @@ inline static int stream_skip(stream_t *s,off_t len){
 
 void stream_reset(stream_t *s);
 int stream_control(stream_t *s, int cmd, void *arg);
+void stream_update_size(stream_t *s);
 stream_t* new_stream(int fd,int type);
 void free_stream(stream_t *s);
 stream_t* new_memory_stream(unsigned char* data,int len);
@@ -303,6 +349,10 @@ extern int dvd_chapter;
 extern int dvd_last_chapter;
 extern int dvd_angle;
 
+extern int stream_file_buffer_size;
+extern int stream_file_mmap;
+extern int stream_file_follow;
+
 extern char * audio_stream;
 
 typedef struct {
@@ -44,6 +44,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
 #include "help_mp.h"
 #include "m_option.h"
 #include "m_struct.h"
+#include "osdep/timer.h"
 
 #include "dvbin.h"
 
@@ -115,7 +116,7 @@ extern int dvb_set_ts_filt(int fd, uint16_t pid, dmx_pes_type_t pestype);
 extern int dvb_demux_stop(int fd);
 extern int dvb_get_tuner_type(int fd);
 int dvb_open_devices(dvb_priv_t *priv, int n, int demux_cnt, int *pids);
-int dvb_fix_demuxes(dvb_priv_t *priv, int cnt, int *pids);
+int dvb_swap_filters(dvb_priv_t *priv, int cnt, int *pids);
 
 extern int dvb_tune(dvb_priv_t *priv, int freq, char pol, int srate, int diseqc, int tone,
 		fe_spectral_inversion_t specInv, fe_modulation_t modulation, fe_guard_interval_t guardInterval,
@@ -126,6 +127,64 @@ extern char *dvb_dvrdev[4], *dvb_demuxdev[4], *dvb_frontenddev[4];
 static dvb_config_t *dvb_config = NULL;
 
 
+static unsigned int dvb_name_hash(const char *name)
+{
+	unsigned int h = 0;
+	while(*name)
+		h = h * 31 + (unsigned char) *name++;
+	return h;
+}
+
+static void dvb_hash_channels(dvb_channels_list *list)
+{
+	int i, size = 16;
+	unsigned int h;
+
+	while(size < 2 * list->NUM_CHANNELS)
+		size *= 2;
+	list->hash = malloc(size * sizeof(int));
+	if(list->hash == NULL)
+		return;
+	list->hash_size = size;
+	for(i = 0; i < size; i++)
+		list->hash[i] = -1;
+
+	// keep the first of several channels with the same name, as the linear search did
+	for(i = 0; i < list->NUM_CHANNELS; i++)
+	{
+		h = dvb_name_hash(list->channels[i].name) & (size - 1);
+		while(list->hash[h] >= 0 && strcmp(list->channels[list->hash[h]].name, list->channels[i].name))
+			h = (h + 1) & (size - 1);
+		if(list->hash[h] < 0)
+			list->hash[h] = i;
+	}
+}
+
+/// number of the channel called name, -1 if there is none
+int dvb_find_channel(dvb_channels_list *list, const char *name)
+{
+	unsigned int h;
+	int i;
+
+	if(list->hash == NULL)
+	{
+		for(i = 0; i < list->NUM_CHANNELS; i++)
+			if(! strcmp(list->channels[i].name, name))
+				return i;
+		return -1;
+	}
+
+	h = dvb_name_hash(name) & (list->hash_size - 1);
+	while(list->hash[h] >= 0)
+	{
+		if(! strcmp(list->channels[list->hash[h]].name, name))
+			return list->hash[h];
+		h = (h + 1) & (list->hash_size - 1);
+	}
+	return -1;
+}
+
+
 static dvb_channels_list *dvb_get_channels(char *filename, int type)
 {
 	dvb_channels_list  *list;
@@ -134,6 +193,7 @@ static dvb_channels_list *dvb_get_channels(char *filename, int type)
 
 	int fields, cnt, pcnt, k;
 	int has8192, has0;
+	unsigned int start = GetTimer();
 	dvb_channel_t *ptr, *tmp, chn;
 	char tmp_lcr[256], tmp_hier[256], inv[256], bw[256], cr[256], mod[256], transm[256], gi[256], vpid_str[256], apid_str[256];
 	const char *cbl_conf = "%d:%255[^:]:%d:%255[^:]:%255[^:]:%255[^:]:%255[^:]\n";
@@ -148,7 +208,7 @@ static dvb_channels_list *dvb_get_channels(char *filename, int type)
 		return NULL;
 	}
 
-	list = malloc(sizeof(dvb_channels_list));
+	list = calloc(1, sizeof(dvb_channels_list));
 	if(list == NULL)
 	{
 		fclose(f);
@@ -420,6 +480,9 @@ static dvb_channels_list *dvb_get_channels(char *filename, int type)
 	}
 
 	list->current = 0;
+	dvb_hash_channels(list);
+	mp_msg(MSGT_DEMUX, MSGL_V, "DVB_GET_CHANNELS: %d channels read in %u ms\n",
+		list->NUM_CHANNELS, (GetTimer() - start) / 1000);
 	return list;
 }
 
@@ -467,15 +530,27 @@ static int dvb_streaming_read(stream_t *stream, char *buffer, int size)
 
 static void dvbin_close(stream_t *stream);
 
+/// throw away what the dvr device has buffered, without waiting for more
+static void dvb_drain_dvr(dvb_priv_t *priv)
+{
+	char buf[4096];
+	int i;
+
+	// filters still running on the multiplex keep it busy, don't chase them
+	for(i = 0; i < 256; i++)
+		if(read(priv->dvr_fd, buf, sizeof(buf)) <= 0)
+			break;
+}
+
 int dvb_set_channel(dvb_priv_t *priv, int card, int n)
 {
 	dvb_channels_list *new_list;
 	dvb_channel_t *channel;
 	stream_t *stream  = (stream_t*) priv->stream;
-	char buf[4096];
 	dvb_config_t *conf = (dvb_config_t *) priv->config;
 	int devno;
-	int i;
+	int i, retune, filters = 0;
+	unsigned int t_start, t_tune = 0, t_filters = 0, t;
 
 	if((card < 0) || (card > conf->count))
 	{
@@ -491,14 +566,33 @@ int dvb_set_channel(dvb_priv_t *priv, int card, int n)
 		return 0;
 	}
 	channel = &(new_list->channels[n]);
+	t_start = GetTimer();
+
+	// a channel on the multiplex we are tuned to only needs other PID filters
+	retune = !priv->is_on || priv->card != card || channel->freq != priv->last_freq;
+	if(priv->tuner_type == TUNER_SAT && (channel->pol != priv->last_pol || channel->diseqc != priv->last_diseqc))
+		retune = 1;
 	
 	if(priv->is_on)	//the fds are already open and we have to stop the demuxers
 	{
-		for(i = 0; i < priv->demux_fds_cnt; i++)
-			dvb_demux_stop(priv->demux_fds[i]);
+		if(retune)
+		{
+			for(i = 0; i < priv->demux_fds_cnt; i++)
+			{
+				dvb_demux_stop(priv->demux_fds[i]);
+				priv->demux_pids[i] = -1;
+			}
+		}
+		else
+		{
+			t = GetTimer();
+			filters = dvb_swap_filters(priv, channel->pids_cnt, channel->pids);
+			if(filters < 0)
+				return 0;
+			t_filters = GetTimer() - t;
+		}
 			
-		priv->retry = 0;
-		while(dvb_streaming_read(stream, buf, 4096) > 0);	//empty both the stream's and driver's buffer
+		dvb_drain_dvr(priv);	//empty the driver's buffer, the stream's is reset below
 		if(priv->card != card)
 		{
 			dvbin_close(stream);
@@ -508,11 +602,6 @@ int dvb_set_channel(dvb_priv_t *priv, int card, int n)
 				return 0;
 			}
 		}
-		else	//close all demux_fds with pos > pids required for the new channel or open other demux_fds if we have too few
-		{	
-			if(! dvb_fix_demuxes(priv, channel->pids_cnt, channel->pids))
-				return 0;
-		}
 	}
 	else
 	{
@@ -535,20 +624,33 @@ int dvb_set_channel(dvb_priv_t *priv, int card, int n)
 	stream_reset(stream);
 
 
-	if(channel->freq != priv->last_freq)
+	if(retune)
+	{
+		t = GetTimer();
 		if (! dvb_tune(priv, channel->freq, channel->pol, channel->srate, channel->diseqc, channel->tone,
 			channel->inv, channel->mod, channel->gi, channel->trans, channel->bw, channel->cr, channel->cr_lp, channel->hier, priv->timeout))
 			return 0;
+		t_tune = GetTimer() - t;
+	}
 
 	priv->last_freq = channel->freq;
+	priv->last_pol = channel->pol;
+	priv->last_diseqc = channel->diseqc;
 	priv->is_on = 1;
 
-	//sets demux filters and restart the stream
-	for(i = 0; i < channel->pids_cnt; i++)
+	//sets demux filters and restart the stream, unless the swap did it already
+	if(retune)
 	{
-		if(! dvb_set_ts_filt(priv->demux_fds[i], channel->pids[i], DMX_PES_OTHER))
+		t = GetTimer();
+		filters = dvb_swap_filters(priv, channel->pids_cnt, channel->pids);
+		if(filters < 0)
 			return 0;
+		t_filters = GetTimer() - t;
 	}
+
+	t = GetTimer() - t_start;
+	mp_msg(MSGT_DEMUX, MSGL_V, "DVB_SET_CHANNEL: %s in %u us: tune %u us, %d filters %u us, stop and flush %u us\n",
+		retune ? "retuned" : "same multiplex", t, t_tune, filters, t_filters, t - t_tune - t_filters);
 	
 	return 1;
 }
@@ -619,19 +721,12 @@ static int dvb_streaming_start(dvb_priv_t *priv, struct stream_priv_s *opts, int
 
 	priv->is_on = 0;
 
-	i = 0;
-	while((channel == NULL) && i < priv->list->NUM_CHANNELS)
-	{
-		if(! strcmp(priv->list->channels[i].name, progname))
-			channel = &(priv->list->channels[i]);
-
-		i++;
-	}
-
-	if(channel != NULL)
+	i = dvb_find_channel(priv->list, progname);
+	if(i >= 0)
 	{
-		priv->list->current = i-1;
-		mp_msg(MSGT_DEMUX, MSGL_V, "PROGRAM NUMBER %d: name=%s, freq=%u\n", i-1, channel->name, channel->freq);
+		channel = &(priv->list->channels[i]);
+		priv->list->current = i;
+		mp_msg(MSGT_DEMUX, MSGL_V, "PROGRAM NUMBER %d: name=%s, freq=%u\n", i, channel->name, channel->freq);
 	}
 	else
 	{
@@ -34,6 +34,7 @@
 #include "m_struct.h"
 
 #include "stream_dvd.h"
+#include "dvd_readahead.h"
 #include "libmpdemux/demuxer.h"
 
 extern int stream_cache_size;
@@ -296,13 +297,13 @@ int dvd_sid_from_lang(stream_t *stream, unsigned char* lang) {
   return -1;
 }
 
-static int dvd_next_cell(dvd_priv_t *d) {
-  int next_cell=d->cur_cell;
+int dvd_pgc_next_cell(pgc_t *pgc, int last_cell, int angle, int cell) {
+  int next_cell=cell;
 
   mp_msg(MSGT_DVD,MSGL_DBG2, "dvd_next_cell: next1=0x%X  \n",next_cell);
-  if( d->cur_pgc->cell_playback[ next_cell ].block_type == BLOCK_TYPE_ANGLE_BLOCK ) {
-    while(next_cell<d->last_cell) {
-      if( d->cur_pgc->cell_playback[next_cell].block_mode == BLOCK_MODE_LAST_CELL )
+  if( pgc->cell_playback[ next_cell ].block_type == BLOCK_TYPE_ANGLE_BLOCK ) {
+    while(next_cell<last_cell) {
+      if( pgc->cell_playback[next_cell].block_mode == BLOCK_MODE_LAST_CELL )
         break;
       ++next_cell;
     }
@@ -310,17 +311,33 @@ static int dvd_next_cell(dvd_priv_t *d) {
   mp_msg(MSGT_DVD,MSGL_DBG2, "dvd_next_cell: next2=0x%X  \n",next_cell);
 
   ++next_cell;
-  if(next_cell>=d->last_cell) 
+  if(next_cell>=last_cell) 
     return -1; // EOF
-  if(d->cur_pgc->cell_playback[next_cell].block_type == BLOCK_TYPE_ANGLE_BLOCK ) {
-    next_cell+=dvd_angle;
-    if(next_cell>=d->last_cell) 
+  if(pgc->cell_playback[next_cell].block_type == BLOCK_TYPE_ANGLE_BLOCK ) {
+    next_cell+=angle;
+    if(next_cell>=last_cell) 
       return -1; // EOF
   }
   mp_msg(MSGT_DVD,MSGL_DBG2, "dvd_next_cell: next3=0x%X  \n",next_cell);
   return next_cell;
 }
 
+int dvd_next_cell(dvd_priv_t *d, int cell) {
+  return dvd_pgc_next_cell(d->cur_pgc, d->last_cell, dvd_angle, cell);
+}
+
+int dvd_parse_nav(unsigned char *data, dsi_t *dsi) {
+  if(!(data[38]==0 && data[39]==0 && data[40]==1 && data[41]==0xBF &&
+       data[1024]==0 && data[1025]==0 && data[1026]==1 && data[1027]==0xBF))
+    return 0;
+#if DVDREAD_VERSION >= LIBDVDREAD_VERSION(0,9,0)
+  navRead_DSI(dsi, &(data[ DSI_START_BYTE ]));
+#else
+  navRead_DSI(dsi, &(data[ DSI_START_BYTE ]), sizeof(dsi_t));
+#endif
+  return 1;
+}
+
 int dvd_read_sector(dvd_priv_t *d,unsigned char* data) {
   int len;
 
@@ -348,7 +365,7 @@ int dvd_read_sector(dvd_priv_t *d,unsigned char* data) {
 read_next:
   if(d->cur_pack>d->cell_last_pack) {
     // end of cell!
-    int next=dvd_next_cell(d);
+    int next=dvd_next_cell(d, d->cur_cell);
     if(next>=0) {
       d->cur_cell=next;
       // if( d->cur_pgc->cell_playback[d->cur_cell].block_type 
@@ -360,17 +377,14 @@ read_next:
         return -1; // EOF
   }
 
-  len = DVDReadBlocks(d->title, d->cur_pack, 1, data);
-  if(!len) return -1; //error
+  if(d->readahead)
+    len = dvd_readahead_read(d->readahead, d->cur_pack, d->cur_cell, data);
+  else
+    len = DVDReadBlocks(d->title, d->cur_pack, 1, data);
+  if(len<=0) return -1; //error
 
-  if(data[38]==0 && data[39]==0 && data[40]==1 && data[41]==0xBF &&
-    data[1024]==0 && data[1025]==0 && data[1026]==1 && data[1027]==0xBF) {
+  if(dvd_parse_nav(data, &d->dsi_pack)) {
        // found a Navi packet!!!
-#if DVDREAD_VERSION >= LIBDVDREAD_VERSION(0,9,0)
-    navRead_DSI(&d->dsi_pack, &(data[ DSI_START_BYTE ]));
-#else
-    navRead_DSI(&d->dsi_pack, &(data[ DSI_START_BYTE ]), sizeof(dsi_t));
-#endif
     if(d->cur_pack != d->dsi_pack.dsi_gi.nv_pck_lbn ) {
       mp_msg(MSGT_DVD,MSGL_V, "Invalid NAVI packet! lba=0x%X  navi=0x%X  \n",
         d->cur_pack,d->dsi_pack.dsi_gi.nv_pck_lbn);
@@ -460,7 +474,7 @@ void dvd_seek(dvd_priv_t *d,int pos) {
         break;
       }
       if(d->cur_pack<=d->cell_last_pack) break; // ok, we find it! :)
-      next=dvd_next_cell(d);
+      next=dvd_next_cell(d, d->cur_cell);
       if(next<0) {
         //d->cur_pack=d->cell_last_pack+1;
         break; // we're after the last cell
@@ -478,6 +492,7 @@ void dvd_seek(dvd_priv_t *d,int pos) {
 }
 
 void dvd_close(dvd_priv_t *d) {
+  dvd_readahead_free(d->readahead);
   ifoClose(d->vts_file);
   ifoClose(d->vmg_file);
   DVDCloseFile(d->title);
@@ -1107,6 +1122,7 @@ static int open_s(stream_t *stream,int mode, void* opts, int* file_format) {
     for(k=0; k<d->cur_pgc->nr_of_cells; k++)
       d->cell_times_table[k] = dvdtimetomsec(&d->cur_pgc->cell_playback[k].playback_time);
     list_chapters(d->cur_pgc);
+    d->readahead = dvd_readahead_new(d);
 
     // ... (unimplemented)
     //    return NULL;
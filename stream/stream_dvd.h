@@ -1,3 +1,5 @@
+#ifndef STREAM_DVD_H
+#define STREAM_DVD_H
 
 #ifdef USE_DVDREAD
 
@@ -38,6 +40,7 @@ typedef struct {
   dsi_t dsi_pack;
   int angle_seek;
   unsigned int *cell_times_table;
+  struct dvd_readahead_s *readahead;
 // audio datas
   int nr_of_channels;
   stream_language_t audio_streams[32];
@@ -52,5 +55,12 @@ int dvd_lang_from_sid(stream_t *stream, int id);
 int dvd_aid_from_lang(stream_t *stream, unsigned char* lang);
 int dvd_sid_from_lang(stream_t *stream, unsigned char* lang);
 int dvd_chapter_from_cell(dvd_priv_t *dvd,int title,int cell);
+int dvd_next_cell(dvd_priv_t *d, int cell);
+/// dvd_next_cell() for the given PGC and angle instead of the current ones
+int dvd_pgc_next_cell(pgc_t *pgc, int last_cell, int angle, int cell);
+/// parse the DSI if data is a NAV pack, \return 1 if it is one
+int dvd_parse_nav(unsigned char *data, dsi_t *dsi);
 
 #endif
+
+#endif /* STREAM_DVD_H */
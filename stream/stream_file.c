@@ -2,17 +2,39 @@
 #include "config.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_INOTIFY
+#include <sys/inotify.h>
+#include <poll.h>
+#endif
 
 #include "mp_msg.h"
 #include "stream.h"
+#include "file_write.h"
+#include "osdep/timer.h"
+#include "input/input.h"
 #include "help_mp.h"
 #include "m_option.h"
 #include "m_struct.h"
 
+/// largest read in kB, reads start at STREAM_BUFFER_SIZE after a seek
+int stream_file_buffer_size = 64;
+/// map the file instead of reading it
+int stream_file_mmap = 0;
+/// seconds to wait at EOF for a file that is still being written, 0 = off
+int stream_file_follow = 0;
+
+/// longest sleep between checks of a growing file, in ms
+#define FOLLOW_POLL_TIME 100
+
 static struct stream_priv_s {
   char* filename;
   char *filename2;
@@ -20,6 +42,19 @@ static struct stream_priv_s {
   NULL, NULL
 };
 
+typedef struct {
+  unsigned char *buffer; // used instead of stream->buffer_data
+  int read_size;         // size of the next read, doubles while sequential
+  off_t advised;         // end of the range passed to POSIX_FADV_WILLNEED
+  off_t size;            // file size known to the mmap code
+  unsigned char *map;    // mapped window of the file
+  off_t map_start;
+  size_t map_len;
+  int follow;            // wait for more data at EOF
+  int notify_fd;         // inotify instance watching the file or -1
+  file_writer_t *writer; // buffers the writes of output files
+} file_priv_t;
+
 #define ST_OFF(f) M_ST_OFF(struct stream_priv_s,f)
 /// URL definition
 static m_option_t stream_opts_fields[] = {
@@ -34,18 +69,149 @@ static struct m_struct_st stream_opts = {
   stream_opts_fields
 };  
 
+/// ask the kernel to read ahead of the position the next read starts at
+static void advise_readahead(stream_t *s, file_priv_t *p, off_t len) {
+#ifdef POSIX_FADV_WILLNEED
+  if(s->pos + len / 2 < p->advised)
+    return;
+  posix_fadvise(s->fd, s->pos, len, POSIX_FADV_WILLNEED);
+  p->advised = s->pos + len;
+#endif
+}
+
+/**
+ * \brief sleep until the file is modified or time ms have passed
+ * \return 1 if the user wants to quit or go to another file
+ */
+static int wait_modify(stream_t *s, file_priv_t *p, int time) {
+#ifdef HAVE_INOTIFY
+  if(p->notify_fd >= 0) {
+    struct pollfd pfd;
+    char events[1024];
+    pfd.fd = p->notify_fd;
+    pfd.events = POLLIN;
+    if(poll(&pfd, 1, time) > 0 &&
+       read(p->notify_fd, events, sizeof(events)) < 0 && errno != EINTR) {
+      // a readable fd that cannot be read would make poll() return at once
+      mp_msg(MSGT_STREAM,MSGL_V,"[file] inotify failed, polling the file instead\n");
+      close(p->notify_fd);
+      p->notify_fd = -1;
+    }
+  } else
+#endif
+  usec_sleep(time * 1000);
+  // the cache process must leave the input to the player
+  return !s->cache_data && mp_input_check_interrupt(0);
+}
+
+/**
+ * \brief wait for a file that is still being written to grow past s->pos
+ * \return 1 if there is new data, 0 if the file stopped growing or the
+ *         user wants to quit
+ */
+static int wait_growth(stream_t *s, file_priv_t *p) {
+  unsigned int start = GetTimerMS();
+  struct stat st;
+
+  mp_msg(MSGT_STREAM,MSGL_DBG2,"[file] Waiting for data at %"PRId64"\n", (int64_t)s->pos);
+  while(fstat(s->fd, &st) == 0) {
+    if(st.st_size > s->end_pos)
+      s->end_pos = st.st_size;
+    if(st.st_size > s->pos) {
+      p->size = st.st_size;
+      return 1;
+    }
+    if(GetTimerMS() - start >= stream_file_follow * 1000)
+      break;
+    if(wait_modify(s, p, FOLLOW_POLL_TIME))
+      return 0;
+  }
+  mp_msg(MSGT_STREAM,MSGL_V,"[file] File stopped growing at %"PRId64" bytes\n", (int64_t)s->pos);
+  return 0;
+}
+
 static int fill_buffer(stream_t *s, char* buffer, int max_len){
-  int r = read(s->fd,buffer,max_len);
+  file_priv_t *p = s->priv;
+  int r;
+  if(p) {
+    if(max_len > p->read_size) max_len = p->read_size;
+    if(p->read_size < s->buffer_size) p->read_size *= 2;
+    else advise_readahead(s, p, 4 * (off_t)s->buffer_size);
+  }
+  r = read(s->fd,buffer,max_len);
+  if(r == 0 && p && p->follow && wait_growth(s, p))
+    r = read(s->fd,buffer,max_len);
   return (r <= 0) ? -1 : r;
 }
 
+#ifdef HAVE_SYS_MMAN_H
+static void unmap_window(file_priv_t *p) {
+  if(p->map) munmap(p->map, p->map_len);
+  p->map = NULL;
+  p->map_len = 0;
+}
+
+/// point stream->buffer into a mapped window of the file instead of copying
+static int fill_buffer_mmap(stream_t *s, char* buffer, int max_len){
+  file_priv_t *p = s->priv;
+  off_t start;
+
+  if(s->pos >= p->size) {
+    // the file may have grown since the last time
+    struct stat st;
+    if(fstat(s->fd, &st) < 0)
+      return -1;
+    p->size = st.st_size;
+    if(p->size <= s->pos && !(p->follow && wait_growth(s, p)))
+      return -1;
+  }
+  if(!p->map || s->pos < p->map_start || s->pos >= p->map_start + p->map_len) {
+    long page = sysconf(_SC_PAGESIZE);
+    unmap_window(p);
+    start = s->pos - s->pos % page;
+    p->map_len = s->buffer_size;
+    if(p->map_len > p->size - start)
+      p->map_len = p->size - start;
+    p->map = mmap(NULL, p->map_len, PROT_READ, MAP_SHARED, s->fd, start);
+    if(p->map == MAP_FAILED) {
+      mp_msg(MSGT_STREAM,MSGL_WARN,"[file] mmap failed, reading the file instead\n");
+      p->map = NULL;
+      p->map_len = 0;
+      s->fill_buffer = fill_buffer;
+      s->buffer = p->buffer ? p->buffer : s->buffer_data;
+      if(!p->buffer) s->buffer_size = STREAM_BUFFER_SIZE;
+      if(lseek(s->fd, s->pos, SEEK_SET) < 0) return -1;
+      return fill_buffer(s, s->buffer, s->buffer_size);
+    }
+    p->map_start = start;
+    advise_readahead(s, p, 2 * (off_t)s->buffer_size);
+  }
+  s->buffer = p->map + (s->pos - p->map_start);
+  return p->map_start + p->map_len - s->pos;
+}
+#endif
+
 static int write_buffer(stream_t *s, char* buffer, int len) {
   int r = write(s->fd,buffer,len);
   return (r <= 0) ? -1 : r;
 }
 
+static int write_buffered(stream_t *s, char* buffer, int len) {
+  file_priv_t *p = s->priv;
+  return file_writer_write(p->writer, s->pos, buffer, len);
+}
+
 static int seek(stream_t *s,off_t newpos) {
+  file_priv_t *p = s->priv;
   s->pos = newpos;
+  if(p && p->writer)
+    return 1; // the next write goes to s->pos
+  if(p) {
+    p->read_size = STREAM_BUFFER_SIZE;
+    p->advised = 0;
+    if(s->fill_buffer != fill_buffer)
+      return 1; // mapped, there is no file position to move
+  }
   if(lseek(s->fd,s->pos,SEEK_SET)<0) {
     s->eof=1;
     return 0;
@@ -59,7 +225,7 @@ static int seek_forward(stream_t *s,off_t newpos) {
     return 0;
   }
   while(s->pos<newpos){
-    int len=s->fill_buffer(s,s->buffer,STREAM_BUFFER_SIZE);
+    int len=s->fill_buffer(s,s->buffer,s->buffer_size);
     if(len<=0){ s->eof=1; s->buf_pos=s->buf_len=0; break; } // EOF
     s->buf_pos=0;
     s->buf_len=len;
@@ -72,9 +238,15 @@ static int control(stream_t *s, int cmd, void *arg) {
   switch(cmd) {
     case STREAM_CTRL_GET_SIZE: {
       off_t size;
+      struct stat st;
 
-      size = lseek(s->fd, 0, SEEK_END);
-      lseek(s->fd, s->pos, SEEK_SET);
+      // fstat() leaves the file position alone, the cache process shares it
+      if(fstat(s->fd, &st) == 0 && S_ISREG(st.st_mode))
+        size = st.st_size;
+      else {
+        size = lseek(s->fd, 0, SEEK_END);
+        lseek(s->fd, s->pos, SEEK_SET);
+      }
       if(size != (off_t)-1) {
         *((off_t*)arg) = size;
         return 1;
@@ -84,6 +256,94 @@ static int control(stream_t *s, int cmd, void *arg) {
   return STREAM_UNSUPORTED;
 }
 
+static void close_f(stream_t *s) {
+  file_priv_t *p = s->priv;
+#ifdef HAVE_SYS_MMAN_H
+  unmap_window(p);
+#endif
+#ifdef HAVE_INOTIFY
+  if(p->notify_fd >= 0) close(p->notify_fd);
+#endif
+  if(p->writer) file_writer_close(p->writer);
+  free(p->buffer);
+  free(p);
+  s->priv = NULL;
+  s->buffer = s->buffer_data;
+}
+
+/// set up large reads, mapping or following for files opened for reading
+static void setup_read(stream_t *stream, off_t len, char *filename) {
+  file_priv_t *p;
+  int size = stream_file_buffer_size * 1024;
+  struct stat st;
+  int regular = stream->type == STREAMTYPE_FILE &&
+                fstat(stream->fd, &st) == 0 && S_ISREG(st.st_mode);
+
+  if(size > STREAM_MAX_BUFFER_SIZE) size = STREAM_MAX_BUFFER_SIZE;
+  if(size <= STREAM_BUFFER_SIZE && !stream_file_mmap &&
+     !(stream_file_follow && regular))
+    return;
+  p = calloc(1, sizeof(file_priv_t));
+  p->read_size = STREAM_BUFFER_SIZE;
+  p->size = len;
+  p->notify_fd = -1;
+  stream->priv = p;
+  stream->close = close_f;
+  stream->buffer_size = size;
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise(stream->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  if(stream_file_follow && regular) {
+    p->follow = 1;
+    stream->flags |= STREAM_GROWING;
+#ifdef HAVE_INOTIFY
+    p->notify_fd = inotify_init();
+    if(p->notify_fd >= 0 &&
+       inotify_add_watch(p->notify_fd, filename, IN_MODIFY | IN_CLOSE_WRITE) < 0) {
+      close(p->notify_fd);
+      p->notify_fd = -1;
+    }
+#endif
+    mp_msg(MSGT_OPEN,MSGL_V,"[file] Waiting up to %d s for the file to grow at EOF%s\n",
+           stream_file_follow, p->notify_fd >= 0 ? " (inotify)" : "");
+  }
+#ifdef HAVE_SYS_MMAN_H
+  if(stream_file_mmap && regular) {
+    // smaller windows cost more in mmap()/munmap() than the copy they save
+    stream->buffer_size = STREAM_MAX_BUFFER_SIZE;
+    stream->fill_buffer = fill_buffer_mmap;
+    mp_msg(MSGT_OPEN,MSGL_V,"[file] Mapping the file in %d kB windows\n",
+           stream->buffer_size / 1024);
+    return;
+  }
+#endif
+  if(size > STREAM_BUFFER_SIZE) {
+    p->buffer = malloc(size);
+    if(!p->buffer) {
+      stream->buffer_size = STREAM_BUFFER_SIZE;
+      return;
+    }
+    stream->buffer = p->buffer;
+    mp_msg(MSGT_OPEN,MSGL_V,"[file] Reading up to %d kB at once\n", size / 1024);
+  } else
+    stream->buffer_size = STREAM_BUFFER_SIZE;
+}
+
+/// set up buffered writing for files opened for writing
+static void setup_write(stream_t *stream) {
+  file_priv_t *p;
+  file_writer_t *w = file_writer_new(stream->fd, stream->type == STREAMTYPE_FILE);
+
+  if(!w)
+    return;
+  p = calloc(1, sizeof(file_priv_t));
+  p->notify_fd = -1;
+  p->writer = w;
+  stream->priv = p;
+  stream->close = close_f;
+  stream->write_buffer = write_buffered;
+}
+
 static int open_f(stream_t *stream,int mode, void* opts, int* file_format) {
   int f;
   mode_t m = 0;
@@ -170,6 +430,10 @@ static int open_f(stream_t *stream,int mode, void* opts, int* file_format) {
   stream->fill_buffer = fill_buffer;
   stream->write_buffer = write_buffer;
   stream->control = control;
+  if(mode == STREAM_READ)
+    setup_read(stream, len, filename);
+  else
+    setup_write(stream);
 
   m_struct_free(&stream_opts,opts);
   return STREAM_OK;
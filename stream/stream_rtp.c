@@ -26,6 +26,7 @@
 #include "url.h"
 #include "udp.h"
 #include "rtp.h"
+#include "udp_recv.h"
 
 static int
 rtp_streaming_read (int fd, char *buffer,
@@ -34,6 +35,14 @@ rtp_streaming_read (int fd, char *buffer,
   return read_rtp_from_server (fd, buffer, size);
 }
 
+static void
+rtp_stream_close (stream_t *stream)
+{
+  rtp_set_receiver (NULL);
+  udp_recv_free (stream->streaming_ctrl->data);
+  stream->streaming_ctrl->data = NULL;
+}
+
 static int
 rtp_streaming_start (stream_t *stream)
 {
@@ -54,6 +63,10 @@ rtp_streaming_start (stream_t *stream)
     stream->fd = fd;
   }
 
+  streaming_ctrl->data = udp_recv_new (fd, 1);
+  if (!streaming_ctrl->data)
+    return -1;
+  rtp_set_receiver (streaming_ctrl->data);
   streaming_ctrl->streaming_read = rtp_streaming_read;
   streaming_ctrl->streaming_seek = nop_streaming_seek;
   streaming_ctrl->prebuffer_size = 64 * 1024; /* 64 KBytes */
@@ -98,6 +111,7 @@ rtp_stream_open (stream_t *stream, int mode, void *opts, int *file_format)
   }
 
   stream->type = STREAMTYPE_STREAM;
+  stream->close = rtp_stream_close;
   fixup_network_stream_cache (stream);
   
   return STREAM_OK;
@@ -45,6 +45,7 @@ char *tv_param_channel = NULL;
 char *tv_param_norm = "pal";
 #ifdef HAVE_TV_V4L2
 int tv_param_normid = -1;
+int tv_param_zerocopy = 0;
 #endif
 char *tv_param_chanlist = "europe-east";
 char *tv_param_device = NULL;
@@ -141,10 +142,23 @@ static int demux_tv_fill_buffer(demuxer_t *demux, demux_stream_t *ds)
     if (ds==demux->video && tvh->functions->control(tvh->priv, 
                             TVI_CONTROL_IS_VIDEO, 0) == TVI_CONTROL_TRUE)
         {
-		len = tvh->functions->get_video_framesize(tvh->priv);
-       	dp=new_demux_packet(len);
+		tv_frame_t frame;
+
+		if (tvh->functions->control(tvh->priv, TVI_CONTROL_VID_EXPORT_FRAME,
+		                            &frame) == TVI_CONTROL_TRUE) {
+		    /* the packet holds the driver's buffer until it is freed */
+		    dp=new_demux_packet(0);
+		    dp->buffer=frame.buffer;
+		    dp->len=frame.len;
+		    dp->free_buffer=frame.release;
+		    dp->free_buffer_ctx=frame.ctx;
+		    dp->pts=frame.pts;
+		} else {
+		    len = tvh->functions->get_video_framesize(tvh->priv);
+		    dp=new_demux_packet(len);
+		    dp->pts=tvh->functions->grab_video_frame(tvh->priv, dp->buffer, len);
+		}
 		dp->flags|=1; /* Keyframe */
-  		dp->pts=tvh->functions->grab_video_frame(tvh->priv, dp->buffer, len);
    		ds_add_packet(demux->video,dp);
 	 }
 
@@ -664,6 +678,8 @@ static void demux_close_tv(demuxer_t *demuxer)
 {
     tvi_handle_t *tvh=(tvi_handle_t*)(demuxer->priv);
     if (!tvh) return;
+    // packets may still hold capture buffers of the driver
+    ds_free_packs(demuxer->video);
     tvh->functions->uninit(tvh->priv);
     demuxer->priv=NULL;
 }
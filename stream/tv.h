@@ -15,6 +15,7 @@ extern char *tv_param_chanlist;
 extern char *tv_param_norm;
 #ifdef HAVE_TV_V4L2
 extern int tv_param_normid;
+extern int tv_param_zerocopy;
 #endif
 extern char *tv_param_device;
 extern char *tv_param_driver;
@@ -137,6 +138,16 @@ extern char *tv_channel_last_real;
 #define TVI_CONTROL_VID_SET_CONTRAST	0x11c
 #define TVI_CONTROL_VID_GET_PICTURE	0x11d
 #define TVI_CONTROL_VID_SET_PICTURE	0x11e
+#define TVI_CONTROL_VID_EXPORT_FRAME	0x11f	/* hand out a frame without copying, arg is tv_frame_t* */
+
+/* a captured frame in a buffer of the driver, returned with release() */
+typedef struct {
+    unsigned char *buffer;
+    int len;
+    double pts;
+    void (*release)(void *ctx, unsigned char *buffer);
+    void *ctx;
+} tv_frame_t;
 
 /* TUNER controls */
 #define TVI_CONTROL_TUN_GET_FREQ	0x201
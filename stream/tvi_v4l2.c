@@ -64,6 +64,10 @@ struct map {
 };
 
 #define BUFFER_COUNT 6
+/* capture buffers requested when handing them out without copying */
+#define ZEROCOPY_BUFFER_COUNT 16
+/* capture buffers always left queued in the driver while handing out */
+#define ZEROCOPY_MIN_QUEUED 2
 
 /* private data */
 typedef struct {
@@ -100,6 +104,13 @@ typedef struct {
     pthread_t			video_grabber_thread;
     pthread_mutex_t             video_buffer_mutex;
 
+    /* ring buffer entries point into map[], dequeued buffers stay out
+       of the driver until the frame is handed out and released */
+    int                         zerocopy;
+    volatile int                video_exported;
+    long                        frames_exported;
+    long                        frames_copied;
+
     /* audio */
     char			*audio_dev;
     audio_in_t                  audio_in;
@@ -137,6 +148,7 @@ typedef struct {
 
 static void *audio_grabber(void *data);
 static void *video_grabber(void *data);
+static int export_video_frame(priv_t *priv, tv_frame_t *frame);
 
 /**********************************************************************\
 
@@ -557,6 +569,9 @@ static int control(priv_t *priv, int cmd, void *arg)
     case TVI_CONTROL_IMMEDIATE:
 	priv->immediate_mode = 1;
 	return TVI_CONTROL_TRUE;
+    case TVI_CONTROL_VID_EXPORT_FRAME:
+	if (!priv->zerocopy) return TVI_CONTROL_UNKNOWN;
+	return export_video_frame(priv, arg);
     case TVI_CONTROL_VID_GET_FPS:
 	*(float *)arg = (float)priv->standard.frameperiod.denominator /
 	    priv->standard.frameperiod.numerator;
@@ -908,7 +923,7 @@ static int uninit(priv_t *priv)
 
     if (priv->video_ringbuffer) {
 	int i;
-	for (i = 0; i < priv->video_buffer_size_current; i++) {
+	for (i = 0; i < priv->video_buffer_size_current && !priv->zerocopy; i++) {
 	    free(priv->video_ringbuffer[i]);
 	}
 	free(priv->video_ringbuffer);
@@ -930,6 +945,9 @@ static int uninit(priv_t *priv)
 	   info.short_name, priv->frames, dropped);
     mp_msg(MSGT_TV, MSGL_V, "%s: up to %u video frames buffered.\n",
 	   info.short_name, priv->video_buffer_size_current);
+    if (priv->zerocopy)
+	mp_msg(MSGT_TV, MSGL_V, "%s: %ld frames passed without copying, %ld copied.\n",
+	       info.short_name, priv->frames_exported, priv->frames_copied);
     return 1;
 }
 
@@ -1155,7 +1173,7 @@ static int get_capture_buffer_size(priv_t *priv)
 static int start(priv_t *priv)
 {
     struct v4l2_requestbuffers request;
-    int i;
+    int i, ring_size;
 
     /* setup audio parameters */
 
@@ -1168,6 +1186,16 @@ static int start(priv_t *priv)
     } else {
 	priv->video_buffer_size_max = get_capture_buffer_size(priv);
     }
+    priv->zerocopy = tv_param_zerocopy;
+    if (priv->zerocopy) {
+	/* the capture buffers make up the ring buffer, with some more for
+	   the driver to capture into while the player holds a frame or two */
+	priv->video_buffer_size_current = priv->video_buffer_size_max + ZEROCOPY_MIN_QUEUED + 2;
+	if (priv->video_buffer_size_current > ZEROCOPY_BUFFER_COUNT)
+	    priv->video_buffer_size_current = ZEROCOPY_BUFFER_COUNT;
+	if (priv->video_buffer_size_max > priv->video_buffer_size_current)
+	    priv->video_buffer_size_max = priv->video_buffer_size_current;
+    }
     
     if (!tv_param_noaudio) {
 	setup_audio_buffer_sizes(priv);
@@ -1228,14 +1256,15 @@ static int start(priv_t *priv)
 	       priv->video_buffer_size_max*priv->format.fmt.pix.height*bytesperline/(1024*1024));
     }
 
-    priv->video_ringbuffer = calloc(priv->video_buffer_size_max, sizeof(unsigned char*));
+    ring_size = priv->zerocopy ? priv->video_buffer_size_current : priv->video_buffer_size_max;
+    priv->video_ringbuffer = calloc(ring_size, sizeof(unsigned char*));
     if (!priv->video_ringbuffer) {
 	mp_msg(MSGT_TV, MSGL_ERR, "cannot allocate video buffer: %s\n", strerror(errno));
 	return 0;
     }
-    for (i = 0; i < priv->video_buffer_size_max; i++)
+    for (i = 0; i < ring_size; i++)
 	priv->video_ringbuffer[i] = NULL;
-    priv->video_timebuffer = calloc(priv->video_buffer_size_max, sizeof(long long));
+    priv->video_timebuffer = calloc(ring_size, sizeof(long long));
     if (!priv->video_timebuffer) {
 	mp_msg(MSGT_TV, MSGL_ERR, "cannot allocate time buffer: %s\n", strerror(errno));
 	return 0;
@@ -1248,7 +1277,9 @@ static int start(priv_t *priv)
     priv->video_cnt = 0;
     
     /* request buffers */
-    if (priv->immediate_mode) {
+    if (priv->zerocopy) {
+	request.count = priv->video_buffer_size_current;
+    } else if (priv->immediate_mode) {
 	request.count = 2;
     } else {
 	request.count = BUFFER_COUNT;
@@ -1301,6 +1332,17 @@ static int start(priv_t *priv)
 	}
     }
 
+    if (priv->zerocopy) {
+	/* the driver may have granted fewer buffers than requested */
+	if (request.count < priv->video_buffer_size_current)
+	    priv->video_buffer_size_current = request.count;
+	if (priv->video_buffer_size_max > priv->video_buffer_size_current)
+	    priv->video_buffer_size_max = priv->video_buffer_size_current;
+	priv->video_exported = 0;
+	mp_msg(MSGT_TV, MSGL_V, "%s: passing %d capture buffers without copying\n",
+	       info.short_name, priv->video_buffer_size_current);
+    }
+
     /* start audio thread */
     priv->shutdown = 0;
     priv->audio_skew_measure_time = 0;
@@ -1333,6 +1375,11 @@ static inline void copy_frame(priv_t *priv, unsigned char *dest, unsigned char *
     memcpy(dest, source, bytesperline * h);
 }
 
+// capture buffers left to the driver in zerocopy mode, one more
+// may be held by the grabber right now
+#define zerocopy_queued(priv) \
+    ((priv)->mapcount - (priv)->video_cnt - (priv)->video_exported - 1)
+
 // maximum skew change, in frames
 #define MAX_SKEW_DELTA 0.6
 static void *video_grabber(void *data)
@@ -1369,7 +1416,8 @@ static void *video_grabber(void *data)
 	int ret;
 	
 	if (priv->immediate_mode) {
-	    while (priv->video_cnt == priv->video_buffer_size_max) {
+	    while (priv->video_cnt == priv->video_buffer_size_max ||
+		   (priv->zerocopy && zerocopy_queued(priv) < 1)) {
 		usleep(10000);
 		if (priv->shutdown) {
 		    return NULL;
@@ -1472,7 +1520,7 @@ static void *video_grabber(void *data)
 
 	/* allocate a new buffer, if needed */
 	pthread_mutex_lock(&priv->video_buffer_mutex);
-	if (priv->video_buffer_size_current < priv->video_buffer_size_max) {
+	if (priv->video_buffer_size_current < priv->video_buffer_size_max && !priv->zerocopy) {
 	    if (priv->video_cnt == priv->video_buffer_size_current) {
 		unsigned char *newbuf = malloc(framesize);
 		if (newbuf) {
@@ -1488,7 +1536,8 @@ static void *video_grabber(void *data)
 	}
 	pthread_mutex_unlock(&priv->video_buffer_mutex);
 
-	if (priv->video_cnt == priv->video_buffer_size_current) {
+	if (priv->video_cnt == priv->video_buffer_size_current ||
+	    (priv->zerocopy && zerocopy_queued(priv) < 1)) {
 	    if (!priv->immediate_mode) {
 		mp_msg(MSGT_TV, MSGL_ERR, "\nvideo buffer full - dropping frame\n");
 		if (priv->audio_insert_null_samples) {
@@ -1515,6 +1564,15 @@ static void *video_grabber(void *data)
 		}
 	    }
 
+	    if (priv->zerocopy) {
+		/* keep the buffer out of the driver until it is consumed */
+		pthread_mutex_lock(&priv->video_buffer_mutex);
+		priv->video_ringbuffer[priv->video_tail] = priv->map[buf.index].addr;
+		priv->video_tail = (priv->video_tail+1)%priv->video_buffer_size_current;
+		priv->video_cnt++;
+		pthread_mutex_unlock(&priv->video_buffer_mutex);
+		continue;
+	    }
 	    copy_frame(priv, priv->video_ringbuffer[priv->video_tail], priv->map[buf.index].addr);
 	    priv->video_tail = (priv->video_tail+1)%priv->video_buffer_size_current;
 	    priv->video_cnt++;
@@ -1528,10 +1586,33 @@ static void *video_grabber(void *data)
     return NULL;
 }
 
+// gives a capture buffer held in zerocopy mode back to the driver
+static void queue_buffer(priv_t *priv, unsigned char *addr)
+{
+    int i;
+
+    for (i = 0; i < priv->mapcount; i++)
+	if (priv->map[i].addr == addr) break;
+    if (i == priv->mapcount || !priv->streamon) return;
+    if (ioctl(priv->video_fd, VIDIOC_QBUF, &(priv->map[i].buf)) < 0) {
+	mp_msg(MSGT_TV, MSGL_ERR, "%s: ioctl queue buffer failed: %s\n",
+	       info.short_name, strerror(errno));
+    }
+}
+
+static void release_video_frame(void *ctx, unsigned char *buffer)
+{
+    priv_t *priv = ctx;
+
+    pthread_mutex_lock(&priv->video_buffer_mutex);
+    priv->video_exported--;
+    pthread_mutex_unlock(&priv->video_buffer_mutex);
+    queue_buffer(priv, buffer);
+}
+
 #define MAX_LOOP 50
-static double grab_video_frame(priv_t *priv, char *buffer, int len)
+static int wait_video_frame(priv_t *priv)
 {
-    double interval;
     int loop_cnt = 0;
 
     if (priv->first) {
@@ -1543,17 +1624,56 @@ static double grab_video_frame(priv_t *priv, char *buffer, int len)
 	usleep(10000);
 	if (loop_cnt++ > MAX_LOOP) return 0;
     }
+    return 1;
+}
+
+static double grab_video_frame(priv_t *priv, char *buffer, int len)
+{
+    double interval;
+    unsigned char *frame;
+
+    if (!wait_video_frame(priv)) return 0;
 
     pthread_mutex_lock(&priv->video_buffer_mutex);
     interval = (double)priv->video_timebuffer[priv->video_head]*1e-6;
-    memcpy(buffer, priv->video_ringbuffer[priv->video_head], len);
+    frame = priv->video_ringbuffer[priv->video_head];
+    memcpy(buffer, frame, len);
     priv->video_cnt--;
     priv->video_head = (priv->video_head+1)%priv->video_buffer_size_current;
     pthread_mutex_unlock(&priv->video_buffer_mutex);
 
+    if (priv->zerocopy) {
+	priv->frames_copied++;
+	queue_buffer(priv, frame);
+    }
     return interval;
 }
 
+/* hands out the next frame in its capture buffer, unless that would
+   leave the driver too few buffers to capture into meanwhile */
+static int export_video_frame(priv_t *priv, tv_frame_t *frame)
+{
+    if (!wait_video_frame(priv)) return TVI_CONTROL_FALSE;
+
+    pthread_mutex_lock(&priv->video_buffer_mutex);
+    if (zerocopy_queued(priv) < ZEROCOPY_MIN_QUEUED) {
+	pthread_mutex_unlock(&priv->video_buffer_mutex);
+	return TVI_CONTROL_FALSE;
+    }
+    frame->buffer = priv->video_ringbuffer[priv->video_head];
+    frame->len = priv->format.fmt.pix.sizeimage;
+    frame->pts = (double)priv->video_timebuffer[priv->video_head]*1e-6;
+    frame->release = release_video_frame;
+    frame->ctx = priv;
+    priv->video_cnt--;
+    priv->video_head = (priv->video_head+1)%priv->video_buffer_size_current;
+    priv->video_exported++;
+    pthread_mutex_unlock(&priv->video_buffer_mutex);
+
+    priv->frames_exported++;
+    return TVI_CONTROL_TRUE;
+}
+
 static int get_video_framesize(priv_t *priv)
 {
     return priv->format.fmt.pix.sizeimage;
@@ -44,6 +44,7 @@
 #include "udp.h"
 
 int reuse_socket=0;
+int udp_rcvbuf=1024;
 
 /* Start listening on a UDP port. If multicast, join the group. */
 int
@@ -58,6 +59,7 @@ udp_open_socket (URL_t *url)
   struct timeval tv;
   struct hostent *hp;
   int reuse=reuse_socket;
+  socklen_t optlen;
 
   mp_msg (MSGT_NETWORK, MSGL_V,
           "Listening for traffic on %s:%d ...\n", url->hostname, url->port);
@@ -140,14 +142,24 @@ udp_open_socket (URL_t *url)
   }
 #endif /* HAVE_WINSOCK2 */
 
-  /* Increase the socket rx buffer size to maximum -- this is UDP */
-  rxsockbufsz = 240 * 1024;
+  /* Increase the socket rx buffer size -- this is UDP */
+  rxsockbufsz = udp_rcvbuf * 1024;
+#ifdef SO_RCVBUFFORCE
+  /* may exceed net.core.rmem_max, but only with CAP_NET_ADMIN */
+  if (setsockopt (socket_server_fd, SOL_SOCKET, SO_RCVBUFFORCE,
+                  &rxsockbufsz, sizeof (rxsockbufsz)))
+#endif
   if (setsockopt (socket_server_fd, SOL_SOCKET, SO_RCVBUF,
                   &rxsockbufsz, sizeof (rxsockbufsz)))
   {
     mp_msg (MSGT_NETWORK, MSGL_ERR,
             "Couldn't set receive socket buffer size\n");
   }
+  optlen = sizeof (rxsockbufsz);
+  if (!getsockopt (socket_server_fd, SOL_SOCKET, SO_RCVBUF,
+                   &rxsockbufsz, &optlen))
+    mp_msg (MSGT_NETWORK, MSGL_V,
+            "Receive socket buffer is %d kB\n", rxsockbufsz / 1024);
 
   if ((ntohl (server_address.sin_addr.s_addr) >> 28) == 0xe)
   {
@@ -20,6 +20,8 @@
 #ifndef _UDP_H_
 #define _UDP_H_
 
+extern int udp_rcvbuf;
+
 int udp_open_socket (URL_t *url);
 
 #endif /* _UDP_H_ */
@@ -0,0 +1,452 @@
+/*
+ *   Threaded receiver for UDP and RTP streams.
+ *
+ *   A thread drains the socket into a ring of datagrams, with recvmmsg()
+ *   where available, so that the kernel socket buffer does not overflow
+ *   while the player is busy decoding.
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define _GNU_SOURCE /* recvmmsg() */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <inttypes.h>
+#include <sys/types.h>
+
+#ifndef HAVE_WINSOCK2
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <poll.h>
+#else
+#include <winsock2.h>
+#undef HAVE_PTHREADS /* no poll(), read the socket directly */
+#endif
+
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+#include "mp_msg.h"
+#include "udp_recv.h"
+
+int udp_ring_size = 4096;
+
+#define UDP_SLOT_SIZE 2048    /* room for any datagram of an ethernet MTU */
+#define UDP_BATCH 32          /* datagrams per recvmmsg() call */
+#define UDP_POLL_TIME 200     /* ms between checks of the quit flag */
+#define UDP_REPORT_TIME 5     /* s between packet loss warnings */
+
+#define RTP_MAX_DROPOUT 3000  /* larger jumps mean the sender restarted */
+#define RTP_MAX_MISORDER 100
+
+struct udp_recv_s {
+  int fd;
+  int rtp;
+
+  /* ring of datagrams, head is only moved by the thread, tail only by
+   * the reader, both count datagrams and are used modulo slots */
+  unsigned char *data;
+  int *len;
+  unsigned int slots;
+  unsigned int head, tail;
+  int pos;                    /* bytes of the tail datagram already read */
+  int quit, error;
+  int waiting;                /* the reader or the thread waits on cond */
+  pid_t pid;                  /* process running the thread, 0 if none */
+#ifdef HAVE_PTHREADS
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+#endif
+
+  /* statistics */
+  unsigned int packets, full;
+  int64_t bytes;
+  int have_seq;
+  unsigned int next_seq;      /* RTP sequence number expected next */
+  unsigned int expected, received, late;
+  unsigned int reported_lost;
+  time_t report_time;
+};
+
+udp_recv_t *
+udp_recv_new (int fd, int rtp)
+{
+  udp_recv_t *r = calloc (1, sizeof (udp_recv_t));
+
+  if (!r)
+    return NULL;
+  r->fd = fd;
+  r->rtp = rtp;
+  return r;
+}
+
+/* account one datagram, RTP loss is counted as in RFC 3550 A.3 */
+static void
+count_packet (udp_recv_t *r, const unsigned char *p, int len)
+{
+  unsigned int seq;
+  int delta;
+
+  r->packets++;
+  r->bytes += len;
+  if (!r->rtp || len < 12 || (p[0] >> 6) != 2)
+    return;
+
+  seq = p[2] << 8 | p[3];
+  if (!r->have_seq)
+  {
+    r->have_seq = 1;
+    r->expected = 1;
+    r->next_seq = (seq + 1) & 0xffff;
+  }
+  else
+  {
+    delta = (int16_t) (seq - r->next_seq);
+    if (delta >= 0 && delta < RTP_MAX_DROPOUT)
+    {
+      r->expected += delta + 1;
+      r->next_seq = (seq + 1) & 0xffff;
+    }
+    else if (delta < 0 && delta >= -RTP_MAX_MISORDER)
+      r->late++;
+    else
+    {
+      mp_msg (MSGT_NETWORK, MSGL_V,
+              "udp: RTP sequence jumps from %u to %u\n", r->next_seq, seq);
+      r->expected++;
+      r->next_seq = (seq + 1) & 0xffff;
+    }
+  }
+  r->received++;
+}
+
+static unsigned int
+packets_lost (udp_recv_t *r)
+{
+  return r->expected > r->received ? r->expected - r->received : 0;
+}
+
+static void
+report_loss (udp_recv_t *r)
+{
+  unsigned int lost = packets_lost (r);
+  time_t now;
+
+  if (lost <= r->reported_lost)
+    return;
+  now = time (NULL);
+  if (now - r->report_time < UDP_REPORT_TIME)
+    return;
+  mp_msg (MSGT_NETWORK, MSGL_WARN,
+          "udp: %u of %u RTP packets lost, %u out of order\n",
+          lost, r->expected, r->late);
+  r->reported_lost = lost;
+  r->report_time = now;
+}
+
+#ifdef HAVE_PTHREADS
+static void *
+recv_thread (void *arg)
+{
+  udp_recv_t *r = arg;
+#ifdef HAVE_RECVMMSG
+  struct mmsghdr msgs[UDP_BATCH];
+  struct iovec iov[UDP_BATCH];
+#endif
+  struct pollfd pfd;
+  unsigned int head, n, i;
+  int got;
+
+  pfd.fd = r->fd;
+  pfd.events = POLLIN;
+  while (1)
+  {
+    pthread_mutex_lock (&r->lock);
+    if (r->head - r->tail >= r->slots && !r->quit)
+    {
+      /* the reader fell behind, leave the data in the socket buffer */
+      r->full++;
+      r->waiting = 1;
+      while (r->head - r->tail >= r->slots && !r->quit)
+        pthread_cond_wait (&r->cond, &r->lock);
+      r->waiting = 0;
+    }
+    head = r->head;
+    n = r->slots - (head - r->tail);
+    pthread_mutex_unlock (&r->lock);
+    if (r->quit)
+      break;
+
+    if (poll (&pfd, 1, UDP_POLL_TIME) <= 0)
+      continue;
+
+    /* fill the free slots up to the end of the ring */
+    if (n > r->slots - head % r->slots)
+      n = r->slots - head % r->slots;
+#ifdef HAVE_RECVMMSG
+    if (n > UDP_BATCH)
+      n = UDP_BATCH;
+    memset (msgs, 0, n * sizeof (struct mmsghdr));
+    for (i = 0; i < n; i++)
+    {
+      iov[i].iov_base = r->data + ((head + i) % r->slots) * UDP_SLOT_SIZE;
+      iov[i].iov_len = UDP_SLOT_SIZE;
+      msgs[i].msg_hdr.msg_iov = &iov[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    got = recvmmsg (r->fd, msgs, n, MSG_DONTWAIT, NULL);
+    for (i = 0; (int) i < got; i++)
+      r->len[(head + i) % r->slots] = msgs[i].msg_len;
+#else
+    got = recv (r->fd, r->data + (head % r->slots) * UDP_SLOT_SIZE,
+                UDP_SLOT_SIZE, MSG_DONTWAIT);
+    if (got >= 0)
+    {
+      r->len[head % r->slots] = got;
+      got = 1;
+    }
+#endif
+    if (got < 0)
+    {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        continue;
+      mp_msg (MSGT_NETWORK, MSGL_ERR,
+              "udp: receive error: %s\n", strerror (errno));
+      pthread_mutex_lock (&r->lock);
+      r->error = 1;
+      pthread_cond_signal (&r->cond);
+      pthread_mutex_unlock (&r->lock);
+      break;
+    }
+
+    pthread_mutex_lock (&r->lock);
+    for (i = 0; (int) i < got; i++)
+    {
+      unsigned int slot = (head + i) % r->slots;
+      count_packet (r, r->data + slot * UDP_SLOT_SIZE, r->len[slot]);
+    }
+    r->head = head + got;
+    if (r->waiting)
+      pthread_cond_signal (&r->cond);
+    pthread_mutex_unlock (&r->lock);
+  }
+  return NULL;
+}
+
+/* start the thread in the calling process, 0 means read directly */
+static int
+start_thread (udp_recv_t *r)
+{
+  sigset_t sigs, oldsigs;
+  int err;
+
+  if (r->pid == getpid ())
+    return r->slots != 0;
+
+  /* a thread started before the cache forked did not come along,
+   * its ring is a private copy now and nobody else uses it */
+  free (r->data);
+  free (r->len);
+  r->data = NULL;
+  r->len = NULL;
+  r->head = r->tail = r->pos = 0;
+  r->quit = r->error = 0;
+  r->pid = getpid ();
+
+  r->slots = udp_ring_size * 1024 / UDP_SLOT_SIZE;
+  if (!r->slots)
+    return 0;
+  if (r->slots < UDP_BATCH)
+    r->slots = UDP_BATCH;
+  r->data = malloc (r->slots * UDP_SLOT_SIZE);
+  r->len = malloc (r->slots * sizeof (int));
+  if (!r->data || !r->len)
+    goto fail;
+  pthread_mutex_init (&r->lock, NULL);
+  pthread_cond_init (&r->cond, NULL);
+  /* signals must go to the player, which cleans up on them */
+  sigfillset (&sigs);
+  pthread_sigmask (SIG_SETMASK, &sigs, &oldsigs);
+  err = pthread_create (&r->thread, NULL, recv_thread, r);
+  pthread_sigmask (SIG_SETMASK, &oldsigs, NULL);
+  if (err)
+  {
+    pthread_cond_destroy (&r->cond);
+    pthread_mutex_destroy (&r->lock);
+    goto fail;
+  }
+  mp_msg (MSGT_NETWORK, MSGL_V,
+          "udp: receiving into a ring of %u datagrams%s\n", r->slots,
+#ifdef HAVE_RECVMMSG
+          " with recvmmsg()"
+#else
+          ""
+#endif
+          );
+  return 1;
+
+fail:
+  mp_msg (MSGT_NETWORK, MSGL_WARN,
+          "udp: cannot start the receive thread, reading directly\n");
+  free (r->data);
+  free (r->len);
+  r->data = NULL;
+  r->len = NULL;
+  r->slots = 0;
+  return 0;
+}
+
+/* copy datagrams from the ring, one at most if whole is set */
+static int
+ring_read (udp_recv_t *r, char *buffer, int size, int whole)
+{
+  unsigned int head, tail;
+  int len = 0;
+
+  pthread_mutex_lock (&r->lock);
+  if (r->head == r->tail && !r->error)
+  {
+    r->waiting = 1;
+    while (r->head == r->tail && !r->error)
+      pthread_cond_wait (&r->cond, &r->lock);
+    r->waiting = 0;
+  }
+  head = r->head;
+  if (r->rtp)
+    report_loss (r);
+  pthread_mutex_unlock (&r->lock);
+  if (head == r->tail)
+    return -1;
+
+  /* the slots between tail and head belong to the reader */
+  tail = r->tail;
+  while (len < size && tail != head)
+  {
+    unsigned int slot = tail % r->slots;
+    int n = r->len[slot] - r->pos;
+
+    if (n > size - len)
+      n = size - len;
+    memcpy (buffer + len, r->data + slot * UDP_SLOT_SIZE + r->pos, n);
+    len += n;
+    r->pos += n;
+    if (whole || r->pos >= r->len[slot])
+    {
+      r->pos = 0;
+      tail++;
+      if (whole)
+        break;
+    }
+  }
+
+  pthread_mutex_lock (&r->lock);
+  r->tail = tail;
+  if (r->waiting)
+    pthread_cond_signal (&r->cond);
+  pthread_mutex_unlock (&r->lock);
+  return len;
+}
+#else
+#define start_thread(r) 0
+#define ring_read(r, buffer, size, whole) -1
+#endif /* HAVE_PTHREADS */
+
+static int
+direct_read (udp_recv_t *r, char *buffer, int size)
+{
+  int len = recv (r->fd, buffer, size, 0);
+
+  if (len < 0)
+    mp_msg (MSGT_NETWORK, MSGL_ERR,
+            "udp: receive error: %s\n", strerror (errno));
+  else
+  {
+    count_packet (r, (unsigned char *) buffer, len);
+    if (r->rtp)
+      report_loss (r);
+  }
+  return len;
+}
+
+int
+udp_recv_read (udp_recv_t *r, char *buffer, int size)
+{
+  if (!start_thread (r))
+    return direct_read (r, buffer, size);
+  return ring_read (r, buffer, size, 0);
+}
+
+int
+udp_recv_packet (udp_recv_t *r, char *buffer, int size)
+{
+  if (!start_thread (r))
+    return direct_read (r, buffer, size);
+  return ring_read (r, buffer, size, 1);
+}
+
+void
+udp_recv_free (udp_recv_t *r)
+{
+  if (!r)
+    return;
+#ifdef HAVE_PTHREADS
+  if (r->pid == getpid () && r->slots)
+  {
+    int i;
+
+    /* when a signal interrupted the reader it may still hold the lock,
+     * the thread only holds it briefly */
+    for (i = 0; pthread_mutex_trylock (&r->lock); i++)
+    {
+      if (i == 100)
+        return; /* exiting anyway, leave the thread running */
+      usleep (1000);
+    }
+    r->quit = 1;
+    pthread_cond_signal (&r->cond);
+    pthread_mutex_unlock (&r->lock);
+    pthread_join (r->thread, NULL);
+    /* destroying the condition would wait for an interrupted reader */
+    if (!r->waiting)
+    {
+      pthread_cond_destroy (&r->cond);
+      pthread_mutex_destroy (&r->lock);
+    }
+  }
+#endif
+  if (r->pid == getpid ())
+  {
+    /* with the cache, the statistics are in the cache process */
+    mp_msg (MSGT_NETWORK, MSGL_V,
+            "udp: %u datagrams, %"PRId64" bytes, reader behind %u times\n",
+            r->packets, r->bytes, r->full);
+    if (r->rtp && r->have_seq)
+      mp_msg (MSGT_NETWORK, MSGL_V,
+              "udp: %u of %u RTP packets lost, %u out of order\n",
+              packets_lost (r), r->expected, r->late);
+  }
+  free (r->data);
+  free (r->len);
+  free (r);
+}
@@ -0,0 +1,45 @@
+/*
+ *   Threaded receiver for UDP and RTP streams.
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef _UDP_RECV_H_
+#define _UDP_RECV_H_
+
+/// size of the receive ring in kB, 0 reads the socket directly
+extern int udp_ring_size;
+
+typedef struct udp_recv_s udp_recv_t;
+
+/**
+ * \brief set up receiving from a bound UDP socket
+ * \param rtp keep RTP sequence number statistics
+ *
+ * The receive thread is started by the first read, in the process that
+ * does the reading, so that it also works behind the forked cache.
+ */
+udp_recv_t *udp_recv_new (int fd, int rtp);
+
+/// read up to size bytes, datagrams may be split across calls
+int udp_recv_read (udp_recv_t *r, char *buffer, int size);
+
+/// read one datagram, truncated to size bytes
+int udp_recv_packet (udp_recv_t *r, char *buffer, int size);
+
+/// stop the receive thread, the socket is left open
+void udp_recv_free (udp_recv_t *r);
+
+#endif /* _UDP_RECV_H_ */
@@ -50,6 +50,9 @@ int sub_no_text_pp=0;   // 1 => do not apply text post-processing
 
 int sub_match_fuzziness=0; // level of sub name matching fuzziness
 
+int sub_lazy=0;         // 1 => only index the file when loading it and
+                        // read the text of the subtitles when needed
+
 /* Use the SUB_* constant defined in the header file */
 int sub_format=SUB_INVALID;
 #ifdef USE_SORTSUB
@@ -1119,12 +1122,12 @@ void	subcp_close (void)
 	}
 }
 
-subtitle* subcp_recode (subtitle *sub)
+static subtitle* sub_recode (iconv_t cd, subtitle *sub)
 {
 	int l=sub->lines;
 	size_t ileft, oleft;
 	char *op, *ip, *ot;
-	if(icdsc == (iconv_t)(-1)) return sub;
+	if(cd == (iconv_t)(-1)) return sub;
 
 	while (l){
 		ip = sub->text[--l];
@@ -1136,7 +1139,7 @@ subtitle* subcp_recode (subtitle *sub)
 		   	continue;
 		}
 		op = ot;
-		if (iconv(icdsc, &ip, &ileft,
+		if (iconv(cd, &ip, &ileft,
 			  &op, &oleft) == (size_t)(-1)) {
 			mp_msg(MSGT_SUBREADER,MSGL_WARN,"SUB: error recoding line.\n");
 			free(ot);
@@ -1148,6 +1151,11 @@ subtitle* subcp_recode (subtitle *sub)
 	}
 	return sub;
 }
+
+subtitle* subcp_recode (subtitle *sub)
+{
+	return sub_recode(icdsc, sub);
+}
 #endif
 
 #ifdef USE_FRIBIDI
@@ -1270,8 +1278,39 @@ struct subreader {
     subtitle * (*read)(stream_t *st,subtitle *dest);
     void       (*post)(subtitle *dest);
     const char *name;
+    int         lazy;   // a subtitle can be read again from its offset
+};
+
+/* number of subtitles before/after the current one that have their text
+   loaded in -sub-lazy mode */
+#define SUB_LAZY_BEHIND 16
+#define SUB_LAZY_AHEAD  64
+
+struct sub_lazy_s {
+    stream_t *stream;
+    struct subreader reader;
+    off_t *offsets;     // where the reading of each subtitle starts
+    char *loaded;       // the text of the subtitle has been read
+    int first, last;    // loaded window of subtitles
+    int utf8;           // sub_utf8 at the time the file was opened
+#ifdef USE_ICONV
+    iconv_t icdsc;
+#endif
 };
 
+static void sub_lazy_free(struct sub_lazy_s *l)
+{
+    if (!l) return;
+#ifdef USE_ICONV
+    if (l->icdsc != (iconv_t)(-1))
+	iconv_close(l->icdsc);
+#endif
+    free_stream(l->stream);
+    free(l->offsets);
+    free(l->loaded);
+    free(l);
+}
+
 #ifdef HAVE_ENCA
 void* guess_buffer_cp(unsigned char* buffer, int buflen, char *preferred_language, char *fallback)
 {
@@ -1340,22 +1379,24 @@ sub_data* sub_read_file (char *filename, float fps) {
     subtitle *first, *second, *sub, *return_sub;
     sub_data *subt_data;
     int uses_time = 0, sub_num = 0, sub_errs = 0;
+    struct sub_lazy_s *lazy = NULL;
+    off_t pos;
     struct subreader sr[]=
     {
-	    { sub_read_line_microdvd, NULL, "microdvd" },
-	    { sub_read_line_subrip, NULL, "subrip" },
-	    { sub_read_line_subviewer, NULL, "subviewer" },
-	    { sub_read_line_sami, NULL, "sami" },
-	    { sub_read_line_vplayer, NULL, "vplayer" },
-	    { sub_read_line_rt, NULL, "rt" },
-	    { sub_read_line_ssa, sub_pp_ssa, "ssa" },
-	    { sub_read_line_pjs, NULL, "pjs" },
-	    { sub_read_line_mpsub, NULL, "mpsub" },
-	    { sub_read_line_aqt, NULL, "aqt" },
-	    { sub_read_line_subviewer2, NULL, "subviewer 2.0" },
-	    { sub_read_line_subrip09, NULL, "subrip 0.9" },
-	    { sub_read_line_jacosub, NULL, "jacosub" },
-	    { sub_read_line_mpl2, NULL, "mpl2" }
+	    { sub_read_line_microdvd, NULL, "microdvd", 1 },
+	    { sub_read_line_subrip, NULL, "subrip", 1 },
+	    { sub_read_line_subviewer, NULL, "subviewer", 1 },
+	    { sub_read_line_sami, NULL, "sami", 0 },
+	    { sub_read_line_vplayer, NULL, "vplayer", 1 },
+	    { sub_read_line_rt, NULL, "rt", 1 },
+	    { sub_read_line_ssa, sub_pp_ssa, "ssa", 0 },
+	    { sub_read_line_pjs, NULL, "pjs", 1 },
+	    { sub_read_line_mpsub, NULL, "mpsub", 0 },
+	    { sub_read_line_aqt, NULL, "aqt", 0 },
+	    { sub_read_line_subviewer2, NULL, "subviewer 2.0", 1 },
+	    { sub_read_line_subrip09, NULL, "subrip 0.9", 0 },
+	    { sub_read_line_jacosub, NULL, "jacosub", 0 },
+	    { sub_read_line_mpl2, NULL, "mpl2", 1 }
     };
     struct subreader *srp;
     
@@ -1398,6 +1439,23 @@ sub_data* sub_read_file (char *filename, float fps) {
 #endif
 	    return NULL;
     }
+
+    // Index the file: keep the timing and where each subtitle starts, and
+    // read the text again when it is displayed. Only for formats whose
+    // reader has no state across subtitles, and not when the overlap
+    // processing needs the text of all subtitles.
+    if (sub_lazy && srp->lazy && suboverlap_enabled != 2) {
+	lazy = calloc(1, sizeof(struct sub_lazy_s));
+	lazy->stream = fd;
+	lazy->reader = *srp;
+	lazy->offsets = malloc(n_max*sizeof(off_t));
+	lazy->utf8 = sub_utf8;
+#ifdef USE_ICONV
+	// the descriptor is needed after loading, keep our own
+	lazy->icdsc = icdsc;
+	icdsc = (iconv_t)(-1);
+#endif
+    }
     
 #ifdef USE_SORTSUB
     sub = malloc(sizeof(subtitle));
@@ -1407,31 +1465,41 @@ sub_data* sub_read_file (char *filename, float fps) {
 #endif    
     while(1){
         if(sub_num>=n_max){
-            n_max+=16;
+            n_max+=n_max/2;
             first=realloc(first,n_max*sizeof(subtitle));
+            if (lazy)
+                lazy->offsets=realloc(lazy->offsets,n_max*sizeof(off_t));
         }
 #ifndef USE_SORTSUB
 	sub = &first[sub_num];
 #endif	
 	memset(sub, '\0', sizeof(subtitle));
+        pos=stream_tell(fd);
         sub=srp->read(fd,sub);
         if(!sub) break;   // EOF
+        if (lazy && sub!=ERR) {
+            // only the timing is kept, the text is read again when needed
+            for (i=0; i<sub->lines; i++) free(sub->text[i]);
+            memset(sub->text, 0, sizeof(sub->text));
+            sub->lines=0;
+        }
 #ifdef USE_ICONV
-	if ((sub!=ERR) && (sub_utf8 & 2)) sub=subcp_recode(sub);
+	if (!lazy && (sub!=ERR) && (sub_utf8 & 2)) sub=subcp_recode(sub);
 #endif
 #ifdef USE_FRIBIDI
-	if (sub!=ERR) sub=sub_fribidi(sub,sub_utf8);
+	if (!lazy && sub!=ERR) sub=sub_fribidi(sub,sub_utf8);
 #endif
 	if ( sub == ERR )
 	 {
 #ifdef USE_ICONV
           subcp_close();
 #endif
+          sub_lazy_free(lazy);
     	  if ( first ) free(first);
 	  return NULL; 
 	 }
         // Apply any post processing that needs recoding first
-        if ((sub!=ERR) && !sub_no_text_pp && srp->post) srp->post(sub);
+        if ((sub!=ERR) && !lazy && !sub_no_text_pp && srp->post) srp->post(sub);
 #ifdef USE_SORTSUB
 	if(!sub_num || (first[sub_num - 1].start <= sub->start)){
 	    first[sub_num].start = sub->start;
@@ -1445,6 +1513,7 @@ sub_data* sub_read_file (char *filename, float fps) {
   		first[sub_num - 1].end = previous_sub_end;
     		previous_sub_end = 0;
 	    }
+	    if (lazy) lazy->offsets[sub_num] = pos;
 	} else {
 	    for(j = sub_num - 1; j >= 0; --j){
     		first[j + 1].start = first[j].start;
@@ -1454,6 +1523,7 @@ sub_data* sub_read_file (char *filename, float fps) {
     		for(i = 0; i < first[j].lines; ++i){
       		    first[j + 1].text[i] = first[j].text[i];
 		}
+		if (lazy) lazy->offsets[j + 1] = lazy->offsets[j];
 		if(!j || (first[j - 1].start <= sub->start)){
 	    	    first[j].start = sub->start;
 	    	    first[j].end   = sub->end;
@@ -1467,15 +1537,19 @@ sub_data* sub_read_file (char *filename, float fps) {
 			first[j - 1].end = previous_sub_end;
 			previous_sub_end = 0;
 		    }
+		    if (lazy) lazy->offsets[j] = pos;
 		    break;
     		}
 	    }
 	}
+#else
+	if (lazy) lazy->offsets[sub_num] = pos;
 #endif	
         if(sub==ERR) ++sub_errs; else ++sub_num; // Error vs. Valid
     }
     
-    free_stream(fd);
+    if (!lazy)
+	free_stream(fd);
 
 #ifdef USE_ICONV
     subcp_close();
@@ -1487,6 +1561,7 @@ sub_data* sub_read_file (char *filename, float fps) {
     else 	  mp_msg(MSGT_SUBREADER,MSGL_INFO,".\n");
 
     if(sub_num<=0){
+	sub_lazy_free(lazy);
 	free(first);
 	return NULL;
     }
@@ -1709,9 +1784,96 @@ if ((suboverlap_enabled == 2) ||
     subt_data->sub_num = sub_num;
     subt_data->sub_errs = sub_errs;
     subt_data->subtitles = return_sub;
+    subt_data->lazy = lazy;
+    if (lazy) {
+	lazy->loaded = calloc(sub_num, 1);
+	mp_msg(MSGT_SUBREADER,MSGL_V,"SUB: Reading the text on demand.\n");
+    }
     return subt_data;
 }
 
+/**
+ * \brief read the text of subtitle n of a -sub-lazy file
+ * Timing comes from the index, which adjust_subs_time already fixed up.
+ */
+static void sub_lazy_read(sub_data *subd, int n)
+{
+    struct sub_lazy_s *l = subd->lazy;
+    subtitle tmp, *sub, *dest = &subd->subtitles[n];
+    int i;
+
+    memset(&tmp, 0, sizeof(tmp));
+    stream_reset(l->stream);
+    stream_seek(l->stream, l->offsets[n]);
+    sub = l->reader.read(l->stream, &tmp);
+#ifdef USE_ICONV
+    if (sub && sub != ERR && (l->utf8 & 2)) sub = sub_recode(l->icdsc, sub);
+#endif
+#ifdef USE_FRIBIDI
+    if (sub && sub != ERR) sub = sub_fribidi(sub, l->utf8);
+#endif
+    l->loaded[n] = 1;
+    if (!sub || sub == ERR) {
+	mp_msg(MSGT_SUBREADER,MSGL_WARN,"SUB: Could not read subtitle %d again.\n", n);
+	return;
+    }
+    if (!sub_no_text_pp && l->reader.post) l->reader.post(sub);
+    dest->lines = sub->lines;
+    dest->alignment = sub->alignment;
+    for (i = 0; i < SUB_MAX_TEXT; i++)
+	dest->text[i] = sub->text[i];
+}
+
+static void sub_lazy_unload(sub_data *subd, int n)
+{
+    subtitle *sub = &subd->subtitles[n];
+    int i;
+
+    for (i = 0; i < sub->lines; i++)
+	free(sub->text[i]);
+    memset(sub->text, 0, sizeof(sub->text));
+    sub->lines = 0;
+    subd->lazy->loaded[n] = 0;
+}
+
+/**
+ * \brief make sure the text of subtitle n and the ones around it is loaded
+ * The text of subtitles outside that window is freed again.
+ */
+void sub_lazy_load(sub_data *subd, int n)
+{
+    struct sub_lazy_s *l;
+    int first, last, i;
+
+    if (!subd || !(l = subd->lazy) || n < 0 || n >= subd->sub_num || l->loaded[n])
+	return;
+    first = n > SUB_LAZY_BEHIND ? n - SUB_LAZY_BEHIND : 0;
+    last = n + SUB_LAZY_AHEAD < subd->sub_num ? n + SUB_LAZY_AHEAD : subd->sub_num;
+    for (i = l->first; i < l->last; i++)
+	if ((i < first || i >= last) && l->loaded[i])
+	    sub_lazy_unload(subd, i);
+    for (i = first; i < last; i++)
+	if (!l->loaded[i])
+	    sub_lazy_read(subd, i);
+    l->first = first;
+    l->last = last;
+}
+
+/// load the text of all subtitles, for users that go through all of them
+void sub_load_all(sub_data *subd)
+{
+    struct sub_lazy_s *l;
+    int i;
+
+    if (!subd || !(l = subd->lazy))
+	return;
+    for (i = 0; i < subd->sub_num; i++)
+	if (!l->loaded[i])
+	    sub_lazy_read(subd, i);
+    l->first = 0;
+    l->last = subd->sub_num;
+}
+
 #if 0
 char * strreplace( char * in,char * what,char * whereof )
 {
@@ -1987,6 +2149,7 @@ char** sub_filenames(const char* path, char *fname)
 void list_sub_file(sub_data* subd){
     int i,j;
     subtitle *subs = subd->subtitles;
+    sub_load_all(subd);
 
     for(j=0; j < subd->sub_num; j++){
 	subtitle* egysub=&subs[j];
@@ -2013,6 +2176,7 @@ void dump_srt(sub_data* subd, float fps){
     subtitle * onesub;
     unsigned long temp;
     subtitle *subs = subd->subtitles;
+    sub_load_all(subd);
 
     if (!subd->sub_uses_time && sub_fps == 0)
 	sub_fps = fps;
@@ -2061,6 +2225,7 @@ void dump_mpsub(sub_data* subd, float fps){
 	FILE *fd;
 	float a,b;
         subtitle *subs = subd->subtitles;
+        sub_load_all(subd);
 
 	mpsub_position = subd->sub_uses_time? (sub_delay*100) : (sub_delay*fps);
 	if (sub_fps==0) sub_fps=fps;
@@ -2108,6 +2273,7 @@ void dump_microdvd(sub_data* subd, float fps) {
     int i, delay;
     FILE *fd;
     subtitle *subs = subd->subtitles;
+    sub_load_all(subd);
     if (sub_fps == 0)
 	sub_fps = fps;
     fd = fopen("dumpsub.sub", "w");
@@ -2146,6 +2312,7 @@ void dump_jacosub(sub_data* subd, float fps) {
     subtitle * onesub;
     unsigned long temp;
     subtitle *subs = subd->subtitles;
+    sub_load_all(subd);
 
     if (!subd->sub_uses_time && sub_fps == 0)
 	sub_fps = fps;
@@ -2195,6 +2362,7 @@ void dump_sami(sub_data* subd, float fps) {
     subtitle * onesub;
     unsigned long temp;
     subtitle *subs = subd->subtitles;
+    sub_load_all(subd);
 
     if (!subd->sub_uses_time && sub_fps == 0)
 	sub_fps = fps;
@@ -2250,9 +2418,14 @@ void sub_free( sub_data * subd )
     if ( !subd ) return;
  
     if (subd->subtitles) {
-	for (i=0; i < subd->subtitles->lines; i++) free( subd->subtitles->text[i] );
+	for (i=0; i < subd->sub_num; i++) {
+	    int j;
+	    for (j=0; j < subd->subtitles[i].lines; j++)
+		free( subd->subtitles[i].text[j] );
+	}
 	free( subd->subtitles );
     }
+    sub_lazy_free( subd->lazy );
     if (subd->filename) free( subd->filename );
     free( subd );
 }
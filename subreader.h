@@ -6,6 +6,7 @@
 extern int suboverlap_enabled;
 extern int sub_no_text_pp;  // disable text post-processing
 extern int sub_match_fuzziness;
+extern int sub_lazy;    // read subtitle text on demand
 
 // subtitle formats
 #define SUB_INVALID   -1
@@ -58,6 +59,7 @@ typedef struct {
     int sub_uses_time; 
     int sub_num;          // number of subtitle structs
     int sub_errs;
+    struct sub_lazy_s *lazy; // set when the text is read on demand
 } sub_data;
 
 #ifdef  USE_FRIBIDI
@@ -85,6 +87,8 @@ void dump_microdvd(sub_data* subd, float fps);
 void dump_jacosub(sub_data* subd, float fps);
 void dump_sami(sub_data* subd, float fps);
 void sub_free( sub_data * subd );
+void sub_lazy_load(sub_data *subd, int n);
+void sub_load_all(sub_data *subd);
 void find_sub(sub_data* subd,int key);
 void step_sub(sub_data *subd, float pts, int movement);
 void sub_add_text(subtitle *sub, const char *txt, int len, double endpts);